@@ -27,7 +27,13 @@ void ARaymarchLight::Tick(float DeltaSeconds)
 
 FDirLightParameters ARaymarchLight::GetCurrentParameters() const
 {
-	return FDirLightParameters(this->GetActorForwardVector(), LightIntensity);
+	FDirLightParameters Parameters(this->GetActorForwardVector(), LightIntensity, LightGroup, LightColor);
+	Parameters.LightType = LightType;
+	Parameters.LightPosition = this->GetActorLocation();
+	Parameters.AttenuationRadius = AttenuationRadius;
+	Parameters.InnerConeAngle = InnerConeAngle;
+	Parameters.OuterConeAngle = OuterConeAngle;
+	return Parameters;
 }
 
 #if WITH_EDITOR
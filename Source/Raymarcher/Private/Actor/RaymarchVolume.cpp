@@ -6,8 +6,14 @@
 #include "Actor/RaymarchVolume.h"
 
 #include "GenericPlatform/GenericPlatformTime.h"
+#include "Hash/CityHash.h"
+#include "ProceduralMeshComponent.h"
 #include "RenderTargetVolumeMipped.h"
+#include "Rendering/BrickMapShaders.h"
+#include "Rendering/OctreeShaders.h"
 #include "Rendering/RaymarchMaterialParameters.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/CustomVersion.h"
 #include "TextureUtilities.h"
 #include "UObject/SavePackage.h"
 #include "Util/RaymarchUtils.h"
@@ -23,6 +29,39 @@ DEFINE_LOG_CATEGORY(LogRaymarchVolume)
 #pragma optimize("", off)
 #endif
 
+// Versions of the properties saved with raymarch volumes, for migrating the ones whose meaning changed.
+struct FRaymarchVolumeCustomVersion
+{
+	enum Type
+	{
+		BeforeCustomVersionWasAdded = 0,
+		// bFastShader (on by default) got replaced by bSingleDispatchLightPropagation (off by default).
+		SingleDispatchLightPropagation,
+
+		VersionPlusOne,
+		LatestVersion = VersionPlusOne - 1
+	};
+
+	static const FGuid GUID;
+};
+
+const FGuid FRaymarchVolumeCustomVersion::GUID(0x1030C164, 0xF27D4072, 0x91BF1F27, 0xE0F9C35F);
+
+static FCustomVersionRegistration GRegisterRaymarchVolumeCustomVersion(
+	FRaymarchVolumeCustomVersion::GUID, FRaymarchVolumeCustomVersion::LatestVersion, TEXT("RaymarchVolumeVer"));
+
+// Checkpoints recorded for the old light volume contents are useless after a reset. Lights get new ones as they're added.
+static void EmptyPropagationCheckpoints(const FBasicRaymarchRenderingResources& Resources)
+{
+	ENQUEUE_RENDER_COMMAND(EmptyLightPropagationCheckpoints)
+	([Checkpoints = Resources.PropagationCheckpoints](FRHICommandListImmediate& RHICmdList) {
+		if (Checkpoints)
+		{
+			Checkpoints->Empty();
+		}
+	});
+}
+
 // Sets default values
 ARaymarchVolume::ARaymarchVolume() : AActor()
 {
@@ -67,6 +106,12 @@ ARaymarchVolume::ARaymarchVolume() : AActor()
 		}
 	}
 
+	// The occupancy proxy is built in the cube's local space, so it just follows the cube around. Hidden until it gets built.
+	OccupancyProxyComponent = CreateDefaultSubobject<UProceduralMeshComponent>(TEXT("Raymarch Occupancy Proxy"));
+	OccupancyProxyComponent->SetupAttachment(StaticMeshComponent);
+	OccupancyProxyComponent->SetCollisionEnabled(ECollisionEnabled::Type::NoCollision);
+	OccupancyProxyComponent->SetVisibility(false);
+
 	// Find and assign default raymarch materials.
 	static ConstructorHelpers::FObjectFinder<UMaterial> LitMaterial(TEXT("/TBRaymarcherPlugin/Materials/M_Raymarch"));
 	static ConstructorHelpers::FObjectFinder<UMaterial> IntensityMaterial(
@@ -88,9 +133,8 @@ ARaymarchVolume::ARaymarchVolume() : AActor()
 		OctreeRaymarchMaterialBase = OctreeMaterial.Object;
 	}
 
-	// Set default values for steps and half-res.
+	// Set default values for steps.
 	RaymarchingSteps = 150;
-	RaymarchResources.LightVolumeHalfResolution = false;
 }
 
 // Called after registering all components. This is the last action performed before editor window is spawned and before BeginPlay.
@@ -117,6 +161,10 @@ void ARaymarchVolume::PostRegisterAllComponents()
 		LitRaymarchMaterial = UMaterialInstanceDynamic::Create(LitRaymarchMaterialBase, this, "Lit Raymarch Mat Dynamic Inst");
 		// Set default values for the lit and intensity raymarchers.
 		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::EmptySpaceSkipping, GetEmptySpaceSkippingParameter());
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::AdaptiveStepScale, AdaptiveStepMaxScale);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::TerminationOpacity, RaymarchTerminationOpacity);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::MaxStepsPerPixel, MaxRaymarchStepsPerPixel);
 	}
 
 	if (IntensityRaymarchMaterialBase)
@@ -136,6 +184,16 @@ void ARaymarchVolume::PostRegisterAllComponents()
 		OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::OctreeMip, OctreeVolumeMip);
 	}
 
+	if (HeadlightRaymarchMaterialBase)
+	{
+		HeadlightRaymarchMaterial =
+			UMaterialInstanceDynamic::Create(HeadlightRaymarchMaterialBase, this, "Headlight Raymarch Mat Dynamic Inst");
+		HeadlightRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+		SetMaterialHeadlightParameters();
+	}
+
+	FallBackFromMissingHeadlightMaterial();
+
 	if (StaticMeshComponent)
 	{
 		if (LitRaymarchMaterial && SelectRaymarchMaterial == ERaymarchMaterial::Lit)
@@ -150,6 +208,10 @@ void ARaymarchVolume::PostRegisterAllComponents()
 		{
 			StaticMeshComponent->SetMaterial(0, OctreeRaymarchMaterial);
 		}
+		else if (HeadlightRaymarchMaterial && SelectRaymarchMaterial == ERaymarchMaterial::Headlight)
+		{
+			StaticMeshComponent->SetMaterial(0, HeadlightRaymarchMaterial);
+		}
 	}
 
 	if (VolumeAsset)
@@ -172,6 +234,41 @@ void ARaymarchVolume::OnConstruction(const FTransform& Transform)
 	}
 }
 
+void ARaymarchVolume::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+	Ar.UsingCustomVersion(FRaymarchVolumeCustomVersion::GUID);
+}
+
+void ARaymarchVolume::PostLoad()
+{
+	Super::PostLoad();
+
+	// Older levels only saved bFastShader when it was turned off, so the deprecated property starts out with the old default.
+	if (GetLinkerCustomVersion(FRaymarchVolumeCustomVersion::GUID) < FRaymarchVolumeCustomVersion::SingleDispatchLightPropagation)
+	{
+		bSingleDispatchLightPropagation = bFastShader_DEPRECATED;
+	}
+
+	if (bLightVolume32Bit_DEPRECATED)
+	{
+		LightVolumeFormat = ERaymarchLightVolumeFormat::R32F;
+		bLightVolume32Bit_DEPRECATED = false;
+	}
+
+	if (RaymarchResources.LightVolumeHalfResolution_DEPRECATED)
+	{
+		LightVolumeDownscale = FVector(2.0, 2.0, 2.0);
+		RaymarchResources.LightVolumeHalfResolution_DEPRECATED = false;
+	}
+
+	if (bOccupancyProxy_DEPRECATED)
+	{
+		bOccupancyBoundsProxy = true;
+		bOccupancyProxy_DEPRECATED = false;
+	}
+}
+
 #if WITH_EDITOR
 
 void ARaymarchVolume::OnVolumeAssetChangedTF(UCurveLinearColor* Curve)
@@ -271,8 +368,14 @@ void ARaymarchVolume::PostEditChangeProperty(FPropertyChangedEvent& PropertyChan
 		return;
 	}
 
-	if (PropertyName == GET_MEMBER_NAME_CHECKED(FBasicRaymarchRenderingResources, LightVolumeHalfResolution) ||
-		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, bLightVolume32Bit))
+	// Downscale is a vector, so the changed property is one of it's components.
+	if (PropertyChangedEvent.GetMemberPropertyName() == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, LightVolumeDownscale) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, LightVolumeVoxelBudget) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, LightVolumeFormat) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, LightingModel) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, AmbientOcclusionDownscale) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, OctreeNumMips) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, EmptySpaceSkippingBrickSize))
 	{
 		InitializeRaymarchResources(RaymarchResources.DataVolumeTextureRef);
 		SetMaterialVolumeParameters();
@@ -283,171 +386,940 @@ void ARaymarchVolume::PostEditChangeProperty(FPropertyChangedEvent& PropertyChan
 		return;
 	}
 
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, LightVolumeSnapshotBudgetMB))
+	{
+		// Snapshots get taken again on the next resets, within the new budget.
+		EmptyLightVolumeSnapshots();
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, AmbientOcclusionRadius))
+	{
+		bAmbientOcclusionRecomputeNeeded = true;
+		return;
+	}
+
 	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, RaymarchingSteps))
 	{
-		if (RaymarchResources.bIsInitialized)
-		{
-			LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
-			IntensityRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
-			OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
-		}
+		if (RaymarchResources.bIsInitialized)
+		{
+			LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+			IntensityRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+			OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+			if (HeadlightRaymarchMaterial)
+			{
+				HeadlightRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+			}
+		}
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, HeadlightShadowStrength) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, HeadlightGradientShading))
+	{
+		SetMaterialHeadlightParameters();
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, RaymarchTerminationOpacity) ||
+		PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, MaxRaymarchStepsPerPixel))
+	{
+		SetRaymarchBudget(RaymarchTerminationOpacity, MaxRaymarchStepsPerPixel);
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, AdaptiveStepMaxScale))
+	{
+		if (LitRaymarchMaterial)
+		{
+			LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::AdaptiveStepScale, AdaptiveStepMaxScale);
+		}
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, bOccupancyBoundsProxy))
+	{
+		// The proxy gets built from the readback following the next brick distance update.
+		if (bOccupancyBoundsProxy)
+		{
+			bBrickDistanceUpdateNeeded = true;
+		}
+		bOccupancyProxyBuilt = false;
+		UpdateOccupancyProxyVisibility();
+		return;
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, bEmptySpaceSkipping))
+	{
+		if (LitRaymarchMaterial)
+		{
+			LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::EmptySpaceSkipping, GetEmptySpaceSkippingParameter());
+		}
+		return;
+	}
+
+	if (PropertyName == GET_ENUMERATOR_NAME_CHECKED(ARaymarchVolume, SelectRaymarchMaterial))
+	{
+		FallBackFromMissingHeadlightMaterial();
+		// The headlight material doesn't use a light volume, so it's only allocated for the other materials.
+		const bool bHasLightVolume = RaymarchResources.LightVolumeRenderTarget != nullptr;
+		if (RaymarchResources.DataVolumeTextureRef &&
+			bHasLightVolume != (SelectRaymarchMaterial != ERaymarchMaterial::Headlight))
+		{
+			InitializeRaymarchResources(RaymarchResources.DataVolumeTextureRef);
+			SetMaterialVolumeParameters();
+		}
+		UpdateOctreeAllocation();
+		SwitchRenderer(SelectRaymarchMaterial);
+		if (SelectRaymarchMaterial == ERaymarchMaterial::Lit)
+		{
+			bRequestedRecompute = true;
+		}
+		if (SelectRaymarchMaterial == ERaymarchMaterial::Octree)
+		{
+			bRequestedOctreeRebuild = true;
+		}
+	}
+
+	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, OctreeVolumeMip))
+	{
+		if (RaymarchResources.bIsInitialized)
+		{
+			OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::OctreeMip, OctreeVolumeMip);
+		}
+	}
+}
+
+bool ARaymarchVolume::ShouldTickIfViewportsOnly() const
+{
+	return true;
+}
+
+#endif	  // #if WITH_EDITOR
+
+// Called every frame
+void ARaymarchVolume::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Uncomment to see logs of potentially weird ticking behavior in-editor when dragging sliders in VolumeInfo.
+	//
+	// 	static int TickFrame = 0;
+	//
+	// 	FString Log = "Tick :\nInitialized = " + FString::FromInt(RaymarchResources.bIsInitialized) +
+	// 				  "\nRecompute = " + FString::FromInt(bRequestedRecompute) + "\nDeltaTime = " +
+	// FString::SanitizeFloat(DeltaTime)
+	// +
+	// 				  "\nTick number = " + FString::FromInt(TickFrame++);
+	//
+	// 	GEngine->AddOnScreenDebugMessage(0, 0, FColor::Yellow, Log);
+
+	if (!RaymarchResources.bIsInitialized || !RootComponent->IsVisible())
+	{
+		// If not initialized, return.
+		// #TODO? we could also stop ticks altogether when not initialized.
+		return;
+	}
+
+	// Volume transform changed or clipping plane moved -> need to recompute lights.
+	const FRaymarchWorldParameters CurrentWorldParameters = GetWorldParameters();
+	if (WorldParameters != CurrentWorldParameters)
+	{
+		if (bLocalizedLightUpdate && WorldParameters.VolumeTransform.Equals(CurrentWorldParameters.VolumeTransform))
+		{
+			// Only the clipping plane moved -> only light behind the bricks it moved through changes.
+			DirtyLightBricks.MarkClippingPlaneMoved(
+				GetLocalClippingParameters(WorldParameters), GetLocalClippingParameters(CurrentWorldParameters));
+		}
+		else
+		{
+			bRequestedRecompute = true;
+		}
+		UpdateWorldParameters();
+		SetMaterialClippingParameters();
+	}
+
+	if (DirtyVolumeBoxes.Num() > 0)
+	{
+		UpdateDirtyVolumeRegions();
+	}
+
+	if (bRequestedOctreeRebuild && IsOctreeUsed())
+	{
+		URaymarchUtils::GenerateOctree(RaymarchResources);
+		// We rebuild the octree. Set to false to prevent additional unwanted rebuild.
+		bRequestedOctreeRebuild = false;
+	}
+
+	// Only check if we need to update lights if we're using Lit raymarch material.
+	// (No point in recalculating a light volume that's not currently being used anyways).
+	if (SelectRaymarchMaterial == ERaymarchMaterial::Lit)
+	{
+		// For testing light calculation shader speed - comment out when not testing! (otherwise lights get recalculated every tick
+		// for no reason).
+		// 		ResetAllLights();
+		// 		return;
+
+		// Only skip empty bricks when propagating lights while the brick distances get kept up to date.
+		RaymarchResources.bSkipEmptyBricksInLightPropagation = bLightPropagationEmptySpaceSkipping;
+
+		if (AreBrickDistancesUsed() && bRequestedBrickMapRebuild)
+		{
+			bool bBrickMapGenerated = false;
+			URaymarchUtils::GenerateBrickMap(RaymarchResources, bBrickMapGenerated);
+			bRequestedBrickMapRebuild = false;
+			bBrickDistanceUpdateNeeded = true;
+		}
+
+		// Brick distances only depend on the brick map, transfer function and windowing.
+		if (AreBrickDistancesUsed() &&
+			(bBrickDistanceUpdateNeeded ||
+				BrickDistanceWindowingParameters != RaymarchResources.WindowingParameters.ToLinearColor()))
+		{
+			UpdateBrickDistances();
+		}
+
+		if (IsOccupancyProxyUsed())
+		{
+			UpdateOccupancyProxy();
+		}
+
+		// Ambient occlusion only depends on the transfer function and windowing.
+		if (RaymarchResources.AmbientOcclusionVolumeRenderTarget &&
+			(bAmbientOcclusionRecomputeNeeded ||
+				AmbientOcclusionWindowingParameters != RaymarchResources.WindowingParameters.ToLinearColor()))
+		{
+			ComputeAmbientOcclusion();
+		}
+
+		if (LightingModel == ERaymarchLightingModel::AmbientOcclusion)
+		{
+			// Lights aren't used, switching the lighting model back resets them.
+		}
+		else if (bRequestedRecompute)
+		{
+			// If we're requesting recompute or parameters changed, start over. Also during an amortized reset, its back light
+			// volume got propagated with the old transfer function, windowing or volume transform. The request only gets cleared
+			// by the branches that actually start a reset.
+			StartLightReset();
+		}
+		else if (AmortizedLightReset.bRunning)
+		{
+			// Keep rendering with the old light volume until the reset is done. Lights changed in the meantime get applied after
+			// the swap, the reset propagates the ones it started with.
+			ContinueAmortizedLightReset();
+		}
+		else
+		{
+			if (DirtyLightBricks.IsDirty())
+			{
+				UpdateDirtyLightBricks();
+			}
+
+			// Check each individual light if it needs an update.
+			TArray<ARaymarchLight*> LightsToUpdate;
+			for (ARaymarchLight* Light : LightsArray)
+			{
+				if (!Light)
+				{
+					continue;
+				}
+				if (!LightParametersMap.Contains(Light))
+				{
+					LightParametersMap.Add(Light, Light->GetCurrentParameters());
+					LightsToUpdate.Add(Light);
+				}
+				else if (Light->GetCurrentParameters() != LightParametersMap[Light])
+				{
+					LightsToUpdate.Add(Light);
+				}
+			}
+
+			// More than half lights need update -> full reset is quicker
+			if ((LightsToUpdate.Num() > 1) && LightsToUpdate.Num() >= (LightsArray.Num() / 2))
+			{
+				StartLightReset();
+			}
+			else
+			{
+				// Only update the lights that need it.
+				for (ARaymarchLight* UpdatedLight : LightsToUpdate)
+				{
+					UpdateSingleLight(UpdatedLight);
+					LightParametersMap[UpdatedLight] = UpdatedLight->GetCurrentParameters();
+				}
+			}
+		}
+
+		// Re-weighting light groups or changing the ambient light only needs the derived light volumes updated, not the lights
+		// propagated.
+		const bool bResolveNeeded = RaymarchResources.ResolvedLightVolumeRenderTarget &&
+									(bLightVolumeChanged || ResolvedLightGroupWeights != LightGroupWeights);
+		if (bResolveNeeded)
+		{
+			ResolveLightGroups();
+		}
+		if (RaymarchResources.CombinedLightVolumeRenderTarget &&
+			(bLightVolumeChanged || bResolveNeeded || bAmbientOcclusionCombineNeeded ||
+				CombinedAmbientIntensity != AmbientIntensity))
+		{
+			CombineAmbientOcclusion();
+		}
+		bLightVolumeChanged = false;
+	}
+}
+
+void ARaymarchVolume::ResetAllLights()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	// Everything gets propagated right now, an amortized reset still running would only overwrite it with older lights.
+	AmortizedLightReset.bRunning = false;
+
+	// Clear Light volume to zero.
+	UVolumeTextureToolkit::ClearVolumeTexture(RaymarchResources.LightVolumeRenderTarget, 0);
+	EmptyPropagationCheckpoints(RaymarchResources);
+	bLightVolumeChanged = true;
+
+	// Everything gets propagated with the current parameters, so nothing is dirty anymore.
+	DirtyLightBricks.Reset();
+	LightVolumeWorldParameters = WorldParameters;
+
+	// Remember which lights are in the light volume now, so that changes get applied to what was actually propagated.
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (Light)
+		{
+			LightParametersMap.Add(Light, Light->GetCurrentParameters());
+		}
+	}
+
+	// Add all lights. Both batched and per-light propagation record the checkpoints localized light updates restart from.
+	bool bResetWasSuccessful = true;
+	if (bBatchLightPropagation && !bSingleDispatchLightPropagation)
+	{
+		TArray<FDirLightParameters> LightParameters;
+		for (ARaymarchLight* Light : LightsArray)
+		{
+			if (Light)
+			{
+				LightParameters.Add(Light->GetCurrentParameters());
+			}
+		}
+
+		URaymarchUtils::AddDirLightsToSingleVolumeBatched(
+			RaymarchResources, LightParameters, true, WorldParameters, bResetWasSuccessful);
+
+		if (!bResetWasSuccessful)
+		{
+			UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not add batched lights in volume %s."), *GetName());
+			return;
+		}
+
+		bRequestedRecompute = false;
+		return;
+	}
+
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (!Light)
+		{
+			continue;
+		}
+		bool bLightAddWasSuccessful = false;
+
+		URaymarchUtils::AddDirLightToSingleVolume(RaymarchResources, Light->GetCurrentParameters(), true, WorldParameters,
+			bResetWasSuccessful, bSingleDispatchLightPropagation);
+
+		if (!bResetWasSuccessful)
+		{
+			FString log = "Error. Could not add/remove light " + Light->GetName() + " in volume " + GetName() + " .";
+			UE_LOG(LogRaymarchVolume, Error, TEXT("%s"), *log, 3);
+			return;
+		}
+	}
+
+	// False-out request recompute flag when we succeeded in resetting lights.
+	bRequestedRecompute = false;
+}
+
+void ARaymarchVolume::StartLightReset()
+{
+	// Switching back to a recently used setup doesn't need any propagation.
+	if (RestoreLightVolumeSnapshot())
+	{
+		return;
+	}
+
+	if (bAmortizeLightReset)
+	{
+		StartAmortizedLightReset();
+	}
+	else
+	{
+		// ResetAllLights only clears the request when all lights got propagated, don't snapshot a failed reset.
+		bRequestedRecompute = true;
+		ResetAllLights();
+		if (!bRequestedRecompute)
+		{
+			SaveLightVolumeSnapshot(GetLightVolumeSnapshotKey());
+		}
+	}
+}
+
+uint64 ARaymarchVolume::GetLightVolumeSnapshotKey() const
+{
+	TArray<uint8> KeyData;
+	FMemoryWriter Writer(KeyData);
+
+	FTransform VolumeTransform = WorldParameters.VolumeTransform;
+	FVector ClippingCenter = WorldParameters.ClippingPlaneParameters.Center;
+	FVector ClippingDirection = WorldParameters.ClippingPlaneParameters.Direction;
+	uint64 PropagationParametersKey = GetPropagationParametersKey();
+	Writer << VolumeTransform << ClippingCenter << ClippingDirection << PropagationParametersKey;
+
+	for (const ARaymarchLight* Light : LightsArray)
+	{
+		if (!Light)
+		{
+			continue;
+		}
+		FDirLightParameters LightParameters = Light->GetCurrentParameters();
+		uint8 LightType = (uint8) LightParameters.LightType;
+		Writer << LightParameters.LightDirection << LightParameters.LightIntensity << LightParameters.LightGroup
+			   << LightParameters.LightColor << LightType << LightParameters.LightPosition << LightParameters.AttenuationRadius
+			   << LightParameters.InnerConeAngle << LightParameters.OuterConeAngle;
+	}
+
+	return CityHash64((const char*) KeyData.GetData(), KeyData.Num());
+}
+
+uint64 ARaymarchVolume::GetPropagationParametersKey() const
+{
+	TArray<uint8> KeyData;
+	FMemoryWriter Writer(KeyData);
+
+	FLinearColor Windowing = RaymarchResources.WindowingParameters.ToLinearColor();
+	Writer << Windowing;
+
+	// The transfer function texture is generated from the curve, so the curve's keys identify it.
+	if (CurrentTFCurve)
+	{
+		for (const FRichCurve& Curve : CurrentTFCurve->FloatCurves)
+		{
+			for (FRichCurveKey Key : Curve.GetConstRefOfKeys())
+			{
+				uint8 InterpMode = Key.InterpMode;
+				Writer << Key.Time << Key.Value << Key.ArriveTangent << Key.LeaveTangent << InterpMode;
+			}
+		}
+	}
+
+	return CityHash64((const char*) KeyData.GetData(), KeyData.Num());
+}
+
+bool ARaymarchVolume::RestoreLightVolumeSnapshot()
+{
+	if (LightVolumeSnapshots.Num() == 0 || !RaymarchResources.bIsInitialized)
+	{
+		return false;
+	}
+
+	const int32 Index = LightVolumeSnapshotKeys.Find(GetLightVolumeSnapshotKey());
+	if (Index == INDEX_NONE)
+	{
+		return false;
+	}
+
+	bool bSnapshotCopied = false;
+	UTextureRenderTargetVolume* Snapshot = LightVolumeSnapshots[Index];
+	URaymarchUtils::CopyLightVolume(Snapshot, RaymarchResources.LightVolumeRenderTarget, bSnapshotCopied);
+	if (!bSnapshotCopied)
+	{
+		return false;
+	}
+
+	// Move the snapshot to the most recently used end.
+	const uint64 Key = LightVolumeSnapshotKeys[Index];
+	LightVolumeSnapshots.RemoveAt(Index);
+	LightVolumeSnapshotKeys.RemoveAt(Index);
+	LightVolumeSnapshots.Add(Snapshot);
+	LightVolumeSnapshotKeys.Add(Key);
+
+	// Same bookkeeping as after resetting all lights. The snapshot has no checkpoints, the next localized update records new ones.
+	AmortizedLightReset.bRunning = false;
+	EmptyPropagationCheckpoints(RaymarchResources);
+	bLightVolumeChanged = true;
+	DirtyLightBricks.Reset();
+	LightVolumeWorldParameters = WorldParameters;
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (Light)
+		{
+			LightParametersMap.Add(Light, Light->GetCurrentParameters());
+		}
+	}
+	bRequestedRecompute = false;
+	return true;
+}
+
+void ARaymarchVolume::SaveLightVolumeSnapshot(const uint64 Key)
+{
+	if (LightVolumeSnapshotBudgetMB <= 0 || !RaymarchResources.bIsInitialized || LightVolumeSnapshotKeys.Contains(Key))
+	{
+		return;
+	}
+
+	UTextureRenderTargetVolume* LightVolume = RaymarchResources.LightVolumeRenderTarget;
+	const FIntVector Size(LightVolume->SizeX, LightVolume->SizeY, LightVolume->SizeZ);
+	const int64 SnapshotBytes = (int64) Size.X * Size.Y * Size.Z * GPixelFormats[LightVolume->OverrideFormat].BlockBytes;
+	const int64 MaxSnapshots = ((int64) LightVolumeSnapshotBudgetMB * 1024 * 1024) / FMath::Max<int64>(SnapshotBytes, 1);
+	if (MaxSnapshots == 0)
+	{
+		return;
+	}
+
+	// Evict the least recently used snapshots, reusing one of them for the new snapshot.
+	UTextureRenderTargetVolume* Snapshot = nullptr;
+	while (LightVolumeSnapshots.Num() >= MaxSnapshots)
+	{
+		if (Snapshot)
+		{
+			Snapshot->MarkAsGarbage();
+		}
+		Snapshot = LightVolumeSnapshots[0];
+		LightVolumeSnapshots.RemoveAt(0);
+		LightVolumeSnapshotKeys.RemoveAt(0);
+	}
+	if (!Snapshot)
+	{
+		Snapshot = CreateLightVolumeRenderTarget(Size, LightVolume->OverrideFormat,
+			MakeUniqueObjectName(this, UTextureRenderTargetVolume::StaticClass(), "Light Volume Snapshot"));
+		// Make sure the render target has it's RHI texture before the validity checks in RaymarchUtils look at it.
+		FlushRenderingCommands();
+	}
+
+	bool bSnapshotCopied = false;
+	URaymarchUtils::CopyLightVolume(LightVolume, Snapshot, bSnapshotCopied);
+	if (!bSnapshotCopied)
+	{
+		Snapshot->MarkAsGarbage();
+		return;
+	}
+	LightVolumeSnapshots.Add(Snapshot);
+	LightVolumeSnapshotKeys.Add(Key);
+}
+
+void ARaymarchVolume::EmptyLightVolumeSnapshots()
+{
+	for (UTextureRenderTargetVolume* Snapshot : LightVolumeSnapshots)
+	{
+		if (Snapshot)
+		{
+			Snapshot->MarkAsGarbage();
+		}
+	}
+	LightVolumeSnapshots.Empty();
+	LightVolumeSnapshotKeys.Empty();
+}
+
+void ARaymarchVolume::StartAmortizedLightReset()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	UTextureRenderTargetVolume* LightVolume = RaymarchResources.LightVolumeRenderTarget;
+	const FIntVector Size(LightVolume->SizeX, LightVolume->SizeY, LightVolume->SizeZ);
+	if (!BackLightVolumeRenderTarget)
+	{
+		BackLightVolumeRenderTarget =
+			CreateLightVolumeRenderTarget(Size, LightVolume->OverrideFormat, "Back Light Volume Render Target");
+		// Make sure the render target has it's RHI texture before the validity checks in RaymarchUtils look at it.
+		FlushRenderingCommands();
+	}
+
+	UVolumeTextureToolkit::ClearVolumeTexture(BackLightVolumeRenderTarget, 0);
+	// The checkpoints only get used for the back light volume from now on - the front one doesn't get updated until the swap.
+	EmptyPropagationCheckpoints(RaymarchResources);
+
+	AmortizedLightReset = FAmortizedLightReset();
+	AmortizedLightReset.WorldParameters = WorldParameters;
+	AmortizedLightReset.SnapshotKey = GetLightVolumeSnapshotKey();
+	AmortizedLightReset.PropagationParametersKey = GetPropagationParametersKey();
+
+	FBasicRaymarchRenderingResources BackResources = RaymarchResources;
+	BackResources.LightVolumeRenderTarget = BackLightVolumeRenderTarget;
+
+	// Every axis of a light costs a sweep through the whole light volume, no matter which axis it is.
+	const int64 NumVoxels = (int64) Size.X * Size.Y * Size.Z;
+	int64 TotalVoxels = 0;
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (!Light)
+		{
+			continue;
+		}
+		const FDirLightParameters LightParameters = Light->GetCurrentParameters();
+		AmortizedLightReset.LightParametersMap.Add(Light, LightParameters);
+		// Point and spot lights are ray cast in a single pass over the voxels they reach, there are no axes to spread out.
+		if (LightParameters.IsLocalLight())
+		{
+			bool bLightAdded = false;
+			URaymarchUtils::AddDirLightToSingleVolume(BackResources, LightParameters, true, WorldParameters, bLightAdded);
+			continue;
+		}
+		if (LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
+		{
+			continue;
+		}
+
+		FDirLightParameters LocalLightParams;
+		FMajorAxes LocalMajorAxes;
+		GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+		for (uint32 i = 0; i < 2; i++)
+		{
+			if (LocalMajorAxes.FaceWeight[i].second == 0)
+			{
+				continue;
+			}
+			FDirLightPropagationChunk& Axis = AmortizedLightReset.Axes.AddDefaulted_GetRef();
+			Axis.LightParameters = LightParameters;
+			Axis.AxisIndex = i;
+			Axis.StartStep = 0;
+			Axis.EndStep = GetTransposedDimensions(LocalMajorAxes, Size, i).Z;
+			TotalVoxels += NumVoxels;
+		}
+	}
+
+	AmortizedLightReset.VoxelsPerFrame = FMath::DivideAndRoundUp(TotalVoxels, (int64) FMath::Max(AmortizedLightResetFrames, 1));
+	AmortizedLightReset.bRunning = true;
+
+	// The back light volume gets propagated with the current parameters, so nothing is dirty in it.
+	DirtyLightBricks.Reset();
+	bRequestedRecompute = false;
+
+	ContinueAmortizedLightReset();
+}
+
+void ARaymarchVolume::ContinueAmortizedLightReset()
+{
+	// The chunks get propagated with the current transfer function and windowing. If they changed since the reset started, the
+	// back light volume would match neither them nor the snapshot key, so start over with the current ones.
+	if (GetPropagationParametersKey() != AmortizedLightReset.PropagationParametersKey)
+	{
+		StartLightReset();
+		return;
+	}
+
+	FAmortizedLightReset& Reset = AmortizedLightReset;
+	const UTextureRenderTargetVolume* LightVolume = RaymarchResources.LightVolumeRenderTarget;
+	const int64 NumVoxels = (int64) LightVolume->SizeX * LightVolume->SizeY * LightVolume->SizeZ;
+
+	// Cut the axes into chunks of whole bricks until this frame's voxels are used up. Chunks have to end at a brick boundary,
+	// so that the next one can start from the checkpoint recorded there.
+	TArray<FDirLightPropagationChunk> Chunks;
+	int64 RemainingVoxels = Reset.VoxelsPerFrame;
+	while (RemainingVoxels > 0 && Reset.AxisIndex < Reset.Axes.Num())
+	{
+		const FDirLightPropagationChunk& Axis = Reset.Axes[Reset.AxisIndex];
+		const int64 SliceVoxels = NumVoxels / Axis.EndStep;
+		const int64 BrickVoxels = SliceVoxels * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE;
+		const int64 NumBricks = FMath::Max<int64>(1, (RemainingVoxels + BrickVoxels / 2) / BrickVoxels);
+
+		FDirLightPropagationChunk& Chunk = Chunks.Add_GetRef(Axis);
+		Chunk.StartStep = Reset.NextStep;
+		Chunk.EndStep = (int32) FMath::Min<int64>(Reset.NextStep + NumBricks * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE, Axis.EndStep);
+		RemainingVoxels -= (Chunk.EndStep - Chunk.StartStep) * SliceVoxels;
+
+		if (Chunk.EndStep == Axis.EndStep)
+		{
+			Reset.AxisIndex++;
+			Reset.NextStep = 0;
+		}
+		else
+		{
+			Reset.NextStep = Chunk.EndStep;
+		}
+	}
+
+	FBasicRaymarchRenderingResources BackResources = RaymarchResources;
+	BackResources.LightVolumeRenderTarget = BackLightVolumeRenderTarget;
+
+	bool bChunksAdded = false;
+	URaymarchUtils::AddDirLightChunksToSingleVolume(BackResources, Chunks, Reset.WorldParameters, bChunksAdded);
+	if (!bChunksAdded)
+	{
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not propagate amortized light reset in volume %s."), *GetName());
+		Reset.bRunning = false;
+		bRequestedRecompute = true;
+		return;
+	}
+
+	if (Reset.AxisIndex < Reset.Axes.Num())
+	{
+		return;
+	}
+
+	// All lights are in the back light volume, start rendering with it.
+	Swap(RaymarchResources.LightVolumeRenderTarget, BackLightVolumeRenderTarget);
+	SetMaterialVolumeParameters();
+	LightParametersMap = MoveTemp(Reset.LightParametersMap);
+	LightVolumeWorldParameters = Reset.WorldParameters;
+	bLightVolumeChanged = true;
+	Reset.bRunning = false;
+	SaveLightVolumeSnapshot(Reset.SnapshotKey);
+}
+
+void ARaymarchVolume::UpdateDirtyLightBricks()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	// Update the lights as they were propagated into the light volume, changes to the lights themselves get applied afterwards.
+	TArray<FDirLightParameters> LightParameters;
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		const FDirLightParameters* PropagatedParameters = Light ? LightParametersMap.Find(Light) : nullptr;
+		if (PropagatedParameters)
+		{
+			LightParameters.Add(*PropagatedParameters);
+		}
+	}
+
+	bool bUpdateWasSuccessful = false;
+	URaymarchUtils::UpdateDirtyBricksInSingleVolume(RaymarchResources, LightParameters, DirtyLightBricks,
+		LightVolumeWorldParameters, WorldParameters, bUpdateWasSuccessful);
+
+	if (!bUpdateWasSuccessful)
+	{
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not update dirty light bricks in volume %s."), *GetName());
+		bRequestedRecompute = true;
+		return;
+	}
+
+	DirtyLightBricks.Reset();
+	LightVolumeWorldParameters = WorldParameters;
+	bLightVolumeChanged = true;
+}
+
+void ARaymarchVolume::CompareSingleDispatchToPerSlice()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (Light)
+		{
+			URaymarchUtils::CompareGPUSyncLightPropagation(RaymarchResources, Light->GetCurrentParameters(), WorldParameters);
+		}
+	}
+	bRequestedRecompute = true;
+}
+
+void ARaymarchVolume::BenchmarkLightVolumeFormats()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	TArray<FDirLightParameters> LightParameters;
+	for (ARaymarchLight* Light : LightsArray)
+	{
+		if (Light)
+		{
+			LightParameters.Add(Light->GetCurrentParameters());
+		}
+	}
+	URaymarchUtils::BenchmarkLightVolumeFormats(RaymarchResources, LightParameters, WorldParameters);
+}
+
+void ARaymarchVolume::ResolveLightGroups()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
+	}
+
+	bool bResolveWasSuccessful = false;
+	URaymarchUtils::ResolveLightGroups(RaymarchResources, LightGroupWeights, bResolveWasSuccessful);
+	if (!bResolveWasSuccessful)
+	{
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not resolve light groups in volume %s."), *GetName());
+		return;
+	}
+
+	ResolvedLightGroupWeights = LightGroupWeights;
+}
+
+void ARaymarchVolume::UpdateDirtyVolumeRegions()
+{
+	// Structures that aren't used right now (or get rebuilt anyways) get rebuilt fully once they're used again.
+	if (!bRequestedOctreeRebuild && IsOctreeUsed())
+	{
+		bool bOctreeUpdated = false;
+		URaymarchUtils::UpdateOctreeRegions(RaymarchResources, DirtyVolumeBoxes, bOctreeUpdated);
+		bRequestedOctreeRebuild = !bOctreeUpdated;
+	}
+	else
+	{
+		bRequestedOctreeRebuild = true;
+	}
+
+	if (!bRequestedBrickMapRebuild && AreBrickDistancesUsed() && SelectRaymarchMaterial == ERaymarchMaterial::Lit)
+	{
+		bool bBrickMapUpdated = false;
+		URaymarchUtils::UpdateBrickMapRegions(RaymarchResources, DirtyVolumeBoxes, bBrickMapUpdated);
+		bRequestedBrickMapRebuild = !bBrickMapUpdated;
+		bBrickDistanceUpdateNeeded = true;
+	}
+	else
+	{
+		bRequestedBrickMapRebuild = true;
+	}
+
+	// Changed voxels change the opacity light gets propagated through. Updating the light behind them would remove the light
+	// that was propagated through the old voxels using the new ones, so all lights get recomputed. Snapshots were taken of the
+	// old data and would bring the old light back. Ambient occlusion is low resolution, just recompute it.
+	bRequestedRecompute = true;
+	EmptyLightVolumeSnapshots();
+	bAmbientOcclusionRecomputeNeeded = true;
+
+	DirtyVolumeBoxes.Empty();
+}
+
+void ARaymarchVolume::UpdateBrickDistances()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
 		return;
 	}
 
-	if (PropertyName == GET_ENUMERATOR_NAME_CHECKED(ARaymarchVolume, SelectRaymarchMaterial))
+	bool bComputeWasSuccessful = false;
+	URaymarchUtils::ComputeBrickDistances(RaymarchResources, bComputeWasSuccessful);
+	// Don't retry every frame if it failed, the next transfer function or windowing change will.
+	bBrickDistanceUpdateNeeded = false;
+	BrickDistanceWindowingParameters = RaymarchResources.WindowingParameters.ToLinearColor();
+	if (!bComputeWasSuccessful)
 	{
-		SwitchRenderer(SelectRaymarchMaterial);
-		if (SelectRaymarchMaterial == ERaymarchMaterial::Lit)
-		{
-			bRequestedRecompute = true;
-		}
-		if (SelectRaymarchMaterial == ERaymarchMaterial::Octree)
-		{
-			bRequestedOctreeRebuild = true;
-		}
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not compute brick distances in volume %s."), *GetName());
 	}
-
-	if (PropertyName == GET_MEMBER_NAME_CHECKED(ARaymarchVolume, OctreeVolumeMip))
+	else if (IsOccupancyProxyUsed())
 	{
-		if (RaymarchResources.bIsInitialized)
-		{
-			OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::OctreeMip, OctreeVolumeMip);
-		}
+		OccupancyReadback.Request(RaymarchResources);
 	}
 }
 
-bool ARaymarchVolume::ShouldTickIfViewportsOnly() const
+float ARaymarchVolume::GetEmptySpaceSkippingParameter() const
 {
-	return true;
+	return bEmptySpaceSkipping ? RaymarchResources.BrickSize : 0.0f;
 }
 
-#endif	  // #if WITH_EDITOR
-
-// Called every frame
-void ARaymarchVolume::Tick(float DeltaTime)
+bool ARaymarchVolume::AreBrickDistancesUsed() const
 {
-	Super::Tick(DeltaTime);
+	return bEmptySpaceSkipping || bLightPropagationEmptySpaceSkipping || AdaptiveStepMaxScale > 1.0f || bOccupancyBoundsProxy;
+}
 
-	// Uncomment to see logs of potentially weird ticking behavior in-editor when dragging sliders in VolumeInfo.
-	//
-	// 	static int TickFrame = 0;
-	//
-	// 	FString Log = "Tick :\nInitialized = " + FString::FromInt(RaymarchResources.bIsInitialized) +
-	// 				  "\nRecompute = " + FString::FromInt(bRequestedRecompute) + "\nDeltaTime = " +
-	// FString::SanitizeFloat(DeltaTime)
-	// +
-	// 				  "\nTick number = " + FString::FromInt(TickFrame++);
-	//
-	// 	GEngine->AddOnScreenDebugMessage(0, 0, FColor::Yellow, Log);
+bool ARaymarchVolume::IsOccupancyProxyUsed() const
+{
+	return bOccupancyBoundsProxy && SelectRaymarchMaterial == ERaymarchMaterial::Lit;
+}
 
-	if (!RaymarchResources.bIsInitialized || !RootComponent->IsVisible())
+void ARaymarchVolume::UpdateOccupancyProxy()
+{
+	TArray<uint32> Occupancy;
+	FIntVector BrickMapSize;
+	if (!RaymarchResources.DataVolumeTextureRef || !OccupancyReadback.Poll(Occupancy, BrickMapSize))
 	{
-		// If not initialized, return.
-		// #TODO? we could also stop ticks altogether when not initialized.
 		return;
 	}
 
-	// Volume transform changed or clipping plane moved -> need full recompute.
-	if (WorldParameters != GetWorldParameters())
+	const FIntVector VolumeSize(RaymarchResources.DataVolumeTextureRef->GetSizeX(),
+		RaymarchResources.DataVolumeTextureRef->GetSizeY(), RaymarchResources.DataVolumeTextureRef->GetSizeZ());
+	if (BrickMapSize != GetBrickMapSize(VolumeSize, RaymarchResources.BrickSize))
 	{
-		bRequestedRecompute = true;
-		UpdateWorldParameters();
-		SetMaterialClippingParameters();
+		// The volume or brick size changed since the request, the next brick distance update requests again.
+		return;
 	}
 
-	if (bRequestedOctreeRebuild && SelectRaymarchMaterial == ERaymarchMaterial::Octree)
+	FRaymarchOccupancyProxyMesh ProxyMesh;
+	ProxyMesh.Build(Occupancy, BrickMapSize, RaymarchResources.BrickSize, VolumeSize);
+	OccupancyProxyComponent->CreateMeshSection(0, ProxyMesh.Vertices, ProxyMesh.Triangles, ProxyMesh.Normals,
+		TArray<FVector2D>(), TArray<FColor>(), TArray<FProcMeshTangent>(), false);
+	OccupancyProxyComponent->SetMaterial(0, LitRaymarchMaterial);
+
+	if (LitRaymarchMaterial)
 	{
-		URaymarchUtils::GenerateOctree(RaymarchResources);
-		// We rebuild the octree. Set to false to prevent additional unwanted rebuild.
-		bRequestedOctreeRebuild = false;
+		LitRaymarchMaterial->SetVectorParameterValue(RaymarchParams::OccupancyBoundsMin, FLinearColor(ProxyMesh.Bounds.Min));
+		LitRaymarchMaterial->SetVectorParameterValue(RaymarchParams::OccupancyBoundsMax, FLinearColor(ProxyMesh.Bounds.Max));
 	}
 
-	// Only check if we need to update lights if we're using Lit raymarch material.
-	// (No point in recalculating a light volume that's not currently being used anyways).
-	if (SelectRaymarchMaterial == ERaymarchMaterial::Lit)
-	{
-		// For testing light calculation shader speed - comment out when not testing! (otherwise lights get recalculated every tick
-		// for no reason).
-		// 		ResetAllLights();
-		// 		return;
+	bOccupancyProxyBuilt = true;
+	UpdateOccupancyProxyVisibility();
+}
 
-		if (bRequestedRecompute)
-		{
-			// If we're requesting recompute or parameters changed,
-			ResetAllLights();
-		}
-		else
-		{
-			// Check each individual light if it needs an update.
-			TArray<ARaymarchLight*> LightsToUpdate;
-			for (ARaymarchLight* Light : LightsArray)
-			{
-				if (!Light)
-				{
-					continue;
-				}
-				if (!LightParametersMap.Contains(Light))
-				{
-					LightParametersMap.Add(Light, Light->GetCurrentParameters());
-					LightsToUpdate.Add(Light);
-				}
-				else if (Light->GetCurrentParameters() != LightParametersMap[Light])
-				{
-					LightsToUpdate.Add(Light);
-				}
-			}
+void ARaymarchVolume::UpdateOccupancyProxyVisibility()
+{
+	const bool bShowProxy = IsOccupancyProxyUsed() && bOccupancyProxyBuilt;
 
-			// More than half lights need update -> full reset is quicker
-			if ((LightsToUpdate.Num() > 1) && LightsToUpdate.Num() >= (LightsArray.Num() / 2))
-			{
-				ResetAllLights();
-			}
-			else
-			{
-				// Only update the lights that need it.
-				for (ARaymarchLight* UpdatedLight : LightsToUpdate)
-				{
-					UpdateSingleLight(UpdatedLight);
-					LightParametersMap[UpdatedLight] = UpdatedLight->GetCurrentParameters();
-				}
-			}
-		}
+	// Don't propagate to the children, the cube border stays visible.
+	StaticMeshComponent->SetVisibility(!bShowProxy, false);
+	OccupancyProxyComponent->SetVisibility(bShowProxy);
+
+	if (!bShowProxy && LitRaymarchMaterial)
+	{
+		// Rays going through the cube need to go through all of it.
+		LitRaymarchMaterial->SetVectorParameterValue(RaymarchParams::OccupancyBoundsMin, FLinearColor(0.0f, 0.0f, 0.0f, 0.0f));
+		LitRaymarchMaterial->SetVectorParameterValue(RaymarchParams::OccupancyBoundsMax, FLinearColor(1.0f, 1.0f, 1.0f, 0.0f));
 	}
 }
 
-void ARaymarchVolume::ResetAllLights()
+void ARaymarchVolume::ComputeAmbientOcclusion()
 {
 	if (!RaymarchResources.bIsInitialized)
 	{
 		return;
 	}
 
-	// Clear Light volume to zero.
-	UVolumeTextureToolkit::ClearVolumeTexture(RaymarchResources.LightVolumeRenderTarget, 0);
-
-	// Add all lights.
-	bool bResetWasSuccessful = true;
-	for (ARaymarchLight* Light : LightsArray)
+	bool bComputeWasSuccessful = false;
+	URaymarchUtils::ComputeAmbientOcclusion(RaymarchResources, AmbientOcclusionRadius, bComputeWasSuccessful);
+	// Don't retry every frame if it failed, the next transfer function or windowing change will.
+	bAmbientOcclusionRecomputeNeeded = false;
+	AmbientOcclusionWindowingParameters = RaymarchResources.WindowingParameters.ToLinearColor();
+	if (!bComputeWasSuccessful)
 	{
-		if (!Light)
-		{
-			continue;
-		}
-		bool bLightAddWasSuccessful = false;
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not compute ambient occlusion in volume %s."), *GetName());
+		return;
+	}
 
-		URaymarchUtils::AddDirLightToSingleVolume(
-			RaymarchResources, Light->GetCurrentParameters(), true, WorldParameters, bResetWasSuccessful, bFastShader);
+	bAmbientOcclusionCombineNeeded = true;
+}
 
-		if (!bResetWasSuccessful)
-		{
-			FString log = "Error. Could not add/remove light " + Light->GetName() + " in volume " + GetName() + " .";
-			UE_LOG(LogRaymarchVolume, Error, TEXT("%s"), *log, 3);
-			return;
-		}
+void ARaymarchVolume::CombineAmbientOcclusion()
+{
+	if (!RaymarchResources.bIsInitialized)
+	{
+		return;
 	}
 
-	// False-out request recompute flag when we succeeded in resetting lights.
-	bRequestedRecompute = false;
+	bool bCombineWasSuccessful = false;
+	URaymarchUtils::CombineAmbientOcclusion(RaymarchResources, AmbientIntensity, bCombineWasSuccessful);
+	bAmbientOcclusionCombineNeeded = false;
+	CombinedAmbientIntensity = AmbientIntensity;
+	if (!bCombineWasSuccessful)
+	{
+		UE_LOG(LogRaymarchVolume, Error, TEXT("Error. Could not combine ambient occlusion in volume %s."), *GetName());
+	}
 }
 
 void ARaymarchVolume::UpdateSingleLight(ARaymarchLight* UpdatedLight)
@@ -461,7 +1333,9 @@ void ARaymarchVolume::UpdateSingleLight(ARaymarchLight* UpdatedLight)
 	{
 		FString log = "Error. Could not change light " + UpdatedLight->GetName() + " in volume " + GetName() + " .";
 		UE_LOG(LogRaymarchVolume, Error, TEXT("%s"), *log, 3);
+		return;
 	}
+	bLightVolumeChanged = true;
 }
 
 bool ARaymarchVolume::SetVolumeAsset(UVolumeAsset* InVolumeAsset)
@@ -541,6 +1415,11 @@ bool ARaymarchVolume::SetVolumeAsset(UVolumeAsset* InVolumeAsset)
 		OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::TransferFunction, RaymarchResources.TFTextureRef);
 	}
 
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetTextureParameterValue(RaymarchParams::TransferFunction, RaymarchResources.TFTextureRef);
+	}
+
 	RaymarchResources.WindowingParameters = VolumeAsset->ImageInfo.DefaultWindowingParameters;
 
 	// Unreal units are in cm, MHD and Dicoms both have sizes in mm -> divide by 10.
@@ -550,8 +1429,9 @@ bool ARaymarchVolume::SetVolumeAsset(UVolumeAsset* InVolumeAsset)
 	UpdateWorldParameters();
 	SetAllMaterialParameters();
 	bRequestedRecompute = true;
-	// Update the octree.
+	// Update the octree and brick map.
 	bRequestedOctreeRebuild = true;
+	bRequestedBrickMapRebuild = true;
 
 	// Notify listeners that we've loaded a new volume.
 	OnVolumeLoaded.ExecuteIfBound();
@@ -572,7 +1452,13 @@ void ARaymarchVolume::SetTFCurve(UCurveLinearColor* InTFCurve)
 		// Set TF Texture to the lit and octree material.
 		LitRaymarchMaterial->SetTextureParameterValue(RaymarchParams::TransferFunction, RaymarchResources.TFTextureRef);
 		OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::TransferFunction, RaymarchResources.TFTextureRef);
+		if (HeadlightRaymarchMaterial)
+		{
+			HeadlightRaymarchMaterial->SetTextureParameterValue(RaymarchParams::TransferFunction, RaymarchResources.TFTextureRef);
+		}
 		bRequestedRecompute = true;
+		bAmbientOcclusionRecomputeNeeded = true;
+		bBrickDistanceUpdateNeeded = true;
 	}
 }
 
@@ -615,7 +1501,9 @@ bool ARaymarchVolume::LoadMHDFileIntoVolumeNormalized(FString FileName, bool bPe
 	UVolumeAsset* NewVolumeAsset;
 
 	UMHDLoader* Loader = UMHDLoader::Get();
+	Loader->TransientBlockCompression = DataVolumeCompression;
 	NewVolumeAsset = Loader->CreateVolumeFromFile(FileName, true, false);
+	Loader->TransientBlockCompression = EVolumeBlockCompression::None;
 
 	if (NewVolumeAsset)
 	{
@@ -677,13 +1565,42 @@ void ARaymarchVolume::SetMaterialVolumeParameters()
 	if (LitRaymarchMaterial)
 	{
 		LitRaymarchMaterial->SetTextureParameterValue(RaymarchParams::DataVolume, RaymarchResources.DataVolumeTextureRef);
-		LitRaymarchMaterial->SetTextureParameterValue(RaymarchParams::LightVolume, RaymarchResources.LightVolumeRenderTarget);
+		LitRaymarchMaterial->SetTextureParameterValue(RaymarchParams::LightVolume, GetMaterialLightVolume());
+		LitRaymarchMaterial->SetTextureParameterValue(
+			RaymarchParams::BrickDistanceVolume, RaymarchResources.BrickDistanceRenderTarget);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::EmptySpaceSkipping, GetEmptySpaceSkippingParameter());
+		LitRaymarchMaterial->SetTextureParameterValue(
+			RaymarchParams::BrickStepOpacityVolume, RaymarchResources.BrickStepOpacityRenderTarget);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::BrickSize, RaymarchResources.BrickSize);
 	}
 	if (OctreeRaymarchMaterial)
 	{
 		OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::DataVolume, RaymarchResources.DataVolumeTextureRef);
 		OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::OctreeVolume, RaymarchResources.OctreeVolumeRenderTarget);
 	}
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetTextureParameterValue(RaymarchParams::DataVolume, RaymarchResources.DataVolumeTextureRef);
+	}
+}
+
+UTexture* ARaymarchVolume::GetMaterialLightVolume() const
+{
+	// The ambient occlusion volume can be sampled as is, it's just light that doesn't depend on any light source.
+	if (LightingModel == ERaymarchLightingModel::AmbientOcclusion && RaymarchResources.AmbientOcclusionVolumeRenderTarget)
+	{
+		return RaymarchResources.AmbientOcclusionVolumeRenderTarget;
+	}
+	if (RaymarchResources.CombinedLightVolumeRenderTarget)
+	{
+		return RaymarchResources.CombinedLightVolumeRenderTarget;
+	}
+	// Light group volumes get resolved into a single channel volume for the material.
+	if (RaymarchResources.ResolvedLightVolumeRenderTarget)
+	{
+		return RaymarchResources.ResolvedLightVolumeRenderTarget;
+	}
+	return RaymarchResources.LightVolumeRenderTarget;
 }
 
 void ARaymarchVolume::SetMaterialWindowingParameters()
@@ -703,6 +1620,11 @@ void ARaymarchVolume::SetMaterialWindowingParameters()
 		OctreeRaymarchMaterial->SetVectorParameterValue(
 			RaymarchParams::WindowingParams, RaymarchResources.WindowingParameters.ToLinearColor());
 	}
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetVectorParameterValue(
+			RaymarchParams::WindowingParams, RaymarchResources.WindowingParameters.ToLinearColor());
+	}
 }
 
 void ARaymarchVolume::SetMaterialClippingParameters()
@@ -725,6 +1647,40 @@ void ARaymarchVolume::SetMaterialClippingParameters()
 		OctreeRaymarchMaterial->SetVectorParameterValue(RaymarchParams::ClippingCenter, LocalClippingparameters.Center);
 		OctreeRaymarchMaterial->SetVectorParameterValue(RaymarchParams::ClippingDirection, LocalClippingparameters.Direction);
 	}
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetVectorParameterValue(RaymarchParams::ClippingCenter, LocalClippingparameters.Center);
+		HeadlightRaymarchMaterial->SetVectorParameterValue(RaymarchParams::ClippingDirection, LocalClippingparameters.Direction);
+	}
+}
+
+void ARaymarchVolume::SetMaterialHeadlightParameters()
+{
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetScalarParameterValue(RaymarchParams::HeadlightShadowStrength, HeadlightShadowStrength);
+		HeadlightRaymarchMaterial->SetScalarParameterValue(RaymarchParams::HeadlightGradientShading, HeadlightGradientShading);
+	}
+}
+
+void ARaymarchVolume::FallBackFromMissingHeadlightMaterial()
+{
+	if (SelectRaymarchMaterial == ERaymarchMaterial::Headlight && !HeadlightRaymarchMaterial)
+	{
+		UE_LOG(LogRaymarchVolume, Warning,
+			TEXT("Volume %s has no headlight raymarch material set, falling back to the lit raymarch material."), *GetName());
+		SelectRaymarchMaterial = ERaymarchMaterial::Lit;
+	}
+}
+
+bool ARaymarchVolume::IsOctreeUsed() const
+{
+	return SelectRaymarchMaterial == ERaymarchMaterial::Octree;
+}
+
+void ARaymarchVolume::MarkVolumeRegionsDirty(const TArray<FRaymarchVoxelBox>& DirtyBoxes)
+{
+	DirtyVolumeBoxes.Append(DirtyBoxes);
 }
 
 void ARaymarchVolume::GetMinMaxValues(float& Min, float& Max)
@@ -796,7 +1752,12 @@ void ARaymarchVolume::SwitchRenderer(ERaymarchMaterial InSelectRaymarchMaterial)
 		case ERaymarchMaterial::Octree:
 			StaticMeshComponent->SetMaterial(0, OctreeRaymarchMaterial);
 			break;
+		case ERaymarchMaterial::Headlight:
+			// Without a headlight material, there would be nothing to render the volume with.
+			StaticMeshComponent->SetMaterial(0, HeadlightRaymarchMaterial ? HeadlightRaymarchMaterial : LitRaymarchMaterial);
+			break;
 	}
+	UpdateOccupancyProxyVisibility();
 }
 
 void ARaymarchVolume::SetRaymarchSteps(float InRaymarchingSteps)
@@ -816,6 +1777,22 @@ void ARaymarchVolume::SetRaymarchSteps(float InRaymarchingSteps)
 	{
 		OctreeRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
 	}
+
+	if (HeadlightRaymarchMaterial)
+	{
+		HeadlightRaymarchMaterial->SetScalarParameterValue(RaymarchParams::Steps, RaymarchingSteps);
+	}
+}
+
+void ARaymarchVolume::SetRaymarchBudget(float InTerminationOpacity, int32 InMaxStepsPerPixel)
+{
+	RaymarchTerminationOpacity = InTerminationOpacity;
+	MaxRaymarchStepsPerPixel = FMath::Max(InMaxStepsPerPixel, 0);
+	if (LitRaymarchMaterial)
+	{
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::TerminationOpacity, RaymarchTerminationOpacity);
+		LitRaymarchMaterial->SetScalarParameterValue(RaymarchParams::MaxStepsPerPixel, MaxRaymarchStepsPerPixel);
+	}
 }
 
 void ARaymarchVolume::InitializeRaymarchResources(UVolumeTexture* Volume)
@@ -842,39 +1819,66 @@ void ARaymarchVolume::InitializeRaymarchResources(UVolumeTexture* Volume)
 
 	RaymarchResources.DataVolumeTextureRef = Volume;
 
-	int X = Volume->GetSizeX();
-	int Y = Volume->GetSizeY();
-	int Z = Volume->GetSizeZ();
-
-	// If using half res, divide by two.
-	if (RaymarchResources.LightVolumeHalfResolution)
-	{
-		X = FMath::DivideAndRoundUp(X, 2);
-		Y = FMath::DivideAndRoundUp(Y, 2);
-		Z = FMath::DivideAndRoundUp(Z, 2);
-	}
-
-	EPixelFormat PixelFormat = PF_G8;
-	if (bLightVolume32Bit)
-	{
-		PixelFormat = PF_R32_FLOAT;
+	// Light volume voxels should be cubes in world space, so take the data volume's spacing into account if we know it.
+	const FIntVector DataSize(Volume->GetSizeX(), Volume->GetSizeY(), Volume->GetSizeZ());
+	const FVector WorldSize = (VolumeAsset && !VolumeAsset->ImageInfo.WorldDimensions.IsNearlyZero())
+								  ? VolumeAsset->ImageInfo.WorldDimensions
+								  : FVector(DataSize);
+	const FIntVector LightVolumeSize = GetLightVolumeSize(DataSize, WorldSize, LightVolumeDownscale, LightVolumeVoxelBudget);
+
+	// The headlight material shades without a light volume, so don't spend the memory on one.
+	const bool bNeedsLightVolume = SelectRaymarchMaterial != ERaymarchMaterial::Headlight;
+	RaymarchResources.LightVolumeFormat = LightVolumeFormat;
+	if (bNeedsLightVolume)
+	{
+		const EPixelFormat PixelFormat = GetLightVolumePixelFormat(LightVolumeFormat);
+		RaymarchResources.LightVolumeRenderTarget =
+			CreateLightVolumeRenderTarget(LightVolumeSize, PixelFormat, "Light Volume Render Target");
+		if (LightVolumeFormat == ERaymarchLightVolumeFormat::RGBA16FLightGroups)
+		{
+			RaymarchResources.ResolvedLightVolumeRenderTarget =
+				CreateLightVolumeRenderTarget(LightVolumeSize, PF_R16F, "Resolved Light Volume Render Target");
+			bLightVolumeChanged = true;
+		}
+		if (LightingModel != ERaymarchLightingModel::DirectionalLights)
+		{
+			const FIntVector AmbientOcclusionSize = GetLightVolumeSize(DataSize, WorldSize, FVector(AmbientOcclusionDownscale), 0);
+			RaymarchResources.AmbientOcclusionVolumeRenderTarget =
+				CreateLightVolumeRenderTarget(AmbientOcclusionSize, PF_G8, "Ambient Occlusion Volume Render Target");
+			bAmbientOcclusionRecomputeNeeded = true;
+		}
+		if (LightingModel == ERaymarchLightingModel::DirectionalLightsWithAmbientOcclusion)
+		{
+			// Colored lights stay colored, everything else gets combined into a single channel.
+			RaymarchResources.CombinedLightVolumeRenderTarget = CreateLightVolumeRenderTarget(LightVolumeSize,
+				LightVolumeFormat == ERaymarchLightVolumeFormat::RGBA16FColored ? PF_FloatRGBA : PF_R16F,
+				"Combined Light Volume Render Target");
+			bAmbientOcclusionCombineNeeded = true;
+		}
 	}
-
-	// Call the actual rendering code on RenderThread.
-	FIntPoint XBufferSize = FIntPoint(Y, Z);
-	FIntPoint YBufferSize = FIntPoint(X, Z);
-	FIntPoint ZBufferSize = FIntPoint(X, Y);
-
-	RaymarchResources.LightVolumeRenderTarget = NewObject<UTextureRenderTargetVolume>(this, "Light Volume Render Target");
-	RaymarchResources.LightVolumeRenderTarget->bCanCreateUAV = true;
-	RaymarchResources.LightVolumeRenderTarget->bHDR = bLightVolume32Bit;
-	RaymarchResources.LightVolumeRenderTarget->Init(X, Y, Z, PixelFormat);
-
-	RaymarchResources.OctreeVolumeRenderTarget = NewObject<URenderTargetVolumeMipped>(this, "Octree Render Target");
-	RaymarchResources.OctreeVolumeRenderTarget->bCanCreateUAV = true;
-	RaymarchResources.OctreeVolumeRenderTarget->bHDR = false;
-	RaymarchResources.OctreeVolumeRenderTarget->Init(FMath::RoundUpToPowerOfTwo(Volume->GetSizeX()),
-		FMath::RoundUpToPowerOfTwo(Volume->GetSizeY()), FMath::RoundUpToPowerOfTwo(Volume->GetSizeZ()), 4, PF_G16);
+	DirtyLightBricks.Init(LightVolumeSize);
+
+	UpdateOctreeAllocation();
+
+	// The brick map is a few voxels per brick, so it's stored as full floats to cover unnormalized volumes exactly.
+	RaymarchResources.BrickSize = EmptySpaceSkippingBrickSize;
+	const FIntVector BrickMapSize = GetBrickMapSize(DataSize, RaymarchResources.BrickSize);
+	RaymarchResources.BrickMapRenderTarget = NewObject<URenderTargetVolumeMipped>(this, "Brick Map Render Target");
+	RaymarchResources.BrickMapRenderTarget->bCanCreateUAV = true;
+	RaymarchResources.BrickMapRenderTarget->bHDR = true;
+	RaymarchResources.BrickMapRenderTarget->Init(BrickMapSize.X, BrickMapSize.Y, BrickMapSize.Z, 1, PF_G32R32F);
+	// A new distance volume is all zeros, which doesn't skip anything until the distances are computed.
+	RaymarchResources.BrickDistanceRenderTarget = NewObject<URenderTargetVolumeMipped>(this, "Brick Distance Render Target");
+	RaymarchResources.BrickDistanceRenderTarget->bCanCreateUAV = true;
+	RaymarchResources.BrickDistanceRenderTarget->bHDR = false;
+	RaymarchResources.BrickDistanceRenderTarget->Init(BrickMapSize.X, BrickMapSize.Y, BrickMapSize.Z, 1, PF_G8);
+	// Half floats keep small opacities, which decide between the longest adaptive steps, precise.
+	RaymarchResources.BrickStepOpacityRenderTarget =
+		NewObject<URenderTargetVolumeMipped>(this, "Brick Step Opacity Render Target");
+	RaymarchResources.BrickStepOpacityRenderTarget->bCanCreateUAV = true;
+	RaymarchResources.BrickStepOpacityRenderTarget->bHDR = true;
+	RaymarchResources.BrickStepOpacityRenderTarget->Init(BrickMapSize.X, BrickMapSize.Y, BrickMapSize.Z, 1, PF_R16F);
+	bRequestedBrickMapRebuild = true;
 
 	// Flush rendering commands so that all textures are definitely initialized with resources and we can create a UAV ref.
 	FlushRenderingCommands();
@@ -885,31 +1889,45 @@ void ARaymarchVolume::InitializeRaymarchResources(UVolumeTexture* Volume)
 		{
 			RaymarchResources.DataVolumeTextureRef = Volume;
 
-			// Make buffers fully colored if we need to support colored lights.
-			URaymarchUtils::CreateBufferTextures(XBufferSize, PixelFormat, RaymarchResources.XYZReadWriteBuffers[0]);
-			URaymarchUtils::CreateBufferTextures(YBufferSize, PixelFormat, RaymarchResources.XYZReadWriteBuffers[1]);
-			URaymarchUtils::CreateBufferTextures(ZBufferSize, PixelFormat, RaymarchResources.XYZReadWriteBuffers[2]);
-
-			if (!RaymarchResources.LightVolumeRenderTarget || !RaymarchResources.LightVolumeRenderTarget->GetResource() ||
-				!RaymarchResources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+			if (bNeedsLightVolume &&
+				(!RaymarchResources.LightVolumeRenderTarget || !RaymarchResources.LightVolumeRenderTarget->GetResource() ||
+					!RaymarchResources.LightVolumeRenderTarget->GetResource()->TextureRHI))
 			{
 				// Return if anything was not initialized.
 				return;
 			}
 
-			RaymarchResources.LightVolumeUAVRef =
-				RHICreateUnorderedAccessView(RaymarchResources.LightVolumeRenderTarget->GetResource()->TextureRHI);
-
-			if (!RaymarchResources.OctreeVolumeRenderTarget || !RaymarchResources.OctreeVolumeRenderTarget->GetResource() ||
-				!RaymarchResources.OctreeVolumeRenderTarget->GetResource()->TextureRHI)
+			if (RaymarchResources.ResolvedLightVolumeRenderTarget &&
+				(!RaymarchResources.ResolvedLightVolumeRenderTarget->GetResource() ||
+					!RaymarchResources.ResolvedLightVolumeRenderTarget->GetResource()->TextureRHI))
 			{
 				// Return if anything was not initialized.
 				return;
 			}
 
-			RaymarchResources.OctreeUAVRef =
-				RHICreateUnorderedAccessView(RaymarchResources.OctreeVolumeRenderTarget->GetResource()->TextureRHI);
+			for (UTextureRenderTargetVolume* RenderTarget :
+				{RaymarchResources.AmbientOcclusionVolumeRenderTarget, RaymarchResources.CombinedLightVolumeRenderTarget,
+					static_cast<UTextureRenderTargetVolume*>(RaymarchResources.OctreeVolumeRenderTarget)})
+			{
+				if (RenderTarget && (!RenderTarget->GetResource() || !RenderTarget->GetResource()->TextureRHI))
+				{
+					// Return if anything was not initialized.
+					return;
+				}
+			}
+
+			for (URenderTargetVolumeMipped* RenderTarget :
+				{RaymarchResources.BrickMapRenderTarget, RaymarchResources.BrickDistanceRenderTarget,
+					RaymarchResources.BrickStepOpacityRenderTarget})
+			{
+				if (!RenderTarget || !RenderTarget->GetResource() || !RenderTarget->GetResource()->TextureRHI)
+				{
+					// Return if anything was not initialized.
+					return;
+				}
+			}
 
+			RaymarchResources.PropagationCheckpoints = MakeShared<FLightPropagationCheckpointCache, ESPMode::ThreadSafe>();
 			RaymarchResources.bIsInitialized = true;
 		});
 	FlushRenderingCommands();
@@ -919,8 +1937,58 @@ void ARaymarchVolume::InitializeRaymarchResources(UVolumeTexture* Volume)
 	}
 }
 
+UTextureRenderTargetVolume* ARaymarchVolume::CreateLightVolumeRenderTarget(
+	const FIntVector& Size, const EPixelFormat PixelFormat, const FName& Name)
+{
+	UTextureRenderTargetVolume* RenderTarget = NewObject<UTextureRenderTargetVolume>(this, Name);
+	RenderTarget->bCanCreateUAV = true;
+	RenderTarget->bHDR = PixelFormat != PF_G8;
+	RenderTarget->Init(Size.X, Size.Y, Size.Z, PixelFormat);
+	return RenderTarget;
+}
+
+void ARaymarchVolume::UpdateOctreeAllocation()
+{
+	UVolumeTexture* Volume = RaymarchResources.DataVolumeTextureRef;
+	if (!Volume || IsOctreeUsed() == (RaymarchResources.OctreeVolumeRenderTarget != nullptr))
+	{
+		return;
+	}
+
+	if (!IsOctreeUsed())
+	{
+		RaymarchResources.OctreeVolumeRenderTarget->MarkAsGarbage();
+		RaymarchResources.OctreeVolumeRenderTarget = nullptr;
+		if (OctreeRaymarchMaterial)
+		{
+			OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::OctreeVolume, nullptr);
+		}
+		return;
+	}
+
+	RaymarchResources.OctreeVolumeRenderTarget = NewObject<URenderTargetVolumeMipped>(this, "Octree Render Target");
+	RaymarchResources.OctreeVolumeRenderTarget->bCanCreateUAV = true;
+	RaymarchResources.OctreeVolumeRenderTarget->bHDR = false;
+	const FIntVector VolumeSize(Volume->GetSizeX(), Volume->GetSizeY(), Volume->GetSizeZ());
+	const int32 NumOctreeMips = GetOctreeNumMips(VolumeSize, OctreeNumMips);
+	// Only padded to a multiple of the coarsest node size, so the octree stays about as big as the volume.
+	const FIntVector OctreeSize = GetOctreeSize(VolumeSize, NumOctreeMips);
+	RaymarchResources.OctreeVolumeRenderTarget->Init(OctreeSize.X, OctreeSize.Y, OctreeSize.Z, NumOctreeMips, PF_G16R16);
+	// The octree gets generated on the next tick, once the render target has a resource.
+	FlushRenderingCommands();
+	if (OctreeRaymarchMaterial)
+	{
+		OctreeRaymarchMaterial->SetTextureParameterValue(RaymarchParams::OctreeVolume, RaymarchResources.OctreeVolumeRenderTarget);
+	}
+	bRequestedOctreeRebuild = true;
+}
+
 void ARaymarchVolume::FreeRaymarchResources()
 {
+	AmortizedLightReset.bRunning = false;
+	// Snapshots only fit the light volume they were taken of.
+	EmptyLightVolumeSnapshots();
+
 	ENQUEUE_RENDER_COMMAND(CaptureCommand)
 	(
 		[&](FRHICommandListImmediate& RHICmdList)
@@ -932,17 +2000,56 @@ void ARaymarchVolume::FreeRaymarchResources()
 				RaymarchResources.LightVolumeRenderTarget = nullptr;
 			}
 
+			if (BackLightVolumeRenderTarget)
+			{
+				BackLightVolumeRenderTarget->MarkAsGarbage();
+				BackLightVolumeRenderTarget = nullptr;
+			}
+
+			if (RaymarchResources.ResolvedLightVolumeRenderTarget)
+			{
+				RaymarchResources.ResolvedLightVolumeRenderTarget->MarkAsGarbage();
+				RaymarchResources.ResolvedLightVolumeRenderTarget = nullptr;
+			}
+
+			if (RaymarchResources.AmbientOcclusionVolumeRenderTarget)
+			{
+				RaymarchResources.AmbientOcclusionVolumeRenderTarget->MarkAsGarbage();
+				RaymarchResources.AmbientOcclusionVolumeRenderTarget = nullptr;
+			}
+
+			if (RaymarchResources.CombinedLightVolumeRenderTarget)
+			{
+				RaymarchResources.CombinedLightVolumeRenderTarget->MarkAsGarbage();
+				RaymarchResources.CombinedLightVolumeRenderTarget = nullptr;
+			}
+
 			if (RaymarchResources.OctreeVolumeRenderTarget)
 			{
 				RaymarchResources.OctreeVolumeRenderTarget->MarkAsGarbage();
 				RaymarchResources.OctreeVolumeRenderTarget = nullptr;
 			}
 
-			for (OneAxisReadWriteBufferResources& Buffer : RaymarchResources.XYZReadWriteBuffers)
+			if (RaymarchResources.BrickMapRenderTarget)
+			{
+				RaymarchResources.BrickMapRenderTarget->MarkAsGarbage();
+				RaymarchResources.BrickMapRenderTarget = nullptr;
+			}
+
+			if (RaymarchResources.BrickDistanceRenderTarget)
+			{
+				RaymarchResources.BrickDistanceRenderTarget->MarkAsGarbage();
+				RaymarchResources.BrickDistanceRenderTarget = nullptr;
+			}
+
+			if (RaymarchResources.BrickStepOpacityRenderTarget)
 			{
-				URaymarchUtils::ReleaseOneAxisReadWriteBufferResources(Buffer);
+				RaymarchResources.BrickStepOpacityRenderTarget->MarkAsGarbage();
+				RaymarchResources.BrickStepOpacityRenderTarget = nullptr;
 			}
 
+			// Release the checkpoints here, they hold pooled render targets.
+			RaymarchResources.PropagationCheckpoints.Reset();
 			RaymarchResources.bIsInitialized = false;
 		});
 	FlushRenderingCommands();
@@ -0,0 +1,155 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/AmbientOcclusionShaders.h"
+
+#include "Engine/TextureRenderTargetVolume.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "Rendering/LightingShaderUtils.h"
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", off)
+#endif
+
+#define LOCTEXT_NAMESPACE "RaymarchPlugin"
+
+IMPLEMENT_GLOBAL_SHADER(
+	FAmbientOcclusionOpacityShader, "/Raymarcher/Private/AmbientOcclusionOpacityShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(FDownsampleAmbientOcclusionOpacityShader, "/Raymarcher/Private/DownsampleAmbientOcclusionOpacityShader.usf",
+	"MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FComputeAmbientOcclusionShader, "/Raymarcher/Private/ComputeAmbientOcclusionShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FCombineAmbientOcclusionShader, "/Raymarcher/Private/CombineAmbientOcclusionShader.usf", "MainComputeShader", SF_Compute);
+
+// For making statistics about GPU use - Computing and combining ambient occlusion.
+DECLARE_GPU_STAT_NAMED(GPUComputingAmbientOcclusion, TEXT("ComputingAmbientOcclusion"));
+DECLARE_GPU_STAT_NAMED(GPUCombiningAmbientOcclusion, TEXT("CombiningAmbientOcclusion"));
+
+#define NUM_THREADS_PER_AO_GROUP_DIMENSION 4	// This has to be the same as in the ambient occlusion shaders' spec [X, X, X]
+
+void ComputeAmbientOcclusion_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const float Radius)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ComputeAmbientOcclusion"));
+	FRDGTextureRef AmbientOcclusionVolume = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(
+		Resources.AmbientOcclusionVolumeRenderTarget->GetResource()->TextureRHI, TEXT("AmbientOcclusionVolume")));
+	// Materials (or the combine pass) sample the ambient occlusion volume.
+	GraphBuilder.SetTextureAccessFinal(AmbientOcclusionVolume, ERHIAccess::SRVMask);
+	AddComputeAmbientOcclusionPasses(GraphBuilder, AmbientOcclusionVolume, Resources, Radius);
+	GraphBuilder.Execute();
+}
+
+void AddComputeAmbientOcclusionPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef AmbientOcclusionVolume,
+	const FBasicRaymarchRenderingResources& Resources, const float Radius)
+{
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "ComputingAmbientOcclusion");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUComputingAmbientOcclusion);
+
+	const FIntVector Size = AmbientOcclusionVolume->Desc.GetSize();
+	const int32 NumMips = FMath::Min<int32>(RAYMARCH_AMBIENT_OCCLUSION_MAX_MIPS, FMath::FloorLog2(Size.GetMin()) + 1);
+
+	const FRDGTextureDesc OpacityDesc = FRDGTextureDesc::Create3D(
+		Size, PF_R16F, FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, NumMips);
+	FRDGTextureRef OpacityVolume = GraphBuilder.CreateTexture(OpacityDesc, TEXT("AmbientOcclusionOpacity"));
+
+	// The clipping plane is left out on purpose - the ambient occlusion shouldn't need recomputing every time it moves.
+	FAmbientOcclusionOpacityShader::FParameters* OpacityParameters =
+		GraphBuilder.AllocParameters<FAmbientOcclusionOpacityShader::FParameters>();
+	SetupRaymarchVolumeSamplingParameters(OpacityParameters->VolumeSampling, Resources, FClippingPlaneParameters());
+	OpacityParameters->OpacityVolume = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(OpacityVolume, 0));
+	OpacityParameters->StepSize = 1.0f / Size.GetMax();
+
+	TShaderMapRef<FAmbientOcclusionOpacityShader> OpacityShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("AmbientOcclusionOpacity"), GetRaymarchComputePassFlags(),
+		OpacityShader, OpacityParameters, FComputeShaderUtils::GetGroupCount(Size, NUM_THREADS_PER_AO_GROUP_DIMENSION));
+
+	TShaderMapRef<FDownsampleAmbientOcclusionOpacityShader> DownsampleShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	for (int32 Mip = 1; Mip < NumMips; Mip++)
+	{
+		FDownsampleAmbientOcclusionOpacityShader::FParameters* DownsampleParameters =
+			GraphBuilder.AllocParameters<FDownsampleAmbientOcclusionOpacityShader::FParameters>();
+		DownsampleParameters->SourceMip =
+			GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(OpacityVolume, Mip - 1));
+		DownsampleParameters->DestinationMip = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(OpacityVolume, Mip));
+
+		const FIntVector MipSize(
+			FMath::Max(Size.X >> Mip, 1), FMath::Max(Size.Y >> Mip, 1), FMath::Max(Size.Z >> Mip, 1));
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("DownsampleAmbientOcclusionOpacity Mip %d", Mip),
+			GetRaymarchComputePassFlags(), DownsampleShader, DownsampleParameters,
+			FComputeShaderUtils::GetGroupCount(MipSize, NUM_THREADS_PER_AO_GROUP_DIMENSION));
+	}
+
+	FComputeAmbientOcclusionShader::FParameters* PassParameters =
+		GraphBuilder.AllocParameters<FComputeAmbientOcclusionShader::FParameters>();
+	PassParameters->OpacityVolume = OpacityVolume;
+	PassParameters->OpacityVolumeSampler = TStaticSamplerState<SF_Trilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	PassParameters->AmbientOcclusionVolume = GraphBuilder.CreateUAV(AmbientOcclusionVolume);
+	PassParameters->Radius = FMath::Max(Radius * Size.GetMax(), 1.0f);
+	PassParameters->MaxMip = NumMips - 1;
+
+	TShaderMapRef<FComputeAmbientOcclusionShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ComputeAmbientOcclusion"), GetRaymarchComputePassFlags(),
+		ComputeShader, PassParameters, FComputeShaderUtils::GetGroupCount(Size, NUM_THREADS_PER_AO_GROUP_DIMENSION));
+}
+
+void CombineAmbientOcclusion_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const float AmbientIntensity)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CombineAmbientOcclusion"));
+	// Light groups get combined after being resolved.
+	FRDGTextureRef LightVolume = Resources.ResolvedLightVolumeRenderTarget
+									 ? GraphBuilder.RegisterExternalTexture(CreateRenderTarget(
+										   Resources.ResolvedLightVolumeRenderTarget->GetResource()->TextureRHI,
+										   TEXT("ResolvedLightVolume")))
+									 : RegisterLightVolume(GraphBuilder, Resources);
+	GraphBuilder.SetTextureAccessFinal(LightVolume, ERHIAccess::SRVMask);
+	FRDGTextureRef AmbientOcclusionVolume = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(
+		Resources.AmbientOcclusionVolumeRenderTarget->GetResource()->TextureRHI, TEXT("AmbientOcclusionVolume")));
+	GraphBuilder.SetTextureAccessFinal(AmbientOcclusionVolume, ERHIAccess::SRVMask);
+	FRDGTextureRef CombinedLightVolume = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.CombinedLightVolumeRenderTarget->GetResource()->TextureRHI, TEXT("CombinedLightVolume")));
+	// Materials sample the combined light volume.
+	GraphBuilder.SetTextureAccessFinal(CombinedLightVolume, ERHIAccess::SRVMask);
+	AddCombineAmbientOcclusionPass(GraphBuilder, LightVolume, AmbientOcclusionVolume, CombinedLightVolume, AmbientIntensity);
+	GraphBuilder.Execute();
+}
+
+void AddCombineAmbientOcclusionPass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume, FRDGTextureRef AmbientOcclusionVolume,
+	FRDGTextureRef CombinedLightVolume, const float AmbientIntensity)
+{
+	RDG_EVENT_SCOPE(GraphBuilder, "Combining Ambient Occlusion");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUCombiningAmbientOcclusion);
+
+	FCombineAmbientOcclusionShader::FParameters* PassParameters =
+		GraphBuilder.AllocParameters<FCombineAmbientOcclusionShader::FParameters>();
+	PassParameters->LightVolume = LightVolume;
+	PassParameters->AmbientOcclusionVolume = AmbientOcclusionVolume;
+	PassParameters->AmbientOcclusionVolumeSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	PassParameters->CombinedLightVolume = GraphBuilder.CreateUAV(CombinedLightVolume);
+	PassParameters->AmbientIntensity = AmbientIntensity;
+
+	FCombineAmbientOcclusionShader::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FPackedLightVolumeDim>(IsPackedLightVolumeFormat(CombinedLightVolume->Desc.Format));
+	TShaderMapRef<FCombineAmbientOcclusionShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5), PermutationVector);
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("CombineAmbientOcclusion"), GetRaymarchComputePassFlags(),
+		ComputeShader, PassParameters,
+		FComputeShaderUtils::GetGroupCount(CombinedLightVolume->Desc.GetSize(), NUM_THREADS_PER_AO_GROUP_DIMENSION));
+}
+
+#undef LOCTEXT_NAMESPACE
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", on)
+#endif
@@ -0,0 +1,196 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/BrickMapShaders.h"
+
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "Rendering/LightingShaderUtils.h"
+#include "Runtime/RenderCore/Public/RenderUtils.h"
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", off)
+#endif
+
+#define LOCTEXT_NAMESPACE "RaymarchPlugin"
+
+IMPLEMENT_GLOBAL_SHADER(
+	FGenerateBrickMapShader, "/Raymarcher/Private/GenerateBrickMapShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(FTFOpacityPrefixShader, "/Raymarcher/Private/TFOpacityPrefixShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(FBrickOccupancyShader, "/Raymarcher/Private/BrickOccupancyShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(FBrickDistanceShader, "/Raymarcher/Private/BrickDistanceShader.usf", "MainComputeShader", SF_Compute);
+
+DECLARE_GPU_STAT_NAMED(GPUGeneratingBrickMap, TEXT("GeneratingBrickMap"));
+DECLARE_GPU_STAT_NAMED(GPUComputingBrickDistances, TEXT("ComputingBrickDistances"));
+
+#define BRICK_DISTANCE_NUM_THREADS_PER_GROUP_DIMENSION 4	// This has to be the same as in the brick shaders' spec [X, X, X]
+#define TF_PREFIX_NUM_THREADS_PER_GROUP 64					// This has to be the same as in the TF prefix shader's spec [X, 1, 1]
+
+// Distances are stored in 8 bit UNORM textures.
+#define MAX_BRICK_DISTANCE 255
+
+FIntVector GetBrickMapSize(const FIntVector& VolumeSize, int32 BrickSize)
+{
+	return FIntVector(FMath::DivideAndRoundUp(VolumeSize.X, BrickSize), FMath::DivideAndRoundUp(VolumeSize.Y, BrickSize),
+		FMath::DivideAndRoundUp(VolumeSize.Z, BrickSize));
+}
+
+void GenerateBrickMap_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("GenerateBrickMap"));
+	FRDGTextureRef BrickMap = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.BrickMapRenderTarget->GetResource()->TextureRHI, TEXT("BrickMap")));
+	GraphBuilder.SetTextureAccessFinal(BrickMap, ERHIAccess::SRVMask);
+
+	AddGenerateBrickMapPass(GraphBuilder, BrickMap, Resources);
+
+	GraphBuilder.Execute();
+}
+
+void AddGenerateBrickMapPass(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap, const FBasicRaymarchRenderingResources& Resources)
+{
+	// Generating the whole brick map is the same as updating a region covering all of it.
+	const FIntVector CoveredVoxels = BrickMap->Desc.GetSize() * Resources.BrickSize;
+	AddUpdateBrickMapRegionsPasses(GraphBuilder, BrickMap, Resources, {FRaymarchVoxelBox(FIntVector::ZeroValue, CoveredVoxels)});
+}
+
+void UpdateBrickMapRegions_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, TArray<FRaymarchVoxelBox> DirtyBoxes)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("UpdateBrickMapRegions"));
+	FRDGTextureRef BrickMap = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.BrickMapRenderTarget->GetResource()->TextureRHI, TEXT("BrickMap")));
+	GraphBuilder.SetTextureAccessFinal(BrickMap, ERHIAccess::SRVMask);
+
+	AddUpdateBrickMapRegionsPasses(GraphBuilder, BrickMap, Resources, DirtyBoxes);
+
+	GraphBuilder.Execute();
+}
+
+void AddUpdateBrickMapRegionsPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes)
+{
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "GeneratingBrickMap");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUGeneratingBrickMap);
+
+	// Bricks also include the voxels right around them, so a changed voxel can change the bricks next to its own one too.
+	TArray<FRaymarchVoxelBox> BrickRegions;
+	for (const FRaymarchVoxelBox& Box : DirtyBoxes)
+	{
+		const FRaymarchVoxelBox GrownBox(Box.Min - FIntVector(1), Box.Max + FIntVector(1));
+		BrickRegions.Add(GrownBox.GetCells(Resources.BrickSize).ClampToSize(BrickMap->Desc.GetSize()));
+	}
+	FRaymarchVoxelBox::MergeOverlapping(BrickRegions);
+
+	TShaderMapRef<FGenerateBrickMapShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	for (const FRaymarchVoxelBox& Region : BrickRegions)
+	{
+		FGenerateBrickMapShader::FParameters* PassParameters =
+			GraphBuilder.AllocParameters<FGenerateBrickMapShader::FParameters>();
+		PassParameters->Volume = Resources.DataVolumeTextureRef->GetResource()->TextureRHI;
+		PassParameters->BrickSize = Resources.BrickSize;
+		PassParameters->BrickMap = GraphBuilder.CreateUAV(BrickMap);
+		PassParameters->BrickOffset = Region.Min;
+
+		// One thread group reduces a whole brick.
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("GenerateBrickMap"), GetRaymarchComputePassFlags(),
+			ComputeShader, PassParameters, Region.GetSize());
+	}
+}
+
+void ComputeBrickDistances_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ComputeBrickDistances"));
+	FRDGTextureRef BrickMap = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.BrickMapRenderTarget->GetResource()->TextureRHI, TEXT("BrickMap")));
+	GraphBuilder.SetTextureAccessFinal(BrickMap, ERHIAccess::SRVMask);
+	FRDGTextureRef BrickDistance = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.BrickDistanceRenderTarget->GetResource()->TextureRHI, TEXT("BrickDistance")));
+	// Materials sample the distances to skip empty space.
+	GraphBuilder.SetTextureAccessFinal(BrickDistance, ERHIAccess::SRVMask);
+	FRDGTextureRef BrickStepOpacity = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.BrickStepOpacityRenderTarget->GetResource()->TextureRHI, TEXT("BrickStepOpacity")));
+	// And the step opacities to pick adaptive step lengths.
+	GraphBuilder.SetTextureAccessFinal(BrickStepOpacity, ERHIAccess::SRVMask);
+
+	AddComputeBrickDistancePasses(GraphBuilder, BrickMap, BrickDistance, BrickStepOpacity, Resources);
+
+	GraphBuilder.Execute();
+}
+
+void AddComputeBrickDistancePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap, FRDGTextureRef BrickDistance,
+	FRDGTextureRef BrickStepOpacity, const FBasicRaymarchRenderingResources& Resources)
+{
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "ComputingBrickDistances");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUComputingBrickDistances);
+
+	FRHITexture* TransferFunc = Resources.TFTextureRef->GetResource()->TextureRHI;
+	const int32 TFWidth = TransferFunc->GetSizeX();
+
+	FRDGBufferRef TFOpacityPrefix = GraphBuilder.CreateBuffer(
+		FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), TFWidth), TEXT("TFOpacityPrefix"));
+
+	FTFOpacityPrefixShader::FParameters* PrefixParameters = GraphBuilder.AllocParameters<FTFOpacityPrefixShader::FParameters>();
+	PrefixParameters->TransferFunc = TransferFunc;
+	PrefixParameters->TFWidth = TFWidth;
+	PrefixParameters->TFOpacityPrefix = GraphBuilder.CreateUAV(TFOpacityPrefix, PF_R32_UINT);
+
+	TShaderMapRef<FTFOpacityPrefixShader> PrefixShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("TFOpacityPrefix"), GetRaymarchComputePassFlags(), PrefixShader,
+		PrefixParameters, FIntVector(FMath::DivideAndRoundUp(TFWidth, TF_PREFIX_NUM_THREADS_PER_GROUP), 1, 1));
+
+	// Distances are exact up to the longest side of the brick map, which covers every empty box a ray can leap through.
+	const FIntVector BrickMapSize = BrickMap->Desc.GetSize();
+	const FIntVector GroupCount = FComputeShaderUtils::GetGroupCount(BrickMapSize, BRICK_DISTANCE_NUM_THREADS_PER_GROUP_DIMENSION);
+	const FRDGTextureDesc DistanceDesc = FRDGTextureDesc::Create3D(
+		BrickMapSize, PF_G8, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_UAV);
+	FRDGTextureRef Distances[2] = {GraphBuilder.CreateTexture(DistanceDesc, TEXT("BrickDistanceA")),
+		GraphBuilder.CreateTexture(DistanceDesc, TEXT("BrickDistanceB"))};
+
+	FBrickOccupancyShader::FParameters* OccupancyParameters = GraphBuilder.AllocParameters<FBrickOccupancyShader::FParameters>();
+	OccupancyParameters->BrickMap = BrickMap;
+	OccupancyParameters->TransferFunc = TransferFunc;
+	OccupancyParameters->TFOpacityPrefix = GraphBuilder.CreateSRV(TFOpacityPrefix, PF_R32_UINT);
+	OccupancyParameters->TFWidth = TFWidth;
+	OccupancyParameters->WindowingParameters = FVector4f(Resources.WindowingParameters.ToLinearColor());
+	OccupancyParameters->MaxDistance = FMath::Min(BrickMapSize.GetMax(), MAX_BRICK_DISTANCE);
+	OccupancyParameters->BrickDistance = GraphBuilder.CreateUAV(Distances[0]);
+	OccupancyParameters->BrickStepOpacity = GraphBuilder.CreateUAV(BrickStepOpacity);
+
+	TShaderMapRef<FBrickOccupancyShader> OccupancyShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("BrickOccupancy"), GetRaymarchComputePassFlags(), OccupancyShader,
+		OccupancyParameters, GroupCount);
+
+	// One pass per axis, ping-ponging between the transient textures and ending in the brick distance volume.
+	TShaderMapRef<FBrickDistanceShader> DistanceShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	const FIntVector Axes[3] = {FIntVector(1, 0, 0), FIntVector(0, 1, 0), FIntVector(0, 0, 1)};
+	for (int32 AxisIndex = 0; AxisIndex < 3; AxisIndex++)
+	{
+		FBrickDistanceShader::FParameters* PassParameters = GraphBuilder.AllocParameters<FBrickDistanceShader::FParameters>();
+		PassParameters->SourceDistance = Distances[AxisIndex % 2];
+		PassParameters->DestinationDistance =
+			GraphBuilder.CreateUAV(AxisIndex == 2 ? BrickDistance : Distances[(AxisIndex + 1) % 2]);
+		PassParameters->Axis = Axes[AxisIndex];
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("BrickDistance Axis %d", AxisIndex),
+			GetRaymarchComputePassFlags(), DistanceShader, PassParameters, GroupCount);
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", on)
+#endif
@@ -0,0 +1,160 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/LightVolumeBricks.h"
+
+#include "RenderingThread.h"
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", off)
+#endif
+
+void FLightVolumeDirtyBricks::Init(const FIntVector& InLightVolumeSize)
+{
+	LightVolumeSize = InLightVolumeSize;
+	NumBricks = FIntVector(FMath::DivideAndRoundUp(LightVolumeSize.X, RAYMARCH_LIGHT_VOLUME_BRICK_SIZE),
+		FMath::DivideAndRoundUp(LightVolumeSize.Y, RAYMARCH_LIGHT_VOLUME_BRICK_SIZE),
+		FMath::DivideAndRoundUp(LightVolumeSize.Z, RAYMARCH_LIGHT_VOLUME_BRICK_SIZE));
+	Reset();
+}
+
+void FLightVolumeDirtyBricks::Reset()
+{
+	DirtyBits.Init(false, NumBricks.X * NumBricks.Y * NumBricks.Z);
+	NumDirty = 0;
+	MinDirtyBrick = NumBricks;
+	MaxDirtyBrick = FIntVector(-1, -1, -1);
+}
+
+void FLightVolumeDirtyBricks::MarkBrick(int32 X, int32 Y, int32 Z)
+{
+	FBitReference Bit = DirtyBits[GetBrickIndex(X, Y, Z)];
+	if (Bit)
+	{
+		return;
+	}
+	Bit = true;
+	NumDirty++;
+	MinDirtyBrick = FIntVector(FMath::Min(MinDirtyBrick.X, X), FMath::Min(MinDirtyBrick.Y, Y), FMath::Min(MinDirtyBrick.Z, Z));
+	MaxDirtyBrick = FIntVector(FMath::Max(MaxDirtyBrick.X, X), FMath::Max(MaxDirtyBrick.Y, Y), FMath::Max(MaxDirtyBrick.Z, Z));
+}
+
+void FLightVolumeDirtyBricks::MarkAll()
+{
+	DirtyBits.Init(true, NumBricks.X * NumBricks.Y * NumBricks.Z);
+	NumDirty = DirtyBits.Num();
+	MinDirtyBrick = FIntVector::ZeroValue;
+	MaxDirtyBrick = NumBricks - FIntVector(1, 1, 1);
+}
+
+void FLightVolumeDirtyBricks::MarkClippingPlaneMoved(
+	const FClippingPlaneParameters& OldLocalClipping, const FClippingPlaneParameters& NewLocalClipping)
+{
+	if (DirtyBits.Num() == 0)
+	{
+		return;
+	}
+
+	const FVector Size = FVector(LightVolumeSize);
+	// Propagation samples the volume about a voxel (of the smallest dimension) towards the light and the clipping plane fades out
+	// the voxels it goes through, so grow the bricks by 2 voxels to also catch voxels next to the ones that actually changed.
+	const FVector Margin = FVector(2.0 / Size.GetMin());
+
+	// Returns +1 if the box is completely on the side of the plane that's kept, -1 if it's completely clipped away and 0 if the
+	// plane goes through the box.
+	auto ClassifyBox = [](const FVector& BoxCenter, const FVector& BoxExtent, const FClippingPlaneParameters& Plane) -> int32
+	{
+		const double Distance = FVector::DotProduct(BoxCenter - Plane.Center, Plane.Direction);
+		const double Radius = FVector::DotProduct(BoxExtent, Plane.Direction.GetAbs());
+		return Distance > Radius ? 1 : (Distance < -Radius ? -1 : 0);
+	};
+
+	for (int32 Z = 0; Z < NumBricks.Z; Z++)
+	{
+		for (int32 Y = 0; Y < NumBricks.Y; Y++)
+		{
+			for (int32 X = 0; X < NumBricks.X; X++)
+			{
+				// Brick bounds in local (0-1) space.
+				const FVector Min = FVector(X, Y, Z) * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE / Size - Margin;
+				const FVector Max =
+					FVector::Min(FVector(X + 1, Y + 1, Z + 1) * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE, Size) / Size + Margin;
+				const FVector Center = (Min + Max) * 0.5;
+				const FVector Extent = (Max - Min) * 0.5;
+
+				// If the brick was completely kept or completely clipped both before and after, the plane didn't touch it.
+				const int32 OldSide = ClassifyBox(Center, Extent, OldLocalClipping);
+				const int32 NewSide = ClassifyBox(Center, Extent, NewLocalClipping);
+				if (OldSide == 0 || OldSide != NewSide)
+				{
+					MarkBrick(X, Y, Z);
+				}
+			}
+		}
+	}
+}
+
+int32 FLightVolumeDirtyBricks::GetFirstDirtyStep(FCubeFace Face) const
+{
+	const int32 Axis = (uint8) Face / 2;
+	if (!IsDirty())
+	{
+		return LightVolumeSize[Axis];
+	}
+
+	// Odd faces propagate towards increasing indexes (see GetAxisDirection), so the first dirty slice is at the start of the lowest
+	// dirty brick. Even faces start at the last slice and go down.
+	if ((uint8) Face % 2)
+	{
+		return MinDirtyBrick[Axis] * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE;
+	}
+	return FMath::Max(0, LightVolumeSize[Axis] - (MaxDirtyBrick[Axis] + 1) * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE);
+}
+
+FLightPropagationCheckpointCache::~FLightPropagationCheckpointCache()
+{
+	// Pooled render targets can only be released on the render thread.
+	if (Entries.Num() > 0 && !IsInRenderingThread())
+	{
+		ENQUEUE_RENDER_COMMAND(ReleaseLightPropagationCheckpoints)
+		([ReleasedEntries = MoveTemp(Entries)](FRHICommandListImmediate& RHICmdList) {});
+	}
+}
+
+FLightPropagationCheckpoints* FLightPropagationCheckpointCache::Find(const FDirLightParameters& LightParameters)
+{
+	return Entries.FindByPredicate(
+		[&LightParameters](const FLightPropagationCheckpoints& Entry) { return Entry.LightParameters == LightParameters; });
+}
+
+FLightPropagationCheckpoints& FLightPropagationCheckpointCache::FindOrAdd(const FDirLightParameters& LightParameters)
+{
+	check(IsInRenderingThread());
+	FLightPropagationCheckpoints* Existing = Find(LightParameters);
+	if (Existing)
+	{
+		return *Existing;
+	}
+	FLightPropagationCheckpoints& Added = Entries.AddDefaulted_GetRef();
+	Added.LightParameters = LightParameters;
+	return Added;
+}
+
+void FLightPropagationCheckpointCache::Remove(const FDirLightParameters& LightParameters)
+{
+	check(IsInRenderingThread());
+	Entries.RemoveAll(
+		[&LightParameters](const FLightPropagationCheckpoints& Entry) { return Entry.LightParameters == LightParameters; });
+}
+
+void FLightPropagationCheckpointCache::Empty()
+{
+	check(IsInRenderingThread());
+	Entries.Empty();
+}
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", on)
+#endif
@@ -0,0 +1,461 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/LightingCPUReference.h"
+
+#include "Async/ParallelFor.h"
+#include "Engine/Texture2D.h"
+#include "Engine/TextureRenderTargetVolume.h"
+#include "Engine/VolumeTexture.h"
+#include "RenderingThread.h"
+#include "Rendering/LightingShadersExperimental.h"
+
+#include <cmath>	// std::frexp, std::ldexp
+
+DEFINE_LOG_CATEGORY_STATIC(LogRaymarchCPULighting, Log, All);
+
+// Same as VOLUME_DENSITY and ONE_OVER_SQRT_3 in RaymarcherCommon.usf.
+#define RAYMARCH_VOLUME_DENSITY 100.0f
+#define RAYMARCH_ONE_OVER_SQRT_3 0.57735026919f
+
+// Rounds Value to the given number of mantissa bits (not counting the implicit one), like a small float format would.
+static float RoundMantissa(float Value, int32 MantissaBits)
+{
+	int Exponent;
+	const float Mantissa = std::frexp(Value, &Exponent);
+	const float Scale = (float) (1 << (MantissaBits + 1));
+	return std::ldexp(FMath::RoundToFloat(Mantissa * Scale) / Scale, Exponent);
+}
+
+// Returns Value the way it would be read back after writing it into a texture of the given format.
+static float QuantizeToPixelFormat(float Value, EPixelFormat Format)
+{
+	switch (Format)
+	{
+		case PF_G8:
+			return FMath::RoundToFloat(FMath::Clamp(Value, 0.0f, 1.0f) * 255.0f) / 255.0f;
+		case PF_R16F:
+		case PF_FloatRGBA:
+			return FFloat16(Value).GetFloat();
+		case PF_FloatR11G11B10:
+			// Unsigned, the red channel has a 6 bit mantissa.
+			return Value > 0.0f ? RoundMantissa(Value, 6) : 0.0f;
+		default:
+			return Value;
+	}
+}
+
+// Returns what a border sampler created with the packed BorderColorInt returns in it's red channel. The RHI turns the packed
+// color back into a linear color, so the value goes through the same sRGB conversion and 8 bit rounding.
+static float GetSampledBorderValue(uint32 BorderColorInt)
+{
+	return FLinearColor(FColor(BorderColorInt)).R;
+}
+
+bool FRaymarchCPUVolumeData::InitFromTextures(
+	UVolumeTexture* DataVolume, UTexture2D* TransferFunctionTexture, const FWindowingParameters& Windowing)
+{
+	if (!DataVolume || !TransferFunctionTexture || !DataVolume->GetPlatformData() ||
+		!TransferFunctionTexture->GetPlatformData() || DataVolume->GetPlatformData()->Mips.Num() == 0 ||
+		TransferFunctionTexture->GetPlatformData()->Mips.Num() == 0)
+	{
+		return false;
+	}
+
+	FTexture2DMipMap& VolumeMip = DataVolume->GetPlatformData()->Mips[0];
+	const EPixelFormat VolumeFormat = DataVolume->GetPlatformData()->PixelFormat;
+	const FIntVector VolumeSize(VolumeMip.SizeX, VolumeMip.SizeY, VolumeMip.SizeZ);
+	const int64 NumVoxels = (int64) VolumeSize.X * VolumeSize.Y * VolumeSize.Z;
+	if ((VolumeFormat != PF_G8 && VolumeFormat != PF_G16 && VolumeFormat != PF_R16F && VolumeFormat != PF_R32_FLOAT) ||
+		VolumeMip.BulkData.GetBulkDataSize() < NumVoxels * GPixelFormats[VolumeFormat].BlockBytes)
+	{
+		UE_LOG(LogRaymarchCPULighting, Warning, TEXT("Data volume %s has no CPU data of a supported format."),
+			*DataVolume->GetName());
+		return false;
+	}
+
+	FTexture2DMipMap& TFMip = TransferFunctionTexture->GetPlatformData()->Mips[0];
+	if (TransferFunctionTexture->GetPlatformData()->PixelFormat != PF_FloatRGBA ||
+		TFMip.BulkData.GetBulkDataSize() < (int64) TFMip.SizeX * sizeof(FFloat16) * 4)
+	{
+		UE_LOG(LogRaymarchCPULighting, Warning, TEXT("Transfer function %s has no CPU data of a supported format."),
+			*TransferFunctionTexture->GetName());
+		return false;
+	}
+
+	Size = VolumeSize;
+	Values.SetNumUninitialized(NumVoxels);
+	const void* VolumeData = VolumeMip.BulkData.LockReadOnly();
+	for (int64 i = 0; i < NumVoxels; i++)
+	{
+		switch (VolumeFormat)
+		{
+			case PF_G8:
+				Values[i] = static_cast<const uint8*>(VolumeData)[i] / 255.0f;
+				break;
+			case PF_G16:
+				Values[i] = static_cast<const uint16*>(VolumeData)[i] / 65535.0f;
+				break;
+			case PF_R16F:
+				Values[i] = static_cast<const FFloat16*>(VolumeData)[i].GetFloat();
+				break;
+			default:
+				Values[i] = static_cast<const float*>(VolumeData)[i];
+		}
+	}
+	VolumeMip.BulkData.Unlock();
+
+	// All rows of the transfer function texture are the same, shaders sample the middle one.
+	TransferFunction.SetNumUninitialized(TFMip.SizeX);
+	const FFloat16* TFData = static_cast<const FFloat16*>(TFMip.BulkData.LockReadOnly());
+	for (int32 i = 0; i < TFMip.SizeX; i++)
+	{
+		TransferFunction[i] = FLinearColor(
+			TFData[i * 4].GetFloat(), TFData[i * 4 + 1].GetFloat(), TFData[i * 4 + 2].GetFloat(), TFData[i * 4 + 3].GetFloat());
+	}
+	TFMip.BulkData.Unlock();
+
+	WindowingParameters = Windowing;
+	return true;
+}
+
+float FRaymarchCPUVolumeData::SampleVolume(const FVector& UVW) const
+{
+	const float BorderValue = GetSampledBorderValue(GetDataVolumeBorderColorInt(WindowingParameters));
+
+	const FVector TexelPos = UVW * FVector(Size) - 0.5;
+	const FIntVector Base(FMath::FloorToInt(TexelPos.X), FMath::FloorToInt(TexelPos.Y), FMath::FloorToInt(TexelPos.Z));
+	const FVector Frac = TexelPos - FVector(Base);
+
+	float Result = 0.0f;
+	for (int32 Corner = 0; Corner < 8; Corner++)
+	{
+		const FIntVector Offset(Corner & 1, (Corner >> 1) & 1, (Corner >> 2) & 1);
+		const FIntVector Texel = Base + Offset;
+		const float Weight = (Offset.X ? Frac.X : 1.0 - Frac.X) * (Offset.Y ? Frac.Y : 1.0 - Frac.Y) *
+							 (Offset.Z ? Frac.Z : 1.0 - Frac.Z);
+		const bool bInside = Texel.X >= 0 && Texel.Y >= 0 && Texel.Z >= 0 && Texel.X < Size.X && Texel.Y < Size.Y &&
+							 Texel.Z < Size.Z;
+		Result += Weight * (bInside ? Values[Texel.X + (int64) Size.X * (Texel.Y + (int64) Size.Y * Texel.Z)] : BorderValue);
+	}
+	return Result;
+}
+
+float FRaymarchCPUVolumeData::SampleWindowedOpacity(float Value, float StepSize) const
+{
+	const float TFPos =
+		(Value - WindowingParameters.Center + (WindowingParameters.Width / 2.0f)) / WindowingParameters.Width;
+	if ((TFPos < 0.0f && WindowingParameters.LowCutoff) || (TFPos > 1.0f && WindowingParameters.HighCutoff) ||
+		TransferFunction.Num() == 0)
+	{
+		return 0.0f;
+	}
+
+	// Bilinear sampling of a clamped texture.
+	const int32 NumSamples = TransferFunction.Num();
+	const float TexelPos = FMath::Clamp(TFPos * NumSamples - 0.5f, 0.0f, NumSamples - 1.0f);
+	const int32 Left = FMath::FloorToInt(TexelPos);
+	const int32 Right = FMath::Min(Left + 1, NumSamples - 1);
+	const float Alpha =
+		FMath::Clamp(FMath::Lerp(TransferFunction[Left].A, TransferFunction[Right].A, TexelPos - Left), 0.0f, 1.0f);
+	return 1.0f - FMath::Pow(1.0f - Alpha, StepSize);
+}
+
+void FRaymarchCPULightVolume::Init(const FIntVector& InSize, ERaymarchLightVolumeFormat InFormat)
+{
+	Size = InSize;
+	Format = InFormat;
+	Voxels.Reset();
+	Voxels.SetNumZeroed((int64) Size.X * Size.Y * Size.Z);
+}
+
+float FRaymarchCPULightVolume::GetMaxDifference(
+	const FRaymarchCPULightVolume& Other, float Tolerance, int64& OutMismatchedVoxels) const
+{
+	check(Other.Size == Size);
+	float MaxDifference = 0.0f;
+	OutMismatchedVoxels = 0;
+	for (int64 i = 0; i < Voxels.Num(); i++)
+	{
+		const float Difference = FMath::Abs(Voxels[i] - Other.Voxels[i]);
+		MaxDifference = FMath::Max(MaxDifference, Difference);
+		if (Difference > Tolerance)
+		{
+			OutMismatchedVoxels++;
+		}
+	}
+	return MaxDifference;
+}
+
+TArray<uint8> FRaymarchCPULightVolume::ToBulkData(EPixelFormat PixelFormat) const
+{
+	TArray<uint8> BulkData;
+	switch (PixelFormat)
+	{
+		case PF_G8:
+			BulkData.SetNumUninitialized(Voxels.Num());
+			for (int64 i = 0; i < Voxels.Num(); i++)
+			{
+				BulkData[i] = (uint8) FMath::RoundToInt(FMath::Clamp(Voxels[i], 0.0f, 1.0f) * 255.0f);
+			}
+			break;
+		case PF_R16F:
+		{
+			BulkData.SetNumUninitialized(Voxels.Num() * sizeof(FFloat16));
+			FFloat16* Data = reinterpret_cast<FFloat16*>(BulkData.GetData());
+			for (int64 i = 0; i < Voxels.Num(); i++)
+			{
+				Data[i] = FFloat16(Voxels[i]);
+			}
+			break;
+		}
+		case PF_R32_FLOAT:
+			BulkData.SetNumUninitialized(Voxels.Num() * sizeof(float));
+			FMemory::Memcpy(BulkData.GetData(), Voxels.GetData(), BulkData.Num());
+			break;
+		default:
+			checkNoEntry();
+	}
+	return BulkData;
+}
+
+// One light propagating along one of it's major axes, set up the same way AddDirLightAxisPasses sets up the shader parameters.
+struct FCPUAxisPropagation
+{
+	FCPUAxisPropagation(const FDirLightParameters& LocalLightParams, const FMajorAxes& LocalMajorAxes, const unsigned AxisIndex,
+		const bool Added, const FIntVector& LightVolumeSize, const FRaymarchWorldParameters& WorldParameters,
+		const EPixelFormat InBufferFormat)
+		: BufferFormat(InBufferFormat)
+	{
+		const FCubeFace Face = LocalMajorAxes.FaceWeight[AxisIndex].first;
+		TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolumeSize, AxisIndex);
+		UVOffset = GetUVOffset(Face, -LocalLightParams.LightDirection, TransposedDimensions);
+		GetStepSizeAndUVWOffset(Face, -LocalLightParams.LightDirection, TransposedDimensions, WorldParameters, StepSize, UVWOffset);
+
+		// Same normalization as the GPU propagation does.
+		UVWOffset.Normalize();
+		UVWOffset *= 1.0f / FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
+
+		PermutationMatrix = GetPermutationMatrix(LocalMajorAxes, AxisIndex);
+		BorderValue = GetSampledBorderValue(GetBorderColorIntSingle(LocalLightParams, LocalMajorAxes, AxisIndex));
+		Sign = Added ? 1.0f : -1.0f;
+		GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, AxisIndex, TransposedDimensions.Z);
+
+		// Both buffers start out fully lit.
+		const float LightAlpha = QuantizeToPixelFormat(GetLightAlpha(LocalLightParams, LocalMajorAxes, AxisIndex), BufferFormat);
+		Buffers[0].Init(LightAlpha, TransposedDimensions.X * TransposedDimensions.Y);
+		Buffers[1] = Buffers[0];
+	}
+
+	// Samples a read buffer bilinearly, returning BorderValue outside of it.
+	float SampleBuffer(const int32 BufferIndex, const FVector2D& UV) const
+	{
+		const TArray<float>& Buffer = Buffers[BufferIndex];
+		const FVector2D TexelPos = UV * FVector2D(TransposedDimensions.X, TransposedDimensions.Y) - 0.5;
+		const int32 X = FMath::FloorToInt(TexelPos.X);
+		const int32 Y = FMath::FloorToInt(TexelPos.Y);
+		auto Texel = [&](int32 TexelX, int32 TexelY) {
+			return (TexelX >= 0 && TexelY >= 0 && TexelX < TransposedDimensions.X && TexelY < TransposedDimensions.Y)
+					   ? Buffer[TexelX + TexelY * TransposedDimensions.X]
+					   : BorderValue;
+		};
+		return FMath::BiLerp(Texel(X, Y), Texel(X + 1, Y), Texel(X, Y + 1), Texel(X + 1, Y + 1), TexelPos.X - X, TexelPos.Y - Y);
+	}
+
+	FIntVector TransposedDimensions;
+	FMatrix PermutationMatrix;
+	FVector2D UVOffset;
+	FVector UVWOffset;
+	float StepSize;
+	// Light alpha read from outside of the buffers.
+	float BorderValue;
+	// +1 for an added light, -1 for a removed one.
+	float Sign;
+	int Start, Stop, AxisDirection;
+	EPixelFormat BufferFormat;
+	// Read/write buffers, switched every slice.
+	TArray<float> Buffers[2];
+};
+
+// Returns the part of the voxel at SampleUVW that's not cut away by the clipping plane, approximated the same way as the shaders.
+static float GetClippingAlphaWeight(
+	const FVector& SampleUVW, const FClippingPlaneParameters& LocalClippingParameters, const FVector& Resolution)
+{
+	const float DistanceToCuttingPlane =
+		FVector::DotProduct(SampleUVW - LocalClippingParameters.Center, LocalClippingParameters.Direction);
+	const FVector VoxelCuttingPlaneOffset = -LocalClippingParameters.Direction * DistanceToCuttingPlane * Resolution;
+	const float VoxelDistance = VoxelCuttingPlaneOffset.Size();
+	return FMath::Clamp(0.5f + (RAYMARCH_ONE_OVER_SQRT_3 * VoxelDistance * FMath::Sign(DistanceToCuttingPlane)), 0.0f, 1.0f);
+}
+
+// Propagates lights going along the same axis through the whole light volume, adding the sum of their (signed) light to it. With
+// one light this does what AddDirLightShader.usf does, with a removed and an added light what ChangeDirLightShader.usf does. Like
+// both shaders, it doesn't sample the data volume outside of it.
+static void PropagateAxis(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const FClippingPlaneParameters& LocalClippingParameters, TArrayView<FCPUAxisPropagation*> Propagations)
+{
+	const FCPUAxisPropagation& First = *Propagations[0];
+	const FIntVector Dimensions = First.TransposedDimensions;
+	const FVector Resolution(LightVolume.Size);
+	const EPixelFormat LightVolumeFormat = GetLightVolumePixelFormat(LightVolume.Format);
+
+	for (int Loop = First.Start; Loop != First.Stop; Loop += First.AxisDirection)
+	{
+		const int32 ReadIndex = Loop % 2;
+		const int32 WriteIndex = 1 - ReadIndex;
+
+		// Every row of the slice writes different voxels and buffer texels, so rows can go in parallel.
+		ParallelFor(Dimensions.Y, [&](int32 Y) {
+			for (int32 X = 0; X < Dimensions.X; X++)
+			{
+				const FVector PermutedPos = First.PermutationMatrix.TransformVector(FVector(X, Y, Loop));
+				const FIntVector Pos(FMath::RoundToInt(PermutedPos.X), FMath::RoundToInt(PermutedPos.Y),
+					FMath::RoundToInt(PermutedPos.Z));
+				const FVector UVW = (FVector(Pos) + 0.5) / Resolution;
+				const FVector2D PixelUV = (FVector2D(X, Y) + 0.5) / FVector2D(Dimensions.X, Dimensions.Y);
+
+				float LightChange = 0.0f;
+				for (FCPUAxisPropagation* Propagation : Propagations)
+				{
+					const float PreviousLightAlpha = Propagation->SampleBuffer(ReadIndex, PixelUV + Propagation->UVOffset);
+					const FVector SampleUVW = UVW + Propagation->UVWOffset;
+					const float AlphaWeight = GetClippingAlphaWeight(SampleUVW, LocalClippingParameters, Resolution);
+
+					float CurrentSample = 0.0f;
+					const bool bInside = SampleUVW == SampleUVW.BoundToBox(FVector::ZeroVector, FVector::OneVector);
+					if (AlphaWeight > 0.0f && bInside)
+					{
+						CurrentSample = Data.SampleWindowedOpacity(
+											Data.SampleVolume(SampleUVW), Propagation->StepSize * RAYMARCH_VOLUME_DENSITY) *
+										AlphaWeight;
+					}
+
+					const float CurrentLightAlpha = PreviousLightAlpha * (1.0f - CurrentSample);
+					Propagation->Buffers[WriteIndex][X + Y * Dimensions.X] =
+						QuantizeToPixelFormat(CurrentLightAlpha, Propagation->BufferFormat);
+					LightChange += CurrentLightAlpha * Propagation->Sign;
+				}
+
+				// Ignore changes smaller than 0.001, like the shaders do.
+				if (FMath::Abs(LightChange) > 1e-3f)
+				{
+					float& Voxel = LightVolume.Voxels[LightVolume.GetIndex(Pos)];
+					Voxel = QuantizeToPixelFormat(Voxel + LightChange, LightVolumeFormat);
+				}
+			}
+		});
+	}
+}
+
+void AddDirLightToCPULightVolume(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const FDirLightParameters& LightParameters, const bool Added, const FRaymarchWorldParameters& WorldParameters)
+{
+	if (LightParameters.IsLocalLight())
+	{
+		UE_LOG(LogRaymarchCPULighting, Warning, TEXT("Skipping a point or spot light, only directional lights are supported."));
+		return;
+	}
+
+	// Can't have directional light without direction...
+	if (LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
+	{
+		return;
+	}
+
+	FDirLightParameters LocalLightParams;
+	FMajorAxes LocalMajorAxes;
+	GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+	const FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+	const EPixelFormat BufferFormat = GetPropagationBufferFormat(GetLightVolumePixelFormat(LightVolume.Format));
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		// Break if the axis weight == 0
+		if (LocalMajorAxes.FaceWeight[i].second == 0)
+		{
+			break;
+		}
+
+		FCPUAxisPropagation Propagation(
+			LocalLightParams, LocalMajorAxes, i, Added, LightVolume.Size, WorldParameters, BufferFormat);
+		FCPUAxisPropagation* Propagations[] = {&Propagation};
+		PropagateAxis(LightVolume, Data, LocalClippingParameters, MakeArrayView(Propagations));
+	}
+}
+
+void ChangeDirLightInCPULightVolume(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const FDirLightParameters& OldLightParameters, const FDirLightParameters& NewLightParameters,
+	const FRaymarchWorldParameters& WorldParameters)
+{
+	if (OldLightParameters.IsLocalLight() || NewLightParameters.IsLocalLight() ||
+		OldLightParameters.LightDirection == FVector(0.0, 0.0, 0.0) ||
+		NewLightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
+	{
+		AddDirLightToCPULightVolume(LightVolume, Data, OldLightParameters, false, WorldParameters);
+		AddDirLightToCPULightVolume(LightVolume, Data, NewLightParameters, true, WorldParameters);
+		return;
+	}
+
+	FDirLightParameters RemovedLocalLightParams, AddedLocalLightParams;
+	FMajorAxes RemovedLocalMajorAxes, AddedLocalMajorAxes;
+	GetLocalLightParamsAndAxes(OldLightParameters, WorldParameters.VolumeTransform, RemovedLocalLightParams, RemovedLocalMajorAxes);
+	GetLocalLightParamsAndAxes(NewLightParameters, WorldParameters.VolumeTransform, AddedLocalLightParams, AddedLocalMajorAxes);
+
+	// Lights only get propagated together if they go along the same major axes, like on the GPU.
+	if (RemovedLocalMajorAxes.FaceWeight[0].first != AddedLocalMajorAxes.FaceWeight[0].first ||
+		RemovedLocalMajorAxes.FaceWeight[1].first != AddedLocalMajorAxes.FaceWeight[1].first)
+	{
+		AddDirLightToCPULightVolume(LightVolume, Data, OldLightParameters, false, WorldParameters);
+		AddDirLightToCPULightVolume(LightVolume, Data, NewLightParameters, true, WorldParameters);
+		return;
+	}
+
+	const FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+	const EPixelFormat BufferFormat = GetPropagationBufferFormat(GetLightVolumePixelFormat(LightVolume.Format));
+
+	for (unsigned AxisIndex = 0; AxisIndex < 2; AxisIndex++)
+	{
+		FCPUAxisPropagation Removed(
+			RemovedLocalLightParams, RemovedLocalMajorAxes, AxisIndex, false, LightVolume.Size, WorldParameters, BufferFormat);
+		FCPUAxisPropagation Added(
+			AddedLocalLightParams, AddedLocalMajorAxes, AxisIndex, true, LightVolume.Size, WorldParameters, BufferFormat);
+		FCPUAxisPropagation* Propagations[] = {&Removed, &Added};
+		PropagateAxis(LightVolume, Data, LocalClippingParameters, MakeArrayView(Propagations));
+	}
+}
+
+void CompareLightVolumeWithCPUReference(UTextureRenderTargetVolume* LightVolume, const FRaymarchCPULightVolume& Reference,
+	float Tolerance, float& OutMaxDifference, uint32& OutMismatchedVoxels)
+{
+	OutMaxDifference = 0.0f;
+	OutMismatchedVoxels = 0;
+	if (!LightVolume || !LightVolume->GetResource() ||
+		FIntVector(LightVolume->SizeX, LightVolume->SizeY, LightVolume->SizeZ) != Reference.Size)
+	{
+		UE_LOG(LogRaymarchCPULighting, Warning, TEXT("Light volume doesn't match the size of the CPU reference."));
+		return;
+	}
+
+	float* MaxDifference = &OutMaxDifference;
+	uint32* MismatchedVoxels = &OutMismatchedVoxels;
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([LightVolume, &Reference, Tolerance, MaxDifference, MismatchedVoxels](FRHICommandListImmediate& RHICmdList) {
+		// Upload the reference into a 32 bit volume for the compare shader.
+		const FRHITextureCreateDesc Desc =
+			FRHITextureCreateDesc::Create3D(TEXT("CPUReferenceLightVolume"), Reference.Size, PF_R32_FLOAT)
+				.SetFlags(ETextureCreateFlags::ShaderResource)
+				.SetInitialState(ERHIAccess::SRVMask);
+		FTextureRHIRef ReferenceRHI = RHICreateTexture(Desc);
+		const FUpdateTextureRegion3D Region(0, 0, 0, 0, 0, 0, Reference.Size.X, Reference.Size.Y, Reference.Size.Z);
+		RHICmdList.UpdateTexture3D(ReferenceRHI, 0, Region, Reference.Size.X * sizeof(float),
+			Reference.Size.X * Reference.Size.Y * sizeof(float), reinterpret_cast<const uint8*>(Reference.Voxels.GetData()));
+
+		CompareVolumes_RenderThread(RHICmdList, CreateRenderTarget(ReferenceRHI, TEXT("CPUReferenceLightVolume")),
+			CreateRenderTarget(LightVolume->GetResource()->TextureRHI, TEXT("LightVolume")), Tolerance, *MaxDifference,
+			*MismatchedVoxels);
+	});
+	// The reference and the outputs only live until we return.
+	FlushRenderingCommands();
+}
@@ -1,5 +1,17 @@
 #include "Rendering/LightingShaderUtils.h"
 
+#include "Engine/TextureRenderTargetVolume.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+
+// Every light propagation and octree call builds and executes it's own render graph, so there is no scene rendering in the same
+// graph for the async compute passes to overlap with - they only pay for the cross-pipe fences. Off by default until the passes
+// get recorded into the frame's graph.
+static TAutoConsoleVariable<int32> CVarRaymarcherAsyncCompute(TEXT("r.Raymarcher.AsyncCompute"), 0,
+	TEXT("If 1, light propagation and octree generation passes run on the async compute pipe on platforms that support it ")
+		TEXT("efficiently. 0 (default) keeps them on the graphics pipe."),
+	ECVF_RenderThreadSafe);
+
 FString GetDirectionName(FCubeFace Face)
 {
 	switch (Face)
@@ -45,18 +57,18 @@ FMajorAxes FMajorAxes::GetMajorAxes(FVector LightPos)
 	return RetVal;
 }
 
-FIntVector GetTransposedDimensions(const FMajorAxes& Axes, const FRHITexture3D* VolumeRef, const unsigned index)
+FIntVector GetTransposedDimensions(const FMajorAxes& Axes, const FIntVector& VolumeSize, const unsigned index)
 {
 	FCubeFace face = Axes.FaceWeight[index].first;
 	unsigned axis = (uint8) face / 2;
 	switch (axis)
 	{
 		case 0:	   // going along X -> Volume Y = x, volume Z = y
-			return FIntVector(VolumeRef->GetSizeY(), VolumeRef->GetSizeZ(), VolumeRef->GetSizeX());
+			return FIntVector(VolumeSize.Y, VolumeSize.Z, VolumeSize.X);
 		case 1:	   // going along Y -> Volume X = x, volume Z = y
-			return FIntVector(VolumeRef->GetSizeX(), VolumeRef->GetSizeZ(), VolumeRef->GetSizeY());
+			return FIntVector(VolumeSize.X, VolumeSize.Z, VolumeSize.Y);
 		case 2:	   // going along Z -> Volume X = x, volume Y = y
-			return FIntVector(VolumeRef->GetSizeX(), VolumeRef->GetSizeY(), VolumeRef->GetSizeZ());
+			return FIntVector(VolumeSize.X, VolumeSize.Y, VolumeSize.Z);
 		default:
 			check(false);
 			return FIntVector(0, 0, 0);
@@ -69,14 +81,6 @@ int GetAxisDirection(const FMajorAxes& Axes, unsigned index)
 	return (((uint8) Axes.FaceWeight[index].first) % 2 ? 1 : -1);
 }
 
-OneAxisReadWriteBufferResources& GetBuffers(
-	const FMajorAxes& Axes, const unsigned index, FBasicRaymarchRenderingResources& InParams)
-{
-	FCubeFace Face = Axes.FaceWeight[index].first;
-	unsigned FaceAxis = (uint8) Face / 2;
-	return InParams.XYZReadWriteBuffers[FaceAxis];
-}
-
 
 ///  Returns the UV offset to the previous layer. This is the position in the previous layer that is in the direction of the light.
 FVector2D GetUVOffset(FCubeFace Axis, FVector LightPosition, FIntVector TransposedDimensions)
@@ -163,14 +167,14 @@ void GetLocalLightParamsAndAxes(const FDirLightParameters& LightParameters, cons
 	// #TODO Why the fuck does light direction need NoScale and no multiplication by scale and clipping
 	// plane needs to be multiplied?
 
+	// Everything but the direction (intensity, light group) is the same in local space -> copy.
+	OutLocalLightParameters = LightParameters;
+
 	// Transform light directions into local space.
 	OutLocalLightParameters.LightDirection = VolumeTransform.InverseTransformVector(LightParameters.LightDirection);
 	// Normalize Light Direction to get unit length.
 	OutLocalLightParameters.LightDirection.Normalize();
 
-	// Intensity is the same in local space -> copy.
-	OutLocalLightParameters.LightIntensity = LightParameters.LightIntensity;
-
 	// Get Major Axes (notice inverting of light Direction - for a directional light, the position of
 	// the light is the opposite of the direction) e.g. Directional light with direction (1, 0, 0) is
 	// assumed to be shining from (-1, 0, 0)
@@ -194,6 +198,23 @@ FSamplerStateRHIRef GetBufferSamplerRef(uint32 BorderColorInt)
 		FSamplerStateInitializerRHI(SF_Bilinear, AM_Border, AM_Border, AM_Border, 0, 0, 0, 1, BorderColorInt));
 }
 
+FSamplerStateRHIRef GetDataVolumeSamplerRef(const FWindowingParameters& WindowingParams)
+{
+	return RHICreateSamplerState(FSamplerStateInitializerRHI(
+		SF_Trilinear, AM_Border, AM_Border, AM_Border, 0, 1, 0, 0, GetDataVolumeBorderColorInt(WindowingParams)));
+}
+
+uint32 GetDataVolumeBorderColorInt(const FWindowingParameters& WindowingParams)
+{
+	// Set the zero color to fit the zero point of the windowing parameters (Center - Width/2)
+	// so that after sampling out of bounds, it gets changed to 0 on the Transfer Function in
+	// GetTransferFuncPosition() hlsl function.
+	float ZeroTFValue = WindowingParams.Center - 0.5 * WindowingParams.Width;
+
+	FLinearColor VolumeClearColor = FLinearColor(ZeroTFValue, 0.0, 0.0, 0.0);
+	return VolumeClearColor.ToFColor(false).ToPackedARGB();
+}
+
 uint32 GetBorderColorIntSingle(FDirLightParameters LightParams, FMajorAxes MajorAxes, unsigned index)
 {
 	// Set alpha channel to the texture's red channel (when reading single-channel, only red component
@@ -202,6 +223,18 @@ uint32 GetBorderColorIntSingle(FDirLightParameters LightParams, FMajorAxes Major
 	return LightColor.ToFColor(true).ToPackedARGB();
 }
 
+uint32 GetBorderColorIntBatched(const FVector4f& LightAlphas)
+{
+	// Convert every channel like the single-channel version does with it's red channel, so that batched and single lights
+	// propagate identically. (ToFColor() treats alpha differently from RGB, so we can't just convert the whole color at once).
+	FColor BorderColor;
+	BorderColor.R = FLinearColor(LightAlphas.X, 0.0, 0.0, 0.0).ToFColor(true).R;
+	BorderColor.G = FLinearColor(LightAlphas.Y, 0.0, 0.0, 0.0).ToFColor(true).R;
+	BorderColor.B = FLinearColor(LightAlphas.Z, 0.0, 0.0, 0.0).ToFColor(true).R;
+	BorderColor.A = FLinearColor(LightAlphas.W, 0.0, 0.0, 0.0).ToFColor(true).R;
+	return BorderColor.ToPackedARGB();
+}
+
 FClippingPlaneParameters GetLocalClippingParameters(const FRaymarchWorldParameters WorldParameters)
 {
 	FClippingPlaneParameters RetVal;
@@ -264,12 +297,136 @@ void GetLoopStartStopIndexes(
 	}
 }
 
-void TransitionBufferResources(
-	FRHICommandListImmediate& RHICmdList, FRHITexture* NewlyReadableTexture, FRHIUnorderedAccessView* NewlyWriteableUAV)
+FRDGTextureRef RegisterLightVolume(FRDGBuilder& GraphBuilder, const FBasicRaymarchRenderingResources& Resources)
+{
+	FRHITexture* LightVolumeRHI = Resources.LightVolumeRenderTarget->GetResource()->TextureRHI;
+	FRDGTextureRef LightVolume = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(LightVolumeRHI, TEXT("LightVolume")));
+	// Materials sample the light volume after we're done with it.
+	GraphBuilder.SetTextureAccessFinal(LightVolume, ERHIAccess::SRVMask);
+	return LightVolume;
+}
+
+FRDGTextureRef CreatePropagationBuffer(
+	FRDGBuilder& GraphBuilder, const FIntVector& TransposedDimensions, EPixelFormat Format, const TCHAR* Name)
+{
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2D(FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), Format,
+		FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV);
+	return GraphBuilder.CreateTexture(Desc, Name);
+}
+
+FIntVector GetLightVolumeSize(const FIntVector& DataSize, const FVector& WorldSize, const FVector& Downscale, int64 VoxelBudget)
+{
+	FIntVector Size;
+	if (VoxelBudget <= 0)
+	{
+		for (int32 i = 0; i < 3; i++)
+		{
+			Size[i] = FMath::Max(1, FMath::CeilToInt(DataSize[i] / FMath::Max(Downscale[i], 1.0)));
+		}
+		return Size;
+	}
+
+	// Pick the voxel side giving VoxelBudget cubic voxels. Axes where that's more than the data resolution get clamped to it,
+	// which leaves more of the budget for the others, so repeat for the axes that weren't clamped yet.
+	const FVector Extent = WorldSize.GetAbs().ComponentMax(FVector(UE_KINDA_SMALL_NUMBER));
+	bool bClamped[3] = {false, false, false};
+	for (int32 Iteration = 0; Iteration < 3; Iteration++)
+	{
+		double FreeBudget = (double) VoxelBudget;
+		double FreeExtent = 1.0;
+		int32 NumFree = 0;
+		for (int32 i = 0; i < 3; i++)
+		{
+			if (bClamped[i])
+			{
+				FreeBudget /= Size[i];
+			}
+			else
+			{
+				FreeExtent *= Extent[i];
+				NumFree++;
+			}
+		}
+		if (NumFree == 0)
+		{
+			break;
+		}
+
+		const double VoxelSide = FMath::Pow(FreeExtent / FMath::Max(FreeBudget, 1.0), 1.0 / NumFree);
+		bool bClampedAny = false;
+		for (int32 i = 0; i < 3; i++)
+		{
+			if (bClamped[i])
+			{
+				continue;
+			}
+			// Round down, so that the budget is never exceeded.
+			Size[i] = FMath::Max(1, FMath::FloorToInt(Extent[i] / VoxelSide));
+			if (Size[i] >= DataSize[i])
+			{
+				Size[i] = DataSize[i];
+				bClamped[i] = true;
+				bClampedAny = true;
+			}
+		}
+		if (!bClampedAny)
+		{
+			break;
+		}
+	}
+	return Size;
+}
+
+EPixelFormat GetLightVolumePixelFormat(ERaymarchLightVolumeFormat Format)
+{
+	switch (Format)
+	{
+		case ERaymarchLightVolumeFormat::R16F:
+			return PF_R16F;
+		case ERaymarchLightVolumeFormat::R32F:
+			return PF_R32_FLOAT;
+		case ERaymarchLightVolumeFormat::R11G11B10:
+			return PF_FloatR11G11B10;
+		case ERaymarchLightVolumeFormat::RGBA16FLightGroups:
+		case ERaymarchLightVolumeFormat::RGBA16FColored:
+			return PF_FloatRGBA;
+		case ERaymarchLightVolumeFormat::G8:
+		default:
+			return PF_G8;
+	}
+}
+
+bool IsPackedLightVolumeFormat(EPixelFormat Format)
+{
+	return Format == PF_FloatR11G11B10 || Format == PF_FloatRGBA;
+}
+
+EPixelFormat GetPropagationBufferFormat(EPixelFormat LightVolumeFormat)
+{
+	return IsPackedLightVolumeFormat(LightVolumeFormat) ? PF_R16F : LightVolumeFormat;
+}
+
+FVector4f GetLightVolumeChannelMask(const FDirLightParameters& LightParameters, ERaymarchLightVolumeFormat LightVolumeFormat)
+{
+	switch (LightVolumeFormat)
+	{
+		case ERaymarchLightVolumeFormat::RGBA16FLightGroups:
+		{
+			FVector4f Mask(0, 0, 0, 0);
+			Mask[FMath::Clamp(LightParameters.LightGroup, 0, 3)] = 1;
+			return Mask;
+		}
+		case ERaymarchLightVolumeFormat::RGBA16FColored:
+			return FVector4f(LightParameters.LightColor.R, LightParameters.LightColor.G, LightParameters.LightColor.B, 0);
+		case ERaymarchLightVolumeFormat::R11G11B10:
+			return FVector4f(1, 1, 1, 0);
+		default:
+			return FVector4f(1, 0, 0, 0);
+	}
+}
+
+ERDGPassFlags GetRaymarchComputePassFlags()
 {
-	// 	RHICmdList.Transition(FRHITransitionInfo(NewlyReadableTexture, ERHIAccess::UAVGraphics, ERHIAccess::UAVCompute));
-	//
-	// 	RHICmdList.TransitionResource(EResourceTransitionAccess::EReadable, NewlyReadableTexture);
-	// 	RHICmdList.TransitionResource(
-	// 		EResourceTransitionAccess::EWritable, EResourceTransitionPipeline::EComputeToCompute, NewlyWriteableUAV);
+	const bool bUseAsyncCompute = GSupportsEfficientAsyncCompute && CVarRaymarcherAsyncCompute.GetValueOnRenderThread() != 0;
+	return bUseAsyncCompute ? ERDGPassFlags::AsyncCompute : ERDGPassFlags::Compute;
 }
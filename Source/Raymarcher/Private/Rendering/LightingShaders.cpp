@@ -7,9 +7,10 @@
 
 #include "DataDrivenShaderPlatformInfo.h"
 #include "Engine/TextureRenderTargetVolume.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
 #include "Rendering/LightingShaderUtils.h"
 #include "Runtime/RenderCore/Public/RenderUtils.h"
-#include "Util/UtilityShaders.h"
 
 #if !UE_BUILD_SHIPPING
 #pragma optimize("", off)
@@ -17,10 +18,24 @@
 
 #define LOCTEXT_NAMESPACE "RaymarchPlugin"
 
+IMPLEMENT_GLOBAL_SHADER_PARAMETER_STRUCT(FDirLightPropagationParameters, "DirLightPropagation");
+
 IMPLEMENT_GLOBAL_SHADER(FAddDirLightShader, "/Raymarcher/Private/AddDirLightShader.usf", "MainComputeShader", SF_Compute);
 
+IMPLEMENT_GLOBAL_SHADER(
+	FAddDirLightPerSliceShader, "/Raymarcher/Private/AddDirLightPerSliceShader.usf", "MainComputeShader", SF_Compute);
+
 IMPLEMENT_GLOBAL_SHADER(FChangeDirLightShader, "/Raymarcher/Private/ChangeDirLightShader.usf", "MainComputeShader", SF_Compute);
 
+IMPLEMENT_GLOBAL_SHADER(
+	FAddDirLightsBatchedShader, "/Raymarcher/Private/AddDirLightsBatchedShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FChangeLocalLightShader, "/Raymarcher/Private/ChangeLocalLightShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FResolveLightGroupsShader, "/Raymarcher/Private/ResolveLightGroupsShader.usf", "MainComputeShader", SF_Compute);
+
 // For making statistics about GPU use - Adding Lights.
 DECLARE_FLOAT_COUNTER_STAT(TEXT("AddingLights"), STAT_GPU_AddingLights, STATGROUP_GPU);
 DECLARE_GPU_STAT_NAMED(GPUAddingLights, TEXT("AddingLightsToVolume"));
@@ -29,13 +44,221 @@ DECLARE_GPU_STAT_NAMED(GPUAddingLights, TEXT("AddingLightsToVolume"));
 DECLARE_FLOAT_COUNTER_STAT(TEXT("ChangingLights"), STAT_GPU_ChangingLights, STATGROUP_GPU);
 DECLARE_GPU_STAT_NAMED(GPUChangingLights, TEXT("ChangingLightsInVolume"));
 
+// For making statistics about GPU use - Updating dirty bricks after the clipping plane moved.
+DECLARE_GPU_STAT_NAMED(GPUUpdatingDirtyBricks, TEXT("UpdatingDirtyLightBricks"));
+
+// For making statistics about GPU use - Ray casting point and spot lights.
+DECLARE_GPU_STAT_NAMED(GPUChangingLocalLights, TEXT("ChangingLocalLightsInVolume"));
+
+// For making statistics about GPU use - Resolving light groups into a single light volume.
+DECLARE_GPU_STAT_NAMED(GPUResolvingLightGroups, TEXT("ResolvingLightGroups"));
+
+// Render thread time spent issuing light propagation work. Use "stat Raymarcher" to see it.
+DECLARE_STATS_GROUP(TEXT("Raymarcher"), STATGROUP_Raymarcher, STATCAT_Advanced);
+DECLARE_CYCLE_STAT(TEXT("Add Dir Light (Render Thread)"), STAT_AddDirLight_RenderThread, STATGROUP_Raymarcher);
+DECLARE_CYCLE_STAT(TEXT("Add Dir Lights Batched (Render Thread)"), STAT_AddDirLightsBatched_RenderThread, STATGROUP_Raymarcher);
+DECLARE_CYCLE_STAT(TEXT("Change Dir Light (Render Thread)"), STAT_ChangeDirLight_RenderThread, STATGROUP_Raymarcher);
+DECLARE_CYCLE_STAT(TEXT("Update Dirty Light Bricks (Render Thread)"), STAT_UpdateDirtyBricks_RenderThread, STATGROUP_Raymarcher);
+DECLARE_CYCLE_STAT(TEXT("Add Dir Light Chunks (Render Thread)"), STAT_AddDirLightChunks_RenderThread, STATGROUP_Raymarcher);
+DECLARE_CYCLE_STAT(TEXT("Resolve Light Groups (Render Thread)"), STAT_ResolveLightGroups_RenderThread, STATGROUP_Raymarcher);
+
 // #TODO profile with different dimensions.
 #define NUM_THREADS_PER_GROUP_DIMENSION 16	  // This has to be the same as in the compute shader's spec [X, X, 1]
+#define NUM_THREADS_PER_RESOLVE_GROUP_DIMENSION 8	 // This has to be the same as in the resolve shader's spec [X, X, X]
+#define NUM_THREADS_PER_LOCAL_LIGHT_GROUP_DIMENSION 4	 // This has to be the same as in the local light shader's spec [X, X, X]
+
+// Light passes through bricks the transfer function makes fully transparent unchanged, so propagation can skip sampling them.
+static bool ShouldSkipEmptyBricks(const FBasicRaymarchRenderingResources& Resources)
+{
+	return Resources.bSkipEmptyBricksInLightPropagation && Resources.BrickDistanceRenderTarget &&
+		   Resources.BrickDistanceRenderTarget->GetResource();
+}
+
+void SetupRaymarchVolumeSamplingParameters(FRaymarchVolumeSamplingParameters& OutParameters,
+	const FBasicRaymarchRenderingResources& Resources, const FClippingPlaneParameters& LocalClippingParameters)
+{
+	OutParameters.Volume = Resources.DataVolumeTextureRef->GetResource()->TextureRHI;
+	OutParameters.VolumeSampler = GetDataVolumeSamplerRef(Resources.WindowingParameters);
+	OutParameters.TransferFunc = Resources.TFTextureRef->GetResource()->TextureRHI;
+	OutParameters.TransferFuncSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	OutParameters.LocalClippingCenter = FVector3f(LocalClippingParameters.Center);
+	OutParameters.LocalClippingDirection = FVector3f(LocalClippingParameters.Direction);
+	OutParameters.WindowingParameters = FVector4f(Resources.WindowingParameters.ToLinearColor());
+	const bool bSkipEmptyBricks = ShouldSkipEmptyBricks(Resources);
+	OutParameters.BrickDistanceVolume =
+		bSkipEmptyBricks ? Resources.BrickDistanceRenderTarget->GetResource()->TextureRHI : GBlackVolumeTexture->TextureRHI;
+	OutParameters.EmptySpaceBrickSize = bSkipEmptyBricks ? Resources.BrickSize : 0;
+}
 
 void AddDirLightToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
 	const FDirLightParameters LightParameters, const bool Added, const FRaymarchWorldParameters WorldParameters)
 {
 	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_AddDirLight_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("AddDirLightToSingleLightVolume"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, LightParameters, Added, WorldParameters);
+	GraphBuilder.Execute();
+}
+
+// Returns how many checkpoints get stored when propagating through NumSlices slices. There's no checkpoint for the first brick, the
+// light entering it is just the light's alpha.
+static int32 GetNumPropagationCheckpoints(int32 NumSlices)
+{
+	return (NumSlices - 1) / RAYMARCH_LIGHT_VOLUME_BRICK_SIZE;
+}
+
+static FRDGTextureRef CreatePropagationCheckpoints(
+	FRDGBuilder& GraphBuilder, const FIntVector& TransposedDimensions, EPixelFormat Format)
+{
+	const FRDGTextureDesc Desc = FRDGTextureDesc::Create2DArray(FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), Format,
+		FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, GetNumPropagationCheckpoints(TransposedDimensions.Z));
+	return GraphBuilder.CreateTexture(Desc, TEXT("LightPropagationCheckpoints"));
+}
+
+// Adds the passes propagating a single light along one of it's axes. Propagation goes from StartStep to EndStep slices from the
+// face the light enters through (MAX_int32 = to the end of the volume). If StartStep is not the first slice, the light entering it
+// is read from Checkpoints (so StartStep has to be at a brick boundary). With bRecordCheckpoints, the light entering every
+// following brick is stored into Checkpoints.
+static void AddDirLightAxisPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& LocalLightParams,
+	const FMajorAxes& LocalMajorAxes, const unsigned AxisIndex, const bool Added, const FRaymarchWorldParameters& WorldParameters,
+	const int32 StartStep, const int32 EndStep, FRDGTextureRef Checkpoints, const bool bRecordCheckpoints)
+{
+	check(StartStep % RAYMARCH_LIGHT_VOLUME_BRICK_SIZE == 0);
+	check((StartStep == 0 && !bRecordCheckpoints) || Checkpoints);
+
+	// Transform clipping parameters into local space.
+	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+
+	// Get the X, Y and Z transposed into the current axis orientation.
+	FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolume->Desc.GetSize(), AxisIndex);
+
+	FVector2D UVOffset =
+		GetUVOffset(LocalMajorAxes.FaceWeight[AxisIndex].first, -LocalLightParams.LightDirection, TransposedDimensions);
+
+	FVector UVWOffset;
+	float StepSize;
+	GetStepSizeAndUVWOffset(LocalMajorAxes.FaceWeight[AxisIndex].first, -LocalLightParams.LightDirection, TransposedDimensions,
+		WorldParameters, StepSize, UVWOffset);
+
+	// Normalize UVW offset to length of largest voxel size to get rid of artifacts. (Not correct,
+	// but consistent!)
+	int LowestVoxelCount = FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
+	float LongestVoxelSide = 1.0f / LowestVoxelCount;
+	UVWOffset.Normalize();
+	UVWOffset *= LongestVoxelSide;
+
+	// Everything that doesn't change between slices goes into a uniform buffer, bound once for the whole axis.
+	FDirLightPropagationParameters UniformParameters;
+	UniformParameters.Volume = Resources.DataVolumeTextureRef->GetResource()->TextureRHI;
+	UniformParameters.VolumeSampler = GetDataVolumeSamplerRef(Resources.WindowingParameters);
+	UniformParameters.TransferFunc = Resources.TFTextureRef->GetResource()->TextureRHI;
+	UniformParameters.TransferFuncSampler = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
+	UniformParameters.LocalClippingCenter = FVector3f(LocalClippingParameters.Center);
+	UniformParameters.LocalClippingDirection = FVector3f(LocalClippingParameters.Direction);
+	UniformParameters.WindowingParameters = FVector4f(Resources.WindowingParameters.ToLinearColor());
+	UniformParameters.StepSize = StepSize;
+	UniformParameters.PermutationMatrix = FMatrix44f(GetPermutationMatrix(LocalMajorAxes, AxisIndex));
+	UniformParameters.PrevPixelOffset = FVector2f(UVOffset);
+	UniformParameters.UVWOffset = FVector3f(UVWOffset);
+	UniformParameters.bAdded = Added ? 1 : -1;
+	UniformParameters.ReadBufferSampler =
+		GetBufferSamplerRef(GetBorderColorIntSingle(LocalLightParams, LocalMajorAxes, AxisIndex));
+	UniformParameters.LightVolumeChannelMask = GetLightVolumeChannelMask(LocalLightParams, Resources.LightVolumeFormat);
+	const bool bSkipEmptyBricks = ShouldSkipEmptyBricks(Resources);
+	UniformParameters.BrickDistanceVolume =
+		bSkipEmptyBricks ? Resources.BrickDistanceRenderTarget->GetResource()->TextureRHI : GBlackVolumeTexture->TextureRHI;
+	UniformParameters.EmptySpaceBrickSize = bSkipEmptyBricks ? Resources.BrickSize : 0;
+	TUniformBufferRef<FDirLightPropagationParameters> UniformBuffer =
+		TUniformBufferRef<FDirLightPropagationParameters>::CreateUniformBufferImmediate(
+			UniformParameters, UniformBuffer_SingleFrame);
+
+	// The read/write buffers only live within the graph, so their memory gets reused once the axis is done.
+	const EPixelFormat BufferFormat = GetPropagationBufferFormat(LightVolume->Desc.Format);
+	FRDGTextureRef ReadWriteBuffers[2] = {
+		CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("IlluminationBuffer0")),
+		CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("IlluminationBuffer1"))};
+	FRDGTextureUAVRef ReadWriteBufferUAVs[2] = {
+		GraphBuilder.CreateUAV(ReadWriteBuffers[0]), GraphBuilder.CreateUAV(ReadWriteBuffers[1])};
+
+	int Start, Stop, AxisDirection;
+	GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, AxisIndex, TransposedDimensions.Z);
+	const int FirstSlice = Start + StartStep * AxisDirection;
+
+	if (StartStep == 0)
+	{
+		// Both buffers start out fully lit.
+		const float LightAlpha = GetLightAlpha(LocalLightParams, LocalMajorAxes, AxisIndex);
+		const float ClearValues[4] = {LightAlpha, LightAlpha, LightAlpha, LightAlpha};
+		AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[0], ClearValues);
+		AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[1], ClearValues);
+	}
+	else
+	{
+		// The first slice reads the light that entered it the last time it was propagated. The other buffer gets written first.
+		FRHICopyTextureInfo CopyInfo;
+		CopyInfo.SourceSliceIndex = StartStep / RAYMARCH_LIGHT_VOLUME_BRICK_SIZE - 1;
+		CopyInfo.NumSlices = 1;
+		AddCopyTexturePass(GraphBuilder, Checkpoints, ReadWriteBuffers[FirstSlice % 2], CopyInfo);
+	}
+
+	// Every slice writes different voxels, so there is no need for barriers on the light volume within one axis. The next
+	// axis gets a new UAV, so it waits for this one to finish.
+	FRDGTextureUAVRef LightVolumeUAV =
+		GraphBuilder.CreateUAV(FRDGTextureUAVDesc(LightVolume), ERDGUnorderedAccessViewFlags::SkipBarrier);
+
+	// Same for the checkpoints, every slice of the array is written by exactly one pass.
+	FRDGTextureUAVRef CheckpointsUAV = nullptr;
+	if (bRecordCheckpoints)
+	{
+		CheckpointsUAV = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Checkpoints), ERDGUnorderedAccessViewFlags::SkipBarrier);
+	}
+
+	FAddDirLightShader::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FAddDirLightShader::FRecordCheckpoints>(bRecordCheckpoints);
+	PermutationVector.Set<FPackedLightVolumeDim>(IsPackedLightVolumeFormat(LightVolume->Desc.Format));
+	TShaderMapRef<FAddDirLightShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5), PermutationVector);
+	const ERDGPassFlags PassFlags = GetRaymarchComputePassFlags();
+
+	const FIntVector GroupCount(FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION),
+		FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION), 1);
+
+	const int32 LastStep = FMath::Min(EndStep, TransposedDimensions.Z);
+	for (int j = FirstSlice; j != Stop && (j - Start) * AxisDirection < LastStep; j += AxisDirection)
+	{
+		// Only the loop index and the read/write buffers change per slice.
+		FAddDirLightShader::FParameters* PassParameters = GraphBuilder.AllocParameters<FAddDirLightShader::FParameters>();
+		PassParameters->DirLightPropagation = UniformBuffer;
+		PassParameters->Loop = j;
+		// Switch read and write buffers each row.
+		PassParameters->ReadBuffer = ReadWriteBuffers[j % 2];
+		PassParameters->WriteBuffer = ReadWriteBufferUAVs[1 - (j % 2)];
+		PassParameters->ALightVolume = LightVolumeUAV;
+
+		// The light written by this slice enters the next one - store it if that's the first slice of a brick.
+		const int32 NextStep = (j - Start) * AxisDirection + 1;
+		const bool bBrickBoundary = (NextStep % RAYMARCH_LIGHT_VOLUME_BRICK_SIZE == 0) && (NextStep < TransposedDimensions.Z);
+		PassParameters->Checkpoints = CheckpointsUAV;
+		PassParameters->CheckpointIndex = bBrickBoundary ? NextStep / RAYMARCH_LIGHT_VOLUME_BRICK_SIZE - 1 : -1;
+
+		FComputeShaderUtils::AddPass(
+			GraphBuilder, RDG_EVENT_NAME("AddDirLightSlice"), PassFlags, ComputeShader, PassParameters, GroupCount);
+	}
+}
+
+void AddDirLightToSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters)
+{
+	if (LightParameters.IsLocalLight())
+	{
+		AddChangeLocalLightInSingleLightVolumePass(GraphBuilder, LightVolume, Resources,
+			Added ? FDirLightParameters() : LightParameters, Added ? LightParameters : FDirLightParameters(), WorldParameters,
+			WorldParameters);
+		return;
+	}
 
 	// Can't have directional light without direction...
 	if (LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
@@ -50,15 +273,27 @@ void AddDirLightToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICm
 	// Calculate local Light parameters and corresponding axes.
 	GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
 
-	// Transform clipping parameters into local space.
-	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+	// Record checkpoints for added lights, so that they can later be updated starting at a dirty brick. A removed light's
+	// checkpoints are of no use anymore.
+	FLightPropagationCheckpoints* Checkpoints = nullptr;
+	if (Resources.PropagationCheckpoints)
+	{
+		if (Added)
+		{
+			Checkpoints = &Resources.PropagationCheckpoints->FindOrAdd(LightParameters);
+			Checkpoints->Textures[0] = nullptr;
+			Checkpoints->Textures[1] = nullptr;
+		}
+		else
+		{
+			Resources.PropagationCheckpoints->Remove(LightParameters);
+		}
+	}
 
 	// For GPU profiling.
-	SCOPED_DRAW_EVENTF(RHICmdList, AddDirLightToSingleLightVolume_RenderThread, TEXT("Adding Lights"));
-	SCOPED_GPU_STAT(RHICmdList, GPUAddingLights);
+	RDG_EVENT_SCOPE(GraphBuilder, "Adding Lights");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUAddingLights);
 
-	// TODO create structure with 2 sets of buffers so we don't have to look for them again in the
-	// actual shader loop! Clear buffers for the two axes we will be using.
 	for (unsigned i = 0; i < 2; i++)
 	{
 		// Break if the axis weight == 0
@@ -66,109 +301,387 @@ void AddDirLightToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICm
 		{
 			break;
 		}
-		// Get the X, Y and Z transposed into the current axis orientation.
-		FIntVector TransposedDimensions = GetTransposedDimensions(
-			LocalMajorAxes, Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetTexture3D(), i);
-		OneAxisReadWriteBufferResources& Buffers = GetBuffers(LocalMajorAxes, i, Resources);
 
-		float LightAlpha = GetLightAlpha(LocalLightParams, LocalMajorAxes, i);
+		FRDGTextureRef CheckpointTexture = nullptr;
+		const FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolume->Desc.GetSize(), i);
+		if (Checkpoints && GetNumPropagationCheckpoints(TransposedDimensions.Z) > 0)
+		{
+			CheckpointTexture = CreatePropagationCheckpoints(
+				GraphBuilder, TransposedDimensions, GetPropagationBufferFormat(LightVolume->Desc.Format));
+			Checkpoints->Faces[i] = LocalMajorAxes.FaceWeight[i].first;
+			Checkpoints->Textures[i] = GraphBuilder.ConvertToExternalTexture(CheckpointTexture);
+		}
 
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[0], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), LightAlpha);
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[1], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), LightAlpha);
+		AddDirLightAxisPasses(GraphBuilder, LightVolume, Resources, LocalLightParams, LocalMajorAxes, i, Added, WorldParameters, 0,
+			MAX_int32, CheckpointTexture, CheckpointTexture != nullptr);
 	}
+}
 
-	// Find and set compute shader
-	TShaderMapRef<FAddDirLightShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
-	FRHIComputeShader* ShaderRHI = ComputeShader.GetComputeShader();
-	SetComputePipelineState(RHICmdList, ShaderRHI);
+void AddDirLightToSingleLightVolumePerSliceBaseline_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters)
+{
+	check(IsInRenderingThread());
+	check(!LightParameters.IsLocalLight() && LightParameters.LightDirection != FVector(0.0, 0.0, 0.0));
 
-	// Transition the resource to Compute-shader.
-	// Otherwise the renderer might touch our textures while we're writing to them.
-	RHICmdList.Transition(FRHITransitionInfo(Resources.LightVolumeUAVRef, ERHIAccess::UAVGraphics, ERHIAccess::UAVCompute));
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("AddDirLightPerSliceBaseline"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	check(!IsPackedLightVolumeFormat(LightVolume->Desc.Format));
 
-	for (unsigned i = 0; i < 2; i++)
+	FDirLightParameters LocalLightParams;
+	FMajorAxes LocalMajorAxes;
+	GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+
+	TShaderMapRef<FAddDirLightPerSliceShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	const ERDGPassFlags PassFlags = GetRaymarchComputePassFlags();
+
+	for (unsigned AxisIndex = 0; AxisIndex < 2; AxisIndex++)
 	{
-		// Break if the main axis weight == 1
-		if (LocalMajorAxes.FaceWeight[i].second == 0)
+		if (LocalMajorAxes.FaceWeight[AxisIndex].second == 0)
 		{
 			break;
 		}
-		OneAxisReadWriteBufferResources& Buffers = GetBuffers(LocalMajorAxes, i, Resources);
-
-		uint32 ColorInt = GetBorderColorIntSingle(LocalLightParams, LocalMajorAxes, i);
-		FSamplerStateRHIRef readBuffSampler = GetBufferSamplerRef(ColorInt);
-
-		// Get the X, Y and Z transposed into the current axis orientation.
-		FIntVector TransposedDimensions = GetTransposedDimensions(
-			LocalMajorAxes, Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetTexture3D(), i);
 
+		// Same per axis setup as AddDirLightAxisPasses().
+		FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolume->Desc.GetSize(), AxisIndex);
 		FVector2D UVOffset =
-			GetUVOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions);
-		FMatrix PermutationMatrix = GetPermutationMatrix(LocalMajorAxes, i);
-
-		FIntVector LightVolumeSize = FIntVector(Resources.LightVolumeRenderTarget->SizeX, Resources.LightVolumeRenderTarget->SizeY,
-			Resources.LightVolumeRenderTarget->SizeZ);
-
+			GetUVOffset(LocalMajorAxes.FaceWeight[AxisIndex].first, -LocalLightParams.LightDirection, TransposedDimensions);
 		FVector UVWOffset;
 		float StepSize;
-		GetStepSizeAndUVWOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions,
-			WorldParameters, StepSize, UVWOffset);
-
-		// Normalize UVW offset to length of largest voxel size to get rid of artifacts. (Not correct,
-		// but consistent!)
+		GetStepSizeAndUVWOffset(LocalMajorAxes.FaceWeight[AxisIndex].first, -LocalLightParams.LightDirection,
+			TransposedDimensions, WorldParameters, StepSize, UVWOffset);
 		int LowestVoxelCount = FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
-		float LongestVoxelSide = 1.0f / LowestVoxelCount;
 		UVWOffset.Normalize();
-		UVWOffset *= LongestVoxelSide;
+		UVWOffset *= 1.0f / LowestVoxelCount;
 
-		uint32 GroupSizeX = FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION);
-		uint32 GroupSizeY = FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION);
+		const EPixelFormat BufferFormat = GetPropagationBufferFormat(LightVolume->Desc.Format);
+		FRDGTextureRef ReadWriteBuffers[2] = {
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("IlluminationBuffer0")),
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("IlluminationBuffer1"))};
+		FRDGTextureUAVRef ReadWriteBufferUAVs[2] = {
+			GraphBuilder.CreateUAV(ReadWriteBuffers[0]), GraphBuilder.CreateUAV(ReadWriteBuffers[1])};
+		const float LightAlpha = GetLightAlpha(LocalLightParams, LocalMajorAxes, AxisIndex);
+		const float ClearValues[4] = {LightAlpha, LightAlpha, LightAlpha, LightAlpha};
+		AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[0], ClearValues);
+		AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[1], ClearValues);
 
-		int Start, Stop, AxisDirection;
-		GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, i, TransposedDimensions.Z);
+		// No barriers between the slices, same as AddDirLightAxisPasses(), so only the parameter binding differs.
+		FRDGTextureUAVRef LightVolumeUAV =
+			GraphBuilder.CreateUAV(FRDGTextureUAVDesc(LightVolume), ERDGUnorderedAccessViewFlags::SkipBarrier);
+		FSamplerStateRHIRef ReadBufferSampler =
+			GetBufferSamplerRef(GetBorderColorIntSingle(LocalLightParams, LocalMajorAxes, AxisIndex));
+		const FIntVector GroupCount(FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION),
+			FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION), 1);
 
+		int Start, Stop, AxisDirection;
+		GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, AxisIndex, TransposedDimensions.Z);
 		for (int j = Start; j != Stop; j += AxisDirection)
 		{
-			// Set all compute shader parameters
-			// TODO find out why this has to be set for every invocation when it was fine to just SetLoop before UE 5.3
-			ComputeShader->SetRaymarchParameters(
-				RHICmdList, ShaderRHI, LocalClippingParameters, Resources.WindowingParameters.ToLinearColor());
-			ComputeShader->SetRaymarchResources(RHICmdList, ShaderRHI,
-				Resources.DataVolumeTextureRef->GetResource()->TextureRHI->GetTexture3D(),
-				Resources.TFTextureRef->GetResource()->TextureRHI->GetTexture2D(), Resources.WindowingParameters);
-			ComputeShader->SetLightAdded(RHICmdList, ShaderRHI, Added);
-			ComputeShader->SetALightVolume(RHICmdList, ShaderRHI, Resources.LightVolumeUAVRef);
-			ComputeShader->SetUVOffset(RHICmdList, ShaderRHI, UVOffset);
-			ComputeShader->SetUVWOffset(RHICmdList, ShaderRHI, UVWOffset);
-			ComputeShader->SetPermutationMatrix(RHICmdList, ShaderRHI, PermutationMatrix);
-			ComputeShader->SetStepSize(RHICmdList, ShaderRHI, StepSize);
-
-			// Switch read and write buffers each row.
-			if (j % 2 == 0)
+			// Every parameter (including the data volume sampler state lookup) gets set again for every slice.
+			FAddDirLightPerSliceShader::FParameters* PassParameters =
+				GraphBuilder.AllocParameters<FAddDirLightPerSliceShader::FParameters>();
+			SetupRaymarchVolumeSamplingParameters(PassParameters->VolumeSampling, Resources, LocalClippingParameters);
+			PassParameters->StepSize = StepSize;
+			PassParameters->PermutationMatrix = FMatrix44f(GetPermutationMatrix(LocalMajorAxes, AxisIndex));
+			PassParameters->PrevPixelOffset = FVector2f(UVOffset);
+			PassParameters->UVWOffset = FVector3f(UVWOffset);
+			PassParameters->bAdded = Added ? 1 : -1;
+			PassParameters->Loop = j;
+			PassParameters->ReadBuffer = ReadWriteBuffers[j % 2];
+			PassParameters->ReadBufferSampler = ReadBufferSampler;
+			PassParameters->WriteBuffer = ReadWriteBufferUAVs[1 - (j % 2)];
+			PassParameters->ALightVolume = LightVolumeUAV;
+
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("AddDirLightPerSliceBaseline"), PassFlags, ComputeShader,
+				PassParameters, GroupCount);
+		}
+	}
+
+	GraphBuilder.Execute();
+}
+
+void AddDirLightsToSingleLightVolumeBatched_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightParameters> LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters)
+{
+	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_AddDirLightsBatched_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("AddDirLightsToSingleLightVolumeBatched"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddDirLightsToSingleLightVolumeBatchedPasses(GraphBuilder, LightVolume, Resources, LightParameters, Added, WorldParameters);
+	GraphBuilder.Execute();
+}
+
+void AddDirLightsToSingleLightVolumeBatchedPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightParameters>& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters)
+{
+	// One propagation along one of the (up to 2) major axes of a light.
+	struct FLightAxisPass
+	{
+		FDirLightParameters LightParameters;
+		FDirLightParameters LocalLightParams;
+		FMajorAxes LocalMajorAxes;
+		unsigned AxisIndex;
+	};
+
+	// Split all lights into their axis passes and group them by the cube face they propagate from. All passes in a group share
+	// the buffers, dimensions, permutation matrix and loop direction, so they can be propagated together.
+	TArray<FLightAxisPass> PassesPerFace[6];
+	for (const FDirLightParameters& Light : LightParameters)
+	{
+		// Point and spot lights don't go along any axis, they get ray cast on their own.
+		if (Light.IsLocalLight())
+		{
+			AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, Light, Added, WorldParameters);
+			continue;
+		}
+
+		// Can't have directional light without direction...
+		if (Light.LightDirection == FVector(0.0, 0.0, 0.0))
+		{
+			GEngine->AddOnScreenDebugMessage(
+				-1, 100.0f, FColor::Yellow, TEXT("Skipping a directional light that doesn't have a direction."));
+			continue;
+		}
+
+		// Same as for single lights - added lights get new checkpoints (recorded below), removed ones don't need theirs anymore.
+		if (Resources.PropagationCheckpoints)
+		{
+			if (Added)
 			{
-				ComputeShader->SetLoop(RHICmdList, ShaderRHI, j, Buffers.Buffers[0], readBuffSampler, Buffers.UAVs[1]);
+				FLightPropagationCheckpoints& Checkpoints = Resources.PropagationCheckpoints->FindOrAdd(Light);
+				Checkpoints.Textures[0] = nullptr;
+				Checkpoints.Textures[1] = nullptr;
 			}
 			else
 			{
-				ComputeShader->SetLoop(RHICmdList, ShaderRHI, j, Buffers.Buffers[1], readBuffSampler, Buffers.UAVs[0]);
+				Resources.PropagationCheckpoints->Remove(Light);
+			}
+		}
+
+		FLightAxisPass Pass;
+		Pass.LightParameters = Light;
+		GetLocalLightParamsAndAxes(Light, WorldParameters.VolumeTransform, Pass.LocalLightParams, Pass.LocalMajorAxes);
+		for (unsigned i = 0; i < 2; i++)
+		{
+			// Break if the axis weight == 0
+			if (Pass.LocalMajorAxes.FaceWeight[i].second == 0)
+			{
+				break;
 			}
-			RHICmdList.DispatchComputeShader(GroupSizeX, GroupSizeY, 1);
+			Pass.AxisIndex = i;
+			PassesPerFace[(uint8) Pass.LocalMajorAxes.FaceWeight[i].first].Add(Pass);
 		}
 	}
 
-	// Unbind UAVs.
-	ComputeShader->UnbindResourcesLightPropagation(RHICmdList, ShaderRHI);
+	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+	FRaymarchVolumeSamplingParameters VolumeSampling;
+	SetupRaymarchVolumeSamplingParameters(VolumeSampling, Resources, LocalClippingParameters);
+
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "Adding Lights Batched");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUAddingLights);
+
+	const EPixelFormat CheckpointFormat = GetPropagationBufferFormat(LightVolume->Desc.Format);
+	const ERDGPassFlags PassFlags = GetRaymarchComputePassFlags();
+
+	for (const TArray<FLightAxisPass>& FacePasses : PassesPerFace)
+	{
+		for (int32 BatchStart = 0; BatchStart < FacePasses.Num(); BatchStart += RAYMARCH_MAX_BATCHED_LIGHTS)
+		{
+			const int32 BatchNum = FMath::Min(FacePasses.Num() - BatchStart, RAYMARCH_MAX_BATCHED_LIGHTS);
+			const FLightAxisPass& FirstPass = FacePasses[BatchStart];
+
+			// Get the X, Y and Z transposed into the current axis orientation.
+			FIntVector TransposedDimensions =
+				GetTransposedDimensions(FirstPass.LocalMajorAxes, LightVolume->Desc.GetSize(), FirstPass.AxisIndex);
+
+			// Normalize UVW offsets to length of largest voxel size to get rid of artifacts. (Not correct,
+			// but consistent!)
+			int LowestVoxelCount = FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
+			float LongestVoxelSide = 1.0f / LowestVoxelCount;
 
-	// Transition resources back to the renderer.
-	RHICmdList.Transition(FRHITransitionInfo(Resources.LightVolumeUAVRef, ERHIAccess::UAVCompute, ERHIAccess::UAVGraphics));
+			// Gather per-light parameters, unused channels stay zeroed.
+			FVector4f LightAlphas(0, 0, 0, 0);
+			FVector4f StepSizes(0, 0, 0, 0);
+			FVector4f PrevPixelOffsets[RAYMARCH_MAX_BATCHED_LIGHTS];
+			FVector4f UVWOffsets[RAYMARCH_MAX_BATCHED_LIGHTS];
+			FVector4f ChannelMasks[RAYMARCH_MAX_BATCHED_LIGHTS];
+			for (int32 n = 0; n < RAYMARCH_MAX_BATCHED_LIGHTS; n++)
+			{
+				PrevPixelOffsets[n] = FVector4f(0, 0, 0, 0);
+				UVWOffsets[n] = FVector4f(0, 0, 0, 0);
+				ChannelMasks[n] = FVector4f(0, 0, 0, 0);
+				if (n >= BatchNum)
+				{
+					continue;
+				}
+
+				const FLightAxisPass& Pass = FacePasses[BatchStart + n];
+				const FCubeFace Face = Pass.LocalMajorAxes.FaceWeight[Pass.AxisIndex].first;
+				LightAlphas[n] = GetLightAlpha(Pass.LocalLightParams, Pass.LocalMajorAxes, Pass.AxisIndex);
+				ChannelMasks[n] = GetLightVolumeChannelMask(Pass.LocalLightParams, Resources.LightVolumeFormat);
+
+				FVector2D UVOffset = GetUVOffset(Face, -Pass.LocalLightParams.LightDirection, TransposedDimensions);
+				PrevPixelOffsets[n] = FVector4f(UVOffset.X, UVOffset.Y, 0, 0);
+
+				FVector UVWOffset;
+				float StepSize;
+				GetStepSizeAndUVWOffset(
+					Face, -Pass.LocalLightParams.LightDirection, TransposedDimensions, WorldParameters, StepSize, UVWOffset);
+				UVWOffset.Normalize();
+				UVWOffset *= LongestVoxelSide;
+				UVWOffsets[n] = FVector4f(UVWOffset.X, UVWOffset.Y, UVWOffset.Z, 0);
+				StepSizes[n] = StepSize;
+			}
+
+			// Batched propagation keeps one light per channel, so these are always RGBA.
+			FRDGTextureRef ReadWriteBuffers[2] = {
+				CreatePropagationBuffer(GraphBuilder, TransposedDimensions, PF_FloatRGBA, TEXT("BatchedIlluminationBuffer0")),
+				CreatePropagationBuffer(GraphBuilder, TransposedDimensions, PF_FloatRGBA, TEXT("BatchedIlluminationBuffer1"))};
+			FRDGTextureUAVRef ReadWriteBufferUAVs[2] = {
+				GraphBuilder.CreateUAV(ReadWriteBuffers[0]), GraphBuilder.CreateUAV(ReadWriteBuffers[1])};
+
+			// Both buffers start out as fully lit by every light in the batch.
+			const float ClearValues[4] = {LightAlphas.X, LightAlphas.Y, LightAlphas.Z, LightAlphas.W};
+			AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[0], ClearValues);
+			AddClearUAVPass(GraphBuilder, ReadWriteBufferUAVs[1], ClearValues);
+
+			// Record the checkpoints of all lights in the batch into one texture array, so that they can later be updated starting
+			// at a dirty brick just like lights added one at a time.
+			const int32 NumCheckpoints = GetNumPropagationCheckpoints(TransposedDimensions.Z);
+			const bool bRecordCheckpoints = Added && Resources.PropagationCheckpoints && NumCheckpoints > 0;
+			FRDGTextureRef BatchCheckpoints = nullptr;
+			FRDGTextureUAVRef BatchCheckpointsUAV = nullptr;
+			if (bRecordCheckpoints)
+			{
+				const FIntPoint CheckpointSize(TransposedDimensions.X, TransposedDimensions.Y);
+				const FRDGTextureDesc Desc = FRDGTextureDesc::Create2DArray(CheckpointSize, CheckpointFormat,
+					FClearValueBinding::None, TexCreate_ShaderResource | TexCreate_UAV, BatchNum * NumCheckpoints);
+				BatchCheckpoints = GraphBuilder.CreateTexture(Desc, TEXT("BatchedLightPropagationCheckpoints"));
+				// Every slice of the array is written by exactly one pass.
+				BatchCheckpointsUAV =
+					GraphBuilder.CreateUAV(FRDGTextureUAVDesc(BatchCheckpoints), ERDGUnorderedAccessViewFlags::SkipBarrier);
+			}
+
+			FAddDirLightsBatchedShader::FPermutationDomain PermutationVector;
+			PermutationVector.Set<FAddDirLightsBatchedShader::FRecordCheckpoints>(bRecordCheckpoints);
+			PermutationVector.Set<FPackedLightVolumeDim>(IsPackedLightVolumeFormat(LightVolume->Desc.Format));
+			TShaderMapRef<FAddDirLightsBatchedShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5), PermutationVector);
+
+			FSamplerStateRHIRef ReadBuffSampler = GetBufferSamplerRef(GetBorderColorIntBatched(LightAlphas));
+			const FMatrix44f PermutationMatrix = FMatrix44f(GetPermutationMatrix(FirstPass.LocalMajorAxes, FirstPass.AxisIndex));
+
+			// Same as in the single light version - slices write different voxels, batches wait for each other.
+			FRDGTextureUAVRef LightVolumeUAV =
+				GraphBuilder.CreateUAV(FRDGTextureUAVDesc(LightVolume), ERDGUnorderedAccessViewFlags::SkipBarrier);
+
+			const FIntVector GroupCount(FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION),
+				FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION), 1);
+
+			int Start, Stop, AxisDirection;
+			GetLoopStartStopIndexes(
+				Start, Stop, AxisDirection, FirstPass.LocalMajorAxes, FirstPass.AxisIndex, TransposedDimensions.Z);
+
+			for (int j = Start; j != Stop; j += AxisDirection)
+			{
+				FAddDirLightsBatchedShader::FParameters* PassParameters =
+					GraphBuilder.AllocParameters<FAddDirLightsBatchedShader::FParameters>();
+				PassParameters->VolumeSampling = VolumeSampling;
+				PassParameters->PermutationMatrix = PermutationMatrix;
+				for (int32 n = 0; n < RAYMARCH_MAX_BATCHED_LIGHTS; n++)
+				{
+					PassParameters->PrevPixelOffsets[n] = PrevPixelOffsets[n];
+					PassParameters->UVWOffsets[n] = UVWOffsets[n];
+					PassParameters->LightVolumeChannelMasks[n] = ChannelMasks[n];
+				}
+				PassParameters->StepSizes = StepSizes;
+				PassParameters->NumLights = BatchNum;
+				PassParameters->bAdded = Added ? 1 : -1;
+				PassParameters->Loop = j;
+				// Switch read and write buffers each row.
+				PassParameters->ReadBuffer = ReadWriteBuffers[j % 2];
+				PassParameters->ReadBufferSampler = ReadBuffSampler;
+				PassParameters->WriteBuffer = ReadWriteBufferUAVs[1 - (j % 2)];
+				PassParameters->ALightVolume = LightVolumeUAV;
+
+				// Same brick boundaries as in AddDirLightAxisPasses.
+				const int32 NextStep = (j - Start) * AxisDirection + 1;
+				const bool bBrickBoundary =
+					(NextStep % RAYMARCH_LIGHT_VOLUME_BRICK_SIZE == 0) && (NextStep < TransposedDimensions.Z);
+				PassParameters->Checkpoints = BatchCheckpointsUAV;
+				PassParameters->CheckpointIndex = bBrickBoundary ? NextStep / RAYMARCH_LIGHT_VOLUME_BRICK_SIZE - 1 : -1;
+				PassParameters->NumCheckpoints = NumCheckpoints;
+
+				FComputeShaderUtils::AddPass(
+					GraphBuilder, RDG_EVENT_NAME("AddDirLightsBatchedSlice"), PassFlags, ComputeShader, PassParameters, GroupCount);
+			}
+
+			if (!bRecordCheckpoints)
+			{
+				continue;
+			}
+
+			// Split the batch's checkpoints into the ones of each light.
+			for (int32 n = 0; n < BatchNum; n++)
+			{
+				const FLightAxisPass& Pass = FacePasses[BatchStart + n];
+				FRDGTextureRef CheckpointTexture =
+					CreatePropagationCheckpoints(GraphBuilder, TransposedDimensions, CheckpointFormat);
+				FRHICopyTextureInfo CopyInfo;
+				CopyInfo.SourceSliceIndex = n * NumCheckpoints;
+				CopyInfo.NumSlices = NumCheckpoints;
+				AddCopyTexturePass(GraphBuilder, BatchCheckpoints, CheckpointTexture, CopyInfo);
+
+				FLightPropagationCheckpoints& Checkpoints = Resources.PropagationCheckpoints->FindOrAdd(Pass.LightParameters);
+				Checkpoints.Faces[Pass.AxisIndex] = Pass.LocalMajorAxes.FaceWeight[Pass.AxisIndex].first;
+				Checkpoints.Textures[Pass.AxisIndex] = GraphBuilder.ConvertToExternalTexture(CheckpointTexture);
+			}
+		}
+	}
 }
 
 void ChangeDirLightInSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
 	FBasicRaymarchRenderingResources Resources, const FDirLightParameters RemovedLightParameters,
 	const FDirLightParameters AddedLightParameters, const FRaymarchWorldParameters WorldParameters)
 {
+	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_ChangeDirLight_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ChangeDirLightInSingleLightVolume"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddChangeDirLightInSingleLightVolumePasses(
+		GraphBuilder, LightVolume, Resources, RemovedLightParameters, AddedLightParameters, WorldParameters);
+	GraphBuilder.Execute();
+}
+
+void AddChangeDirLightInSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& RemovedLightParameters,
+	const FDirLightParameters& AddedLightParameters, const FRaymarchWorldParameters& WorldParameters)
+{
+	// Point and spot lights get ray cast. If the light changed between directional and local, the directional one still needs to
+	// be propagated.
+	if (RemovedLightParameters.IsLocalLight() || AddedLightParameters.IsLocalLight())
+	{
+		AddChangeLocalLightInSingleLightVolumePass(GraphBuilder, LightVolume, Resources,
+			RemovedLightParameters.IsLocalLight() ? RemovedLightParameters : FDirLightParameters(),
+			AddedLightParameters.IsLocalLight() ? AddedLightParameters : FDirLightParameters(), WorldParameters, WorldParameters);
+		if (!RemovedLightParameters.IsLocalLight())
+		{
+			AddDirLightToSingleLightVolumePasses(
+				GraphBuilder, LightVolume, Resources, RemovedLightParameters, false, WorldParameters);
+		}
+		if (!AddedLightParameters.IsLocalLight())
+		{
+			AddDirLightToSingleLightVolumePasses(
+				GraphBuilder, LightVolume, Resources, AddedLightParameters, true, WorldParameters);
+		}
+		return;
+	}
+
 	// Can't have directional light without direction...
 	if (AddedLightParameters.LightDirection == FVector(0.0, 0.0, 0.0) ||
 		RemovedLightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
@@ -178,6 +691,13 @@ void ChangeDirLightInSingleLightVolume_RenderThread(FRHICommandListImmediate& RH
 		return;
 	}
 
+	// The removed light's checkpoints are stale now. The added light gets it's checkpoints recorded the next time it's propagated
+	// through the whole volume.
+	if (Resources.PropagationCheckpoints)
+	{
+		Resources.PropagationCheckpoints->Remove(RemovedLightParameters);
+	}
+
 	// Create local copies of Light Params, so that if we have to fall back to 2x
 	// AddOrRemoveLight, we can just pass the original parameters.
 	FDirLightParameters RemovedLocalLightParams, AddedLocalLightParams;
@@ -192,73 +712,41 @@ void ChangeDirLightInSingleLightVolume_RenderThread(FRHICommandListImmediate& RH
 	if (RemovedLocalMajorAxes.FaceWeight[0].first != AddedLocalMajorAxes.FaceWeight[0].first ||
 		RemovedLocalMajorAxes.FaceWeight[1].first != AddedLocalMajorAxes.FaceWeight[1].first)
 	{
-		AddDirLightToSingleLightVolume_RenderThread(RHICmdList, Resources, RemovedLightParameters, false, WorldParameters);
-		AddDirLightToSingleLightVolume_RenderThread(RHICmdList, Resources, AddedLightParameters, true, WorldParameters);
+		AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, RemovedLightParameters, false, WorldParameters);
+		AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, AddedLightParameters, true, WorldParameters);
 		return;
 	}
 
 	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
-
-	// Clear buffers for the two axes we will be using.
-	for (unsigned i = 0; i < 2; i++)
-	{
-		// Get the X, Y and Z transposed into the current axis orientation.
-		FIntVector TransposedDimensions = GetTransposedDimensions(
-			RemovedLocalMajorAxes, Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetTexture3D(), i);
-		OneAxisReadWriteBufferResources& Buffers = GetBuffers(RemovedLocalMajorAxes, i, Resources);
-
-		float RemovedLightAlpha = GetLightAlpha(RemovedLocalLightParams, RemovedLocalMajorAxes, i);
-		float AddedLightAlpha = GetLightAlpha(AddedLocalLightParams, AddedLocalMajorAxes, i);
-
-		// Clear R/W buffers for Removed Light
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[0], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), RemovedLightAlpha);
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[1], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), RemovedLightAlpha);
-		// Clear R/W buffers for Added Light
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[2], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), AddedLightAlpha);
-		Clear2DTexture_RenderThread(
-			RHICmdList, Buffers.UAVs[3], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), AddedLightAlpha);
-	}
+	FRaymarchVolumeSamplingParameters VolumeSampling;
+	SetupRaymarchVolumeSamplingParameters(VolumeSampling, Resources, LocalClippingParameters);
 
 	// For GPU profiling.
-	SCOPED_DRAW_EVENTF(RHICmdList, ChangeDirLightInSingleLightVolume_RenderThread, TEXT("Changing Lights"));
-	SCOPED_GPU_STAT(RHICmdList, GPUChangingLights);
+	RDG_EVENT_SCOPE(GraphBuilder, "Changing Lights");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUChangingLights);
 
-	TShaderMapRef<FChangeDirLightShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
-	FRHIComputeShader* ShaderRHI = ComputeShader.GetComputeShader();
-	SetComputePipelineState(RHICmdList, ShaderRHI);
-
-	// Don't need barriers on these - we only ever read/write to the same pixel from one thread ->
-	// no race conditions But we definitely need to transition the resource to Compute-shader
-	// accessible, otherwise the renderer might touch our textures while we're writing them.
-	RHICmdList.Transition(FRHITransitionInfo(Resources.LightVolumeUAVRef, ERHIAccess::UAVGraphics, ERHIAccess::UAVCompute));
+	FChangeDirLightShader::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FPackedLightVolumeDim>(IsPackedLightVolumeFormat(LightVolume->Desc.Format));
+	TShaderMapRef<FChangeDirLightShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5), PermutationVector);
+	const FVector4f AddedChannelMask = GetLightVolumeChannelMask(AddedLightParameters, Resources.LightVolumeFormat);
+	const FVector4f RemovedChannelMask = GetLightVolumeChannelMask(RemovedLightParameters, Resources.LightVolumeFormat);
+	const ERDGPassFlags PassFlags = GetRaymarchComputePassFlags();
 
 	for (unsigned AxisIndex = 0; AxisIndex < 2; AxisIndex++)
 	{
-		// Get Color ints for texture borders.
-		uint32 RemovedColorInt = GetBorderColorIntSingle(RemovedLocalLightParams, RemovedLocalMajorAxes, AxisIndex);
-		uint32 AddedColorInt = GetBorderColorIntSingle(AddedLocalLightParams, AddedLocalMajorAxes, AxisIndex);
 		// Get the sampler for read buffer to use border with the proper light color.
-		FSamplerStateRHIRef RemovedReadBuffSampler = GetBufferSamplerRef(RemovedColorInt);
-		FSamplerStateRHIRef AddedReadBuffSampler = GetBufferSamplerRef(AddedColorInt);
+		FSamplerStateRHIRef RemovedReadBuffSampler =
+			GetBufferSamplerRef(GetBorderColorIntSingle(RemovedLocalLightParams, RemovedLocalMajorAxes, AxisIndex));
+		FSamplerStateRHIRef AddedReadBuffSampler =
+			GetBufferSamplerRef(GetBorderColorIntSingle(AddedLocalLightParams, AddedLocalMajorAxes, AxisIndex));
 
-		OneAxisReadWriteBufferResources& Buffers = GetBuffers(RemovedLocalMajorAxes, AxisIndex, Resources);
-		// TODO take these from buffers.
-		FIntVector TransposedDimensions = GetTransposedDimensions(
-			RemovedLocalMajorAxes, Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetTexture3D(), AxisIndex);
+		FIntVector TransposedDimensions = GetTransposedDimensions(RemovedLocalMajorAxes, LightVolume->Desc.GetSize(), AxisIndex);
 
 		FVector2D AddedPixOffset = GetUVOffset(
 			AddedLocalMajorAxes.FaceWeight[AxisIndex].first, -AddedLocalLightParams.LightDirection, TransposedDimensions);
 		FVector2D RemovedPixOffset = GetUVOffset(
 			RemovedLocalMajorAxes.FaceWeight[AxisIndex].first, -RemovedLocalLightParams.LightDirection, TransposedDimensions);
 
-		FVector2D AddedUVOffset = GetUVOffset(
-			AddedLocalMajorAxes.FaceWeight[AxisIndex].first, -AddedLocalLightParams.LightDirection, TransposedDimensions);
-		FVector2D RemovedUVOffset = GetUVOffset(
-			RemovedLocalMajorAxes.FaceWeight[AxisIndex].first, -RemovedLocalLightParams.LightDirection, TransposedDimensions);
-
 		FVector AddedUVWOffset, RemovedUVWOffset;
 		float AddedStepSize, RemovedStepSize;
 
@@ -277,52 +765,405 @@ void ChangeDirLightInSingleLightVolume_RenderThread(FRHICommandListImmediate& RH
 		RemovedUVWOffset.Normalize();
 		RemovedUVWOffset *= LongestVoxelSide;
 
-		FMatrix PermMatrix = GetPermutationMatrix(RemovedLocalMajorAxes, AxisIndex);
+		const FMatrix44f PermMatrix = FMatrix44f(GetPermutationMatrix(RemovedLocalMajorAxes, AxisIndex));
 
-		// Get group sizes for compute shader
-		uint32 GroupSizeX = FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION);
-		uint32 GroupSizeY = FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION);
+		// Read/write buffers for the removed light (0, 1) and the added light (2, 3).
+		const EPixelFormat BufferFormat = GetPropagationBufferFormat(LightVolume->Desc.Format);
+		FRDGTextureRef Buffers[4] = {
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("RemovedIlluminationBuffer0")),
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("RemovedIlluminationBuffer1")),
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("AddedIlluminationBuffer0")),
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, BufferFormat, TEXT("AddedIlluminationBuffer1"))};
+		FRDGTextureUAVRef BufferUAVs[4];
+		for (int32 n = 0; n < 4; n++)
+		{
+			BufferUAVs[n] = GraphBuilder.CreateUAV(Buffers[n]);
+		}
+
+		// Clear R/W buffers to the full light of the removed and added light.
+		const float RemovedLightAlpha = GetLightAlpha(RemovedLocalLightParams, RemovedLocalMajorAxes, AxisIndex);
+		const float AddedLightAlpha = GetLightAlpha(AddedLocalLightParams, AddedLocalMajorAxes, AxisIndex);
+		const float RemovedClearValues[4] = {RemovedLightAlpha, RemovedLightAlpha, RemovedLightAlpha, RemovedLightAlpha};
+		const float AddedClearValues[4] = {AddedLightAlpha, AddedLightAlpha, AddedLightAlpha, AddedLightAlpha};
+		AddClearUAVPass(GraphBuilder, BufferUAVs[0], RemovedClearValues);
+		AddClearUAVPass(GraphBuilder, BufferUAVs[1], RemovedClearValues);
+		AddClearUAVPass(GraphBuilder, BufferUAVs[2], AddedClearValues);
+		AddClearUAVPass(GraphBuilder, BufferUAVs[3], AddedClearValues);
+
+		// Don't need barriers on the light volume - we only ever read/write to the same voxel from one thread.
+		FRDGTextureUAVRef LightVolumeUAV =
+			GraphBuilder.CreateUAV(FRDGTextureUAVDesc(LightVolume), ERDGUnorderedAccessViewFlags::SkipBarrier);
+
+		const FIntVector GroupCount(FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION),
+			FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION), 1);
 
 		int Start, Stop, AxisDirection;
 		GetLoopStartStopIndexes(Start, Stop, AxisDirection, RemovedLocalMajorAxes, AxisIndex, TransposedDimensions.Z);
 
 		for (int LoopIndex = Start; LoopIndex != Stop; LoopIndex += AxisDirection)
-		{	 // Switch read and write buffers each cycle.
-			ComputeShader->SetRaymarchParameters(
-				RHICmdList, ShaderRHI, LocalClippingParameters, Resources.WindowingParameters.ToLinearColor());
-			ComputeShader->SetRaymarchResources(RHICmdList, ShaderRHI,
-				Resources.DataVolumeTextureRef->GetResource()->TextureRHI->GetTexture3D(),
-				Resources.TFTextureRef->GetResource()->TextureRHI->GetTexture2D(), Resources.WindowingParameters);
-			ComputeShader->SetALightVolume(RHICmdList, ShaderRHI, Resources.LightVolumeUAVRef);
-			ComputeShader->SetStepSizes(RHICmdList, ShaderRHI, AddedStepSize, RemovedStepSize);
-			ComputeShader->SetPermutationMatrix(RHICmdList, ShaderRHI, PermMatrix);
-
-			ComputeShader->SetPixelOffsets(RHICmdList, ShaderRHI, AddedPixOffset, RemovedPixOffset);
-			ComputeShader->SetUVWOffsets(RHICmdList, ShaderRHI, AddedUVWOffset, RemovedUVWOffset);
-
-			if (LoopIndex % 2 == 0)
+		{
+			FChangeDirLightShader::FParameters* PassParameters =
+				GraphBuilder.AllocParameters<FChangeDirLightShader::FParameters>();
+			PassParameters->VolumeSampling = VolumeSampling;
+			PassParameters->PermutationMatrix = PermMatrix;
+			PassParameters->Loop = LoopIndex;
+
+			// Switch read and write buffers each cycle.
+			const int32 ReadIndex = LoopIndex % 2;
+			const int32 WriteIndex = 1 - ReadIndex;
+
+			PassParameters->StepSize = AddedStepSize;
+			PassParameters->PrevPixelOffset = FVector2f(AddedPixOffset);
+			PassParameters->UVWOffset = FVector3f(AddedUVWOffset);
+			PassParameters->ReadBuffer = Buffers[2 + ReadIndex];
+			PassParameters->ReadBufferSampler = AddedReadBuffSampler;
+			PassParameters->WriteBuffer = BufferUAVs[2 + WriteIndex];
+
+			PassParameters->RemovedStepSize = RemovedStepSize;
+			PassParameters->RemovedPrevPixelOffset = FVector2f(RemovedPixOffset);
+			PassParameters->RemovedUVWOffset = FVector3f(RemovedUVWOffset);
+			PassParameters->RemovedReadBuffer = Buffers[ReadIndex];
+			PassParameters->RemovedReadBufferSampler = RemovedReadBuffSampler;
+			PassParameters->RemovedWriteBuffer = BufferUAVs[WriteIndex];
+
+			PassParameters->ALightVolume = LightVolumeUAV;
+			PassParameters->LightVolumeChannelMask = AddedChannelMask;
+			PassParameters->RemovedLightVolumeChannelMask = RemovedChannelMask;
+
+			FComputeShaderUtils::AddPass(
+				GraphBuilder, RDG_EVENT_NAME("ChangeDirLightSlice"), PassFlags, ComputeShader, PassParameters, GroupCount);
+		}
+	}
+}
+
+void UpdateDirtyBricksInSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightParameters> LightParameters,
+	const FLightVolumeDirtyBricks DirtyBricks, const FRaymarchWorldParameters OldWorldParameters,
+	const FRaymarchWorldParameters NewWorldParameters)
+{
+	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_UpdateDirtyBricks_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("UpdateDirtyBricksInSingleLightVolume"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddUpdateDirtyBricksInSingleLightVolumePasses(
+		GraphBuilder, LightVolume, Resources, LightParameters, DirtyBricks, OldWorldParameters, NewWorldParameters);
+	GraphBuilder.Execute();
+}
+
+void AddUpdateDirtyBricksInSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightParameters>& LightParameters,
+	const FLightVolumeDirtyBricks& DirtyBricks, const FRaymarchWorldParameters& OldWorldParameters,
+	const FRaymarchWorldParameters& NewWorldParameters)
+{
+	// Only the clipping plane is allowed to differ - anything else changes the light everywhere.
+	check(OldWorldParameters.VolumeTransform.Equals(NewWorldParameters.VolumeTransform));
+
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "Updating Dirty Light Bricks");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUUpdatingDirtyBricks);
+
+	for (const FDirLightParameters& Light : LightParameters)
+	{
+		// Ray cast lights don't have checkpoints to restart from, cast them again with the new clipping plane.
+		if (Light.IsLocalLight())
+		{
+			AddChangeLocalLightInSingleLightVolumePass(
+				GraphBuilder, LightVolume, Resources, Light, Light, OldWorldParameters, NewWorldParameters);
+			continue;
+		}
+
+		// Can't have directional light without direction...
+		if (Light.LightDirection == FVector(0.0, 0.0, 0.0))
+		{
+			continue;
+		}
+
+		FDirLightParameters LocalLightParams;
+		FMajorAxes LocalMajorAxes;
+		GetLocalLightParamsAndAxes(Light, NewWorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+
+		FLightPropagationCheckpoints* Checkpoints =
+			Resources.PropagationCheckpoints ? &Resources.PropagationCheckpoints->FindOrAdd(Light) : nullptr;
+
+		for (unsigned i = 0; i < 2; i++)
+		{
+			// Break if the axis weight == 0
+			if (LocalMajorAxes.FaceWeight[i].second == 0)
 			{
-				TransitionBufferResources(RHICmdList, Buffers.Buffers[0], Buffers.UAVs[1]);
-				TransitionBufferResources(RHICmdList, Buffers.Buffers[2], Buffers.UAVs[3]);
-				ComputeShader->SetLoop(RHICmdList, ShaderRHI, LoopIndex, Buffers.Buffers[0], RemovedReadBuffSampler,
-					Buffers.UAVs[1], Buffers.Buffers[2], AddedReadBuffSampler, Buffers.UAVs[3]);
+				break;
 			}
-			else
+
+			const FCubeFace Face = LocalMajorAxes.FaceWeight[i].first;
+			const FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolume->Desc.GetSize(), i);
+			const int32 FirstDirtyStep = DirtyBricks.GetFirstDirtyStep(Face);
+			if (FirstDirtyStep >= TransposedDimensions.Z)
 			{
-				TransitionBufferResources(RHICmdList, Buffers.Buffers[1], Buffers.UAVs[0]);
-				TransitionBufferResources(RHICmdList, Buffers.Buffers[3], Buffers.UAVs[2]);
-				ComputeShader->SetLoop(RHICmdList, ShaderRHI, LoopIndex, Buffers.Buffers[1], RemovedReadBuffSampler,
-					Buffers.UAVs[0], Buffers.Buffers[3], AddedReadBuffSampler, Buffers.UAVs[2]);
+				// Nothing this axis propagates through changed.
+				continue;
 			}
-			RHICmdList.DispatchComputeShader(GroupSizeX, GroupSizeY, 1);
+
+			// Restart at the brick containing the first dirty slice if there's a checkpoint for it, otherwise go through the whole
+			// volume and record the checkpoints for next time.
+			FRDGTextureRef CheckpointTexture = nullptr;
+			int32 StartStep = 0;
+			if (Checkpoints && GetNumPropagationCheckpoints(TransposedDimensions.Z) > 0)
+			{
+				if (Checkpoints->Textures[i] && Checkpoints->Faces[i] == Face)
+				{
+					CheckpointTexture = GraphBuilder.RegisterExternalTexture(Checkpoints->Textures[i]);
+					StartStep = (FirstDirtyStep / RAYMARCH_LIGHT_VOLUME_BRICK_SIZE) * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE;
+				}
+				else
+				{
+					CheckpointTexture = CreatePropagationCheckpoints(
+						GraphBuilder, TransposedDimensions, GetPropagationBufferFormat(LightVolume->Desc.Format));
+					Checkpoints->Faces[i] = Face;
+					Checkpoints->Textures[i] = GraphBuilder.ConvertToExternalTexture(CheckpointTexture);
+				}
+			}
+
+			// Nothing before StartStep changed, so the light entering it is the same with both clipping planes. Remove the light
+			// as it was propagated with the old clipping plane and add it with the new one. Only checkpoints after StartStep get
+			// overwritten, so the one we restart from stays valid for every light with the same parameters.
+			AddDirLightAxisPasses(GraphBuilder, LightVolume, Resources, LocalLightParams, LocalMajorAxes, i, false,
+				OldWorldParameters, StartStep, MAX_int32, CheckpointTexture, false);
+			AddDirLightAxisPasses(GraphBuilder, LightVolume, Resources, LocalLightParams, LocalMajorAxes, i, true,
+				NewWorldParameters, StartStep, MAX_int32, CheckpointTexture, CheckpointTexture != nullptr);
 		}
 	}
+}
+
+void AddDirLightChunksToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightPropagationChunk> Chunks,
+	const FRaymarchWorldParameters WorldParameters)
+{
+	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_AddDirLightChunks_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("AddDirLightChunksToSingleLightVolume"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddDirLightChunksToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, Chunks, WorldParameters);
+	GraphBuilder.Execute();
+}
+
+void AddDirLightChunksToSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightPropagationChunk>& Chunks,
+	const FRaymarchWorldParameters& WorldParameters)
+{
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "Adding Light Chunks");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUAddingLights);
+
+	for (const FDirLightPropagationChunk& Chunk : Chunks)
+	{
+		// Can't have directional light without direction...
+		if (Chunk.LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
+		{
+			continue;
+		}
+
+		FDirLightParameters LocalLightParams;
+		FMajorAxes LocalMajorAxes;
+		GetLocalLightParamsAndAxes(Chunk.LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+		if (LocalMajorAxes.FaceWeight[Chunk.AxisIndex].second == 0)
+		{
+			continue;
+		}
+
+		const FIntVector TransposedDimensions =
+			GetTransposedDimensions(LocalMajorAxes, LightVolume->Desc.GetSize(), Chunk.AxisIndex);
+
+		FRDGTextureRef CheckpointTexture = nullptr;
+		if (Resources.PropagationCheckpoints && GetNumPropagationCheckpoints(TransposedDimensions.Z) > 0)
+		{
+			FLightPropagationCheckpoints& Checkpoints = Resources.PropagationCheckpoints->FindOrAdd(Chunk.LightParameters);
+			if (Chunk.StartStep == 0)
+			{
+				CheckpointTexture = CreatePropagationCheckpoints(
+					GraphBuilder, TransposedDimensions, GetPropagationBufferFormat(LightVolume->Desc.Format));
+				Checkpoints.Faces[Chunk.AxisIndex] = LocalMajorAxes.FaceWeight[Chunk.AxisIndex].first;
+				Checkpoints.Textures[Chunk.AxisIndex] = GraphBuilder.ConvertToExternalTexture(CheckpointTexture);
+			}
+			else if (Checkpoints.Textures[Chunk.AxisIndex])
+			{
+				CheckpointTexture = GraphBuilder.RegisterExternalTexture(Checkpoints.Textures[Chunk.AxisIndex]);
+			}
+		}
+
+		if (Chunk.StartStep > 0 && !CheckpointTexture)
+		{
+			// The checkpoint to continue from is gone (all lights were reset in the meantime), nothing sensible to do.
+			continue;
+		}
+
+		AddDirLightAxisPasses(GraphBuilder, LightVolume, Resources, LocalLightParams, LocalMajorAxes, Chunk.AxisIndex, true,
+			WorldParameters, Chunk.StartStep, Chunk.EndStep, CheckpointTexture, CheckpointTexture != nullptr);
+	}
+}
+
+// Parameters of a point or spot light as the local light shader takes them.
+struct FLocalLightShaderParameters
+{
+	FVector3f Position = FVector3f::ZeroVector;
+	FVector3f SpotDirection = FVector3f::ZeroVector;
+	// Intensity, attenuation radius, cosine of the inner and of the outer cone angle.
+	FVector4f Falloff = FVector4f(0.0f, 0.0f, 0.0f, 0.0f);
+	// Light volume voxels the light reaches (MaxVoxel exclusive). Empty if the light doesn't reach any.
+	FIntVector MinVoxel = FIntVector::ZeroValue;
+	FIntVector MaxVoxel = FIntVector::ZeroValue;
+};
+
+static FLocalLightShaderParameters GetLocalLightShaderParameters(
+	const FDirLightParameters& LightParameters, const FTransform& VolumeTransform, const FIntVector& LightVolumeSize)
+{
+	FLocalLightShaderParameters Out;
+	if (!LightParameters.IsLocalLight() || LightParameters.LightIntensity == 0.0f || LightParameters.AttenuationRadius <= 0.0f)
+	{
+		return Out;
+	}
+
+	// Same local (0-1) space as the clipping plane, see GetLocalClippingParameters.
+	const FVector LocalPosition = VolumeTransform.InverseTransformPosition(LightParameters.LightPosition) + 0.5;
+	Out.Position = FVector3f(LocalPosition);
+	// The shader measures distances in world units, so the spot direction only needs rotating.
+	Out.SpotDirection = FVector3f(VolumeTransform.InverseTransformVectorNoScale(LightParameters.LightDirection).GetSafeNormal());
+
+	// Point lights get cone cosines that every direction is inside of.
+	float CosInner = -1.0f;
+	float CosOuter = -2.0f;
+	if (LightParameters.LightType == ERaymarchLightType::Spot)
+	{
+		const float OuterAngle = FMath::Clamp(LightParameters.OuterConeAngle, 0.0f, 180.0f);
+		const float InnerAngle = FMath::Clamp(LightParameters.InnerConeAngle, 0.0f, OuterAngle);
+		CosInner = FMath::Cos(FMath::DegreesToRadians(InnerAngle));
+		CosOuter = FMath::Cos(FMath::DegreesToRadians(OuterAngle));
+	}
+	Out.Falloff = FVector4f(LightParameters.LightIntensity, LightParameters.AttenuationRadius, CosInner, CosOuter);
+
+	// The light reaches a sphere of AttenuationRadius world units, which is an ellipsoid in local space.
+	const FVector Scale = FVector::Max(VolumeTransform.GetScale3D().GetAbs(), FVector(UE_SMALL_NUMBER));
+	const FVector LocalExtent = FVector(LightParameters.AttenuationRadius) / Scale;
+	const FVector Size(LightVolumeSize);
+	const FVector Min = (LocalPosition - LocalExtent) * Size;
+	const FVector Max = (LocalPosition + LocalExtent) * Size;
+	Out.MinVoxel = FIntVector(FMath::Clamp(FMath::FloorToInt(Min.X), 0, LightVolumeSize.X),
+		FMath::Clamp(FMath::FloorToInt(Min.Y), 0, LightVolumeSize.Y), FMath::Clamp(FMath::FloorToInt(Min.Z), 0, LightVolumeSize.Z));
+	Out.MaxVoxel = FIntVector(FMath::Clamp(FMath::CeilToInt(Max.X), 0, LightVolumeSize.X),
+		FMath::Clamp(FMath::CeilToInt(Max.Y), 0, LightVolumeSize.Y), FMath::Clamp(FMath::CeilToInt(Max.Z), 0, LightVolumeSize.Z));
+	return Out;
+}
+
+void AddChangeLocalLightInSingleLightVolumePass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& RemovedLightParameters,
+	const FDirLightParameters& AddedLightParameters, const FRaymarchWorldParameters& RemovedWorldParameters,
+	const FRaymarchWorldParameters& AddedWorldParameters)
+{
+	const FIntVector LightVolumeSize = LightVolume->Desc.GetSize();
+	const FLocalLightShaderParameters Removed =
+		GetLocalLightShaderParameters(RemovedLightParameters, RemovedWorldParameters.VolumeTransform, LightVolumeSize);
+	const FLocalLightShaderParameters Added =
+		GetLocalLightShaderParameters(AddedLightParameters, AddedWorldParameters.VolumeTransform, LightVolumeSize);
+
+	// Only go through the voxels either of the lights reaches.
+	const bool bRemovedReaches = Removed.MaxVoxel.X > Removed.MinVoxel.X && Removed.MaxVoxel.Y > Removed.MinVoxel.Y &&
+								 Removed.MaxVoxel.Z > Removed.MinVoxel.Z;
+	const bool bAddedReaches =
+		Added.MaxVoxel.X > Added.MinVoxel.X && Added.MaxVoxel.Y > Added.MinVoxel.Y && Added.MaxVoxel.Z > Added.MinVoxel.Z;
+	if (!bRemovedReaches && !bAddedReaches)
+	{
+		return;
+	}
+	const FIntVector MinVoxel = !bRemovedReaches ? Added.MinVoxel
+						  : !bAddedReaches		 ? Removed.MinVoxel
+												 : FIntVector(FMath::Min(Removed.MinVoxel.X, Added.MinVoxel.X),
+													   FMath::Min(Removed.MinVoxel.Y, Added.MinVoxel.Y),
+													   FMath::Min(Removed.MinVoxel.Z, Added.MinVoxel.Z));
+	const FIntVector MaxVoxel = !bRemovedReaches ? Added.MaxVoxel
+						  : !bAddedReaches		 ? Removed.MaxVoxel
+												 : FIntVector(FMath::Max(Removed.MaxVoxel.X, Added.MaxVoxel.X),
+													   FMath::Max(Removed.MaxVoxel.Y, Added.MaxVoxel.Y),
+													   FMath::Max(Removed.MaxVoxel.Z, Added.MaxVoxel.Z));
+
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "Changing Local Lights");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUChangingLocalLights);
+
+	FChangeLocalLightShader::FParameters* PassParameters = GraphBuilder.AllocParameters<FChangeLocalLightShader::FParameters>();
+	SetupRaymarchVolumeSamplingParameters(
+		PassParameters->VolumeSampling, Resources, GetLocalClippingParameters(AddedWorldParameters));
+	const FClippingPlaneParameters RemovedLocalClipping = GetLocalClippingParameters(RemovedWorldParameters);
+	PassParameters->RemovedLocalClippingCenter = FVector3f(RemovedLocalClipping.Center);
+	PassParameters->RemovedLocalClippingDirection = FVector3f(RemovedLocalClipping.Direction);
+	PassParameters->ALightVolume = GraphBuilder.CreateUAV(LightVolume);
+	PassParameters->VoxelOffset = MinVoxel;
+	PassParameters->VolumeWorldSize = FVector3f(AddedWorldParameters.VolumeTransform.GetScale3D().GetAbs());
+	// One light volume voxel (along the longest side) per step.
+	PassParameters->StepSize = 1.0f / LightVolumeSize.GetMax();
+	PassParameters->LightPosition = Added.Position;
+	PassParameters->SpotDirection = Added.SpotDirection;
+	PassParameters->LightFalloff = Added.Falloff;
+	PassParameters->LightVolumeChannelMask = GetLightVolumeChannelMask(AddedLightParameters, Resources.LightVolumeFormat);
+	PassParameters->RemovedLightPosition = Removed.Position;
+	PassParameters->RemovedSpotDirection = Removed.SpotDirection;
+	PassParameters->RemovedLightFalloff = Removed.Falloff;
+	PassParameters->RemovedLightVolumeChannelMask = GetLightVolumeChannelMask(RemovedLightParameters, Resources.LightVolumeFormat);
+
+	FChangeLocalLightShader::FPermutationDomain PermutationVector;
+	PermutationVector.Set<FPackedLightVolumeDim>(IsPackedLightVolumeFormat(LightVolume->Desc.Format));
+	TShaderMapRef<FChangeLocalLightShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5), PermutationVector);
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ChangeLocalLight"), GetRaymarchComputePassFlags(), ComputeShader,
+		PassParameters, FComputeShaderUtils::GetGroupCount(MaxVoxel - MinVoxel, NUM_THREADS_PER_LOCAL_LIGHT_GROUP_DIMENSION));
+}
+
+void CopyLightVolume_RenderThread(
+	FRHICommandListImmediate& RHICmdList, UTextureRenderTargetVolume* Source, UTextureRenderTargetVolume* Destination)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CopyLightVolume"));
+	FRDGTextureRef SourceVolume = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Source->GetResource()->TextureRHI, TEXT("SourceLightVolume")));
+	FRDGTextureRef DestinationVolume = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Destination->GetResource()->TextureRHI, TEXT("DestinationLightVolume")));
+	// Either one might be sampled by materials or propagated into afterwards.
+	GraphBuilder.SetTextureAccessFinal(SourceVolume, ERHIAccess::SRVMask);
+	GraphBuilder.SetTextureAccessFinal(DestinationVolume, ERHIAccess::SRVMask);
+	AddCopyTexturePass(GraphBuilder, SourceVolume, DestinationVolume);
+	GraphBuilder.Execute();
+}
+
+void ResolveLightGroups_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const FLinearColor LightGroupWeights)
+{
+	check(IsInRenderingThread());
+	SCOPE_CYCLE_COUNTER(STAT_ResolveLightGroups_RenderThread);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ResolveLightGroups"));
+	FRDGTextureRef LightGroupVolume = RegisterLightVolume(GraphBuilder, Resources);
+	FRDGTextureRef ResolvedLightVolume = GraphBuilder.RegisterExternalTexture(
+		CreateRenderTarget(Resources.ResolvedLightVolumeRenderTarget->GetResource()->TextureRHI, TEXT("ResolvedLightVolume")));
+	// Materials sample the resolved light volume.
+	GraphBuilder.SetTextureAccessFinal(ResolvedLightVolume, ERHIAccess::SRVMask);
+	AddResolveLightGroupsPass(GraphBuilder, LightGroupVolume, ResolvedLightVolume, LightGroupWeights);
+	GraphBuilder.Execute();
+}
+
+void AddResolveLightGroupsPass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightGroupVolume, FRDGTextureRef ResolvedLightVolume,
+	const FLinearColor& LightGroupWeights)
+{
+	RDG_EVENT_SCOPE(GraphBuilder, "Resolving Light Groups");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUResolvingLightGroups);
 
-	// Unbind Resources.
-	ComputeShader->UnbindResourcesChangeDirLight(RHICmdList, ShaderRHI);
+	FResolveLightGroupsShader::FParameters* PassParameters = GraphBuilder.AllocParameters<FResolveLightGroupsShader::FParameters>();
+	PassParameters->LightGroupVolume = LightGroupVolume;
+	PassParameters->ResolvedLightVolume = GraphBuilder.CreateUAV(ResolvedLightVolume);
+	PassParameters->LightGroupWeights = FVector4f(LightGroupWeights);
 
-	// Transition resources back to the renderer.
-	RHICmdList.Transition(FRHITransitionInfo(Resources.LightVolumeUAVRef, ERHIAccess::UAVCompute, ERHIAccess::UAVGraphics));
+	TShaderMapRef<FResolveLightGroupsShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ResolveLightGroups"), GetRaymarchComputePassFlags(),
+		ComputeShader, PassParameters,
+		FComputeShaderUtils::GetGroupCount(ResolvedLightVolume->Desc.GetSize(), NUM_THREADS_PER_RESOLVE_GROUP_DIMENSION));
 }
 
 #undef LOCTEXT_NAMESPACE
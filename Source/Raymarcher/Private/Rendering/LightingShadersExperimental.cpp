@@ -3,136 +3,387 @@
 // Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
 // (original raymarching code).
 
-//#include "Rendering/LightingShadersExperimental.h"
-//#include "Rendering/LightingShaderUtils.h"
-//
-//IMPLEMENT_GLOBAL_SHADER(
-//	FAddDirLightShader_GPUSyncCS, "/Raymarcher/Private/AddDirLightShader_GPUSync.usf", "MainComputeShader", SF_Compute);
-//
-//#define NUM_THREADS_PER_GROUP_DIMENSION 16	  // This has to be the same as in the compute shader's spec [X, X, 1]
-//// #TODO profile with different dimensions.
-//
-//// A GPU-synced version of a light adding shader.
-//void AddDirLightToSingleLightVolume_GPUSync_RenderThread(FRHICommandListImmediate& RHICmdList,
-//	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
-//	const FRaymarchWorldParameters WorldParameters)
-//{
-//	check(IsInRenderingThread());
-//
-//	// Can't have directional light without direction...
-//	if (LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
-//	{
-//		GEngine->AddOnScreenDebugMessage(
-//			-1, 100.0f, FColor::Yellow, TEXT("Returning because the directional light doesn't have a direction."));
-//		return;
-//	}
-//
-//	FDirLightParameters LocalLightParams;
-//	FMajorAxes LocalMajorAxes;
-//	// Calculate local Light parameters and corresponding axes.
-//	GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
-//
-//	// Transform clipping parameters into local space.
-//	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
-//
-//	// For GPU profiling.
-//	SCOPED_DRAW_EVENTF(RHICmdList, AddDirLightToSingleLightVolume_RenderThread, TEXT("Adding Lights"));
-//	SCOPED_GPU_STAT(RHICmdList, GPUAddingLights);
-//
-//	// TODO create structure with 2 sets of buffers so we don't have to look for them again in the
-//	// actual shader loop! Clear buffers for the two axes we will be using.
-//	for (unsigned i = 0; i < 2; i++)
-//	{
-//		// Break if the axis weight == 0
-//		if (LocalMajorAxes.FaceWeight[i].second == 0)
-//		{
-//			break;
-//		}
-//		// Get the X, Y and Z transposed into the current axis orientation.
-//		FIntVector TransposedDimensions =
-//			GetTransposedDimensions(LocalMajorAxes, Resources.LightVolumeRenderTarget->Resource->TextureRHI->GetTexture3D(), i);
-//		OneAxisReadWriteBufferResources& Buffers = GetBuffers(LocalMajorAxes, i, Resources);
-//
-//		float LightAlpha = GetLightAlpha(LocalLightParams, LocalMajorAxes, i);
-//
-//		Clear2DTexture_RenderThread(
-//			RHICmdList, Buffers.UAVs[0], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), LightAlpha);
-//		Clear2DTexture_RenderThread(
-//			RHICmdList, Buffers.UAVs[1], FIntPoint(TransposedDimensions.X, TransposedDimensions.Y), LightAlpha);
-//	}
-//
-//	// Find and set compute shader
-//	TShaderMapRef<FAddDirLightShader_GPUSyncCS> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
-//	FRHIComputeShader* ShaderRHI = ComputeShader.GetComputeShader();
-//	RHICmdList.SetComputeShader(ShaderRHI);
-//
-//	// 	// Don't need barriers on these - we only ever read/write to the same pixel from one thread ->
-//	// 	// no race conditions But we definitely need to transition the resource to Compute-shader
-//	// 	// accessible, otherwise the renderer might touch our textures while we're writing there.
-//	// 	RHICmdList.TransitionResource(
-//	// 		EResourceTransitionAccess::ERWNoBarrier, EResourceTransitionPipeline::EGfxToCompute, Resources.LightVolumeUAVRef);
-//
-//	// Set parameters, resources, LightAdded and ALightVolume
-//	ComputeShader->SetRaymarchParameters(
-//		RHICmdList, ShaderRHI, LocalClippingParameters, Resources.WindowingParameters.ToLinearColor());
-//	ComputeShader->SetRaymarchResources(RHICmdList, ShaderRHI, Resources.DataVolumeTextureRef->Resource->TextureRHI->GetTexture3D(),
-//		Resources.TFTextureRef->Resource->TextureRHI->GetTexture2D(), Resources.WindowingParameters);
-//	ComputeShader->SetLightAdded(RHICmdList, ShaderRHI, Added);
-//	ComputeShader->SetALightVolume(RHICmdList, ShaderRHI, Resources.LightVolumeUAVRef);
-//
-//	for (unsigned i = 0; i < 2; i++)
-//	{
-//		// Break if the main axis weight == 0
-//		if (LocalMajorAxes.FaceWeight[i].second == 0)
-//		{
-//			break;
-//		}
-//		OneAxisReadWriteBufferResources& Buffers = GetBuffers(LocalMajorAxes, i, Resources);
-//
-//		// Get the X, Y and Z transposed into the current axis orientation.
-//		FIntVector TransposedDimensions =
-//			GetTransposedDimensions(LocalMajorAxes, Resources.LightVolumeRenderTarget->Resource->TextureRHI->GetTexture3D(), i);
-//
-//		FVector2D UVOffset =
-//			GetUVOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions);
-//		FMatrix PermutationMatrix = GetPermutationMatrix(LocalMajorAxes, i);
-//
-//		FIntVector LightVolumeSize = FIntVector(Resources.LightVolumeRenderTarget->SizeX, Resources.LightVolumeRenderTarget->SizeY,
-//			Resources.LightVolumeRenderTarget->SizeZ);
-//
-//		FVector UVWOffset;
-//		float StepSize;
-//		GetStepSizeAndUVWOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions,
-//			WorldParameters, StepSize, UVWOffset);
-//
-//		// Normalize UVW offset to length of largest voxel size to get rid of artifacts. (Not correct,
-//		// but consistent!)
-//		int LowestVoxelCount = FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
-//		float LongestVoxelSide = 1.0f / LowestVoxelCount;
-//		UVWOffset.Normalize();
-//		UVWOffset *= LongestVoxelSide;
-//
-//		ComputeShader->SetStepSize(RHICmdList, ShaderRHI, StepSize);
-//		ComputeShader->SetPermutationMatrix(RHICmdList, ShaderRHI, PermutationMatrix);
-//		ComputeShader->SetUVOffset(RHICmdList, ShaderRHI, UVOffset);
-//		ComputeShader->SetUVWOffset(RHICmdList, ShaderRHI, UVWOffset);
-//		ComputeShader->SetReadWriteBuffer(RHICmdList, ShaderRHI, Buffers.Buffers[i], Buffers.UAVs[i]);
-//
-//		int Start, Stop, AxisDirection;
-//		GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, i, TransposedDimensions.Z);
-//
-//		ComputeShader->SetLoopParameters(RHICmdList, ShaderRHI, Start, Stop, AxisDirection);
-//		ComputeShader->SetOutsideLight(RHICmdList, ShaderRHI, GetLightAlpha(LocalLightParams, LocalMajorAxes, i));
-//
-//		uint32 GroupSizeX = FMath::DivideAndRoundUp(TransposedDimensions.X, NUM_THREADS_PER_GROUP_DIMENSION);
-//		uint32 GroupSizeY = FMath::DivideAndRoundUp(TransposedDimensions.Y, NUM_THREADS_PER_GROUP_DIMENSION);
-//
-//		RHICmdList.DispatchComputeShader(GroupSizeX, GroupSizeY, 1);
-//	}
-//
-//	// Unbind UAVs.
-//	ComputeShader->UnbindResourcesLightPropagation(RHICmdList, ShaderRHI);
-//
-//	// Transition resources back to the renderer.
-//	RHICmdList.Transition(FRHITransitionInfo(Resources.LightVolumeUAVRef, ERHIAccess::UAVCompute, ERHIAccess::UAVGraphics));
-//}
\ No newline at end of file
+#include "Rendering/LightingShadersExperimental.h"
+
+#include "DataDrivenShaderPlatformInfo.h"
+#include "Engine/TextureRenderTargetVolume.h"
+#include "HAL/PlatformTime.h"
+#include "RHIGPUReadback.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "Rendering/LightingShaderUtils.h"
+#include "Util/UtilityShaders.h"
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", off)
+#endif
+
+#define LOCTEXT_NAMESPACE "RaymarchPlugin"
+
+DEFINE_LOG_CATEGORY_STATIC(LogRaymarchLighting, Log, All);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FAddDirLightShader_GPUSyncCS, "/Raymarcher/Private/AddDirLightShader_GPUSync.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(FCompareVolumesCS, "/Raymarcher/Private/CompareVolumesShader.usf", "MainComputeShader", SF_Compute);
+
+// For making statistics about GPU use - Adding Lights in a single dispatch.
+DECLARE_GPU_STAT_NAMED(GPUAddingLightsGPUSync, TEXT("AddingLightsToVolumeGPUSync"));
+
+#define NUM_THREADS_PER_COMPARE_GROUP_DIMENSION 8	 // This has to be the same as in the compare shader's spec [X, X, X]
+
+void AddDirLightToSingleLightVolume_GPUSync_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("AddDirLightToSingleLightVolume_GPUSync"));
+	FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+	AddDirLightToSingleLightVolumeGPUSyncPasses(GraphBuilder, LightVolume, Resources, LightParameters, Added, WorldParameters);
+	GraphBuilder.Execute();
+}
+
+void AddDirLightToSingleLightVolumeGPUSyncPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters)
+{
+	// Can't have directional light without direction...
+	if (!LightParameters.IsLocalLight() && LightParameters.LightDirection == FVector(0.0, 0.0, 0.0))
+	{
+		GEngine->AddOnScreenDebugMessage(
+			-1, 100.0f, FColor::Yellow, TEXT("Returning because the directional light doesn't have a direction."));
+		return;
+	}
+
+	// The single-dispatch shader only writes single-channel light volumes and only propagates directional lights.
+	if (IsPackedLightVolumeFormat(LightVolume->Desc.Format) || LightParameters.IsLocalLight())
+	{
+		AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, LightParameters, Added, WorldParameters);
+		return;
+	}
+
+	FDirLightParameters LocalLightParams;
+	FMajorAxes LocalMajorAxes;
+	// Calculate local Light parameters and corresponding axes.
+	GetLocalLightParamsAndAxes(LightParameters, WorldParameters.VolumeTransform, LocalLightParams, LocalMajorAxes);
+
+	const FIntVector LightVolumeSize = LightVolume->Desc.GetSize();
+
+	// A tile only waits for its direct neighbours, so a pixel must never read further than a tile away in the previous slice.
+	// (The bilinear footprint adds another pixel.) Lights this oblique are rare, just use the per-slice path for them.
+	for (unsigned i = 0; i < 2; i++)
+	{
+		if (LocalMajorAxes.FaceWeight[i].second == 0)
+		{
+			break;
+		}
+		FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolumeSize, i);
+		FVector2D UVOffset =
+			GetUVOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions);
+		if (FMath::Abs(UVOffset.X * TransposedDimensions.X) >= RAYMARCH_GPUSYNC_TILE_SIZE - 1 ||
+			FMath::Abs(UVOffset.Y * TransposedDimensions.Y) >= RAYMARCH_GPUSYNC_TILE_SIZE - 1)
+		{
+			AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, LightParameters, Added, WorldParameters);
+			return;
+		}
+	}
+
+	// Transform clipping parameters into local space.
+	FClippingPlaneParameters LocalClippingParameters = GetLocalClippingParameters(WorldParameters);
+	FRaymarchVolumeSamplingParameters VolumeSampling;
+	SetupRaymarchVolumeSamplingParameters(VolumeSampling, Resources, LocalClippingParameters);
+
+	// For GPU profiling.
+	RDG_EVENT_SCOPE(GraphBuilder, "Adding Lights GPU Synced");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUAddingLightsGPUSync);
+
+	TShaderMapRef<FAddDirLightShader_GPUSyncCS> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+
+	for (unsigned i = 0; i < 2; i++)
+	{
+		// Break if the axis weight == 0
+		if (LocalMajorAxes.FaceWeight[i].second == 0)
+		{
+			break;
+		}
+
+		// Get the X, Y and Z transposed into the current axis orientation.
+		FIntVector TransposedDimensions = GetTransposedDimensions(LocalMajorAxes, LightVolumeSize, i);
+
+		FVector2D UVOffset =
+			GetUVOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions);
+
+		FVector UVWOffset;
+		float StepSize;
+		GetStepSizeAndUVWOffset(LocalMajorAxes.FaceWeight[i].first, -LocalLightParams.LightDirection, TransposedDimensions,
+			WorldParameters, StepSize, UVWOffset);
+
+		// Normalize UVW offset to length of largest voxel size to get rid of artifacts. (Not correct,
+		// but consistent!)
+		int LowestVoxelCount = FMath::Min3(TransposedDimensions.X, TransposedDimensions.Y, TransposedDimensions.Z);
+		float LongestVoxelSide = 1.0f / LowestVoxelCount;
+		UVWOffset.Normalize();
+		UVWOffset *= LongestVoxelSide;
+
+		int Start, Stop, AxisDirection;
+		GetLoopStartStopIndexes(Start, Stop, AxisDirection, LocalMajorAxes, i, TransposedDimensions.Z);
+
+		FIntPoint NumTiles(FMath::DivideAndRoundUp(TransposedDimensions.X, RAYMARCH_GPUSYNC_TILE_SIZE),
+			FMath::DivideAndRoundUp(TransposedDimensions.Y, RAYMARCH_GPUSYNC_TILE_SIZE));
+
+		// The light buffers are read by other groups in the same dispatch, so they're always 32 bit floats to be sure typed
+		// UAV loads are supported. They don't need clearing, every pixel is written before it's read.
+		FRDGTextureRef LightBuffer0 =
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, PF_R32_FLOAT, TEXT("LightBuffer0"));
+		FRDGTextureRef LightBuffer1 =
+			CreatePropagationBuffer(GraphBuilder, TransposedDimensions, PF_R32_FLOAT, TEXT("LightBuffer1"));
+
+		// One work counter + a progress counter for every tile. Has to start out zeroed.
+		FRDGBufferRef SyncBuffer = GraphBuilder.CreateBuffer(
+			FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 1 + NumTiles.X * NumTiles.Y), TEXT("PropagationSyncBuffer"));
+		FRDGBufferUAVRef SyncBufferUAV = GraphBuilder.CreateUAV(SyncBuffer, PF_R32_UINT);
+		AddClearUAVPass(GraphBuilder, SyncBufferUAV, 0u);
+
+		FAddDirLightShader_GPUSyncCS::FParameters* PassParameters =
+			GraphBuilder.AllocParameters<FAddDirLightShader_GPUSyncCS::FParameters>();
+		PassParameters->VolumeSampling = VolumeSampling;
+		PassParameters->StepSize = StepSize;
+		PassParameters->PermutationMatrix = FMatrix44f(GetPermutationMatrix(LocalMajorAxes, i));
+		PassParameters->PrevPixelOffset = FVector2f(UVOffset);
+		PassParameters->UVWOffset = FVector3f(UVWOffset);
+		PassParameters->bAdded = Added ? 1 : -1;
+		PassParameters->Start = Start;
+		PassParameters->AxisDirection = AxisDirection;
+		PassParameters->NumSlices = TransposedDimensions.Z;
+		PassParameters->NumTiles = FUintVector2(NumTiles.X, NumTiles.Y);
+		PassParameters->BufferBorderValue = GetLightAlpha(LocalLightParams, LocalMajorAxes, i);
+		// The second axis adds to the same voxels, so it needs to wait for this one.
+		PassParameters->ALightVolume = GraphBuilder.CreateUAV(LightVolume);
+		PassParameters->LightBuffer0 = GraphBuilder.CreateUAV(LightBuffer0);
+		PassParameters->LightBuffer1 = GraphBuilder.CreateUAV(LightBuffer1);
+		PassParameters->SyncBuffer = SyncBufferUAV;
+
+		// One group per tile is enough, more would just spin waiting for the previous slice.
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("AddDirLightGPUSync"), GetRaymarchComputePassFlags(),
+			ComputeShader, PassParameters, FIntVector(FMath::Min(NumTiles.X * NumTiles.Y, RAYMARCH_GPUSYNC_MAX_GROUPS), 1, 1));
+	}
+}
+
+void CompareVolumes_RenderThread(FRHICommandListImmediate& RHICmdList, const TRefCountPtr<IPooledRenderTarget>& VolumeA,
+	const TRefCountPtr<IPooledRenderTarget>& VolumeB, float Tolerance, float& OutMaxDifference, uint32& OutMismatchedVoxels)
+{
+	FRHIGPUBufferReadback Readback(TEXT("Compare Volumes Readback"));
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CompareVolumes"));
+		FRDGTextureRef TextureA = GraphBuilder.RegisterExternalTexture(VolumeA);
+		FRDGTextureRef TextureB = GraphBuilder.RegisterExternalTexture(VolumeB);
+		GraphBuilder.SetTextureAccessFinal(TextureB, ERHIAccess::SRVMask);
+
+		FRDGBufferRef ResultBuffer =
+			GraphBuilder.CreateBuffer(FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), 2), TEXT("CompareVolumesResult"));
+		FRDGBufferUAVRef ResultUAV = GraphBuilder.CreateUAV(ResultBuffer, PF_R32_UINT);
+		AddClearUAVPass(GraphBuilder, ResultUAV, 0u);
+
+		FCompareVolumesCS::FParameters* PassParameters = GraphBuilder.AllocParameters<FCompareVolumesCS::FParameters>();
+		PassParameters->VolumeA = TextureA;
+		PassParameters->VolumeB = TextureB;
+		PassParameters->Tolerance = Tolerance;
+		PassParameters->Result = ResultUAV;
+
+		TShaderMapRef<FCompareVolumesCS> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("CompareVolumes"), ComputeShader, PassParameters,
+			FComputeShaderUtils::GetGroupCount(TextureA->Desc.GetSize(), NUM_THREADS_PER_COMPARE_GROUP_DIMENSION));
+
+		AddEnqueueCopyPass(GraphBuilder, &Readback, ResultBuffer, 2 * sizeof(uint32));
+		GraphBuilder.Execute();
+	}
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+
+	const uint32* Result = static_cast<const uint32*>(Readback.Lock(2 * sizeof(uint32)));
+	FMemory::Memcpy(&OutMaxDifference, &Result[0], sizeof(float));
+	OutMismatchedVoxels = Result[1];
+	Readback.Unlock();
+}
+
+void CompareGPUSyncLightPropagation_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
+	const FDirLightParameters LightParameters, const FRaymarchWorldParameters WorldParameters, float Tolerance)
+{
+	check(IsInRenderingThread());
+
+	FRHITexture3D* LightVolumeRHI = Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetTexture3D();
+	const FIntVector LightVolumeSize = LightVolumeRHI->GetSizeXYZ();
+
+	// Reference - the per-slice propagation, copied away into a temporary volume.
+	ClearVolumeTexture_RenderThread(RHICmdList, LightVolumeRHI, 0);
+	double StartTime = FPlatformTime::Seconds();
+	AddDirLightToSingleLightVolume_RenderThread(RHICmdList, Resources, LightParameters, true, WorldParameters);
+	const double PerSliceMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	TRefCountPtr<IPooledRenderTarget> ReferenceVolume;
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CopyLightVolumeReference"));
+		FRDGTextureRef LightVolume = RegisterLightVolume(GraphBuilder, Resources);
+		const FRDGTextureDesc ReferenceDesc = FRDGTextureDesc::Create3D(
+			LightVolumeSize, LightVolume->Desc.Format, FClearValueBinding::None, TexCreate_ShaderResource);
+		FRDGTextureRef Reference = GraphBuilder.CreateTexture(ReferenceDesc, TEXT("LightVolumeReference"));
+		AddCopyTexturePass(GraphBuilder, LightVolume, Reference);
+		GraphBuilder.QueueTextureExtraction(Reference, &ReferenceVolume);
+		GraphBuilder.Execute();
+	}
+
+	// The single-dispatch propagation of the same light.
+	ClearVolumeTexture_RenderThread(RHICmdList, LightVolumeRHI, 0);
+	StartTime = FPlatformTime::Seconds();
+	AddDirLightToSingleLightVolume_GPUSync_RenderThread(RHICmdList, Resources, LightParameters, true, WorldParameters);
+	const double GPUSyncMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	float MaxDifference;
+	uint32 MismatchedVoxels;
+	CompareVolumes_RenderThread(RHICmdList, ReferenceVolume, CreateRenderTarget(LightVolumeRHI, TEXT("LightVolume")), Tolerance,
+		MaxDifference, MismatchedVoxels);
+
+	const int64 TotalVoxels = (int64) LightVolumeSize.X * LightVolumeSize.Y * LightVolumeSize.Z;
+	UE_LOG(LogRaymarchLighting, Display,
+		TEXT("GPU synced vs per-slice light propagation: max difference %f, %u of %lld voxels differ by more than %f. "
+			 "Render thread time per-slice %.3f ms, GPU synced %.3f ms."),
+		MaxDifference, MismatchedVoxels, TotalVoxels, Tolerance, PerSliceMs, GPUSyncMs);
+}
+
+// Propagates the lights into a new light volume of the format in Resources, then rotates the first light back and forth
+// NumRoundTrips times, so that the volume ends up with the same lights lit. Packed light group volumes get resolved into a
+// single channel volume, which is returned instead. Times include waiting for the GPU.
+static TRefCountPtr<IPooledRenderTarget> PropagateBenchmarkLightVolume(FRHICommandListImmediate& RHICmdList,
+	const FBasicRaymarchRenderingResources& Resources, const FIntVector& LightVolumeSize,
+	const TArray<FDirLightParameters>& LightParameters, const FRaymarchWorldParameters& WorldParameters, int32 NumRoundTrips,
+	double& OutAddMs, double& OutChangeMs, double& OutResolveMs)
+{
+	TRefCountPtr<IPooledRenderTarget> LightVolumeTarget;
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CreateBenchmarkLightVolume"));
+		const FRDGTextureDesc Desc = FRDGTextureDesc::Create3D(LightVolumeSize,
+			GetLightVolumePixelFormat(Resources.LightVolumeFormat), FClearValueBinding::Black,
+			TexCreate_ShaderResource | TexCreate_UAV);
+		FRDGTextureRef LightVolume = GraphBuilder.CreateTexture(Desc, TEXT("BenchmarkLightVolume"));
+		const float ClearValues[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+		AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(LightVolume), ClearValues);
+		GraphBuilder.QueueTextureExtraction(LightVolume, &LightVolumeTarget);
+		GraphBuilder.Execute();
+	}
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+
+	double StartTime = FPlatformTime::Seconds();
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("BenchmarkAddLights"));
+		FRDGTextureRef LightVolume = GraphBuilder.RegisterExternalTexture(LightVolumeTarget);
+		for (const FDirLightParameters& Light : LightParameters)
+		{
+			AddDirLightToSingleLightVolumePasses(GraphBuilder, LightVolume, Resources, Light, true, WorldParameters);
+		}
+		GraphBuilder.Execute();
+	}
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+	OutAddMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	FDirLightParameters RotatedLight = LightParameters[0];
+	RotatedLight.LightDirection = FQuat(FVector::UpVector, FMath::DegreesToRadians(5.0)).RotateVector(RotatedLight.LightDirection);
+
+	StartTime = FPlatformTime::Seconds();
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("BenchmarkChangeLights"));
+		FRDGTextureRef LightVolume = GraphBuilder.RegisterExternalTexture(LightVolumeTarget);
+		for (int32 i = 0; i < NumRoundTrips; i++)
+		{
+			AddChangeDirLightInSingleLightVolumePasses(
+				GraphBuilder, LightVolume, Resources, LightParameters[0], RotatedLight, WorldParameters);
+			AddChangeDirLightInSingleLightVolumePasses(
+				GraphBuilder, LightVolume, Resources, RotatedLight, LightParameters[0], WorldParameters);
+		}
+		GraphBuilder.Execute();
+	}
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+	OutChangeMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+	OutResolveMs = 0.0;
+	if (Resources.LightVolumeFormat != ERaymarchLightVolumeFormat::RGBA16FLightGroups)
+	{
+		return LightVolumeTarget;
+	}
+
+	TRefCountPtr<IPooledRenderTarget> ResolvedTarget;
+	StartTime = FPlatformTime::Seconds();
+	{
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("BenchmarkResolveLightGroups"));
+		FRDGTextureRef LightVolume = GraphBuilder.RegisterExternalTexture(LightVolumeTarget);
+		const FRDGTextureDesc Desc = FRDGTextureDesc::Create3D(
+			LightVolumeSize, PF_R32_FLOAT, FClearValueBinding::Black, TexCreate_ShaderResource | TexCreate_UAV);
+		FRDGTextureRef ResolvedLightVolume = GraphBuilder.CreateTexture(Desc, TEXT("BenchmarkResolvedLightVolume"));
+		AddResolveLightGroupsPass(GraphBuilder, LightVolume, ResolvedLightVolume, FLinearColor(1.0f, 1.0f, 1.0f, 1.0f));
+		GraphBuilder.QueueTextureExtraction(ResolvedLightVolume, &ResolvedTarget);
+		GraphBuilder.Execute();
+	}
+	RHICmdList.SubmitCommandsAndFlushGPU();
+	RHICmdList.BlockUntilGPUIdle();
+	OutResolveMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	return ResolvedTarget;
+}
+
+void BenchmarkLightVolumeFormats_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
+	TArray<FDirLightParameters> LightParameters, const FRaymarchWorldParameters WorldParameters, int32 NumChanges,
+	float Tolerance)
+{
+	check(IsInRenderingThread());
+
+	if (LightParameters.Num() == 0)
+	{
+		UE_LOG(LogRaymarchLighting, Warning, TEXT("Light volume format benchmark needs at least one light."));
+		return;
+	}
+
+	const FIntVector LightVolumeSize = Resources.LightVolumeRenderTarget->GetResource()->TextureRHI->GetSizeXYZ();
+	const int64 TotalVoxels = (int64) LightVolumeSize.X * LightVolumeSize.Y * LightVolumeSize.Z;
+	// The benchmark volumes have nothing to do with the checkpoints recorded for the real light volume.
+	Resources.PropagationCheckpoints = nullptr;
+	// The reference has no color, so colored light volumes get compared with white lights (in their red channel).
+	for (FDirLightParameters& Light : LightParameters)
+	{
+		Light.LightColor = FLinearColor::White;
+	}
+
+	// Reference - a 32 bit volume with the lights only propagated once, so it doesn't contain any error accumulated by changes.
+	double AddMs, ChangeMs, ResolveMs;
+	Resources.LightVolumeFormat = ERaymarchLightVolumeFormat::R32F;
+	TRefCountPtr<IPooledRenderTarget> ReferenceVolume = PropagateBenchmarkLightVolume(
+		RHICmdList, Resources, LightVolumeSize, LightParameters, WorldParameters, 0, AddMs, ChangeMs, ResolveMs);
+
+	const int32 NumRoundTrips = FMath::Max(1, NumChanges / 2);
+	const UEnum* FormatEnum = StaticEnum<ERaymarchLightVolumeFormat>();
+	for (int32 i = 0; i < FormatEnum->NumEnums() - 1; i++)
+	{
+		Resources.LightVolumeFormat = (ERaymarchLightVolumeFormat) FormatEnum->GetValueByIndex(i);
+		const EPixelFormat Format = GetLightVolumePixelFormat(Resources.LightVolumeFormat);
+		TRefCountPtr<IPooledRenderTarget> TestVolume = PropagateBenchmarkLightVolume(RHICmdList, Resources, LightVolumeSize,
+			LightParameters, WorldParameters, NumRoundTrips, AddMs, ChangeMs, ResolveMs);
+
+		float MaxDifference;
+		uint32 MismatchedVoxels;
+		CompareVolumes_RenderThread(RHICmdList, ReferenceVolume, TestVolume, Tolerance, MaxDifference, MismatchedVoxels);
+
+		const double MegaBytes = (double) TotalVoxels * GPixelFormats[Format].BlockBytes / (1024.0 * 1024.0);
+		UE_LOG(LogRaymarchLighting, Display,
+			TEXT("Light volume format %s: %.2f MB, adding %d lights %.3f ms, %d light changes %.3f ms, resolving %.3f ms. "
+				 "Max difference %f, %u of %lld voxels differ by more than %f."),
+			*FormatEnum->GetDisplayNameTextByIndex(i).ToString(), MegaBytes, LightParameters.Num(), AddMs, NumRoundTrips * 2,
+			ChangeMs, ResolveMs, MaxDifference, MismatchedVoxels, TotalVoxels, Tolerance);
+	}
+}
+
+#undef LOCTEXT_NAMESPACE
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", on)
+#endif
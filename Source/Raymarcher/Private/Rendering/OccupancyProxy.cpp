@@ -0,0 +1,205 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/OccupancyProxy.h"
+
+#include "RHIGPUReadback.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RenderTargetVolumeMipped.h"
+#include "RenderingThread.h"
+#include "Rendering/LightingShaderUtils.h"
+
+#include <atomic>
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", off)
+#endif
+
+IMPLEMENT_GLOBAL_SHADER(
+	FPackBrickOccupancyShader, "/Raymarcher/Private/PackBrickOccupancyShader.usf", "MainComputeShader", SF_Compute);
+
+#define PACK_OCCUPANCY_NUM_THREADS_PER_GROUP 64	   // This has to be the same as in the pack shader's spec [X, 1, 1]
+
+struct FBrickOccupancyReadback::FState
+{
+	// Created on the render thread along with the copy.
+	TUniquePtr<FRHIGPUBufferReadback> Readback;
+
+	FIntVector BrickMapSize = FIntVector::ZeroValue;
+	int32 NumWords = 0;
+
+	// Filled on the render thread once the readback is ready, owned by the game thread after bArrived is set.
+	TArray<uint32> Occupancy;
+	std::atomic<bool> bArrived = false;
+
+	// Set while a render command checking the readback is in flight, so that polling every tick doesn't pile them up.
+	std::atomic<bool> bCheckEnqueued = false;
+};
+
+void FBrickOccupancyReadback::Request(const FBasicRaymarchRenderingResources& Resources)
+{
+	URenderTargetVolumeMipped* BrickDistanceTarget = Resources.BrickDistanceRenderTarget;
+	if (!BrickDistanceTarget || !BrickDistanceTarget->GetResource())
+	{
+		State.Reset();
+		return;
+	}
+
+	// A request that didn't arrive yet just gets dropped, the render commands still in flight keep its state alive.
+	State = MakeShared<FState, ESPMode::ThreadSafe>();
+	State->BrickMapSize = FIntVector(BrickDistanceTarget->SizeX, BrickDistanceTarget->SizeY, BrickDistanceTarget->SizeZ);
+	State->NumWords = FMath::DivideAndRoundUp(State->BrickMapSize.X * State->BrickMapSize.Y * State->BrickMapSize.Z, 32);
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([BrickDistanceTarget, NewState = State](FRHICommandListImmediate& RHICmdList) {
+		NewState->Readback = MakeUnique<FRHIGPUBufferReadback>(TEXT("Brick Occupancy Readback"));
+
+		FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ReadBrickOccupancy"));
+		FRDGTextureRef BrickDistance = GraphBuilder.RegisterExternalTexture(
+			CreateRenderTarget(BrickDistanceTarget->GetResource()->TextureRHI, TEXT("BrickDistance")));
+		// Materials sample the distances to skip empty space.
+		GraphBuilder.SetTextureAccessFinal(BrickDistance, ERHIAccess::SRVMask);
+
+		FRDGBufferRef Occupancy = GraphBuilder.CreateBuffer(
+			FRDGBufferDesc::CreateBufferDesc(sizeof(uint32), NewState->NumWords), TEXT("BrickOccupancy"));
+
+		FPackBrickOccupancyShader::FParameters* PassParameters =
+			GraphBuilder.AllocParameters<FPackBrickOccupancyShader::FParameters>();
+		PassParameters->BrickDistance = BrickDistance;
+		PassParameters->Occupancy = GraphBuilder.CreateUAV(Occupancy, PF_R32_UINT);
+		PassParameters->NumWords = NewState->NumWords;
+
+		TShaderMapRef<FPackBrickOccupancyShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("PackBrickOccupancy"), GetRaymarchComputePassFlags(),
+			ComputeShader, PassParameters,
+			FIntVector(FMath::DivideAndRoundUp(NewState->NumWords, PACK_OCCUPANCY_NUM_THREADS_PER_GROUP), 1, 1));
+
+		AddEnqueueCopyPass(GraphBuilder, NewState->Readback.Get(), Occupancy, NewState->NumWords * sizeof(uint32));
+		GraphBuilder.Execute();
+	});
+}
+
+bool FBrickOccupancyReadback::Poll(TArray<uint32>& OutOccupancy, FIntVector& OutBrickMapSize)
+{
+	if (!State.IsValid())
+	{
+		return false;
+	}
+
+	if (State->bArrived)
+	{
+		OutOccupancy = MoveTemp(State->Occupancy);
+		OutBrickMapSize = State->BrickMapSize;
+		State.Reset();
+		return true;
+	}
+
+	// The readback can only be checked and locked on the render thread, the result gets picked up by a later poll.
+	if (!State->bCheckEnqueued.exchange(true))
+	{
+		ENQUEUE_RENDER_COMMAND(CaptureCommand)
+		([PendingState = State](FRHICommandListImmediate& RHICmdList) {
+			if (PendingState->Readback->IsReady())
+			{
+				const uint32 NumBytes = PendingState->NumWords * sizeof(uint32);
+				const uint32* Data = static_cast<const uint32*>(PendingState->Readback->Lock(NumBytes));
+				PendingState->Occupancy = TArray<uint32>(Data, PendingState->NumWords);
+				PendingState->Readback->Unlock();
+				PendingState->bArrived = true;
+			}
+			PendingState->bCheckEnqueued = false;
+		});
+	}
+	return false;
+}
+
+void FRaymarchOccupancyProxyMesh::Build(
+	const TArray<uint32>& Occupancy, const FIntVector& BrickMapSize, int32 BrickSize, const FIntVector& VolumeSize)
+{
+	Vertices.Reset();
+	Normals.Reset();
+	Triangles.Reset();
+	Bounds = FBox(ForceInit);
+
+	auto IsVisible = [&Occupancy, &BrickMapSize](const FIntVector& Brick)
+	{
+		if (Brick.X < 0 || Brick.Y < 0 || Brick.Z < 0 || Brick.X >= BrickMapSize.X || Brick.Y >= BrickMapSize.Y ||
+			Brick.Z >= BrickMapSize.Z)
+		{
+			return false;
+		}
+		const int64 Index = Brick.X + (int64) BrickMapSize.X * (Brick.Y + (int64) BrickMapSize.Y * Brick.Z);
+		return ((Occupancy[Index / 32] >> (Index % 32)) & 1) != 0;
+	};
+
+	// Returns the UVW position of a corner of the brick grid, the last bricks end at the end of the volume.
+	auto GetCornerUVW = [BrickSize, &VolumeSize](const FIntVector& Corner)
+	{
+		return FVector(FMath::Min(Corner.X * BrickSize, VolumeSize.X), FMath::Min(Corner.Y * BrickSize, VolumeSize.Y),
+				   FMath::Min(Corner.Z * BrickSize, VolumeSize.Z)) /
+			   FVector(VolumeSize);
+	};
+
+	for (int32 Z = 0; Z < BrickMapSize.Z; Z++)
+	{
+		for (int32 Y = 0; Y < BrickMapSize.Y; Y++)
+		{
+			for (int32 X = 0; X < BrickMapSize.X; X++)
+			{
+				if (IsVisible(FIntVector(X, Y, Z)))
+				{
+					Bounds += GetCornerUVW(FIntVector(X, Y, Z));
+					Bounds += GetCornerUVW(FIntVector(X + 1, Y + 1, Z + 1));
+				}
+			}
+		}
+	}
+
+	if (!Bounds.IsValid)
+	{
+		return;
+	}
+
+	// The lit material composites every fragment it gets drawn on, so a mesh with several pieces (or a concave one) would
+	// composite the volume twice wherever the pieces overlap on screen. A convex box gets drawn once per pixel from inside.
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const int32 U = (Axis + 1) % 3;
+		const int32 V = (Axis + 2) % 3;
+		for (int32 Side = 0; Side < 2; Side++)
+		{
+			FVector Corners[4];
+			for (int32 Corner = 0; Corner < 4; Corner++)
+			{
+				Corners[Corner][Axis] = Side == 0 ? Bounds.Min[Axis] : Bounds.Max[Axis];
+				Corners[Corner][U] = (Corner == 1 || Corner == 2) ? Bounds.Max[U] : Bounds.Min[U];
+				Corners[Corner][V] = Corner >= 2 ? Bounds.Max[V] : Bounds.Min[V];
+			}
+			// Faces look into the box.
+			FVector Normal = FVector::ZeroVector;
+			Normal[Axis] = Side == 0 ? 1.0 : -1.0;
+
+			const int32 FirstVertex = Vertices.Num();
+			for (const FVector& Corner : Corners)
+			{
+				Vertices.Add(Corner - 0.5);
+				Normals.Add(Normal);
+			}
+
+			// Wind the triangles so that they face along the normal (using the same triangle normal as
+			// UKismetProceduralMeshLibrary::CalculateTangentsForMesh), otherwise they'd get culled from inside.
+			const FVector TriangleNormal =
+				(Vertices[FirstVertex + 1] - Vertices[FirstVertex + 2]) ^ (Vertices[FirstVertex] - Vertices[FirstVertex + 2]);
+			const bool bFlip = (TriangleNormal | Normal) < 0.0;
+			Triangles.Append({FirstVertex, FirstVertex + (bFlip ? 2 : 1), FirstVertex + (bFlip ? 1 : 2)});
+			Triangles.Append({FirstVertex, FirstVertex + (bFlip ? 3 : 2), FirstVertex + (bFlip ? 2 : 3)});
+		}
+	}
+}
+
+#if !UE_BUILD_SHIPPING
+#pragma optimize("", on)
+#endif
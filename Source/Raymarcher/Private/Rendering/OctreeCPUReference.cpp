@@ -0,0 +1,147 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/OctreeCPUReference.h"
+
+#include "Async/ParallelFor.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "RenderTargetVolumeMipped.h"
+#include "RenderingThread.h"
+#include "Rendering/LightingShaderUtils.h"
+#include "Rendering/LightingShadersExperimental.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogRaymarchCPUOctree, Log, All);
+
+// Returns Value the way it would be read back after writing it into a 16 bit UNORM channel.
+static float QuantizeToUnorm16(float Value)
+{
+	return FMath::RoundToFloat(FMath::Clamp(Value, 0.0f, 1.0f) * 65535.0f) / 65535.0f;
+}
+
+void FRaymarchCPUOctree::Generate(const FRaymarchCPUVolumeData& Data, const FIntVector& OctreeSize, int32 NumMips)
+{
+	Size = OctreeSize;
+	Mips.SetNum(NumMips);
+
+	// A single voxel's minimum and maximum are the voxel value, the padding outside of the volume is 0.
+	Mips[0].SetNumUninitialized((int64) Size.X * Size.Y * Size.Z);
+	ParallelFor(Size.Z,
+		[this, &Data](int32 Z)
+		{
+			for (int32 Y = 0; Y < Size.Y; Y++)
+			{
+				for (int32 X = 0; X < Size.X; X++)
+				{
+					float Value = 0.0f;
+					if (X < Data.Size.X && Y < Data.Size.Y && Z < Data.Size.Z)
+					{
+						Value = QuantizeToUnorm16(Data.Values[X + (int64) Data.Size.X * (Y + (int64) Data.Size.Y * Z)]);
+					}
+					Mips[0][X + (int64) Size.X * (Y + (int64) Size.Y * Z)] = FVector2f(Value, Value);
+				}
+			}
+		});
+
+	// Every node gets the minimum and maximum of it's 8 children in the previous mip.
+	for (int32 Mip = 1; Mip < NumMips; Mip++)
+	{
+		const FIntVector SourceSize = GetMipSize(Mip - 1);
+		const FIntVector MipSize = GetMipSize(Mip);
+		const TArray<FVector2f>& Source = Mips[Mip - 1];
+		TArray<FVector2f>& Destination = Mips[Mip];
+		Destination.SetNumUninitialized((int64) MipSize.X * MipSize.Y * MipSize.Z);
+		ParallelFor(MipSize.Z,
+			[&Source, &Destination, SourceSize, MipSize](int32 Z)
+			{
+				for (int32 Y = 0; Y < MipSize.Y; Y++)
+				{
+					for (int32 X = 0; X < MipSize.X; X++)
+					{
+						FVector2f MinMax(1.0f, 0.0f);
+						for (int32 Child = 0; Child < 8; Child++)
+						{
+							const FIntVector ChildPos(X * 2 + (Child & 1), Y * 2 + ((Child >> 1) & 1), Z * 2 + (Child >> 2));
+							const FVector2f& ChildMinMax =
+								Source[ChildPos.X + (int64) SourceSize.X * (ChildPos.Y + (int64) SourceSize.Y * ChildPos.Z)];
+							MinMax = FVector2f(FMath::Min(MinMax.X, ChildMinMax.X), FMath::Max(MinMax.Y, ChildMinMax.Y));
+						}
+						Destination[X + (int64) MipSize.X * (Y + (int64) MipSize.Y * Z)] = MinMax;
+					}
+				}
+			});
+	}
+}
+
+FIntVector FRaymarchCPUOctree::GetMipSize(int32 Mip) const
+{
+	return FIntVector(FMath::Max(Size.X >> Mip, 1), FMath::Max(Size.Y >> Mip, 1), FMath::Max(Size.Z >> Mip, 1));
+}
+
+void CompareOctreeWithCPUReference(URenderTargetVolumeMipped* Octree, const FRaymarchCPUOctree& Reference, float Tolerance,
+	float& OutMaxDifference, uint32& OutMismatchedNodes)
+{
+	OutMaxDifference = 0.0f;
+	OutMismatchedNodes = 0;
+	if (!Octree || !Octree->GetResource() || FIntVector(Octree->SizeX, Octree->SizeY, Octree->SizeZ) != Reference.Size ||
+		Octree->GetNumMips() != Reference.Mips.Num())
+	{
+		UE_LOG(LogRaymarchCPUOctree, Warning, TEXT("Octree doesn't match the size or mips of the CPU reference."));
+		return;
+	}
+
+	float* MaxDifference = &OutMaxDifference;
+	uint32* MismatchedNodes = &OutMismatchedNodes;
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([Octree, &Reference, Tolerance, MaxDifference, MismatchedNodes](FRHICommandListImmediate& RHICmdList) {
+		for (int32 Mip = 0; Mip < Reference.Mips.Num(); Mip++)
+		{
+			const FIntVector MipSize = Reference.GetMipSize(Mip);
+
+			// The compare shader reads whole textures, so copy the mip out of the octree first.
+			TRefCountPtr<IPooledRenderTarget> OctreeMip;
+			{
+				FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("CopyOctreeMip"));
+				FRDGTextureRef OctreeTexture = GraphBuilder.RegisterExternalTexture(
+					CreateRenderTarget(Octree->GetResource()->TextureRHI, TEXT("Octree")));
+				FRDGTextureRef MipTexture = GraphBuilder.CreateTexture(
+					FRDGTextureDesc::Create3D(MipSize, PF_G16R16, FClearValueBinding::Black, TexCreate_ShaderResource),
+					TEXT("OctreeMipCopy"));
+
+				FRHICopyTextureInfo CopyInfo;
+				CopyInfo.Size = MipSize;
+				CopyInfo.SourceMipIndex = Mip;
+				AddCopyTexturePass(GraphBuilder, OctreeTexture, MipTexture, CopyInfo);
+				GraphBuilder.QueueTextureExtraction(MipTexture, &OctreeMip);
+				GraphBuilder.Execute();
+			}
+
+			// Upload the reference mip with the same format, so both sides go through the same UNORM conversion.
+			TArray<uint16> ReferenceData;
+			ReferenceData.Reserve(Reference.Mips[Mip].Num() * 2);
+			for (const FVector2f& MinMax : Reference.Mips[Mip])
+			{
+				ReferenceData.Add((uint16) FMath::RoundToInt(MinMax.X * 65535.0f));
+				ReferenceData.Add((uint16) FMath::RoundToInt(MinMax.Y * 65535.0f));
+			}
+			const FRHITextureCreateDesc Desc = FRHITextureCreateDesc::Create3D(TEXT("CPUReferenceOctreeMip"), MipSize, PF_G16R16)
+												   .SetFlags(ETextureCreateFlags::ShaderResource)
+												   .SetInitialState(ERHIAccess::SRVMask);
+			FTextureRHIRef ReferenceRHI = RHICreateTexture(Desc);
+			const FUpdateTextureRegion3D Region(0, 0, 0, 0, 0, 0, MipSize.X, MipSize.Y, MipSize.Z);
+			RHICmdList.UpdateTexture3D(ReferenceRHI, 0, Region, MipSize.X * 2 * sizeof(uint16),
+				MipSize.X * MipSize.Y * 2 * sizeof(uint16), reinterpret_cast<const uint8*>(ReferenceData.GetData()));
+
+			float MipMaxDifference;
+			uint32 MipMismatchedNodes;
+			CompareVolumes_RenderThread(RHICmdList, CreateRenderTarget(ReferenceRHI, TEXT("CPUReferenceOctreeMip")), OctreeMip,
+				Tolerance, MipMaxDifference, MipMismatchedNodes);
+			*MaxDifference = FMath::Max(*MaxDifference, MipMaxDifference);
+			*MismatchedNodes += MipMismatchedNodes;
+		}
+	});
+	// The reference and the outputs only live until we return.
+	FlushRenderingCommands();
+}
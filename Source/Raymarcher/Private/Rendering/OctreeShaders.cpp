@@ -6,8 +6,10 @@
 #include "Rendering/OctreeShaders.h"
 
 #include "Engine/TextureRenderTargetVolume.h"
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+#include "Rendering/LightingShaderUtils.h"
 #include "Runtime/RenderCore/Public/RenderUtils.h"
-#include "Util/UtilityShaders.h"
 
 #if !UE_BUILD_SHIPPING
 #pragma optimize("", off)
@@ -17,40 +19,160 @@
 
 IMPLEMENT_GLOBAL_SHADER(FGenerateOctreeShader, "/Raymarcher/Private/GenerateOctreeShader.usf", "MainComputeShader", SF_Compute);
 
+IMPLEMENT_GLOBAL_SHADER(
+	FDownsampleOctreeShader, "/Raymarcher/Private/DownsampleOctreeShader.usf", "MainComputeShader", SF_Compute);
+
+IMPLEMENT_GLOBAL_SHADER(
+	FGenerateOctreeSerialShader, "/Raymarcher/Private/GenerateOctreeSerialShader.usf", "MainComputeShader", SF_Compute);
+
 // For making statistics about GPU use - Generating Octree.
 DECLARE_FLOAT_COUNTER_STAT(TEXT("GeneratingOctree"), STAT_GPU_GeneratingOctree, STATGROUP_GPU);
 DECLARE_GPU_STAT_NAMED(GPUGeneratingOctree, TEXT("GeneratingOctree_"));
 
-// #TODO profile with different dimensions.
-#define OCTREE_NUM_THREADS_PER_GROUP_DIMENSION 1	// This has to be the same as in the compute shader's spec [X, X, X]
-#define LEAF_NODE_SIZE 8							// Provided to the shader as a uniform.
+#define OCTREE_NUM_THREADS_PER_GROUP_DIMENSION 4	// This has to be the same as in the octree shaders' spec [X, X, X]
+#define OCTREE_SERIAL_LEAF_NODE_SIZE 8				// Every thread of the serial baseline shader generates a leaf this big.
+#define OCTREE_SERIAL_NUM_MIPS 4					// The serial baseline shader has a UAV for exactly this many mips.
+
+int32 GetOctreeNumMips(const FIntVector& VolumeSize, int32 RequestedNumMips)
+{
+	const int32 MaxNumMips = FMath::Max(FMath::FloorLog2(FMath::Max(VolumeSize.GetMin(), 1)) + 1, 2);
+	return FMath::Clamp(RequestedNumMips, 2, MaxNumMips);
+}
+
+FIntVector GetOctreeSize(const FIntVector& VolumeSize, int32 NumMips)
+{
+	const int32 CoarsestNodeSize = 1 << (NumMips - 1);
+	return FIntVector(FMath::DivideAndRoundUp(VolumeSize.X, CoarsestNodeSize) * CoarsestNodeSize,
+		FMath::DivideAndRoundUp(VolumeSize.Y, CoarsestNodeSize) * CoarsestNodeSize,
+		FMath::DivideAndRoundUp(VolumeSize.Z, CoarsestNodeSize) * CoarsestNodeSize);
+}
 
 void GenerateOctreeForVolume_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources)
 {
 	check(IsInRenderingThread());
-	constexpr int32 GroupSizePerDimension = OCTREE_NUM_THREADS_PER_GROUP_DIMENSION * LEAF_NODE_SIZE;
 
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("GenerateOctreeForVolume"));
+
+	FRHITexture* OctreeRHI = Resources.OctreeVolumeRenderTarget->GetResource()->TextureRHI;
+	FRDGTextureRef Octree = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(OctreeRHI, TEXT("Octree")));
+	// Materials sample the octree once it's generated.
+	GraphBuilder.SetTextureAccessFinal(Octree, ERHIAccess::SRVMask);
+
+	AddGenerateOctreeForVolumePass(GraphBuilder, Octree, Resources);
+
+	GraphBuilder.Execute();
+}
+
+void AddGenerateOctreeForVolumePass(
+	FRDGBuilder& GraphBuilder, FRDGTextureRef Octree, const FBasicRaymarchRenderingResources& Resources)
+{
+	// Generating the whole octree is the same as updating a region covering all of it.
+	AddUpdateOctreeRegionsPasses(
+		GraphBuilder, Octree, Resources, {FRaymarchVoxelBox(FIntVector::ZeroValue, Octree->Desc.GetSize())});
+}
+
+void GenerateOctreeSerialBaseline_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources)
+{
+	check(IsInRenderingThread());
+	check(Resources.OctreeVolumeRenderTarget->GetNumMips() == OCTREE_SERIAL_NUM_MIPS);
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("GenerateOctreeSerialBaseline"));
+
+	FRHITexture* OctreeRHI = Resources.OctreeVolumeRenderTarget->GetResource()->TextureRHI;
+	FRDGTextureRef Octree = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(OctreeRHI, TEXT("Octree")));
+	GraphBuilder.SetTextureAccessFinal(Octree, ERHIAccess::SRVMask);
+
+	TShaderMapRef<FGenerateOctreeSerialShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	FGenerateOctreeSerialShader::FParameters* PassParameters =
+		GraphBuilder.AllocParameters<FGenerateOctreeSerialShader::FParameters>();
+	PassParameters->Volume = Resources.DataVolumeTextureRef->GetResource()->TextureRHI;
+	// Every mip gets it's own UAV.
+	PassParameters->OctreeVolumeMip0 = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, 0));
+	PassParameters->OctreeVolumeMip1 = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, 1));
+	PassParameters->OctreeVolumeMip2 = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, 2));
+	PassParameters->OctreeVolumeMip3 = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, 3));
+	PassParameters->LeafNodeSize = OCTREE_SERIAL_LEAF_NODE_SIZE;
+	PassParameters->NumberOfMips = OCTREE_SERIAL_NUM_MIPS;
+
+	// A single thread per group and per leaf.
+	const FIntVector OctreeSize = Octree->Desc.GetSize();
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("GenerateOctreeSerial"), GetRaymarchComputePassFlags(),
+		ComputeShader, PassParameters, FComputeShaderUtils::GetGroupCount(OctreeSize, OCTREE_SERIAL_LEAF_NODE_SIZE));
+
+	GraphBuilder.Execute();
+}
+
+void UpdateOctreeRegions_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, TArray<FRaymarchVoxelBox> DirtyBoxes)
+{
+	check(IsInRenderingThread());
+
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("UpdateOctreeRegions"));
+
+	FRHITexture* OctreeRHI = Resources.OctreeVolumeRenderTarget->GetResource()->TextureRHI;
+	FRDGTextureRef Octree = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(OctreeRHI, TEXT("Octree")));
+	GraphBuilder.SetTextureAccessFinal(Octree, ERHIAccess::SRVMask);
+
+	AddUpdateOctreeRegionsPasses(GraphBuilder, Octree, Resources, DirtyBoxes);
+
+	GraphBuilder.Execute();
+}
+
+void AddUpdateOctreeRegionsPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef Octree,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes)
+{
 	// For GPU profiling.
-	SCOPED_DRAW_EVENTF(RHICmdList, GenerateOctreeForVolume_RenderThread, TEXT("GeneratingOctree"));
-	SCOPED_GPU_STAT(RHICmdList, GPUGeneratingOctree);
+	RDG_EVENT_SCOPE(GraphBuilder, "GeneratingOctree");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUGeneratingOctree);
+
+	const FIntVector OctreeSize = Octree->Desc.GetSize();
+
+	// Node (X, Y, Z) of mip M covers voxels (X, Y, Z) * 2^M to (X, Y, Z) * 2^M + 2^M - 1 (see GetOctreeSize()), so the nodes to
+	// update in every mip are the cells of 2^M voxels the dirty boxes touch. Boxes that overlap in a mip get merged, so that no
+	// node gets generated twice.
+	auto GetMipRegions = [&DirtyBoxes, OctreeSize](int32 Mip)
+	{
+		const FIntVector MipSize(
+			FMath::Max(OctreeSize.X >> Mip, 1), FMath::Max(OctreeSize.Y >> Mip, 1), FMath::Max(OctreeSize.Z >> Mip, 1));
+		TArray<FRaymarchVoxelBox> Regions;
+		for (const FRaymarchVoxelBox& Box : DirtyBoxes)
+		{
+			Regions.Add(Box.GetCells(1 << Mip).ClampToSize(MipSize));
+		}
+		FRaymarchVoxelBox::MergeOverlapping(Regions);
+		return Regions;
+	};
 
 	TShaderMapRef<FGenerateOctreeShader> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
-	FRHIComputeShader* ShaderRHI = ComputeShader.GetComputeShader();
-	SetComputePipelineState(RHICmdList, ShaderRHI);
-	RHICmdList.Transition(FRHITransitionInfo(Resources.OctreeUAVRef, ERHIAccess::UAVGraphics, ERHIAccess::UAVCompute));
-
-	ComputeShader->SetGeneratingResources(RHICmdList, ShaderRHI,
-		Resources.DataVolumeTextureRef->GetResource()->TextureRHI->GetTexture3D(),
-		Resources.OctreeVolumeRenderTarget->MippedTexture3DRTResource, LEAF_NODE_SIZE,
-		Resources.OctreeVolumeRenderTarget->GetNumMips());
-
-	const uint32 GroupSizeX = FMath::DivideAndRoundUp(Resources.OctreeVolumeRenderTarget->SizeX, GroupSizePerDimension);
-	const uint32 GroupSizeY = FMath::DivideAndRoundUp(Resources.OctreeVolumeRenderTarget->SizeY, GroupSizePerDimension);
-	const uint32 GroupSizeZ = FMath::DivideAndRoundUp(Resources.OctreeVolumeRenderTarget->SizeZ, GroupSizePerDimension);
-	RHICmdList.DispatchComputeShader(GroupSizeX, GroupSizeY, GroupSizeZ);
-
-	ComputeShader->UnbindResources(RHICmdList, ShaderRHI);
-	RHICmdList.Transition(FRHITransitionInfo(Resources.OctreeUAVRef, ERHIAccess::UAVCompute, ERHIAccess::UAVGraphics));
+	for (const FRaymarchVoxelBox& Region : GetMipRegions(0))
+	{
+		FGenerateOctreeShader::FParameters* PassParameters = GraphBuilder.AllocParameters<FGenerateOctreeShader::FParameters>();
+		PassParameters->Volume = Resources.DataVolumeTextureRef->GetResource()->TextureRHI;
+		PassParameters->OctreeVolumeMip0 = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, 0));
+		PassParameters->RegionMin = Region.Min;
+		PassParameters->RegionMax = Region.Max;
+		FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("GenerateOctree"), GetRaymarchComputePassFlags(),
+			ComputeShader, PassParameters,
+			FComputeShaderUtils::GetGroupCount(Region.GetSize(), OCTREE_NUM_THREADS_PER_GROUP_DIMENSION));
+	}
+
+	// Every mip only depends on the previous one, the graph puts a barrier between the passes.
+	TShaderMapRef<FDownsampleOctreeShader> DownsampleShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
+	for (int32 Mip = 1; Mip < Octree->Desc.NumMips; Mip++)
+	{
+		for (const FRaymarchVoxelBox& Region : GetMipRegions(Mip))
+		{
+			FDownsampleOctreeShader::FParameters* DownsampleParameters =
+				GraphBuilder.AllocParameters<FDownsampleOctreeShader::FParameters>();
+			DownsampleParameters->SourceMip = GraphBuilder.CreateSRV(FRDGTextureSRVDesc::CreateForMipLevel(Octree, Mip - 1));
+			DownsampleParameters->DestinationMip = GraphBuilder.CreateUAV(FRDGTextureUAVDesc(Octree, Mip));
+			DownsampleParameters->RegionMin = Region.Min;
+			DownsampleParameters->RegionMax = Region.Max;
+			FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("DownsampleOctree Mip %d", Mip),
+				GetRaymarchComputePassFlags(), DownsampleShader, DownsampleParameters,
+				FComputeShaderUtils::GetGroupCount(Region.GetSize(), OCTREE_NUM_THREADS_PER_GROUP_DIMENSION));
+		}
+	}
 }
 
 #undef LOCTEXT_NAMESPACE
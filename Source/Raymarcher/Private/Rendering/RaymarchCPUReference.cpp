@@ -0,0 +1,179 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Rendering/RaymarchCPUReference.h"
+
+#include "Async/ParallelFor.h"
+#include "Rendering/BrickMapShaders.h"
+
+// Same as VOLUME_DENSITY in RaymarcherCommon.usf and RAYMARCH_ADAPTIVE_STEP_OPACITY in WindowedRaymarchMaterials.usf.
+#define RAYMARCH_VOLUME_DENSITY 100.0f
+#define RAYMARCH_ADAPTIVE_STEP_OPACITY 0.02f
+
+// Same as the step opacity BrickOccupancyShader.usf stores for a brick with the given minimum and maximum.
+static float GetBrickStepOpacity(const FRaymarchCPUVolumeData& Data, const FVector2f& MinMax)
+{
+	const FWindowingParameters& Windowing = Data.WindowingParameters;
+	const int32 TFWidth = Data.TransferFunction.Num();
+	// Homogeneous bricks get the longest steps.
+	if (TFWidth == 0 || FMath::Abs(MinMax.Y - MinMax.X) / Windowing.Width * TFWidth <= 1.0f)
+	{
+		return 0.0f;
+	}
+
+	float Low = (MinMax.X - Windowing.Center + (Windowing.Width / 2.0f)) / Windowing.Width;
+	float High = (MinMax.Y - Windowing.Center + (Windowing.Width / 2.0f)) / Windowing.Width;
+	if ((High < 0.0f && Windowing.LowCutoff) || (Low > 1.0f && Windowing.HighCutoff))
+	{
+		return 0.0f;
+	}
+	if (Windowing.LowCutoff)
+	{
+		Low = FMath::Max(Low, 0.0f);
+	}
+	if (Windowing.HighCutoff)
+	{
+		High = FMath::Min(High, 1.0f);
+	}
+
+	// Every texel the bilinear sampler can blend for a value within the range.
+	const int32 First = FMath::Clamp(FMath::FloorToInt(Low * TFWidth - 0.5f), 0, TFWidth - 1);
+	const int32 Last = FMath::Clamp(FMath::FloorToInt(High * TFWidth - 0.5f) + 1, 0, TFWidth - 1);
+	float StepOpacity = 0.0f;
+	for (int32 Texel = First; Texel <= Last; Texel++)
+	{
+		StepOpacity = FMath::Max(StepOpacity, FMath::Clamp(Data.TransferFunction[Texel].A, 0.0f, 1.0f));
+	}
+	return StepOpacity;
+}
+
+void FRaymarchCPUBrickMap::Generate(const FRaymarchCPUVolumeData& Data, int32 InBrickSize)
+{
+	BrickSize = InBrickSize;
+	Size = GetBrickMapSize(Data.Size, BrickSize);
+	Bricks.SetNumUninitialized((int64) Size.X * Size.Y * Size.Z);
+	StepOpacities.SetNumUninitialized(Bricks.Num());
+
+	ParallelFor(Size.Z,
+		[this, &Data](int32 BrickZ)
+		{
+			for (int32 BrickY = 0; BrickY < Size.Y; BrickY++)
+			{
+				for (int32 BrickX = 0; BrickX < Size.X; BrickX++)
+				{
+					// Includes the voxels around the brick, like the shader.
+					const FIntVector Brick(BrickX, BrickY, BrickZ);
+					const FIntVector First(FMath::Max(Brick.X * BrickSize - 1, 0), FMath::Max(Brick.Y * BrickSize - 1, 0),
+						FMath::Max(Brick.Z * BrickSize - 1, 0));
+					const FIntVector Last(FMath::Min((Brick.X + 1) * BrickSize, Data.Size.X - 1),
+						FMath::Min((Brick.Y + 1) * BrickSize, Data.Size.Y - 1),
+						FMath::Min((Brick.Z + 1) * BrickSize, Data.Size.Z - 1));
+
+					FVector2f MinMax(TNumericLimits<float>::Max(), TNumericLimits<float>::Lowest());
+					for (int32 Z = First.Z; Z <= Last.Z; Z++)
+					{
+						for (int32 Y = First.Y; Y <= Last.Y; Y++)
+						{
+							for (int32 X = First.X; X <= Last.X; X++)
+							{
+								const float Value = Data.Values[X + (int64) Data.Size.X * (Y + (int64) Data.Size.Y * Z)];
+								MinMax = FVector2f(FMath::Min(MinMax.X, Value), FMath::Max(MinMax.Y, Value));
+							}
+						}
+					}
+					const int64 Index = BrickX + (int64) Size.X * (BrickY + (int64) Size.Y * BrickZ);
+					Bricks[Index] = MinMax;
+					StepOpacities[Index] = GetBrickStepOpacity(Data, MinMax);
+				}
+			}
+		});
+}
+
+// Same as GetAdaptiveStepScale() in WindowedRaymarchMaterials.usf.
+static float GetAdaptiveStepScale(const FRaymarchCPUVolumeData& Data, const FRaymarchCPUBrickMap& BrickMap, const FVector& CurPos,
+	const FVector& LocalCamVec, float StepSizeWorld, float MaxStepScale)
+{
+	const FVector DataVolumeSize(Data.Size);
+	FIntVector Brick;
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const int32 Voxel = FMath::Min(int32(FMath::Clamp(CurPos[Axis], 0.0, 1.0) * Data.Size[Axis]), Data.Size[Axis] - 1);
+		Brick[Axis] = Voxel / BrickMap.BrickSize;
+	}
+
+	// Samples closer than half a voxel to the volume's sides read the sampler's border, which isn't part of any brick.
+	float ExitTime = TNumericLimits<float>::Max();
+	for (int32 Axis = 0; Axis < 3; Axis++)
+	{
+		const double BoundsMin = FMath::Max(double(Brick[Axis] * BrickMap.BrickSize), 0.5) / DataVolumeSize[Axis];
+		const double BoundsMax = FMath::Min(double((Brick[Axis] + 1) * BrickMap.BrickSize), DataVolumeSize[Axis] - 0.5) /
+								 DataVolumeSize[Axis];
+		if (CurPos[Axis] < BoundsMin || CurPos[Axis] > BoundsMax)
+		{
+			return 1.0f;
+		}
+		// Same as the exit time of RayAABBIntersection(), a zero direction gives an infinite time on that axis.
+		const double InverseDir = 1.0 / LocalCamVec[Axis];
+		ExitTime = FMath::Min(ExitTime,
+			float(FMath::Max((BoundsMin - CurPos[Axis]) * InverseDir, (BoundsMax - CurPos[Axis]) * InverseDir)));
+	}
+
+	const float StepOpacity =
+		BrickMap.StepOpacities[Brick.X + (int64) BrickMap.Size.X * (Brick.Y + (int64) BrickMap.Size.Y * Brick.Z)];
+	const float MaxOpacity = 1.0f - FMath::Pow(1.0f - StepOpacity, StepSizeWorld);
+	const float Scale = FMath::Clamp(RAYMARCH_ADAPTIVE_STEP_OPACITY / FMath::Max(MaxOpacity, 1e-5f), 1.0f, MaxStepScale);
+	return FMath::Min(Scale, FMath::Max(ExitTime, 1.0f));
+}
+
+FRaymarchCPURayResult RaymarchCPURay(const FRaymarchCPUVolumeData& Data, const FVector& EntryPos, const FVector& Direction,
+	float Thickness, float StepCount, const FRaymarchCPUBrickMap* BrickMap, float MaxStepScale, float TerminationOpacity,
+	float MaxStepsPerPixel)
+{
+	// Same as GetBudgetedStepCount().
+	if (MaxStepsPerPixel > 0.0f && StepCount * Thickness > MaxStepsPerPixel)
+	{
+		StepCount = MaxStepsPerPixel / Thickness;
+	}
+
+	const float StepSize = 1.0f / StepCount;
+	const float FloatActualSteps = StepCount * Thickness;
+	const int32 MaxSteps = FMath::FloorToInt(FloatActualSteps) + 1;
+	const FVector LocalCamVec = Direction * StepSize;
+	const float StepSizeWorld = RAYMARCH_VOLUME_DENSITY * StepSize;
+	const bool bAdaptive = BrickMap && BrickMap->BrickSize > 0 && MaxStepScale > 1.0f;
+
+	// Same loop as PerformWindowedLitRaymarchAdaptive(), which takes the same samples as PerformWindowedLitRaymarch() when every
+	// step has the base length.
+	FRaymarchCPURayResult Result;
+	float Time = 0.0f;
+	for (int32 i = 0; i < MaxSteps; i++)
+	{
+		const float RemainingSteps = FloatActualSteps - Time;
+		if (RemainingSteps <= 0.0f)
+		{
+			break;
+		}
+
+		float StepScale = 1.0f;
+		if (bAdaptive)
+		{
+			const FVector StepStart = EntryPos + Time * LocalCamVec;
+			StepScale = GetAdaptiveStepScale(Data, *BrickMap, StepStart, LocalCamVec, StepSizeWorld, MaxStepScale);
+		}
+		StepScale = FMath::Min(StepScale, RemainingSteps);
+		Time += StepScale;
+
+		const float Value = Data.SampleVolume(EntryPos + Time * LocalCamVec);
+		const float Opacity = Data.SampleWindowedOpacity(Value, StepSizeWorld * StepScale);
+		Result.Opacity += Opacity * (1.0f - Result.Opacity);
+		Result.NumSamples++;
+		if (Result.Opacity > TerminationOpacity)
+		{
+			Result.Opacity = 1.0f;
+			break;
+		}
+	}
+	return Result;
+}
@@ -12,11 +12,15 @@
 #include "RHICommandList.h"
 #include "RHIDefinitions.h"
 #include "RHIStaticStates.h"
+#include "Rendering/AmbientOcclusionShaders.h"
+#include "Rendering/LightingCPUReference.h"
 #include "Rendering/LightingShaders.h"
+#include "Rendering/LightingShadersExperimental.h"
 #include "Rendering/RaymarchTypes.h"
 #include "SceneInterface.h"
 #include "SceneUtils.h"
 #include "ShaderParameterUtils.h"
+#include "Rendering/BrickMapShaders.h"
 #include "Rendering/OctreeShaders.h"
 #include "VolumeTextureToolkit/Public/TextureUtilities.h"
 
@@ -51,11 +55,10 @@ void URaymarchUtils::AddDirLightToSingleVolume(const FBasicRaymarchRenderingReso
 	if (bGPUSync)
 	{
 		// Call the actual rendering code on RenderThread.
-		// #todo fix GPUSync'd version of shader.
-		//ENQUEUE_RENDER_COMMAND(CaptureCommand)
-		//([=](FRHICommandListImmediate& RHICmdList) {
-		//	AddDirLightToSingleLightVolume_GPUSync_RenderThread(RHICmdList, Resources, LightParameters, Added, WorldParameters);
-		//});
+		ENQUEUE_RENDER_COMMAND(CaptureCommand)
+		([=](FRHICommandListImmediate& RHICmdList) {
+			AddDirLightToSingleLightVolume_GPUSync_RenderThread(RHICmdList, Resources, LightParameters, Added, WorldParameters);
+		});
 	}
 	else
 	{
@@ -67,6 +70,130 @@ void URaymarchUtils::AddDirLightToSingleVolume(const FBasicRaymarchRenderingReso
 	}
 }
 
+void URaymarchUtils::AddDirLightsToSingleVolumeBatched(const FBasicRaymarchRenderingResources& Resources,
+	const TArray<FDirLightParameters>& LightParameters, const bool Added, const FRaymarchWorldParameters WorldParameters,
+	bool& LightsAdded)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() || !Resources.TFTextureRef->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource() || !Resources.DataVolumeTextureRef->GetResource()->TextureRHI ||
+		!Resources.TFTextureRef->GetResource()->TextureRHI || !Resources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		LightsAdded = false;
+		return;
+	}
+	else
+	{
+		LightsAdded = true;
+	}
+
+	if (LightParameters.Num() == 0)
+	{
+		return;
+	}
+
+	// Call the actual rendering code on RenderThread.
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) {
+		AddDirLightsToSingleLightVolumeBatched_RenderThread(RHICmdList, Resources, LightParameters, Added, WorldParameters);
+	});
+}
+
+void URaymarchUtils::CompareGPUSyncLightPropagation(const FBasicRaymarchRenderingResources& Resources,
+	const FDirLightParameters& LightParameters, const FRaymarchWorldParameters WorldParameters, float Tolerance)
+{
+	if (!Resources.bIsInitialized || !Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.TFTextureRef->GetResource() || !Resources.LightVolumeRenderTarget->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		return;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) {
+		CompareGPUSyncLightPropagation_RenderThread(RHICmdList, Resources, LightParameters, WorldParameters, Tolerance);
+	});
+}
+
+void URaymarchUtils::BenchmarkLightVolumeFormats(const FBasicRaymarchRenderingResources& Resources,
+	const TArray<FDirLightParameters>& LightParameters, const FRaymarchWorldParameters WorldParameters, int32 NumChanges,
+	float Tolerance)
+{
+	if (!Resources.bIsInitialized || !Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.TFTextureRef->GetResource() || !Resources.LightVolumeRenderTarget->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		return;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) {
+		BenchmarkLightVolumeFormats_RenderThread(RHICmdList, Resources, LightParameters, WorldParameters, NumChanges, Tolerance);
+	});
+}
+
+void URaymarchUtils::ResolveLightGroups(
+	const FBasicRaymarchRenderingResources& Resources, const FLinearColor LightGroupWeights, bool& LightGroupsResolved)
+{
+	if (!Resources.LightVolumeRenderTarget || !Resources.LightVolumeRenderTarget->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource()->TextureRHI || !Resources.ResolvedLightVolumeRenderTarget ||
+		!Resources.ResolvedLightVolumeRenderTarget->GetResource() ||
+		!Resources.ResolvedLightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		LightGroupsResolved = false;
+		return;
+	}
+	else
+	{
+		LightGroupsResolved = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { ResolveLightGroups_RenderThread(RHICmdList, Resources, LightGroupWeights); });
+}
+
+void URaymarchUtils::ComputeAmbientOcclusion(
+	const FBasicRaymarchRenderingResources& Resources, const float Radius, bool& AmbientOcclusionComputed)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.DataVolumeTextureRef->GetResource()->TextureRHI || !Resources.TFTextureRef ||
+		!Resources.TFTextureRef->GetResource() || !Resources.TFTextureRef->GetResource()->TextureRHI ||
+		!Resources.AmbientOcclusionVolumeRenderTarget || !Resources.AmbientOcclusionVolumeRenderTarget->GetResource() ||
+		!Resources.AmbientOcclusionVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		AmbientOcclusionComputed = false;
+		return;
+	}
+	else
+	{
+		AmbientOcclusionComputed = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { ComputeAmbientOcclusion_RenderThread(RHICmdList, Resources, Radius); });
+}
+
+void URaymarchUtils::CombineAmbientOcclusion(
+	const FBasicRaymarchRenderingResources& Resources, const float AmbientIntensity, bool& AmbientOcclusionCombined)
+{
+	if (!Resources.LightVolumeRenderTarget || !Resources.LightVolumeRenderTarget->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource()->TextureRHI || !Resources.AmbientOcclusionVolumeRenderTarget ||
+		!Resources.AmbientOcclusionVolumeRenderTarget->GetResource() ||
+		!Resources.AmbientOcclusionVolumeRenderTarget->GetResource()->TextureRHI || !Resources.CombinedLightVolumeRenderTarget ||
+		!Resources.CombinedLightVolumeRenderTarget->GetResource() ||
+		!Resources.CombinedLightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		AmbientOcclusionCombined = false;
+		return;
+	}
+	else
+	{
+		AmbientOcclusionCombined = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { CombineAmbientOcclusion_RenderThread(RHICmdList, Resources, AmbientIntensity); });
+}
+
 void URaymarchUtils::ChangeDirLightInSingleVolume(FBasicRaymarchRenderingResources& Resources,
 	const FDirLightParameters OldLightParameters, const FDirLightParameters NewLightParameters,
 	const FRaymarchWorldParameters WorldParameters, bool& LightAdded, bool bGpuSync)
@@ -91,6 +218,61 @@ void URaymarchUtils::ChangeDirLightInSingleVolume(FBasicRaymarchRenderingResourc
 	});
 }
 
+void URaymarchUtils::UpdateDirtyBricksInSingleVolume(const FBasicRaymarchRenderingResources& Resources,
+	const TArray<FDirLightParameters>& LightParameters, const FLightVolumeDirtyBricks& DirtyBricks,
+	const FRaymarchWorldParameters OldWorldParameters, const FRaymarchWorldParameters NewWorldParameters, bool& LightsUpdated)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() || !Resources.TFTextureRef->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource() || !Resources.DataVolumeTextureRef->GetResource()->TextureRHI ||
+		!Resources.TFTextureRef->GetResource()->TextureRHI || !Resources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		LightsUpdated = false;
+		return;
+	}
+	else
+	{
+		LightsUpdated = true;
+	}
+
+	if (LightParameters.Num() == 0 || !DirtyBricks.IsDirty())
+	{
+		return;
+	}
+
+	// Call the actual rendering code on RenderThread.
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) {
+		UpdateDirtyBricksInSingleLightVolume_RenderThread(
+			RHICmdList, Resources, LightParameters, DirtyBricks, OldWorldParameters, NewWorldParameters);
+	});
+}
+
+void URaymarchUtils::AddDirLightChunksToSingleVolume(const FBasicRaymarchRenderingResources& Resources,
+	const TArray<FDirLightPropagationChunk>& Chunks, const FRaymarchWorldParameters WorldParameters, bool& LightsAdded)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() || !Resources.TFTextureRef->GetResource() ||
+		!Resources.LightVolumeRenderTarget->GetResource() || !Resources.DataVolumeTextureRef->GetResource()->TextureRHI ||
+		!Resources.TFTextureRef->GetResource()->TextureRHI || !Resources.LightVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		LightsAdded = false;
+		return;
+	}
+	else
+	{
+		LightsAdded = true;
+	}
+
+	if (Chunks.Num() == 0)
+	{
+		return;
+	}
+
+	// Call the actual rendering code on RenderThread.
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList)
+		{ AddDirLightChunksToSingleLightVolume_RenderThread(RHICmdList, Resources, Chunks, WorldParameters); });
+}
+
 void URaymarchUtils::GenerateOctree(FBasicRaymarchRenderingResources& Resources)
 {
 	// Call the actual rendering code on RenderThread. We capture by value so that if
@@ -101,6 +283,141 @@ void URaymarchUtils::GenerateOctree(FBasicRaymarchRenderingResources& Resources)
 	});
 }
 
+void URaymarchUtils::UpdateOctreeRegions(
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes, bool& OctreeUpdated)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.DataVolumeTextureRef->GetResource()->TextureRHI || !Resources.OctreeVolumeRenderTarget ||
+		!Resources.OctreeVolumeRenderTarget->GetResource() || !Resources.OctreeVolumeRenderTarget->GetResource()->TextureRHI)
+	{
+		OctreeUpdated = false;
+		return;
+	}
+	else
+	{
+		OctreeUpdated = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { UpdateOctreeRegions_RenderThread(RHICmdList, Resources, DirtyBoxes); });
+}
+
+void URaymarchUtils::GenerateBrickMap(const FBasicRaymarchRenderingResources& Resources, bool& BrickMapGenerated)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.DataVolumeTextureRef->GetResource()->TextureRHI || !Resources.BrickMapRenderTarget ||
+		!Resources.BrickMapRenderTarget->GetResource() || !Resources.BrickMapRenderTarget->GetResource()->TextureRHI)
+	{
+		BrickMapGenerated = false;
+		return;
+	}
+	else
+	{
+		BrickMapGenerated = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { GenerateBrickMap_RenderThread(RHICmdList, Resources); });
+}
+
+void URaymarchUtils::UpdateBrickMapRegions(
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes, bool& BrickMapUpdated)
+{
+	if (!Resources.DataVolumeTextureRef || !Resources.DataVolumeTextureRef->GetResource() ||
+		!Resources.DataVolumeTextureRef->GetResource()->TextureRHI || !Resources.BrickMapRenderTarget ||
+		!Resources.BrickMapRenderTarget->GetResource() || !Resources.BrickMapRenderTarget->GetResource()->TextureRHI)
+	{
+		BrickMapUpdated = false;
+		return;
+	}
+	else
+	{
+		BrickMapUpdated = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { UpdateBrickMapRegions_RenderThread(RHICmdList, Resources, DirtyBoxes); });
+}
+
+void URaymarchUtils::ComputeBrickDistances(const FBasicRaymarchRenderingResources& Resources, bool& DistancesComputed)
+{
+	if (!Resources.TFTextureRef || !Resources.TFTextureRef->GetResource() || !Resources.TFTextureRef->GetResource()->TextureRHI ||
+		!Resources.BrickMapRenderTarget || !Resources.BrickMapRenderTarget->GetResource() ||
+		!Resources.BrickMapRenderTarget->GetResource()->TextureRHI || !Resources.BrickDistanceRenderTarget ||
+		!Resources.BrickDistanceRenderTarget->GetResource() || !Resources.BrickDistanceRenderTarget->GetResource()->TextureRHI ||
+		!Resources.BrickStepOpacityRenderTarget || !Resources.BrickStepOpacityRenderTarget->GetResource() ||
+		!Resources.BrickStepOpacityRenderTarget->GetResource()->TextureRHI)
+	{
+		DistancesComputed = false;
+		return;
+	}
+	else
+	{
+		DistancesComputed = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { ComputeBrickDistances_RenderThread(RHICmdList, Resources); });
+}
+
+void URaymarchUtils::CopyLightVolume(
+	UTextureRenderTargetVolume* Source, UTextureRenderTargetVolume* Destination, bool& LightVolumeCopied)
+{
+	if (!Source || !Source->GetResource() || !Source->GetResource()->TextureRHI || !Destination || !Destination->GetResource() ||
+		!Destination->GetResource()->TextureRHI || Source->SizeX != Destination->SizeX || Source->SizeY != Destination->SizeY ||
+		Source->SizeZ != Destination->SizeZ || Source->OverrideFormat != Destination->OverrideFormat)
+	{
+		LightVolumeCopied = false;
+		return;
+	}
+	else
+	{
+		LightVolumeCopied = true;
+	}
+
+	ENQUEUE_RENDER_COMMAND(CaptureCommand)
+	([=](FRHICommandListImmediate& RHICmdList) { CopyLightVolume_RenderThread(RHICmdList, Source, Destination); });
+}
+
+void URaymarchUtils::BakeLightVolumeOnCPU(const FBasicRaymarchRenderingResources& Resources,
+	const TArray<FDirLightParameters>& LightParameters, const FRaymarchWorldParameters WorldParameters, const FString AssetName,
+	UVolumeTexture*& OutLightVolume, bool& LightVolumeBaked)
+{
+	OutLightVolume = nullptr;
+	LightVolumeBaked = false;
+
+	FRaymarchCPUVolumeData Data;
+	if (!Data.InitFromTextures(Resources.DataVolumeTextureRef, Resources.TFTextureRef, Resources.WindowingParameters))
+	{
+		return;
+	}
+
+	const UTextureRenderTargetVolume* LightVolumeRenderTarget = Resources.LightVolumeRenderTarget;
+	const FIntVector Size = LightVolumeRenderTarget ? FIntVector(LightVolumeRenderTarget->SizeX, LightVolumeRenderTarget->SizeY,
+														  LightVolumeRenderTarget->SizeZ)
+													: Data.Size;
+	FRaymarchCPULightVolume LightVolume;
+	LightVolume.Init(Size, Resources.LightVolumeFormat);
+	for (const FDirLightParameters& Light : LightParameters)
+	{
+		AddDirLightToCPULightVolume(LightVolume, Data, Light, true, WorldParameters);
+	}
+
+	// The baked volume is single channel, packed light volume formats get baked into R16F.
+	const EPixelFormat PixelFormat = GetPropagationBufferFormat(GetLightVolumePixelFormat(Resources.LightVolumeFormat));
+	TArray<uint8> BulkData = LightVolume.ToBulkData(PixelFormat);
+	if (AssetName.IsEmpty())
+	{
+		LightVolumeBaked =
+			UVolumeTextureToolkit::CreateVolumeTextureTransient(OutLightVolume, PixelFormat, Size, BulkData.GetData());
+	}
+	else
+	{
+		LightVolumeBaked = UVolumeTextureToolkit::CreateVolumeTextureAsset(
+			OutLightVolume, AssetName, "", PixelFormat, Size, BulkData.GetData(), true);
+	}
+}
+
 void URaymarchUtils::ClearResourceLightVolumes(const FBasicRaymarchRenderingResources Resources, float ClearValue)
 {
 	if (!Resources.LightVolumeRenderTarget)
@@ -173,49 +490,6 @@ void URaymarchUtils::ColorCurveToTexture(UCurveLinearColor* Curve, UTexture2D*&
 	return;
 }
 
-void URaymarchUtils::CreateBufferTextures(FIntPoint Size, EPixelFormat PixelFormat, OneAxisReadWriteBufferResources& RWBuffers)
-{
-	if (Size.X == 0 || Size.Y == 0)
-	{
-		UE_LOG(LogTemp, Warning, TEXT("Warning: Creating Buffer Textures: Size is Zero!"), 3);
-		return;
-	}
-
-	FRHITextureCreateDesc Desc =
-		FRHITextureCreateDesc::Create2D(TEXT("Illumination Buffer"), Size.X, Size.Y, PixelFormat);
-	Desc.Flags |= TexCreate_ShaderResource | TexCreate_UAV;
-	Desc.NumMips = 1;
-	Desc.NumSamples = 1;
-	
-	for (int i = 0; i < 4; i++)
-	{
-		RWBuffers.Buffers[i] =
-			RHICreateTexture(Desc);
-		RWBuffers.UAVs[i] = GetCmdList().CreateUnorderedAccessView(RWBuffers.Buffers[i]);
-	}
-}
-
-void URaymarchUtils::ReleaseOneAxisReadWriteBufferResources(OneAxisReadWriteBufferResources& Buffer)
-{
-	for (FUnorderedAccessViewRHIRef& UAV : Buffer.UAVs)
-	{
-		if (UAV)
-		{
-			UAV.SafeRelease();
-		}
-		UAV = nullptr;
-	}
-
-	for (FTexture2DRHIRef& TextureRef : Buffer.Buffers)
-	{
-		if (TextureRef)
-		{
-			TextureRef.SafeRelease();
-		}
-		TextureRef = nullptr;
-	}
-}
-
 void URaymarchUtils::GetVolumeTextureDimensions(UVolumeTexture* Texture, FIntVector& Dimensions)
 {
 	if (Texture)
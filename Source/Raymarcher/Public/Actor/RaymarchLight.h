@@ -29,6 +29,33 @@ public:
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	float LightIntensity;
 
+	// Channel of a RGBA16F light group light volume this light gets propagated into. Ignored by other light volume formats.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (ClampMin = 0, ClampMax = 3))
+	int32 LightGroup = 0;
+
+	// Color of the light in a colored (RGBA16F) light volume. Ignored by other light volume formats.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere, meta = (HideAlphaChannel))
+	FLinearColor LightColor = FLinearColor::White;
+
+	// Directional lights shine along the actor's forward vector, point and spot lights from the actor's location.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere)
+	ERaymarchLightType LightType = ERaymarchLightType::Directional;
+
+	// Distance (in world units) at which a point or spot light's influence reaches zero.
+	UPROPERTY(
+		BlueprintReadWrite, EditAnywhere, meta = (ClampMin = 0, EditCondition = "LightType != ERaymarchLightType::Directional"))
+	float AttenuationRadius = 100.0f;
+
+	// Angle (in degrees) from the spot light's forward vector inside which the light is at full intensity.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere,
+		meta = (ClampMin = 0, ClampMax = 180, EditCondition = "LightType == ERaymarchLightType::Spot"))
+	float InnerConeAngle = 20.0f;
+
+	// Angle (in degrees) from the spot light's forward vector at which the light fades out completely.
+	UPROPERTY(BlueprintReadWrite, EditAnywhere,
+		meta = (ClampMin = 0, ClampMax = 180, EditCondition = "LightType == ERaymarchLightType::Spot"))
+	float OuterConeAngle = 30.0f;
+
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	UStaticMeshComponent* StaticMeshComponent;
 
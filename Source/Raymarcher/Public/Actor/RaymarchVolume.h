@@ -9,12 +9,16 @@
 #include "Actor/RaymarchLight.h"
 #include "CoreMinimal.h"
 #include "Math/IntVector.h"
+#include "Rendering/LightVolumeBricks.h"
+#include "Rendering/OccupancyProxy.h"
 #include "UObject/UnrealType.h"
 #include "VR/Grabbable.h"
 #include "VolumeAsset/VolumeAsset.h"
 
 #include "RaymarchVolume.generated.h"
 
+class UProceduralMeshComponent;
+
 DECLARE_LOG_CATEGORY_EXTERN(LogRaymarchVolume, Log, All);
 
 DECLARE_DYNAMIC_DELEGATE(FOnVolumeLoaded);
@@ -25,7 +29,9 @@ enum class ERaymarchMaterial : uint8
 {
 	Lit,
 	Intensity,
-	Octree
+	Octree,
+	/// Lit by a light at the camera, shadowed by the opacity along the view ray. Needs no light volume.
+	Headlight
 };
 
 UCLASS()
@@ -43,6 +49,12 @@ public:
 
 	virtual void OnConstruction(const FTransform& Transform) override;
 
+	/** Records the version of the saved properties, so that PostLoad knows which ones need migrating.*/
+	virtual void Serialize(FArchive& Ar) override;
+
+	/** Migrates properties saved by older versions of the plugin.*/
+	virtual void PostLoad() override;
+
 	/** Updates a single provided light affecting the LightVolume. */
 	void UpdateSingleLight(ARaymarchLight* UpdatedLight);
 
@@ -60,9 +72,51 @@ public:
 	UFUNCTION(BlueprintCallable)
 	bool SetVolumeAsset(UVolumeAsset* InVolumeAsset);
 
-	/** Use faster shader for light calculation. Leads to instability with more lights.*/
+	/** Propagate every light through the volume in a single dispatch using persistent thread groups, instead of a dispatch per
+		slice. Relies on thread groups waiting for each other on the GPU, which all desktop GPUs handle, but it's not guaranteed.
+		Takes precedence over bBatchLightPropagation when resetting lights. Replaces bFastShader, which was on by default - levels
+		saved before keep the setting they had.*/
+	UPROPERTY(EditAnywhere)
+	bool bSingleDispatchLightPropagation = false;
+
+	/** When resetting all lights, propagate lights going along the same axis together (up to 4 per sweep through the volume)
+		instead of doing a separate sweep for every light.*/
 	UPROPERTY(EditAnywhere)
-	bool bFastShader = true;
+	bool bBatchLightPropagation = true;
+
+	/** When only the clipping plane moved, recompute light starting at the first brick of the light volume the plane moved
+		through, instead of resetting all lights. Restarting needs checkpoints recorded by per-light or batched propagation, so
+		the first update after a single dispatch reset propagates every light through the whole volume.*/
+	UPROPERTY(EditAnywhere)
+	bool bLocalizedLightUpdate = true;
+
+	/** Spread resetting all lights over several frames instead of propagating them all in one frame. Lights get propagated into
+		a second light volume, rendering keeps using the current one until all of them are done and the light volumes get
+		swapped. Costs the memory of another light volume and changes show up a few frames late. Changing the transfer function,
+		windowing or volume transform during a reset starts it over.*/
+	UPROPERTY(EditAnywhere)
+	bool bAmortizeLightReset = false;
+
+	/** Number of frames an amortized light reset gets spread over. The work per frame is whole bricks of slices, so thin volumes
+		and many frames might finish sooner.*/
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "bAmortizeLightReset", ClampMin = 1))
+	int32 AmortizedLightResetFrames = 8;
+
+	/** GPU memory (in MB) for keeping copies of recently computed light volumes. Resetting all lights with the same lights,
+		transfer function, windowing, clipping plane and volume transform as one of the copies just copies it back instead of
+		propagating the lights. 0 disables the snapshots. The least recently used snapshots get dropped to stay within budget.*/
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+	int32 LightVolumeSnapshotBudgetMB = 0;
+
+	/** Propagates every light with both the per-slice and the single-dispatch shader and logs the difference between the
+		resulting light volumes. Resets all lights afterwards.*/
+	UFUNCTION(CallInEditor, Category = "Raymarcher")
+	void CompareSingleDispatchToPerSlice();
+
+	/** Propagates the current lights into temporary light volumes of every light volume format and logs the memory, time and
+		error of each. Leaves the actual light volume alone.*/
+	UFUNCTION(CallInEditor, Category = "Raymarcher")
+	void BenchmarkLightVolumeFormats();
 
 	/// Map for storing previous ticks parameters per-light. Used to detect changes.
 	UPROPERTY(Transient)
@@ -85,6 +139,149 @@ protected:
 	UFUNCTION()
 	void ResetAllLights();
 
+	/** Recalculates the light downstream of the dirty bricks of the light volume. **/
+	void UpdateDirtyLightBricks();
+
+	/** Bricks of the light volume the clipping plane moved through since the light volume was last propagated. **/
+	FLightVolumeDirtyBricks DirtyLightBricks;
+
+	/** World parameters the lights currently in the light volume were propagated with. **/
+	FRaymarchWorldParameters LightVolumeWorldParameters;
+
+	/** Resets all lights, either right away or by starting an amortized reset (see bAmortizeLightReset). **/
+	void StartLightReset();
+
+	/** Clears the back light volume and schedules propagating all current lights into it over the next frames. **/
+	void StartAmortizedLightReset();
+
+	/** Propagates this frame's share of the running amortized light reset. Swaps the light volumes once all lights are done. **/
+	void ContinueAmortizedLightReset();
+
+	/** Creates a light volume render target usable by the light propagation shaders. **/
+	UTextureRenderTargetVolume* CreateLightVolumeRenderTarget(
+		const FIntVector& Size, const EPixelFormat PixelFormat, const FName& Name);
+
+	/** Allocates the octree render target if the selected material uses the octree and releases it otherwise. The octree is about
+	 * as big as the data volume, so it's not worth keeping around for the other materials. **/
+	void UpdateOctreeAllocation();
+
+	/** Light volume an amortized light reset propagates into. Swapped with the one in RaymarchResources when the reset finishes.
+	 * Created on the first amortized reset. **/
+	UPROPERTY(Transient)
+	UTextureRenderTargetVolume* BackLightVolumeRenderTarget = nullptr;
+
+	/** State of a running amortized light reset. **/
+	struct FAmortizedLightReset
+	{
+		bool bRunning = false;
+
+		// Every axis of every light being propagated, each spanning the whole axis.
+		TArray<FDirLightPropagationChunk> Axes;
+
+		// Where to continue next frame.
+		int32 AxisIndex = 0;
+		int32 NextStep = 0;
+
+		// Light volume voxels to propagate each frame.
+		int64 VoxelsPerFrame = 0;
+
+		// Lights and world parameters the back light volume is being propagated with. Become the current ones after the swap.
+		TMap<ARaymarchLight*, FDirLightParameters> LightParametersMap;
+		FRaymarchWorldParameters WorldParameters;
+
+		// Snapshot key of the state the back light volume is being propagated with.
+		uint64 SnapshotKey = 0;
+
+		// Propagation parameters key (see GetPropagationParametersKey) every chunk has to be propagated with.
+		uint64 PropagationParametersKey = 0;
+	};
+
+	FAmortizedLightReset AmortizedLightReset;
+
+	/** Returns a hash of everything the light volume contents depend on - current lights, world parameters, windowing and
+	 * transfer function. **/
+	uint64 GetLightVolumeSnapshotKey() const;
+
+	/** Returns a hash of the windowing and transfer function, the parameters light propagation reads from RaymarchResources. **/
+	uint64 GetPropagationParametersKey() const;
+
+	/** Copies the snapshot with the current state's key into the light volume. Returns false if there is no such snapshot. **/
+	bool RestoreLightVolumeSnapshot();
+
+	/** Saves a copy of the light volume under Key, evicting the least recently used snapshots to stay within budget. **/
+	void SaveLightVolumeSnapshot(const uint64 Key);
+
+	/** Drops all light volume snapshots, e.g. because the light volume got recreated with a different size or format. **/
+	void EmptyLightVolumeSnapshots();
+
+	/** Copies of previously computed light volumes, least recently used first. **/
+	UPROPERTY(Transient)
+	TArray<UTextureRenderTargetVolume*> LightVolumeSnapshots;
+
+	/** Key (see GetLightVolumeSnapshotKey) of each of the light volume snapshots. **/
+	TArray<uint64> LightVolumeSnapshotKeys;
+
+	/** Sums the light groups into the resolved light volume using the current LightGroupWeights. **/
+	void ResolveLightGroups();
+
+	/** Set when the light volume changed since the light volumes derived from it (resolved light groups, light combined with
+	 * ambient occlusion) were last updated. **/
+	bool bLightVolumeChanged = false;
+
+	/** Weights the resolved light volume was resolved with. **/
+	FLinearColor ResolvedLightGroupWeights = FLinearColor(1.0f, 1.0f, 1.0f, 1.0f);
+
+	/** Computes the brick distances and step opacities with the current transfer function and windowing. **/
+	void UpdateBrickDistances();
+
+	/** Set when the brick distances need updating, e.g. because the brick map or transfer function changed. **/
+	bool bBrickDistanceUpdateNeeded = false;
+
+	/** Windowing parameters the brick distances were computed with. **/
+	FLinearColor BrickDistanceWindowingParameters = FLinearColor::Transparent;
+
+	/** Returns the EmptySpaceSkipping material parameter - the brick size, or 0 if skipping is disabled. **/
+	float GetEmptySpaceSkippingParameter() const;
+
+	/** Returns true if the brick map and brick distances need to be kept up to date, for the material or light propagation. **/
+	bool AreBrickDistancesUsed() const;
+
+	/** Returns true if the volume gets drawn with the occupancy proxy instead of the cube. **/
+	bool IsOccupancyProxyUsed() const;
+
+	/** Reads the brick occupancy back after every brick distance update, for rebuilding the occupancy proxy. **/
+	FBrickOccupancyReadback OccupancyReadback;
+
+	/** Rebuilds the occupancy proxy mesh if an occupancy readback arrived. **/
+	void UpdateOccupancyProxy();
+
+	/** Shows either the occupancy proxy or the cube, depending on whether the proxy is used and was built yet. **/
+	void UpdateOccupancyProxyVisibility();
+
+	/** Set once the occupancy proxy mesh was built from a readback. **/
+	bool bOccupancyProxyBuilt = false;
+
+	/** Computes the ambient occlusion volume with the current transfer function and windowing. **/
+	void ComputeAmbientOcclusion();
+
+	/** Adds the occluded ambient light to the (resolved) light volume. **/
+	void CombineAmbientOcclusion();
+
+	/** Set when the ambient occlusion volume needs computing, e.g. because the transfer function changed. **/
+	bool bAmbientOcclusionRecomputeNeeded = false;
+
+	/** Set when the ambient occlusion volume changed since it was last combined with the light volume. **/
+	bool bAmbientOcclusionCombineNeeded = false;
+
+	/** Windowing parameters the ambient occlusion volume was computed with. **/
+	FLinearColor AmbientOcclusionWindowingParameters = FLinearColor::Transparent;
+
+	/** Ambient intensity the combined light volume was combined with. **/
+	float CombinedAmbientIntensity = 0.0f;
+
+	/** Returns the volume the lit material should sample light from. **/
+	UTexture* GetMaterialLightVolume() const;
+
 public:
 #if WITH_EDITOR
 	/** Fired when curve gradient is updated.*/
@@ -138,6 +335,11 @@ public:
 	UPROPERTY(BlueprintReadOnly, EditAnywhere)
 	UMaterial* OctreeRaymarchMaterialBase;
 
+	/** The base material for headlight rendering. Should call PerformWindowedHeadlightRaymarch from
+		WindowedRaymarchMaterials.usf, with the HeadlightShadowStrength and HeadlightGradientShading scalar parameters.*/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere)
+	UMaterial* HeadlightRaymarchMaterialBase = nullptr;
+
 	/** Dynamic material instance for Lit rendering*/
 	UPROPERTY(BlueprintReadOnly, Transient)
 	UMaterialInstanceDynamic* LitRaymarchMaterial = nullptr;
@@ -150,10 +352,18 @@ public:
 	UPROPERTY(BlueprintReadOnly, Transient)
 	UMaterialInstanceDynamic* OctreeRaymarchMaterial = nullptr;
 
+	/** Dynamic material instance for headlight rendering*/
+	UPROPERTY(BlueprintReadOnly, Transient)
+	UMaterialInstanceDynamic* HeadlightRaymarchMaterial = nullptr;
+
 	/** Cube border mesh - this is just a cube with wireframe borders.**/
 	UPROPERTY(VisibleAnywhere)
 	UStaticMeshComponent* CubeBorderMeshComponent = nullptr;
 
+	/** Box bounding the visible bricks, drawn with the lit material instead of the cube when bOccupancyBoundsProxy is set.**/
+	UPROPERTY(VisibleAnywhere)
+	UProceduralMeshComponent* OccupancyProxyComponent = nullptr;
+
 	/** The clipping plane affecting this volume.**/
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	ARaymarchClipPlane* ClippingPlane = nullptr;
@@ -168,6 +378,15 @@ public:
 	/** If set to true, octree will be recomputed on next tick.**/
 	bool bRequestedOctreeRebuild = false;
 
+	/** If set to true, the brick map will be regenerated on next tick.**/
+	bool bRequestedBrickMapRebuild = false;
+
+	/** Boxes of data volume voxels that changed since the last tick, see MarkVolumeRegionsDirty().**/
+	TArray<FRaymarchVoxelBox> DirtyVolumeBoxes;
+
+	/** Regenerates the parts of the octree, brick map and light volume that depend on the voxels in DirtyVolumeBoxes. **/
+	void UpdateDirtyVolumeRegions();
+
 	/** Raymarch the volume based on defined material. **/
 	UPROPERTY(EditAnywhere)
 	ERaymarchMaterial SelectRaymarchMaterial;
@@ -188,15 +407,142 @@ public:
 	UPROPERTY(EditAnywhere)
 	float RaymarchingSteps = 150;
 
+	/** Accumulated opacity at which a ray of the lit material stops marching. Lower values end rays sooner behind opaque parts of
+		the volume, at the cost of letting a bit of what's behind them show through. Needs a lit material passing the
+		TerminationOpacity scalar parameter to the raymarch function in WindowedRaymarchMaterials.usf.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0.5, ClampMax = 1, EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	float RaymarchTerminationOpacity = 0.95f;
+
+	/** Most steps a ray of the lit material can take, 0 for no limit. Pixels whose path through the volume would take more steps
+		spread this many over the whole path as longer steps, so the cost of every pixel stays bounded whatever the view direction
+		(e.g. for VR). Needs a lit material passing the MaxStepsPerPixel scalar parameter to the raymarch function.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0, EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	int32 MaxRaymarchStepsPerPixel = 0;
+
+	/** Number of octree mips, including the finest one with a node per voxel. Every mip halves the resolution of the previous
+		one, down to at most a single node along the volume's shortest axis.	**/
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 2, ClampMax = 12))
+	int32 OctreeNumMips = 4;
+
 	/** Define mip level that octree raymarch material will render.**/
 	UPROPERTY(EditAnywhere,meta=(EditCondition="SelectRaymarchMaterial==ERaymarchMaterial::Octree", EditConditionHides))
 	uint32 OctreeVolumeMip = 0;
 
-	/** If true, the light volume texture will be created using R32F format instead of the standard G8. This allows
-		Illumination values greater than 1 (over-lighted) to be visible. Comes at the cost of 4x memory consumption and
-		noticeably (but not significantly, in the ballpark of 10%) slower illumination calculation and materials.	**/
+	/** How much the headlight gets occluded by the samples in front of the current one. 0 disables shadowing.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0, ClampMax = 1, EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Headlight",
+			EditConditionHides))
+	float HeadlightShadowStrength = 1.0f;
+
+	/** How much surfaces seen edge-on are darkened by the headlight, using the data gradient. 0 skips the gradient samples.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0, ClampMax = 1, EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Headlight",
+			EditConditionHides))
+	float HeadlightGradientShading = 0.5f;
+
+	/** If true, the lit material leaps through bricks that are fully transparent under the current windowing and transfer
+		function. Needs a lit material calling PerformWindowedLitRaymarchSkipping from WindowedRaymarchMaterials.usf with the
+		BrickDistanceVolume texture and EmptySpaceSkipping scalar parameters. Changing the transfer function or windowing only
+		updates the brick distances, the brick map itself doesn't get regenerated. Off by default, as the lit material shipped
+		with the plugin doesn't skip empty space, so keeping the brick distances up to date for it would be wasted.	**/
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	bool bEmptySpaceSkipping = false;
+
+	/** Length of the side of an empty space skipping brick, in voxels. Smaller bricks skip closer to the visible data, bigger
+		ones take less memory and time to update. **/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 4, ClampMax = 32,
+			EditCondition =
+				"bEmptySpaceSkipping || bLightPropagationEmptySpaceSkipping || AdaptiveStepMaxScale > 1 || bOccupancyBoundsProxy",
+			EditConditionHides))
+	int32 EmptySpaceSkippingBrickSize = 8;
+
+	/** If true, propagating directional lights doesn't sample the volume and transfer function in bricks that are fully
+		transparent under the current windowing and transfer function, the light just passes through them. The lit result is the
+		same, recomputing lights gets cheaper the more empty space the volume has. Keeps the brick distances up to date even when
+		the material doesn't skip empty space. **/
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	bool bLightPropagationEmptySpaceSkipping = true;
+
+	/** How many times longer than the base step (see RaymarchingSteps) a step of the lit material can get in transparent or
+		homogeneous bricks. Bricks where the transfer function gets opaque keep the base step. 1 takes every step with the base
+		length. Needs a lit material calling PerformWindowedLitRaymarchAdaptive from WindowedRaymarchMaterials.usf with the
+		BrickStepOpacityVolume texture and BrickSize and AdaptiveStepScale scalar parameters.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 1, ClampMax = 16, EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	float AdaptiveStepMaxScale = 1.0f;
+
+	/** If true, the lit material is drawn on a single box bounding all bricks that are visible under the current windowing and
+		transfer function, instead of the whole cube. Pixels whose rays miss those bounds then don't run the raymarch at all, but
+		empty bricks inside the bounds are still drawn and separate clusters of visible bricks share one box. The box gets
+		rebuilt from a readback of the brick distances, so it lags a few frames behind transfer function and windowing
+		changes. A lit material can also start and end its rays at the bounds of the visible bricks by passing the
+		OccupancyBoundsMin and OccupancyBoundsMax vector parameters to PerformRaymarchCubeSetup.	**/
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "SelectRaymarchMaterial==ERaymarchMaterial::Lit", EditConditionHides))
+	bool bOccupancyBoundsProxy = false;
+
+	/** Format of the light volume texture. Anything but G8 allows illumination values greater than 1 (over-lighted) to be
+		visible, at the cost of more memory and slower illumination calculation. See ERaymarchLightVolumeFormat, or run
+		BenchmarkLightVolumeFormats to see the trade-off for this volume.	**/
 	UPROPERTY(EditAnywhere)
-	bool bLightVolume32Bit = false;
+	ERaymarchLightVolumeFormat LightVolumeFormat = ERaymarchLightVolumeFormat::G8;
+
+	/** Factor the light volume is scaled down by along each axis, compared to the data volume. (2, 2, 2) means 1/8 of the voxels
+		and roughly 1/8 of the light propagation time. The lit material interpolates the light volume, see
+		RAYMARCH_EDGE_AWARE_LIGHT_UPSAMPLING in WindowedRaymarchMaterials.usf for hiding the lower resolution at edges.	**/
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 1, EditCondition = "LightVolumeVoxelBudget <= 0"))
+	FVector LightVolumeDownscale = FVector(1.0, 1.0, 1.0);
+
+	/** If above zero, the light volume is sized to have at most this many voxels instead of using LightVolumeDownscale, with the
+		voxels as close to cubes in world space as the data volume's spacing allows. E.g. 16777216 for a 256^3 light volume.	**/
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 0))
+	int64 LightVolumeVoxelBudget = 0;
+
+	/** Weight of each light group (see ARaymarchLight::LightGroup) when resolving a light group volume. Changing these doesn't
+		need the lights to be propagated again.	**/
+	UPROPERTY(EditAnywhere, meta = (EditCondition = "LightVolumeFormat==ERaymarchLightVolumeFormat::RGBA16FLightGroups"))
+	FLinearColor LightGroupWeights = FLinearColor(1.0f, 1.0f, 1.0f, 1.0f);
+
+	/** What the lit material gets its light from - propagated directional lights, ambient occlusion or both. Ambient occlusion
+		only depends on the transfer function and windowing, so moving lights or the clipping plane doesn't recompute it.	**/
+	UPROPERTY(EditAnywhere)
+	ERaymarchLightingModel LightingModel = ERaymarchLightingModel::DirectionalLights;
+
+	/** Factor the ambient occlusion volume is scaled down by along each axis, compared to the data volume.	**/
+	UPROPERTY(EditAnywhere, meta = (ClampMin = 1, EditCondition = "LightingModel!=ERaymarchLightingModel::DirectionalLights"))
+	int32 AmbientOcclusionDownscale = 4;
+
+	/** How far away voxels still occlude, as a fraction of the volume's longest side.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0.01, ClampMax = 1, EditCondition = "LightingModel!=ERaymarchLightingModel::DirectionalLights"))
+	float AmbientOcclusionRadius = 0.15f;
+
+	/** Intensity of the ambient light added to the directional lights. Changing it doesn't need the lights to be propagated
+		again.	**/
+	UPROPERTY(EditAnywhere,
+		meta = (ClampMin = 0, EditCondition = "LightingModel==ERaymarchLightingModel::DirectionalLightsWithAmbientOcclusion"))
+	float AmbientIntensity = 0.3f;
+
+	/** Replaced by LightVolumeFormat, only kept to load older levels. **/
+	UPROPERTY()
+	bool bLightVolume32Bit_DEPRECATED = false;
+
+	/** Replaced by bSingleDispatchLightPropagation, only kept to load older levels. Keeps the old default, which levels didn't
+		save. **/
+	UPROPERTY()
+	bool bFastShader_DEPRECATED = true;
+
+	/** Replaced by bOccupancyBoundsProxy, only kept to load older levels. **/
+	UPROPERTY()
+	bool bOccupancyProxy_DEPRECATED = false;
+
+	/** Block compression used for the data texture of volumes loaded with LoadMHDFileIntoVolumeNormalized.
+		BC4 quarters the memory and bandwidth of G16 volumes, BC6H halves it at better precision. The resulting PSNR is saved
+		in the VolumeAsset's ImageInfo. **/
+	UPROPERTY(EditAnywhere)
+	EVolumeBlockCompression DataVolumeCompression = EVolumeBlockCompression::None;
 
 	/** Switches to using a new Transfer function curve.**/
 	UFUNCTION(BlueprintCallable)
@@ -229,6 +575,21 @@ public:
 	 * provided in Volume-Local space. **/
 	void SetMaterialClippingParameters();
 
+	/** Sets the headlight shadow strength and gradient shading to the headlight material.**/
+	void SetMaterialHeadlightParameters();
+
+	/** Selects the lit material instead of the headlight material if there's no HeadlightRaymarchMaterialBase to render with.**/
+	void FallBackFromMissingHeadlightMaterial();
+
+	/** Returns true if the currently selected material reads the octree, so it needs to be kept up to date.**/
+	bool IsOctreeUsed() const;
+
+	/** Call after changing parts of the data volume texture (e.g. streaming in bricks or editing a segmentation). On the next
+	 * tick only the octree nodes and bricks containing the changed voxels get regenerated, instead of all of them. Lights get
+	 * recomputed fully. Boxes are in data volume voxels.**/
+	UFUNCTION(BlueprintCallable)
+	void MarkVolumeRegionsDirty(const TArray<FRaymarchVoxelBox>& DirtyBoxes);
+
 	/** API function to get the Min and Max values of the current VolumeAsset file.**/
 	UFUNCTION(BlueprintPure)
 	void GetMinMaxValues(float& Min, float& Max);
@@ -264,4 +625,9 @@ public:
 	/** Sets the maximum amount of steps to be taken when raymarching.**/
 	UFUNCTION(BlueprintCallable)
 	void SetRaymarchSteps(float InRaymarchingSteps);
+
+	/** Sets the opacity at which lit rays stop and the most steps a lit ray can take (0 for no limit), e.g. to switch to a
+		tighter budget while rendering to a headset.	**/
+	UFUNCTION(BlueprintCallable)
+	void SetRaymarchBudget(float InTerminationOpacity, int32 InMaxStepsPerPixel);
 };
@@ -0,0 +1,121 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DataDrivenShaderPlatformInfo.h"
+#include "GlobalShader.h"
+#include "RHICommandList.h"
+#include "RenderGraphResources.h"
+#include "Rendering/LightingShaders.h"
+#include "Rendering/RaymarchTypes.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderParameterUtils.h"
+#include "ShaderParameters.h"
+
+// Computes the ambient occlusion volume in Resources.AmbientOcclusionVolumeRenderTarget. The transfer function mapped opacity
+// gets downsampled to the ambient occlusion volume's resolution and mip-mapped, then every voxel traces cones in a fixed set of
+// directions through the mips. Radius is the distance the cones are traced to, as a fraction of the volume's longest side.
+// The clipping plane is ignored, so that only transfer function or windowing changes need a recompute.
+void ComputeAmbientOcclusion_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const float Radius);
+
+void AddComputeAmbientOcclusionPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef AmbientOcclusionVolume,
+	const FBasicRaymarchRenderingResources& Resources, const float Radius);
+
+// Writes the light volume (or the resolved light volume for light groups) with AmbientIntensity times the ambient occlusion added
+// into Resources.CombinedLightVolumeRenderTarget.
+void CombineAmbientOcclusion_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const float AmbientIntensity);
+
+void AddCombineAmbientOcclusionPass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume, FRDGTextureRef AmbientOcclusionVolume,
+	FRDGTextureRef CombinedLightVolume, const float AmbientIntensity);
+
+// Maximum number of mips of the opacity volume ambient occlusion cones are traced through.
+#define RAYMARCH_AMBIENT_OCCLUSION_MAX_MIPS 5
+
+// Downsamples the transfer function mapped opacity of the data volume into the first mip of the ambient occlusion opacity volume.
+class FAmbientOcclusionOpacityShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FAmbientOcclusionOpacityShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FAmbientOcclusionOpacityShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Opacity of a single step through a voxel of the opacity volume.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, OpacityVolume)
+		// Step size of a single opacity volume voxel.
+		SHADER_PARAMETER(float, StepSize)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Averages 2x2x2 voxels of one opacity volume mip into the next one.
+class FDownsampleAmbientOcclusionOpacityShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FDownsampleAmbientOcclusionOpacityShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FDownsampleAmbientOcclusionOpacityShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture3D<float>, SourceMip)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, DestinationMip)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Traces cones from every ambient occlusion voxel through the mips of the opacity volume and stores the average visibility.
+class FComputeAmbientOcclusionShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FComputeAmbientOcclusionShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FComputeAmbientOcclusionShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float>, OpacityVolume)
+		SHADER_PARAMETER_SAMPLER(SamplerState, OpacityVolumeSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, AmbientOcclusionVolume)
+		// Distance to trace the cones to, in opacity volume voxels.
+		SHADER_PARAMETER(float, Radius)
+		// Highest mip of the opacity volume.
+		SHADER_PARAMETER(float, MaxMip)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Adds ambient light occluded by the ambient occlusion volume to a light volume. The packed light volume permutation writes colored
+// light volumes, adding the ambient light to all three colors.
+class FCombineAmbientOcclusionShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FCombineAmbientOcclusionShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FCombineAmbientOcclusionShader, FGlobalShader);
+
+	using FPermutationDomain = TShaderPermutationDomain<FPackedLightVolumeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float4>, LightVolume)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float>, AmbientOcclusionVolume)
+		SHADER_PARAMETER_SAMPLER(SamplerState, AmbientOcclusionVolumeSampler)
+		// Combined light volume to write (float4 in the packed light volume permutation).
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, CombinedLightVolume)
+		SHADER_PARAMETER(float, AmbientIntensity)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
@@ -0,0 +1,132 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DataDrivenShaderPlatformInfo.h"
+#include "GlobalShader.h"
+#include "RHICommandList.h"
+#include "RenderGraphResources.h"
+#include "Rendering/RaymarchTypes.h"
+#include "ShaderParameterStruct.h"
+#include "ShaderParameterUtils.h"
+#include "ShaderParameters.h"
+
+// A brick map splits the volume into bricks of BrickSize^3 voxels and stores the minimum and maximum value of every brick
+// (including the voxels around it). A brick distance volume of the same size then stores the Chebyshev distance (in bricks) from
+// every brick to the closest one that can be visible under the current transfer function and windowing. Materials use it to leap
+// through empty space in a single step (see GetEmptySpaceSkipSteps() in WindowedRaymarchMaterials.usf). A brick step opacity
+// volume stores the highest transfer function opacity within every brick, for picking adaptive step lengths (see
+// GetAdaptiveStepScale()).
+
+// Returns the size of the brick map of a volume of VolumeSize, one brick per started BrickSize^3 voxels.
+RAYMARCHER_API FIntVector GetBrickMapSize(const FIntVector& VolumeSize, int32 BrickSize);
+
+// Generates Resources.BrickMapRenderTarget from the data volume. Only needs rerunning when the data changes.
+void GenerateBrickMap_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources);
+
+// Adds the brick map generation pass to the render graph. BrickMap is the registered BrickMapRenderTarget from the resources.
+void AddGenerateBrickMapPass(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap, const FBasicRaymarchRenderingResources& Resources);
+
+// Regenerates only the bricks whose voxels (including the ones around them) overlap DirtyBoxes, for when only parts of the data
+// volume changed. The brick distances need recomputing afterwards.
+void UpdateBrickMapRegions_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, TArray<FRaymarchVoxelBox> DirtyBoxes);
+
+// Adds the passes regenerating the bricks overlapping DirtyBoxes to the render graph, one per (merged) box of bricks.
+void AddUpdateBrickMapRegionsPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes);
+
+// Computes Resources.BrickDistanceRenderTarget and BrickStepOpacityRenderTarget from the brick map with the resources' current
+// transfer function and windowing. Only needs rerunning when the brick map, transfer function or windowing change.
+void ComputeBrickDistances_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources);
+
+// Adds the brick occupancy and distance transform passes to the render graph. BrickMap, BrickDistance and BrickStepOpacity are the
+// registered render targets from the resources.
+void AddComputeBrickDistancePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef BrickMap, FRDGTextureRef BrickDistance,
+	FRDGTextureRef BrickStepOpacity, const FBasicRaymarchRenderingResources& Resources);
+
+// Generates the brick map of a volume, one thread group per brick.
+class FGenerateBrickMapShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FGenerateBrickMapShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FGenerateBrickMapShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		// Volume texture to generate the brick map from.
+		SHADER_PARAMETER_TEXTURE(Texture3D, Volume)
+		SHADER_PARAMETER(int32, BrickSize)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, BrickMap)
+		// First brick to generate.
+		SHADER_PARAMETER(FIntVector, BrickOffset)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Counts the transfer function texels with opacity up to every texel, so that a range of the transfer function can be checked
+// for being fully transparent in constant time.
+class FTFOpacityPrefixShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FTFOpacityPrefixShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FTFOpacityPrefixShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_TEXTURE(Texture2D, TransferFunc)
+		SHADER_PARAMETER(int32, TFWidth)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, TFOpacityPrefix)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Marks the bricks whose value range gets any opacity from the transfer function with a distance of 0, all others with
+// MaxDistance. Also stores the highest opacity the transfer function gives the range of every brick that isn't homogeneous.
+class FBrickOccupancyShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FBrickOccupancyShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FBrickOccupancyShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float2>, BrickMap)
+		SHADER_PARAMETER_TEXTURE(Texture2D, TransferFunc)
+		SHADER_PARAMETER_RDG_BUFFER_SRV(Buffer<uint>, TFOpacityPrefix)
+		SHADER_PARAMETER(int32, TFWidth)
+		SHADER_PARAMETER(FVector4f, WindowingParameters)
+		SHADER_PARAMETER(int32, MaxDistance)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, BrickDistance)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, BrickStepOpacity)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// One pass of the separable brick distance transform, along Axis.
+class FBrickDistanceShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FBrickDistanceShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FBrickDistanceShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float>, SourceDistance)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, DestinationDistance)
+		SHADER_PARAMETER(FIntVector, Axis)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
@@ -0,0 +1,131 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RendererInterface.h"
+#include "Rendering/LightingShaderUtils.h"
+#include "Rendering/RaymarchTypes.h"
+
+// Edge length (in light volume voxels) of the bricks the light volume is split into for dirty tracking. Propagation also stores
+// a checkpoint every this many slices, so that it can restart at the brick containing the first dirty slice.
+#define RAYMARCH_LIGHT_VOLUME_BRICK_SIZE 16
+
+/** Keeps track of which bricks of a light volume contain voxels whose opacity changed since the light volume was last propagated.
+ * Light at a voxel only depends on voxels between it and the light, so propagation along an axis only needs to be redone from the
+ * first dirty brick onward. Game thread only, a copy gets sent to the render thread with every update. */
+class RAYMARCHER_API FLightVolumeDirtyBricks
+{
+public:
+	FLightVolumeDirtyBricks() = default;
+
+	/// Splits a light volume of the given size into bricks. All bricks start clean.
+	void Init(const FIntVector& InLightVolumeSize);
+
+	/// Marks all bricks the clipping plane might have moved through. Both clipping parameters are in local (0-1) volume space,
+	/// as returned by GetLocalClippingParameters.
+	void MarkClippingPlaneMoved(const FClippingPlaneParameters& OldLocalClipping, const FClippingPlaneParameters& NewLocalClipping);
+
+	/// Marks every brick dirty.
+	void MarkAll();
+
+	/// Marks all bricks clean. Call after the light volume got propagated with the current state.
+	void Reset();
+
+	/// Returns true if any brick is dirty.
+	bool IsDirty() const
+	{
+		return NumDirty > 0;
+	}
+
+	/// Returns the number of dirty bricks.
+	int32 GetNumDirty() const
+	{
+		return NumDirty;
+	}
+
+	/// Returns the number of bricks the light volume is split into.
+	int32 GetNumBricks() const
+	{
+		return DirtyBits.Num();
+	}
+
+	/// Returns how many slices a light entering the volume through Face passes before reaching the first dirty brick. Returns the
+	/// number of slices along that axis if no brick is dirty.
+	int32 GetFirstDirtyStep(FCubeFace Face) const;
+
+private:
+	int32 GetBrickIndex(int32 X, int32 Y, int32 Z) const
+	{
+		return X + NumBricks.X * (Y + NumBricks.Y * Z);
+	}
+
+	void MarkBrick(int32 X, int32 Y, int32 Z);
+
+	FIntVector LightVolumeSize = FIntVector::ZeroValue;
+	FIntVector NumBricks = FIntVector::ZeroValue;
+
+	// One bit per brick.
+	TBitArray<> DirtyBits;
+	int32 NumDirty = 0;
+
+	// Lowest and highest brick index containing a dirty brick along each axis, so that GetFirstDirtyStep doesn't need to go
+	// through all the bricks.
+	FIntVector MinDirtyBrick = FIntVector::ZeroValue;
+	FIntVector MaxDirtyBrick = FIntVector::ZeroValue;
+};
+
+/** A part of a single light's propagation along one of it's axes. Used to spread propagating lights over several frames. */
+struct FDirLightPropagationChunk
+{
+	FDirLightParameters LightParameters;
+
+	// Index of the light's major axis to propagate along (0 or 1).
+	uint32 AxisIndex = 0;
+
+	// Slices (counted from the face the light enters through) to propagate. StartStep has to be at a brick boundary and EndStep
+	// either at a brick boundary or at the end of the axis, so that the next chunk can continue from the checkpoint between them.
+	int32 StartStep = 0;
+	int32 EndStep = 0;
+};
+
+/** Light propagated through the volume, stored every RAYMARCH_LIGHT_VOLUME_BRICK_SIZE slices for both axes a light propagates
+ * along. Slice N of a checkpoint texture holds the light entering slice (N + 1) * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE (counted from
+ * the face the light enters through). */
+struct FLightPropagationCheckpoints
+{
+	// The (world space) light these were recorded for.
+	FDirLightParameters LightParameters;
+
+	// Face each axis propagated from.
+	FCubeFace Faces[2] = {FCubeFace::XPositive, FCubeFace::XPositive};
+
+	// Texture array per axis. Null if the axis wasn't propagated or it's too thin to need any checkpoints.
+	TRefCountPtr<IPooledRenderTarget> Textures[2];
+};
+
+/** All propagation checkpoints recorded for the lights in one light volume. Render thread only - checkpoints are only valid as long
+ * as the light volume contents they were recorded with, so they need to be emptied whenever all lights get reset. */
+class RAYMARCHER_API FLightPropagationCheckpointCache
+{
+public:
+	~FLightPropagationCheckpointCache();
+
+	/// Returns the checkpoints recorded for a light with exactly these parameters, or nullptr if there are none.
+	FLightPropagationCheckpoints* Find(const FDirLightParameters& LightParameters);
+
+	/// Returns the checkpoints for a light, adding an empty entry if there are none yet.
+	FLightPropagationCheckpoints& FindOrAdd(const FDirLightParameters& LightParameters);
+
+	/// Forgets the checkpoints recorded for a light (e.g. because it got removed from the light volume).
+	void Remove(const FDirLightParameters& LightParameters);
+
+	/// Forgets all checkpoints.
+	void Empty();
+
+private:
+	TArray<FLightPropagationCheckpoints> Entries;
+};
@@ -0,0 +1,95 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Rendering/LightingShaderUtils.h"
+#include "Rendering/RaymarchTypes.h"
+#include "VolumeAsset/WindowingParameters.h"
+
+class UTexture2D;
+class UTextureRenderTargetVolume;
+class UVolumeTexture;
+
+// A CPU implementation of the slice-by-slice light propagation in AddDirLightShader.usf and ChangeDirLightShader.usf. It goes
+// through the same steps with the same helpers (GetLocalLightParamsAndAxes, GetUVOffset, GetStepSizeAndUVWOffset...) and samples
+// textures the way the GPU samplers do, so that it can serve as a reference the GPU light volume is checked against and as an
+// offline light volume baker. Slices are propagated one after another, the rows of a slice in parallel.
+//
+// Only directional lights are supported and the light volume is single channel - packed light volumes are treated as if every
+// light went into all channels with a weight of 1.
+
+/** Everything light propagation reads from the data volume, copied to the CPU. */
+struct RAYMARCHER_API FRaymarchCPUVolumeData
+{
+	/// Size of the data volume in voxels.
+	FIntVector Size = FIntVector::ZeroValue;
+
+	/// Voxel values the way shaders read them (normalized to 0-1 for integer formats), X changing fastest.
+	TArray<float> Values;
+
+	/// Samples of the (1D) transfer function texture.
+	TArray<FLinearColor> TransferFunction;
+
+	FWindowingParameters WindowingParameters;
+
+	/// Copies the data volume and the first row of the transfer function texture. Both need their CPU side mip data, which
+	/// textures created by the VolumeTextureToolkit keep. Supports G8, G16, R16F and R32F data volumes and RGBA16F transfer
+	/// functions. Returns false if the textures can't be read.
+	bool InitFromTextures(UVolumeTexture* DataVolume, UTexture2D* TransferFunctionTexture, const FWindowingParameters& Windowing);
+
+	/// Samples the volume trilinearly at UVW (0-1 space). Reading outside the volume returns the windowing zero point, like the
+	/// data volume sampler returned by GetDataVolumeSamplerRef.
+	float SampleVolume(const FVector& UVW) const;
+
+	/// Returns the transfer function mapped opacity of Value after travelling StepSize (in Unreal units), same as
+	/// SampleWindowedTransferFunction() in WindowedSampling.usf.
+	float SampleWindowedOpacity(float Value, float StepSize) const;
+};
+
+/** A single channel light volume on the CPU. Every write gets rounded to the precision of Format, like writes to the light volume
+ * render target would be. */
+struct RAYMARCHER_API FRaymarchCPULightVolume
+{
+	/// Size of the light volume in voxels.
+	FIntVector Size = FIntVector::ZeroValue;
+
+	/// The format the GPU light volume would be created with. Packed formats get the precision of their channels.
+	ERaymarchLightVolumeFormat Format = ERaymarchLightVolumeFormat::R32F;
+
+	/// Light in every voxel, X changing fastest.
+	TArray<float> Voxels;
+
+	/// Allocates the light volume, filled with zeros.
+	void Init(const FIntVector& InSize, ERaymarchLightVolumeFormat InFormat);
+
+	/// Returns the largest absolute difference to another light volume of the same size and counts voxels differing by more than
+	/// Tolerance.
+	float GetMaxDifference(const FRaymarchCPULightVolume& Other, float Tolerance, int64& OutMismatchedVoxels) const;
+
+	/// Returns the voxels converted to a G8, R16F or R32F pixel format, ready to be put into a volume texture.
+	TArray<uint8> ToBulkData(EPixelFormat PixelFormat) const;
+
+	int64 GetIndex(const FIntVector& Pos) const
+	{
+		return Pos.X + (int64) Size.X * (Pos.Y + (int64) Size.Y * Pos.Z);
+	}
+};
+
+/// Adds (or removes) a directional light to the light volume, same as AddDirLightToSingleLightVolume_RenderThread.
+RAYMARCHER_API void AddDirLightToCPULightVolume(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const FDirLightParameters& LightParameters, const bool Added, const FRaymarchWorldParameters& WorldParameters);
+
+/// Replaces a directional light in the light volume with another one, same as ChangeDirLightInSingleLightVolume_RenderThread.
+/// Lights propagating along the same major axes get propagated together, otherwise the old one is removed and the new one added.
+RAYMARCHER_API void ChangeDirLightInCPULightVolume(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const FDirLightParameters& OldLightParameters, const FDirLightParameters& NewLightParameters,
+	const FRaymarchWorldParameters& WorldParameters);
+
+/// Compares a single channel light volume render target with a CPU light volume of the same size on the GPU. Blocks until the
+/// render thread and the GPU are done.
+RAYMARCHER_API void CompareLightVolumeWithCPUReference(UTextureRenderTargetVolume* LightVolume,
+	const FRaymarchCPULightVolume& Reference, float Tolerance, float& OutMaxDifference, uint32& OutMismatchedVoxels);
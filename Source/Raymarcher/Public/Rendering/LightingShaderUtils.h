@@ -9,6 +9,7 @@
 #include "RHICommandList.h"
 #include "RHIResources.h"
 #include "RaymarchTypes.h"
+#include "RenderGraphDefinitions.h"
 
 #include <algorithm>	// std::sort
 #include <utility>		// std::pair, std::make_pair
@@ -55,17 +56,13 @@ struct FMajorAxes
 };
 
 /// Returns the dimensions of the plane cutting through the volume when going along an axis at the given indes.
-FIntVector GetTransposedDimensions(const FMajorAxes& Axes, const FRHITexture3D* VolumeRef, const unsigned index);
+FIntVector GetTransposedDimensions(const FMajorAxes& Axes, const FIntVector& VolumeSize, const unsigned index);
 
 /// Returns +1 if going along the specified axis index means increasing the index.
 /// Returns -1 if going along the axis decreases the index.
 /// E.G. if we're going along +X axis, will return 1, going along -X will return -1.
 int GetAxisDirection(const FMajorAxes& Axes, unsigned index);
 
-/// Returns the ReadWriteBuffer resource appropriate for the axis index.
-OneAxisReadWriteBufferResources& GetBuffers(
-	const FMajorAxes& Axes, const unsigned index, FBasicRaymarchRenderingResources& InParams);
-
 // Comparison function for a Face-weight pair, to sort in Descending order.
 static bool SortDescendingWeights(const std::pair<FCubeFace, float>& a, const std::pair<FCubeFace, float>& b);
 
@@ -86,10 +83,21 @@ void GetLocalLightParamsAndAxes(const FDirLightParameters& LightParameters, cons
 /// The color read from outside the buffer is specified by the BorderColorInt.
 FSamplerStateRHIRef GetBufferSamplerRef(uint32 BorderColorInt);
 
+/// Creates a trilinear SamplerState RHI for the data volume. Reading outside of the volume returns the zero point of the
+/// windowing parameters, so that it maps to 0 on the transfer function and doesn't occlude light.
+FSamplerStateRHIRef GetDataVolumeSamplerRef(const FWindowingParameters& WindowingParams);
+
+/// Returns the integer specifying the border color of the data volume sampler.
+uint32 GetDataVolumeBorderColorInt(const FWindowingParameters& WindowingParams);
+
 /// Returns the integer specifying the color needed for the border sampler.
 /// Used for sampling the light outside the edge of the Read buffer.
 uint32 GetBorderColorIntSingle(FDirLightParameters LightParams, FMajorAxes MajorAxes, unsigned index);
 
+/// Returns the integer specifying the color needed for the border sampler of a batched (RGBA) buffer.
+/// Every channel holds one light's alpha, quantized the same way as in GetBorderColorIntSingle.
+uint32 GetBorderColorIntBatched(const FVector4f& LightAlphas);
+
 /// Returns clipping parameters from global world parameters.
 FClippingPlaneParameters GetLocalClippingParameters(const FRaymarchWorldParameters WorldParameters);
 
@@ -104,6 +112,35 @@ FMatrix GetPermutationMatrix(FMajorAxes MajorAxes, unsigned index);
 void GetLoopStartStopIndexes(
 	int& OutStart, int& OutStop, int& OutAxisDirection, const FMajorAxes& MajorAxes, const unsigned& index, const int zDimension);
 
-// Used for swapping read/write buffers - transitions one to Readable and other to Writable.
-void TransitionBufferResources(
-	FRHICommandListImmediate& RHICmdList, FRHITexture* NewlyReadableTexture, FRHIUnorderedAccessView* NewlyWriteableUAV);
+/// Registers the light volume in the render graph. After the graph executes, the light volume is left readable by materials.
+FRDGTextureRef RegisterLightVolume(FRDGBuilder& GraphBuilder, const FBasicRaymarchRenderingResources& Resources);
+
+/// Creates a read/write buffer for propagating light along the axis with the given transposed dimensions.
+/// The buffer only lives for the duration of the graph, so it's memory is pooled and can be aliased with other transient textures.
+FRDGTextureRef CreatePropagationBuffer(
+	FRDGBuilder& GraphBuilder, const FIntVector& TransposedDimensions, EPixelFormat Format, const TCHAR* Name);
+
+/// Returns the size of the light volume for a data volume with DataSize voxels and the given world size. Every axis is scaled
+/// down by the matching Downscale factor, unless VoxelBudget is above zero. In that case the light volume gets at most
+/// VoxelBudget voxels, sized so that they're as close to cubes in world space as possible (so anisotropic spacing of the data
+/// gets respected). Never larger than the data volume.
+FIntVector GetLightVolumeSize(const FIntVector& DataSize, const FVector& WorldSize, const FVector& Downscale, int64 VoxelBudget);
+
+/// Returns the pixel format light volumes of the given format are created with.
+EPixelFormat GetLightVolumePixelFormat(ERaymarchLightVolumeFormat Format);
+
+/// Returns true if light volumes of this pixel format have more than one channel, so they need to be written by the
+/// PACKED_LIGHT_VOLUME shader permutations.
+bool IsPackedLightVolumeFormat(EPixelFormat Format);
+
+/// Returns the format of the read/write buffers and checkpoints used when propagating into a light volume of the given format.
+/// Those only ever hold a single light, so packed light volumes use R16F ones.
+EPixelFormat GetPropagationBufferFormat(EPixelFormat LightVolumeFormat);
+
+/// Returns what a light's propagated light gets multiplied by in each channel of a packed light volume - one-hot for it's light
+/// group in light group volumes, it's color in colored ones and all three channels for R11G11B10 ones.
+FVector4f GetLightVolumeChannelMask(const FDirLightParameters& LightParameters, ERaymarchLightVolumeFormat LightVolumeFormat);
+
+/// Returns the flags light propagation and octree passes are added with - async compute if the platform supports it efficiently
+/// and it's enabled by r.Raymarcher.AsyncCompute (off by default), regular compute otherwise.
+ERDGPassFlags GetRaymarchComputePassFlags();
@@ -9,419 +9,363 @@
 #include "DataDrivenShaderPlatformInfo.h"
 #include "GlobalShader.h"
 #include "RHICommandList.h"
+#include "RenderGraphResources.h"
+#include "Rendering/LightVolumeBricks.h"
 #include "Rendering/RaymarchTypes.h"
+#include "ShaderParameterStruct.h"
 #include "ShaderParameterUtils.h"
 #include "ShaderParameters.h"
 #include "VolumeAsset/WindowingParameters.h"
 
+// Each of the following _RenderThread functions builds and executes it's own render graph. The passes they add are also available
+// on their own (the Add...Passes functions), so that they can be recorded into a graph that's already being built.
+
 void AddDirLightToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
 	const FDirLightParameters LightParameters, const bool Added, const FRaymarchWorldParameters WorldParameters);
 
+void AddDirLightToSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters);
+
+// Adds a directional light with FAddDirLightPerSliceShader, binding every parameter again for every slice the way it was done
+// before the slice-invariant parameters went into FDirLightPropagationParameters. Only for timing the current propagation against
+// it, doesn't record checkpoints and doesn't support packed light volumes.
+RAYMARCHER_API void AddDirLightToSingleLightVolumePerSliceBaseline_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters);
+
 void ChangeDirLightInSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
 	FBasicRaymarchRenderingResources Resources, const FDirLightParameters OldLightParameters,
 	const FDirLightParameters NewLightParameters, const FRaymarchWorldParameters WorldParameters);
 
+void AddChangeDirLightInSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& OldLightParameters,
+	const FDirLightParameters& NewLightParameters, const FRaymarchWorldParameters& WorldParameters);
+
+// Recomputes the light in the dirty bricks of the light volume after the clipping plane moved from OldWorldParameters to
+// NewWorldParameters. Every light is removed with the old and added with the new clipping plane, starting at the checkpoint of the
+// brick containing the first dirty slice along each of it's axes. Lights without checkpoints are propagated through the whole
+// volume (and get checkpoints recorded).
+void UpdateDirtyBricksInSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightParameters> LightParameters,
+	const FLightVolumeDirtyBricks DirtyBricks, const FRaymarchWorldParameters OldWorldParameters,
+	const FRaymarchWorldParameters NewWorldParameters);
+
+void AddUpdateDirtyBricksInSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightParameters>& LightParameters,
+	const FLightVolumeDirtyBricks& DirtyBricks, const FRaymarchWorldParameters& OldWorldParameters,
+	const FRaymarchWorldParameters& NewWorldParameters);
+
+// Adds the given chunks of light propagation to the light volume. Chunks starting at the first slice record the checkpoints that
+// following chunks of the same light and axis continue from, so chunks of one light axis have to be added in order.
+void AddDirLightChunksToSingleLightVolume_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightPropagationChunk> Chunks,
+	const FRaymarchWorldParameters WorldParameters);
+
+void AddDirLightChunksToSingleLightVolumePasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightPropagationChunk>& Chunks,
+	const FRaymarchWorldParameters& WorldParameters);
+
+// Maximum number of light passes propagated together by AddDirLightsToSingleLightVolumeBatched_RenderThread (one per RGBA channel
+// of the batched read/write buffers). Has to match MAX_BATCHED_LIGHTS in AddDirLightsBatchedShader.usf.
+#define RAYMARCH_MAX_BATCHED_LIGHTS 4
+
+// Adds (or removes) all provided lights to the light volume. Lights propagating along the same face are batched together, so that
+// a sweep through the volume propagates up to RAYMARCH_MAX_BATCHED_LIGHTS lights at once.
+void AddDirLightsToSingleLightVolumeBatched_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const TArray<FDirLightParameters> LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters);
+
+void AddDirLightsToSingleLightVolumeBatchedPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FDirLightParameters>& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters);
+
+// Ray casts point and spot lights into the light volume, instead of propagating them slice by slice. Removes the first light (as
+// lit with the clipping plane in RemovedWorldParameters) and adds the second one (with AddedWorldParameters) in a single pass
+// over the voxels either of them reaches. A light with zero intensity is skipped, so this also adds or removes a single light.
+// The Add/Change/Update passes for directional lights above forward point and spot lights here, so callers don't need to.
+void AddChangeLocalLightInSingleLightVolumePass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& RemovedLightParameters,
+	const FDirLightParameters& AddedLightParameters, const FRaymarchWorldParameters& RemovedWorldParameters,
+	const FRaymarchWorldParameters& AddedWorldParameters);
+
+// Copies the whole Source light volume into Destination. Both need the same size and format.
+void CopyLightVolume_RenderThread(
+	FRHICommandListImmediate& RHICmdList, UTextureRenderTargetVolume* Source, UTextureRenderTargetVolume* Destination);
+
+// Weights the light groups of the RGBA16F light group volume in Resources.LightVolumeRenderTarget into
+// Resources.ResolvedLightVolumeRenderTarget.
+void ResolveLightGroups_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, const FLinearColor LightGroupWeights);
+
+void AddResolveLightGroupsPass(FRDGBuilder& GraphBuilder, FRDGTextureRef LightGroupVolume, FRDGTextureRef ResolvedLightVolume,
+	const FLinearColor& LightGroupWeights);
+
+// Data volume, transfer function, clipping and windowing parameters needed by every shader sampling the volume to
+// propagate light through it.
+BEGIN_SHADER_PARAMETER_STRUCT(FRaymarchVolumeSamplingParameters, RAYMARCHER_API)
+	// Volume texture + transfer function
+	SHADER_PARAMETER_TEXTURE(Texture3D, Volume)
+	SHADER_PARAMETER_SAMPLER(SamplerState, VolumeSampler)
+	SHADER_PARAMETER_TEXTURE(Texture2D, TransferFunc)
+	SHADER_PARAMETER_SAMPLER(SamplerState, TransferFuncSampler)
+	// Clipping and windowing
+	SHADER_PARAMETER(FVector3f, LocalClippingCenter)
+	SHADER_PARAMETER(FVector3f, LocalClippingDirection)
+	SHADER_PARAMETER(FVector4f, WindowingParameters)
+	// Brick distances for skipping empty bricks in light propagation, brick size is 0 if not skipping.
+	SHADER_PARAMETER_TEXTURE(Texture3D, BrickDistanceVolume)
+	SHADER_PARAMETER(int32, EmptySpaceBrickSize)
+END_SHADER_PARAMETER_STRUCT()
+
+// Fills the volume sampling parameters from the rendering resources and local clipping parameters.
+void SetupRaymarchVolumeSamplingParameters(FRaymarchVolumeSamplingParameters& OutParameters,
+	const FBasicRaymarchRenderingResources& Resources, const FClippingPlaneParameters& LocalClippingParameters);
+
+// Parameters of a single-light propagation that stay the same for every slice of one axis. Bound once per axis as a uniform buffer,
+// so that the per-slice passes only need to set the loop index and swap the read/write buffers.
+BEGIN_GLOBAL_SHADER_PARAMETER_STRUCT(FDirLightPropagationParameters, RAYMARCHER_API)
+	// Volume texture + transfer function
+	SHADER_PARAMETER_TEXTURE(Texture3D, Volume)
+	SHADER_PARAMETER_SAMPLER(SamplerState, VolumeSampler)
+	SHADER_PARAMETER_TEXTURE(Texture2D, TransferFunc)
+	SHADER_PARAMETER_SAMPLER(SamplerState, TransferFuncSampler)
+	// Clipping and windowing
+	SHADER_PARAMETER(FVector3f, LocalClippingCenter)
+	SHADER_PARAMETER(FVector3f, LocalClippingDirection)
+	SHADER_PARAMETER(FVector4f, WindowingParameters)
+	// Step size taken each iteration
+	SHADER_PARAMETER(float, StepSize)
+	// Permutation matrix - used to get position in the volume from axis-aligned X,Y and loop index.
+	SHADER_PARAMETER(FMatrix44f, PermutationMatrix)
+	// Pixel offset for reading from the previous loop's buffer and the offset in the volume from the previous volume sample.
+	SHADER_PARAMETER(FVector2f, PrevPixelOffset)
+	SHADER_PARAMETER(FVector3f, UVWOffset)
+	// +1 if adding the light, -1 if removing it.
+	SHADER_PARAMETER(int32, bAdded)
+	// Read buffer sampler, bordered by the light's alpha.
+	SHADER_PARAMETER_SAMPLER(SamplerState, ReadBufferSampler)
+	// Channels of a packed light volume the light goes into.
+	SHADER_PARAMETER(FVector4f, LightVolumeChannelMask)
+	// Brick distances (see BrickMapShaders.h) and their brick size, for skipping the transfer function in empty bricks. A brick
+	// size of 0 samples everything.
+	SHADER_PARAMETER_TEXTURE(Texture3D, BrickDistanceVolume)
+	SHADER_PARAMETER(int32, EmptySpaceBrickSize)
+END_GLOBAL_SHADER_PARAMETER_STRUCT()
+
+// Permutation of the light propagation shaders writing light volumes with more than one channel (see IsPackedLightVolumeFormat).
+class FPackedLightVolumeDim : SHADER_PERMUTATION_BOOL("PACKED_LIGHT_VOLUME");
+
 // A shader implementing adding or removing a single directional light.
 // (As opposed to changing [e.g. add and remove at the same time] a directional light)
-// Only adds the bAdded boolean for toggling adding/removing a light.
+// Dispatched once per slice through the render graph.
 class FAddDirLightShader : public FGlobalShader
 {
-	DECLARE_EXPORTED_SHADER_TYPE(FAddDirLightShader, Global, RAYMARCHER_API);
-
-public:
-	FAddDirLightShader() : FGlobalShader()
-	{
-	}
+	DECLARE_EXPORTED_GLOBAL_SHADER(FAddDirLightShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FAddDirLightShader, FGlobalShader);
+
+	// Also stores the light at every brick boundary into a checkpoint texture array (see FLightPropagationCheckpoints).
+	class FRecordCheckpoints : SHADER_PERMUTATION_BOOL("RECORD_CHECKPOINTS");
+	using FPermutationDomain = TShaderPermutationDomain<FRecordCheckpoints, FPackedLightVolumeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_REF(FDirLightPropagationParameters, DirLightPropagation)
+		// The current loop index of this shader run.
+		SHADER_PARAMETER(int32, Loop)
+		// Read buffer (previous slice) and write buffer (this slice).
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, ReadBuffer)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, WriteBuffer)
+		// Light volume to modify (float4 in the packed light volume permutation).
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+		// Checkpoints and the slice to store this slice's light into (-1 = none). Only used when recording checkpoints.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, Checkpoints)
+		SHADER_PARAMETER(int32, CheckpointIndex)
+	END_SHADER_PARAMETER_STRUCT()
 
-	~FAddDirLightShader(){};
-
-	FAddDirLightShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) : FGlobalShader(Initializer)
-	{
-		Volume.Bind(Initializer.ParameterMap, TEXT("Volume"), SPF_Mandatory);
-		VolumeSampler.Bind(Initializer.ParameterMap, TEXT("VolumeSampler"), SPF_Mandatory);
-
-		TransferFunc.Bind(Initializer.ParameterMap, TEXT("TransferFunc"), SPF_Mandatory);
-		TransferFuncSampler.Bind(Initializer.ParameterMap, TEXT("TransferFuncSampler"), SPF_Mandatory);
-
-		LocalClippingCenter.Bind(Initializer.ParameterMap, TEXT("LocalClippingCenter"), SPF_Mandatory);
-		LocalClippingDirection.Bind(Initializer.ParameterMap, TEXT("LocalClippingDirection"), SPF_Mandatory);
-
-		WindowingParameters.Bind(Initializer.ParameterMap, TEXT("WindowingParameters"), SPF_Mandatory);
-		StepSize.Bind(Initializer.ParameterMap, TEXT("StepSize"), SPF_Mandatory);
-
-		PermutationMatrix.Bind(Initializer.ParameterMap, TEXT("PermutationMatrix"), SPF_Mandatory);
-		// Actual light volume
-		ALightVolume.Bind(Initializer.ParameterMap, TEXT("ALightVolume"), SPF_Mandatory);
-
-		// Offsets to get location to read from from previous layer.
-		PrevPixelOffset.Bind(Initializer.ParameterMap, TEXT("PrevPixelOffset"), SPF_Mandatory);
-		UVWOffset.Bind(Initializer.ParameterMap, TEXT("UVWOffset"), SPF_Mandatory);
-
-		// Multiplier for adding or removing light.
-		bAdded.Bind(Initializer.ParameterMap, TEXT("bAdded"), SPF_Mandatory);
-		Loop.Bind(Initializer.ParameterMap, TEXT("Loop"), SPF_Mandatory);
-		// Read buffer and sampler.
-		ReadBuffer.Bind(Initializer.ParameterMap, TEXT("ReadBuffer"), SPF_Mandatory);
-		ReadBufferSampler.Bind(Initializer.ParameterMap, TEXT("ReadBufferSampler"), SPF_Mandatory);
-		// Write buffer.
-		WriteBuffer.Bind(Initializer.ParameterMap, TEXT("WriteBuffer"), SPF_Mandatory);
-	}
-
-	void SetLightAdded(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, bool bLightAdded)
-	{
-		// Set the multiplier to -1 if we're removing the light. Set to 1 if adding it.
-		SetShaderValue(RHICmdList, ShaderRHI, bAdded, bLightAdded ? 1 : -1);
-	}
-
-	void SetRaymarchResources(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const FTexture3DRHIRef pVolume,
-		const FTexture2DRHIRef pTransferFunc, FWindowingParameters WindowingParams)
-	{
-		// Set the zero color to fit the zero point of the windowing parameters (Center - Width/2)
-		// so that after sampling out of bounds, it gets changed to 0 on the Transfer Function in
-		// GetTransferFuncPosition() hlsl function.
-		float ZeroTFValue = WindowingParams.Center - 0.5 * WindowingParams.Width;
-
-		FLinearColor VolumeClearColor = FLinearColor(ZeroTFValue, 0.0, 0.0, 0.0);
-		const uint32 BorderColorInt = VolumeClearColor.ToFColor(false).ToPackedARGB();
-
-		// Create a static sampler reference and bind it together with the volume texture.
-		FSamplerStateRHIRef DataVolumeSamplerRef = RHICreateSamplerState(
-			FSamplerStateInitializerRHI(SF_Trilinear, AM_Border, AM_Border, AM_Border, 0, 1, 0, 0, BorderColorInt));
-
-		FSamplerStateRHIRef TFSamplerRef = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, VolumeSampler, DataVolumeSamplerRef, pVolume);
-		SetTextureParameter(RHICmdList, ShaderRHI, TransferFunc, TransferFuncSampler, TFSamplerRef, pTransferFunc);
-	}
-
-	// Sets the shader uniforms in the pipeline.
-	void SetRaymarchParameters(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI,
-		FClippingPlaneParameters LocalClippingParams, FLinearColor pWindowingParameters)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, LocalClippingCenter, FVector3f(LocalClippingParams.Center));
-		SetShaderValue(RHICmdList, ShaderRHI, LocalClippingDirection, FVector3f(LocalClippingParams.Direction));
-		SetShaderValue(RHICmdList, ShaderRHI, WindowingParameters, pWindowingParameters);
-	}
-
-	// Sets the step-size. This is a crucial parameter, because when raymarching, we need to know how long our step was,
-	// so that we can calculate how large an effect the volume's density has.
-	void SetStepSize(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, float pStepSize)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, StepSize, pStepSize);
-	}
-
-	// Sets loop-dependent uniforms in the pipeline.
-	void SetLoop(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const int loopIndex,
-		const FTexture2DRHIRef pReadBuffer, const FSamplerStateRHIRef pReadBuffSampler,
-		const FUnorderedAccessViewRHIRef pWriteBuffer)
-	{
-		// Update the Loop index.
-		SetShaderValue(RHICmdList, ShaderRHI, Loop, loopIndex);
-		// Set read/write buffers.
-		SetUAVParameter(RHICmdList, ShaderRHI, WriteBuffer, pWriteBuffer);
-		SetTextureParameter(RHICmdList, ShaderRHI, ReadBuffer, ReadBufferSampler, pReadBuffSampler, pReadBuffer);
-	}
-
-	void SetALightVolume(
-		FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FUnorderedAccessViewRHIRef pALightVolume)
-	{
-		// Set the multiplier to -1 if we're removing the light. Set to 1 if adding it.
-		SetUAVParameter(RHICmdList, ShaderRHI, ALightVolume, pALightVolume);
-	}
-
-	void SetPermutationMatrix(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FMatrix PermMatrix)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, PermutationMatrix, FMatrix44f(PermMatrix));
-	}
-
-	void UnbindResourcesRaymarch(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
-	{
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, nullptr);
-		SetTextureParameter(RHICmdList, ShaderRHI, TransferFunc, nullptr);
-	}
-
-	void UnbindResourcesLightPropagation(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		// Unbind volume buffer.
-		UnbindResourcesRaymarch(RHICmdList, ShaderRHI);
-		SetUAVParameter(RHICmdList, ShaderRHI, ALightVolume, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, WriteBuffer, nullptr);
-		SetTextureParameter(RHICmdList, ShaderRHI, ReadBuffer, nullptr);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	void SetUVOffset(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FVector2D PixelOffset)
-	{
-		auto fPixelOffset = FVector2f(PixelOffset);
-		SetShaderValue(RHICmdList, ShaderRHI, PrevPixelOffset, fPixelOffset);
-	}
+// The previous single light propagation shader, taking all parameters as loose parameters that get set again for every slice. Kept
+// as a baseline for timing, see AddDirLightToSingleLightVolumePerSliceBaseline_RenderThread().
+class FAddDirLightPerSliceShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FAddDirLightPerSliceShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FAddDirLightPerSliceShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Same as in FDirLightPropagationParameters.
+		SHADER_PARAMETER(float, StepSize)
+		SHADER_PARAMETER(FMatrix44f, PermutationMatrix)
+		SHADER_PARAMETER(FVector2f, PrevPixelOffset)
+		SHADER_PARAMETER(FVector3f, UVWOffset)
+		SHADER_PARAMETER(int32, bAdded)
+		// The current loop index of this shader run.
+		SHADER_PARAMETER(int32, Loop)
+		// Read buffer (previous slice) and write buffer (this slice).
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, ReadBuffer)
+		SHADER_PARAMETER_SAMPLER(SamplerState, ReadBufferSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, WriteBuffer)
+		// Light volume to modify.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+	END_SHADER_PARAMETER_STRUCT()
 
-	void SetUVWOffset(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FVector pUVWOffset)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		auto fUVWOffset = FVector3f(pUVWOffset);
-		SetShaderValue(RHICmdList, ShaderRHI, UVWOffset, fUVWOffset);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
-
-protected:
-	// Volume texture + transfer function resource parameters
-	LAYOUT_FIELD(FShaderResourceParameter, Volume);
-	LAYOUT_FIELD(FShaderResourceParameter, VolumeSampler);
-	LAYOUT_FIELD(FShaderResourceParameter, TransferFunc);
-	LAYOUT_FIELD(FShaderResourceParameter, TransferFuncSampler);
-	// Clipping uniforms
-	LAYOUT_FIELD(FShaderParameter, LocalClippingCenter);
-	LAYOUT_FIELD(FShaderParameter, LocalClippingDirection);
-	// TF intensity Domain
-	LAYOUT_FIELD(FShaderParameter, WindowingParameters);
-	// Step size taken each iteration
-	LAYOUT_FIELD(FShaderParameter, StepSize);
-	// Permutation matrix - used to get position in the volume from axis-aligned X,Y and loop index.
-	LAYOUT_FIELD(FShaderParameter, PermutationMatrix);
-	// Light volume to modify.
-	LAYOUT_FIELD(FShaderResourceParameter, ALightVolume);
-	// Tells the shader the pixel offset for reading from the previous loop's buffer
-	LAYOUT_FIELD(FShaderParameter, PrevPixelOffset);
-	// And the offset in the volume from the previous volume sample.
-	LAYOUT_FIELD(FShaderParameter, UVWOffset);
-	// Parameter for the added/removed multiplier.
-	LAYOUT_FIELD(FShaderParameter, bAdded);
-	// The current loop index of this shader run.
-	LAYOUT_FIELD(FShaderParameter, Loop);
-	// Read buffer texture and sampler.
-	LAYOUT_FIELD(FShaderResourceParameter, ReadBuffer);
-	LAYOUT_FIELD(FShaderResourceParameter, ReadBufferSampler);
-	// Write buffer UAV.
-	LAYOUT_FIELD(FShaderResourceParameter, WriteBuffer);
 };
 
 // A shader implementing changing a light in one pass.
 // Works by subtracting the old light and adding the new one.
-// Notice the UE macro DECLARE_SHADER_TYPE, unlike the shaders above (which are abstract)
-// this one actually gets implemented.
 class FChangeDirLightShader : public FGlobalShader
 {
-	DECLARE_EXPORTED_SHADER_TYPE(FChangeDirLightShader, Global, RAYMARCHER_API);
-
-public:
-	FChangeDirLightShader() : FGlobalShader()
-	{
-	}
-	~FChangeDirLightShader(){};
-
-	FChangeDirLightShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) : FGlobalShader(Initializer)
-	{
-		Volume.Bind(Initializer.ParameterMap, TEXT("Volume"), SPF_Mandatory);
-		VolumeSampler.Bind(Initializer.ParameterMap, TEXT("VolumeSampler"), SPF_Mandatory);
-
-		TransferFunc.Bind(Initializer.ParameterMap, TEXT("TransferFunc"), SPF_Mandatory);
-		TransferFuncSampler.Bind(Initializer.ParameterMap, TEXT("TransferFuncSampler"), SPF_Mandatory);
-
-		LocalClippingCenter.Bind(Initializer.ParameterMap, TEXT("LocalClippingCenter"), SPF_Mandatory);
-		LocalClippingDirection.Bind(Initializer.ParameterMap, TEXT("LocalClippingDirection"), SPF_Mandatory);
-
-		WindowingParameters.Bind(Initializer.ParameterMap, TEXT("WindowingParameters"), SPF_Mandatory);
-		StepSize.Bind(Initializer.ParameterMap, TEXT("StepSize"), SPF_Mandatory);
-
-		Loop.Bind(Initializer.ParameterMap, TEXT("Loop"), SPF_Optional);
-		PermutationMatrix.Bind(Initializer.ParameterMap, TEXT("PermutationMatrix"), SPF_Mandatory);
-
-		// Read buffer and sampler.
-		ReadBuffer.Bind(Initializer.ParameterMap, TEXT("ReadBuffer"), SPF_Optional);
-		ReadBufferSampler.Bind(Initializer.ParameterMap, TEXT("ReadBufferSampler"), SPF_Optional);
-		// Write buffer.
-		WriteBuffer.Bind(Initializer.ParameterMap, TEXT("WriteBuffer"), SPF_Optional);
-		// Actual light volume
-		ALightVolume.Bind(Initializer.ParameterMap, TEXT("ALightVolume"), SPF_Mandatory);
-
-		// Offsets to get location to read from from previous layer.
-		PrevPixelOffset.Bind(Initializer.ParameterMap, TEXT("PrevPixelOffset"), SPF_Mandatory);
-		UVWOffset.Bind(Initializer.ParameterMap, TEXT("UVWOffset"), SPF_Mandatory);
-
-		// Volume texture + Transfer function uniforms
-		RemovedPrevPixelOffset.Bind(Initializer.ParameterMap, TEXT("RemovedPrevPixelOffset"), SPF_Mandatory);
-		RemovedReadBuffer.Bind(Initializer.ParameterMap, TEXT("RemovedReadBuffer"), SPF_Mandatory);
-		RemovedReadBufferSampler.Bind(Initializer.ParameterMap, TEXT("RemovedReadBufferSampler"), SPF_Mandatory);
-		RemovedWriteBuffer.Bind(Initializer.ParameterMap, TEXT("RemovedWriteBuffer"), SPF_Mandatory);
-		RemovedUVWOffset.Bind(Initializer.ParameterMap, TEXT("RemovedUVWOffset"), SPF_Mandatory);
-		RemovedStepSize.Bind(Initializer.ParameterMap, TEXT("RemovedStepSize"), SPF_Mandatory);
-	}
+	DECLARE_EXPORTED_GLOBAL_SHADER(FChangeDirLightShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FChangeDirLightShader, FGlobalShader);
+
+	using FPermutationDomain = TShaderPermutationDomain<FPackedLightVolumeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Permutation matrix - used to get position in the volume from axis-aligned X,Y and loop index.
+		SHADER_PARAMETER(FMatrix44f, PermutationMatrix)
+		// The current loop index of this shader run.
+		SHADER_PARAMETER(int32, Loop)
+		// Step size, pixel offset into the previous loop's buffer and offset in the volume from the previous volume sample
+		// of the added light.
+		SHADER_PARAMETER(float, StepSize)
+		SHADER_PARAMETER(FVector2f, PrevPixelOffset)
+		SHADER_PARAMETER(FVector3f, UVWOffset)
+		// Read buffer (previous slice) and write buffer (this slice) of the added light.
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, ReadBuffer)
+		SHADER_PARAMETER_SAMPLER(SamplerState, ReadBufferSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, WriteBuffer)
+		// Same collection of parameters for the removed light.
+		SHADER_PARAMETER(float, RemovedStepSize)
+		SHADER_PARAMETER(FVector2f, RemovedPrevPixelOffset)
+		SHADER_PARAMETER(FVector3f, RemovedUVWOffset)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D, RemovedReadBuffer)
+		SHADER_PARAMETER_SAMPLER(SamplerState, RemovedReadBufferSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, RemovedWriteBuffer)
+		// Light volume to modify (float4 in the packed light volume permutation).
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+		// Channels of a packed light volume the added and the removed light go into.
+		SHADER_PARAMETER(FVector4f, LightVolumeChannelMask)
+		SHADER_PARAMETER(FVector4f, RemovedLightVolumeChannelMask)
+	END_SHADER_PARAMETER_STRUCT()
 
 	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
 		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	// Sets loop-dependent uniforms in the pipeline.
-	void SetLoopAdd(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const int loopIndex,
-		const FTexture2DRHIRef pReadBuffer, const FSamplerStateRHIRef pReadBuffSampler,
-		const FUnorderedAccessViewRHIRef pWriteBuffer)
-	{
-		// Update the Loop index.
-		SetShaderValue(RHICmdList, ShaderRHI, Loop, loopIndex);
-		// Set read/write buffers.
-		SetUAVParameter(RHICmdList, ShaderRHI, WriteBuffer, pWriteBuffer);
-		SetTextureParameter(RHICmdList, ShaderRHI, ReadBuffer, ReadBufferSampler, pReadBuffSampler, pReadBuffer);
-	}
-
-	// Sets loop-dependent uniforms in the pipeline.
-	void SetLoop(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const int loopIndex,
-		const FTexture2DRHIRef pRemovedReadBuffer, const FSamplerStateRHIRef pRemovedReadBuffSampler,
-		const FUnorderedAccessViewRHIRef pRemovedWriteBuffer, const FTexture2DRHIRef pAddedReadBuffer,
-		const FSamplerStateRHIRef pAddedReadBuffSampler, const FUnorderedAccessViewRHIRef pAddedWriteBuffer)
-	{
-		// Actually sets the shader uniforms in the pipeline.
-		SetLoopAdd(RHICmdList, ShaderRHI, loopIndex, pAddedReadBuffer, pAddedReadBuffSampler, pAddedWriteBuffer);
-		// Set read/write buffers for removed light.
-		SetUAVParameter(RHICmdList, ShaderRHI, RemovedWriteBuffer, pRemovedWriteBuffer);
-		SetTextureParameter(
-			RHICmdList, ShaderRHI, RemovedReadBuffer, RemovedReadBufferSampler, pRemovedReadBuffSampler, pRemovedReadBuffer);
-	}
-
-	// Sets loop-dependent uniforms in the pipeline.
-	void SetLoop(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const int loopIndex,
-		const FTexture2DRHIRef pReadBuffer, const FSamplerStateRHIRef pReadBuffSampler,
-		const FUnorderedAccessViewRHIRef pWriteBuffer)
-	{
-		// Update the Loop index.
-		SetShaderValue(RHICmdList, ShaderRHI, Loop, loopIndex);
-		// Set read/write buffers.
-		SetUAVParameter(RHICmdList, ShaderRHI, WriteBuffer, pWriteBuffer);
-		SetTextureParameter(RHICmdList, ShaderRHI, ReadBuffer, ReadBufferSampler, pReadBuffSampler, pReadBuffer);
-	}
-
-	void SetALightVolume(
-		FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FUnorderedAccessViewRHIRef pALightVolume)
-	{
-		// Set the multiplier to -1 if we're removing the light. Set to 1 if adding it.
-		SetUAVParameter(RHICmdList, ShaderRHI, ALightVolume, pALightVolume);
-	}
-
-	void SetPermutationMatrix(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FMatrix PermMatrix)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, PermutationMatrix, FMatrix44f(PermMatrix));
-	}
-
-	void SetPixelOffsets(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FVector2D AddedPixelOffset,
-		FVector2D RemovedPixelOffset)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, PrevPixelOffset, FVector2f(AddedPixelOffset));
-		SetShaderValue(RHICmdList, ShaderRHI, RemovedPrevPixelOffset, FVector2f(RemovedPixelOffset));
-	}
-
-	void SetUVWOffsets(
-		FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FVector pAddedUVWOffset, FVector pRemovedUVWOffset)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, UVWOffset, FVector3f(pAddedUVWOffset));
-		SetShaderValue(RHICmdList, ShaderRHI, RemovedUVWOffset, FVector3f(pRemovedUVWOffset));
-	}
-
-	void SetStepSizes(
-		FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, float pAddedStepSize, float pRemovedStepSize)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, StepSize, pAddedStepSize);
-		SetShaderValue(RHICmdList, ShaderRHI, RemovedStepSize, pRemovedStepSize);
-	}
+// A shader implementing adding or removing up to RAYMARCH_MAX_BATCHED_LIGHTS directional lights propagating along the same face.
+// Every light has it's own channel in the read/write buffers and own offsets and step size, but they share the slice loop.
+class FAddDirLightsBatchedShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FAddDirLightsBatchedShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FAddDirLightsBatchedShader, FGlobalShader);
+
+	// Also stores the light of every light in the batch at every brick boundary, same as FAddDirLightShader::FRecordCheckpoints.
+	class FRecordCheckpoints : SHADER_PERMUTATION_BOOL("RECORD_CHECKPOINTS");
+	using FPermutationDomain = TShaderPermutationDomain<FRecordCheckpoints, FPackedLightVolumeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Permutation matrix - used to get position in the volume from axis-aligned X,Y and loop index.
+		SHADER_PARAMETER(FMatrix44f, PermutationMatrix)
+		// Per-light pixel offsets for reading from the previous loop's buffer and offsets in the volume from the previous
+		// volume sample. Only the first NumLights are used.
+		SHADER_PARAMETER_ARRAY(FVector4f, PrevPixelOffsets, [RAYMARCH_MAX_BATCHED_LIGHTS])
+		SHADER_PARAMETER_ARRAY(FVector4f, UVWOffsets, [RAYMARCH_MAX_BATCHED_LIGHTS])
+		// Step sizes of all lights in the batch.
+		SHADER_PARAMETER(FVector4f, StepSizes)
+		// Number of lights used in this batch.
+		SHADER_PARAMETER(int32, NumLights)
+		// +1 if adding the lights, -1 if removing them.
+		SHADER_PARAMETER(int32, bAdded)
+		// The current loop index of this shader run.
+		SHADER_PARAMETER(int32, Loop)
+		// Read buffer (previous slice) and write buffer (this slice), one light per channel.
+		SHADER_PARAMETER_RDG_TEXTURE(Texture2D<float4>, ReadBuffer)
+		SHADER_PARAMETER_SAMPLER(SamplerState, ReadBufferSampler)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float4>, WriteBuffer)
+		// Light volume to modify (float4 in the packed light volume permutation).
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+		// Per-light channels of a packed light volume the light goes into.
+		SHADER_PARAMETER_ARRAY(FVector4f, LightVolumeChannelMasks, [RAYMARCH_MAX_BATCHED_LIGHTS])
+		// Checkpoints of all lights in the batch, NumCheckpoints slices per light, and the checkpoint to store this slice's light
+		// into (-1 = none). Only used when recording checkpoints.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2DArray<float>, Checkpoints)
+		SHADER_PARAMETER(int32, CheckpointIndex)
+		SHADER_PARAMETER(int32, NumCheckpoints)
+	END_SHADER_PARAMETER_STRUCT()
 
-	void UnbindResourcesRaymarch(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, nullptr);
-		SetTextureParameter(RHICmdList, ShaderRHI, TransferFunc, nullptr);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	void UnbindResourcesLightPropagation(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
-	{
-		// Unbind volume buffer.
-		UnbindResourcesRaymarch(RHICmdList, ShaderRHI);
-		SetUAVParameter(RHICmdList, ShaderRHI, ALightVolume, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, WriteBuffer, nullptr);
-		SetTextureParameter(RHICmdList, ShaderRHI, ReadBuffer, nullptr);
-	}
+// A shader ray casting a point or spot light into every light volume voxel in its reach, while removing another one the same way.
+class FChangeLocalLightShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FChangeLocalLightShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FChangeLocalLightShader, FGlobalShader);
+
+	using FPermutationDomain = TShaderPermutationDomain<FPackedLightVolumeDim>;
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		// Volume sampling with the added light's clipping plane.
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Clipping plane the removed light was added with.
+		SHADER_PARAMETER(FVector3f, RemovedLocalClippingCenter)
+		SHADER_PARAMETER(FVector3f, RemovedLocalClippingDirection)
+		// Light volume to modify (float4 in the packed light volume permutation).
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+		// First voxel of the region of the light volume the lights reach. One thread per voxel of the region gets dispatched.
+		SHADER_PARAMETER(FIntVector, VoxelOffset)
+		// Size of the volume in world units, to get world space distances from local (0-1) positions.
+		SHADER_PARAMETER(FVector3f, VolumeWorldSize)
+		// Length of a ray cast step in local (0-1) space.
+		SHADER_PARAMETER(float, StepSize)
+		// Local (0-1) position, spot direction (in the unscaled local frame), (intensity, attenuation radius, cosine of inner cone
+		// angle, cosine of outer cone angle) and light volume channel mask of the added light.
+		SHADER_PARAMETER(FVector3f, LightPosition)
+		SHADER_PARAMETER(FVector3f, SpotDirection)
+		SHADER_PARAMETER(FVector4f, LightFalloff)
+		SHADER_PARAMETER(FVector4f, LightVolumeChannelMask)
+		// Same collection of parameters for the removed light.
+		SHADER_PARAMETER(FVector3f, RemovedLightPosition)
+		SHADER_PARAMETER(FVector3f, RemovedSpotDirection)
+		SHADER_PARAMETER(FVector4f, RemovedLightFalloff)
+		SHADER_PARAMETER(FVector4f, RemovedLightVolumeChannelMask)
+	END_SHADER_PARAMETER_STRUCT()
 
-	void UnbindResourcesChangeDirLight(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		// Unbind parent and also our added parameters.
-		UnbindResourcesLightPropagation(RHICmdList, ShaderRHI);
-		SetUAVParameter(RHICmdList, ShaderRHI, RemovedWriteBuffer, nullptr);
-		SetTextureParameter(RHICmdList, ShaderRHI, RemovedReadBuffer, nullptr);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	void SetRaymarchResources(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const FTexture3DRHIRef pVolume,
-		const FTexture2DRHIRef pTransferFunc, FWindowingParameters WindowingParams)
-	{
-		// Set the zero color to fit the zero point of the windowing parameters (Center - Width/2)
-		// so that after sampling out of bounds, it gets changed to 0 on the Transfer Function in
-		// GetTransferFuncPosition() hlsl function.
-		float ZeroTFValue = WindowingParams.Center - 0.5 * WindowingParams.Width;
-
-		FLinearColor VolumeClearColor = FLinearColor(ZeroTFValue, 0.0, 0.0, 0.0);
-		const uint32 BorderColorInt = VolumeClearColor.ToFColor(false).ToPackedARGB();
-
-		// Create a static sampler reference and bind it together with the volume texture.
-		FSamplerStateRHIRef DataVolumeSamplerRef = RHICreateSamplerState(
-			FSamplerStateInitializerRHI(SF_Trilinear, AM_Border, AM_Border, AM_Border, 0, 1, 0, 0, BorderColorInt));
+// Weights the light groups of an RGBA16F light group volume into a single channel light volume.
+class FResolveLightGroupsShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FResolveLightGroupsShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FResolveLightGroupsShader, FGlobalShader);
 
-		FSamplerStateRHIRef TFSamplerRef = TStaticSamplerState<SF_Bilinear, AM_Clamp, AM_Clamp, AM_Clamp>::GetRHI();
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, VolumeSampler, DataVolumeSamplerRef, pVolume);
-		SetTextureParameter(RHICmdList, ShaderRHI, TransferFunc, TransferFuncSampler, TFSamplerRef, pTransferFunc);
-	}
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float4>, LightGroupVolume)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ResolvedLightVolume)
+		SHADER_PARAMETER(FVector4f, LightGroupWeights)
+	END_SHADER_PARAMETER_STRUCT()
 
-	// Sets the shader uniforms in the pipeline.
-	void SetRaymarchParameters(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI,
-		FClippingPlaneParameters LocalClippingParams, FLinearColor pWindowingParameters)
-	{
-		SetShaderValue(RHICmdList, ShaderRHI, LocalClippingCenter, FVector3f(LocalClippingParams.Center));
-		SetShaderValue(RHICmdList, ShaderRHI, LocalClippingDirection, FVector3f(LocalClippingParams.Direction));
-		SetShaderValue(RHICmdList, ShaderRHI, WindowingParameters, pWindowingParameters);
-	}
-
-	// Sets the step-size. This is a crucial parameter, because when raymarching, we need to know how long our step was,
-	// so that we can calculate how large an effect the volume's density has.
-	void SetStepSize(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, float pStepSize)
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		SetShaderValue(RHICmdList, ShaderRHI, StepSize, pStepSize);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
-
-protected:
-	// Volume texture + transfer function resource parameters
-	LAYOUT_FIELD(FShaderResourceParameter, Volume);
-	LAYOUT_FIELD(FShaderResourceParameter, VolumeSampler);
-	LAYOUT_FIELD(FShaderResourceParameter, TransferFunc);
-	LAYOUT_FIELD(FShaderResourceParameter, TransferFuncSampler);
-	// Clipping uniforms
-	LAYOUT_FIELD(FShaderParameter, LocalClippingCenter);
-	LAYOUT_FIELD(FShaderParameter, LocalClippingDirection);
-	// TF intensity Domain
-	LAYOUT_FIELD(FShaderParameter, WindowingParameters);
-	// Step size taken each iteration
-	LAYOUT_FIELD(FShaderParameter, StepSize);
-
-	// The current loop index of this shader run.
-	LAYOUT_FIELD(FShaderParameter, Loop);
-	// Permutation matrix - used to get position in the volume from axis-aligned X,Y and loop index.
-	LAYOUT_FIELD(FShaderParameter, PermutationMatrix);
-	// Read buffer texture and sampler.
-	LAYOUT_FIELD(FShaderResourceParameter, ReadBuffer);
-	LAYOUT_FIELD(FShaderResourceParameter, ReadBufferSampler);
-	// Write buffer UAV.
-	LAYOUT_FIELD(FShaderResourceParameter, WriteBuffer);
-	// Light volume to modify.
-	LAYOUT_FIELD(FShaderResourceParameter, ALightVolume);
-
-	// Tells the shader the pixel offset for reading from the previous loop's buffer
-	LAYOUT_FIELD(FShaderParameter, PrevPixelOffset);
-	// And the offset in the volume from the previous volume sample.
-	LAYOUT_FIELD(FShaderParameter, UVWOffset);
-
-	// Same collection of parameters as for a "add dir light" shader, but these ones are the ones of
-	// the removed light.
-
-	// Tells the shader the pixel offset for reading from the previous loop's buffer
-	LAYOUT_FIELD(FShaderParameter, RemovedPrevPixelOffset);
-
-	LAYOUT_FIELD(FShaderResourceParameter, RemovedReadBuffer);
-	LAYOUT_FIELD(FShaderResourceParameter, RemovedReadBufferSampler);
-	// Write buffer UAV.
-	LAYOUT_FIELD(FShaderResourceParameter, RemovedWriteBuffer);
-	// Removed light step size (is different than added one's)
-	LAYOUT_FIELD(FShaderParameter, RemovedStepSize);
-	// Removed light UVW offset
-	LAYOUT_FIELD(FShaderParameter, RemovedUVWOffset);
-};
\ No newline at end of file
+};
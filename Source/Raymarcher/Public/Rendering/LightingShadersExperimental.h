@@ -3,66 +3,99 @@
 // Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
 // (original raymarching code).
 
-//#pragma once
-//
-//#include "LightingShaders.h"
-//
-//void AddDirLightToSingleLightVolume_GPUSync_RenderThread(FRHICommandListImmediate& RHICmdList,
-//	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
-//	const FRaymarchWorldParameters WorldParameters);
-//
-//class FAddDirLightShader_GPUSyncCS : public FAddDirLightShader
-//{
-//	DECLARE_EXPORTED_SHADER_TYPE(FAddDirLightShader_GPUSyncCS, Global, RAYMARCHER_API);
-//
-//public:
-//	FAddDirLightShader_GPUSyncCS() : FAddDirLightShader()
-//	{
-//	}
-//
-//	FAddDirLightShader_GPUSyncCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer)
-//		: FAddDirLightShader(Initializer)
-//	{
-//		// Volume texture + Transfer function uniforms
-//		Start.Bind(Initializer.ParameterMap, TEXT("Start"), SPF_Mandatory);
-//		Stop.Bind(Initializer.ParameterMap, TEXT("Stop"), SPF_Mandatory);
-//		AxisDirection.Bind(Initializer.ParameterMap, TEXT("AxisDirection"), SPF_Mandatory);
-//		BufferBorderValue.Bind(Initializer.ParameterMap, TEXT("BufferBorderValue"), SPF_Mandatory);
-//		// !!!!!!!!!!!
-//		// When binding FRWShaderParameter, we must omit the "RW" from the name provided into the Bind function
-//		// Otherwise it gets bound as a SRV (no RW access)! See FRWShaderParameter::Init() in ShaderParameters.h !!!
-//		// !!!!!!!!!!!
-//		LightBuffer.Bind(Initializer.ParameterMap, TEXT("LightBuffer"));
-//	}
-//
-//	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
-//	{
-//		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
-//	}
-//
-//	void SetReadWriteBuffer(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, FTexture2DRHIRef pTexture,
-//		FRHIUnorderedAccessView* pRWBuffer)
-//	{
-//		LightBuffer.SetTexture(RHICmdList, ShaderRHI, pTexture, pRWBuffer);
-//	}
-//
-//	void SetLoopParameters(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const int pStart, const int pStop,
-//		const int pAxisDirection)
-//	{
-//		SetShaderValue(RHICmdList, ShaderRHI, Start, pStart);
-//		SetShaderValue(RHICmdList, ShaderRHI, Stop, pStop);
-//		SetShaderValue(RHICmdList, ShaderRHI, AxisDirection, pAxisDirection);
-//	};
-//
-//	void SetOutsideLight(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, float OutsideLightIntensity)
-//	{
-//		SetShaderValue(RHICmdList, ShaderRHI, BufferBorderValue, OutsideLightIntensity);
-//	};
-//
-//protected:
-//	LAYOUT_FIELD(FShaderParameter, Start);
-//	LAYOUT_FIELD(FShaderParameter, Stop);
-//	LAYOUT_FIELD(FShaderParameter, AxisDirection);
-//	LAYOUT_FIELD(FShaderParameter, BufferBorderValue);
-//	LAYOUT_FIELD(FRWShaderParameter, LightBuffer);
-//};
\ No newline at end of file
+#pragma once
+
+#include "Rendering/LightingShaders.h"
+
+// Side of the square tile of the propagation plane processed by one thread group of the GPU-synced propagation.
+// Has to match TILE_SIZE in AddDirLightShader_GPUSync.usf.
+#define RAYMARCH_GPUSYNC_TILE_SIZE 16
+
+// Maximum number of persistent thread groups launched by the GPU-synced propagation. Groups loop over work items, so this only
+// needs to be large enough to fill the GPU.
+#define RAYMARCH_GPUSYNC_MAX_GROUPS 1024
+
+// Adds (or removes) a light to the light volume, propagating through the whole volume in a single dispatch per axis instead of
+// one dispatch per slice. Falls back to AddDirLightToSingleLightVolume_RenderThread if the light is so oblique that a slice would
+// read further than a tile from the previous one, or if the light volume has a packed (multi-channel) format.
+void AddDirLightToSingleLightVolume_GPUSync_RenderThread(FRHICommandListImmediate& RHICmdList,
+	FBasicRaymarchRenderingResources Resources, const FDirLightParameters LightParameters, const bool Added,
+	const FRaymarchWorldParameters WorldParameters);
+
+void AddDirLightToSingleLightVolumeGPUSyncPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef LightVolume,
+	const FBasicRaymarchRenderingResources& Resources, const FDirLightParameters& LightParameters, const bool Added,
+	const FRaymarchWorldParameters& WorldParameters);
+
+// Propagates the light once with the per-slice and once with the GPU-synced shader and logs the largest per-voxel difference of
+// the resulting light volumes, the number of voxels differing by more than Tolerance and the render thread time of both.
+// Blocks until the GPU is idle. Leaves only the light from the GPU-synced propagation in the light volume.
+void CompareGPUSyncLightPropagation_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
+	const FDirLightParameters LightParameters, const FRaymarchWorldParameters WorldParameters, float Tolerance);
+
+// Propagates the lights into temporary light volumes of every supported format (see ERaymarchLightVolumeFormat), rotates the first
+// light back and forth so that NumChanges light changes get applied, and logs the memory used, the time taken to add and change
+// the lights and the difference to a 32 bit light volume the lights were only added to once. Light group volumes are compared
+// after resolving them with all weights at 1, colored ones with white lights. Blocks until the GPU is idle, the actual light
+// volume is left untouched.
+void BenchmarkLightVolumeFormats_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources,
+	TArray<FDirLightParameters> LightParameters, const FRaymarchWorldParameters WorldParameters, int32 NumChanges,
+	float Tolerance);
+
+// Compares two single channel (or two channel) volumes of the same size on the GPU and only reads back the largest difference and
+// the number of voxels differing by more than Tolerance. Blocks until the GPU is idle.
+void CompareVolumes_RenderThread(FRHICommandListImmediate& RHICmdList, const TRefCountPtr<IPooledRenderTarget>& VolumeA,
+	const TRefCountPtr<IPooledRenderTarget>& VolumeB, float Tolerance, float& OutMaxDifference, uint32& OutMismatchedVoxels);
+
+// A shader propagating a single directional light through the whole volume in one dispatch, using persistent thread groups
+// synchronized through a global progress buffer. See AddDirLightShader_GPUSync.usf.
+class FAddDirLightShader_GPUSyncCS : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FAddDirLightShader_GPUSyncCS, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FAddDirLightShader_GPUSyncCS, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_STRUCT_INCLUDE(FRaymarchVolumeSamplingParameters, VolumeSampling)
+		// Light parameters, same meaning as in FAddDirLightShader.
+		SHADER_PARAMETER(float, StepSize)
+		SHADER_PARAMETER(FMatrix44f, PermutationMatrix)
+		SHADER_PARAMETER(FVector2f, PrevPixelOffset)
+		SHADER_PARAMETER(FVector3f, UVWOffset)
+		SHADER_PARAMETER(int32, bAdded)
+		// Parameters of the loop the shader runs through the whole axis.
+		SHADER_PARAMETER(int32, Start)
+		SHADER_PARAMETER(int32, AxisDirection)
+		SHADER_PARAMETER(int32, NumSlices)
+		SHADER_PARAMETER(FUintVector2, NumTiles)
+		SHADER_PARAMETER(float, BufferBorderValue)
+		// Light volume, ping-pong light buffers and the synchronization buffer.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, ALightVolume)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, LightBuffer0)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture2D<float>, LightBuffer1)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, SyncBuffer)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
+
+// Compares the first two channels of two volumes of the same size, writing the largest absolute difference (as uint bits) and
+// the number of voxels differing by more than a tolerance into a result buffer.
+class FCompareVolumesCS : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FCompareVolumesCS, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FCompareVolumesCS, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float2>, VolumeA)
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float2>, VolumeB)
+		SHADER_PARAMETER(float, Tolerance)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, Result)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
@@ -0,0 +1,76 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DataDrivenShaderPlatformInfo.h"
+#include "GlobalShader.h"
+#include "RenderGraphResources.h"
+#include "Rendering/RaymarchTypes.h"
+#include "ShaderParameterStruct.h"
+
+// The occupancy proxy is a box wrapping the bricks that can contain visible samples (bricks with a brick distance of 0, see
+// BrickMapShaders.h). Drawing the volume with it instead of the whole cube only runs the raymarch material for pixels whose rays
+// go through the bounds of the visible bricks, and the material can start and end the rays at those bounds.
+
+/** Reads the brick occupancy of a volume back to the CPU, a bit per brick, without stalling the game or render thread. */
+class RAYMARCHER_API FBrickOccupancyReadback
+{
+public:
+	/// Enqueues packing and copying the current brick distances of Resources. Replaces a previous request that didn't arrive yet.
+	void Request(const FBasicRaymarchRenderingResources& Resources);
+
+	/// Returns true once per request, when the occupancy reached the CPU. OutOccupancy then has a bit per brick (X changing
+	/// fastest, 32 bricks per element) and OutBrickMapSize the size of the brick map.
+	bool Poll(TArray<uint32>& OutOccupancy, FIntVector& OutBrickMapSize);
+
+	/// Returns true while a request didn't arrive yet.
+	bool IsPending() const
+	{
+		return State.IsValid();
+	}
+
+private:
+	struct FState;
+	TSharedPtr<FState, ESPMode::ThreadSafe> State;
+};
+
+/** The proxy mesh, in the local space of the unit cube the volume is drawn with (-0.5 to 0.5). */
+struct RAYMARCHER_API FRaymarchOccupancyProxyMesh
+{
+	TArray<FVector> Vertices;
+
+	/// Normals point into the box, so the mesh is inside-out like the cube it replaces.
+	TArray<FVector> Normals;
+
+	TArray<int32> Triangles;
+
+	/// Bounds of the visible bricks in UVW space (0 to 1), empty if no brick is visible.
+	FBox Bounds = FBox(ForceInit);
+
+	/// Builds the box bounding all visible bricks, or nothing if no brick is visible. The mesh has to stay convex, the lit
+	/// material is translucent and would composite the volume twice where separate or concave pieces overlap on screen. Bricks
+	/// are clamped to VolumeSize, the last bricks along an axis can be partially outside of the volume.
+	void Build(const TArray<uint32>& Occupancy, const FIntVector& BrickMapSize, int32 BrickSize, const FIntVector& VolumeSize);
+};
+
+// Packs the brick distances into a bit per brick, set for visible bricks.
+class FPackBrickOccupancyShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FPackBrickOccupancyShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FPackBrickOccupancyShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE(Texture3D<float>, BrickDistance)
+		SHADER_PARAMETER_RDG_BUFFER_UAV(RWBuffer<uint>, Occupancy)
+		SHADER_PARAMETER(int32, NumWords)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
+	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
+	}
+};
@@ -0,0 +1,35 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Rendering/LightingCPUReference.h"
+
+class URenderTargetVolumeMipped;
+
+// A CPU implementation of the octree generation in GenerateOctreeShader.usf and DownsampleOctreeShader.usf, used to validate
+// the GPU octree and as a baseline to time it against.
+
+/** A min/max octree on the CPU, laid out the same way as the OctreeVolumeRenderTarget. */
+struct RAYMARCHER_API FRaymarchCPUOctree
+{
+	/// Size of the finest mip, which has a node per data volume voxel (padded with zeros).
+	FIntVector Size = FIntVector::ZeroValue;
+
+	/// Minimum (X) and maximum (Y) of every node, X changing fastest. Values are rounded to 16 bits, like the G16R16 octree.
+	TArray<TArray<FVector2f>> Mips;
+
+	/// Generates NumMips mips of an octree of OctreeSize from the data volume. Nodes of every mip are generated in parallel.
+	void Generate(const FRaymarchCPUVolumeData& Data, const FIntVector& OctreeSize, int32 NumMips);
+
+	/// Returns the size of a mip in nodes.
+	FIntVector GetMipSize(int32 Mip) const;
+};
+
+/// Compares every mip of an octree render target with a CPU octree of the same size on the GPU. Blocks until the render thread and
+/// the GPU are done.
+RAYMARCHER_API void CompareOctreeWithCPUReference(URenderTargetVolumeMipped* Octree, const FRaymarchCPUOctree& Reference,
+	float Tolerance, float& OutMaxDifference, uint32& OutMismatchedNodes);
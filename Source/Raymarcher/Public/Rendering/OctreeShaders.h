@@ -6,76 +6,112 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "DataDrivenShaderPlatformInfo.h"
 #include "GlobalShader.h"
 #include "RHICommandList.h"
+#include "RenderGraphResources.h"
 #include "Rendering/RaymarchTypes.h"
+#include "ShaderParameterStruct.h"
 #include "ShaderParameterUtils.h"
 #include "ShaderParameters.h"
 
+// Returns how many octree mips a volume of VolumeSize gets when RequestedNumMips are wanted. At least 2 and at most as many as it
+// takes to get to a single node along the volume's shortest axis.
+RAYMARCHER_API int32 GetOctreeNumMips(const FIntVector& VolumeSize, int32 RequestedNumMips);
+
+// Returns the size of the first mip of an octree with NumMips for a volume of VolumeSize. Every axis is rounded up to a multiple of
+// the coarsest node size (not to a power of two), so that every mip has exactly half the nodes of the previous one and node
+// (X, Y, Z) of mip M covers data voxels (X, Y, Z) * 2^M to (X, Y, Z) * 2^M + 2^M - 1.
+RAYMARCHER_API FIntVector GetOctreeSize(const FIntVector& VolumeSize, int32 NumMips);
+
 void GenerateOctreeForVolume_RenderThread(FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources);
 
-// A shader that generates a TF-independent octree accelerator structure for a volume.
+// Adds the octree generation passes to the render graph, one per mip. Octree is the registered OctreeVolumeRenderTarget from the
+// resources, all of its mips get generated.
+void AddGenerateOctreeForVolumePass(
+	FRDGBuilder& GraphBuilder, FRDGTextureRef Octree, const FBasicRaymarchRenderingResources& Resources);
+
+// Generates the octree with FGenerateOctreeSerialShader, the way it was generated before the mips got generated in parallel. Only
+// for timing the current generation against it, the octree has to have exactly 4 mips.
+RAYMARCHER_API void GenerateOctreeSerialBaseline_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources);
+
+// Regenerates only the octree nodes containing voxels in DirtyBoxes (in data volume voxels) and their ancestors, for when only
+// parts of the data volume changed. The rest of the octree has to be up to date already.
+void UpdateOctreeRegions_RenderThread(
+	FRHICommandListImmediate& RHICmdList, FBasicRaymarchRenderingResources Resources, TArray<FRaymarchVoxelBox> DirtyBoxes);
+
+// Adds the passes regenerating the nodes containing DirtyBoxes and their ancestors to the render graph, one per (merged) box and
+// mip. The work scales with the size of the boxes, not the size of the volume.
+void AddUpdateOctreeRegionsPasses(FRDGBuilder& GraphBuilder, FRDGTextureRef Octree,
+	const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes);
+
+// A shader that generates the finest mip of a TF-independent octree accelerator structure for a volume. Every node stores the
+// minimum and maximum value in it.
 class FGenerateOctreeShader : public FGlobalShader
 {
-	DECLARE_EXPORTED_SHADER_TYPE(FGenerateOctreeShader, Global, RAYMARCHER_API);
+	DECLARE_EXPORTED_GLOBAL_SHADER(FGenerateOctreeShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FGenerateOctreeShader, FGlobalShader);
 
-public:
-	FGenerateOctreeShader() : FGlobalShader()
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		// Volume texture to generate the octree from.
+		SHADER_PARAMETER_TEXTURE(Texture3D, Volume)
+		// First mip of the OctreeVolume to write.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, OctreeVolumeMip0)
+		// Nodes to generate, max exclusive.
+		SHADER_PARAMETER(FIntVector, RegionMin)
+		SHADER_PARAMETER(FIntVector, RegionMax)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	~FGenerateOctreeShader(){};
+// Generates one octree mip from the previous one, taking the minimum and maximum of every 2x2x2 nodes.
+class FDownsampleOctreeShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FDownsampleOctreeShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FDownsampleOctreeShader, FGlobalShader);
 
-	FGenerateOctreeShader(const ShaderMetaType::CompiledShaderInitializerType& Initializer) : FGlobalShader(Initializer)
-	{
-		Volume.Bind(Initializer.ParameterMap, TEXT("Volume"), SPF_Mandatory);
-		OctreeVolume0.Bind(Initializer.ParameterMap, TEXT("OctreeVolumeMip0"), SPF_Mandatory);
-		OctreeVolume1.Bind(Initializer.ParameterMap, TEXT("OctreeVolumeMip1"), SPF_Mandatory);
-		OctreeVolume2.Bind(Initializer.ParameterMap, TEXT("OctreeVolumeMip2"), SPF_Mandatory);
-		OctreeVolume3.Bind(Initializer.ParameterMap, TEXT("OctreeVolumeMip3"), SPF_Mandatory);
-		MinMaxValues.Bind(Initializer.ParameterMap, TEXT("MinMaxValues"), SPF_Mandatory);
-		LeafNodeSize.Bind(Initializer.ParameterMap, TEXT("LeafNodeSize"), SPF_Mandatory);
-		NumberOfMips.Bind(Initializer.ParameterMap, TEXT("NumberOfMips"), SPF_Mandatory);
-	}
-		
-	void SetGeneratingResources(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI, const FTexture3DRHIRef pVolume,
-		const FTexture3DComputeResource* ComputeResource, int InLeafNodeSize, int InNumberOfMips)
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		SHADER_PARAMETER_RDG_TEXTURE_SRV(Texture3D<float2>, SourceMip)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, DestinationMip)
+		// Nodes of DestinationMip to generate, max exclusive.
+		SHADER_PARAMETER(FIntVector, RegionMin)
+		SHADER_PARAMETER(FIntVector, RegionMax)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, pVolume);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume0, ComputeResource->UnorderedAccessViewRHIs[0]);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume1, ComputeResource->UnorderedAccessViewRHIs[1]);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume2, ComputeResource->UnorderedAccessViewRHIs[2]);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume3, ComputeResource->UnorderedAccessViewRHIs[3]);
-		SetShaderValue(RHICmdList, ShaderRHI, MinMaxValues, FVector2f(0.0, 1.0));
-		SetShaderValue(RHICmdList, ShaderRHI, LeafNodeSize, InLeafNodeSize);
-		SetShaderValue(RHICmdList, ShaderRHI, NumberOfMips, InNumberOfMips);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
+};
 
-	void UnbindResources(FRHICommandListImmediate& RHICmdList, FRHIComputeShader* ShaderRHI)
+// The previous octree generation shader, with one thread per 8^3 leaf block writing the leaf's nodes of all 4 mips. Kept as a
+// baseline for timing, see GenerateOctreeSerialBaseline_RenderThread().
+class FGenerateOctreeSerialShader : public FGlobalShader
+{
+	DECLARE_EXPORTED_GLOBAL_SHADER(FGenerateOctreeSerialShader, RAYMARCHER_API);
+	SHADER_USE_PARAMETER_STRUCT(FGenerateOctreeSerialShader, FGlobalShader);
+
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		// Volume texture to generate the octree from.
+		SHADER_PARAMETER_TEXTURE(Texture3D, Volume)
+		// OctreeVolume volume mips to modify.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, OctreeVolumeMip0)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, OctreeVolumeMip1)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, OctreeVolumeMip2)
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float2>, OctreeVolumeMip3)
+		// Length of the size of the cube that creates a single leaf. (Each leaf node will have LeafNodeSize^3 voxels)
+		SHADER_PARAMETER(int32, LeafNodeSize)
+		// Number of mips to generate.
+		SHADER_PARAMETER(int32, NumberOfMips)
+	END_SHADER_PARAMETER_STRUCT()
+
+	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
-		SetTextureParameter(RHICmdList, ShaderRHI, Volume, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume0, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume1, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume2, nullptr);
-		SetUAVParameter(RHICmdList, ShaderRHI, OctreeVolume3, nullptr);
+		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
-
-protected:
-	// Volume texture + transfer function resource parameters
-	LAYOUT_FIELD(FShaderResourceParameter, Volume);
-
-	// OctreeVolume volume mips to modify.
-	LAYOUT_FIELD(FShaderResourceParameter, OctreeVolume0);
-	LAYOUT_FIELD(FShaderResourceParameter, OctreeVolume1);
-	LAYOUT_FIELD(FShaderResourceParameter, OctreeVolume2);
-	LAYOUT_FIELD(FShaderResourceParameter, OctreeVolume3);
-
-	// Parameter for the added/removed multiplier.
-	LAYOUT_FIELD(FShaderParameter, MinMaxValues);
-	
-	// Length of the size of the cube that creates a single leaf. (Each leaf node will have LeafNodeSize^3 voxels)
-	LAYOUT_FIELD(FShaderParameter, LeafNodeSize);
-
-	// Number of mips to generate.
-	LAYOUT_FIELD(FShaderParameter, NumberOfMips)
-};
\ No newline at end of file
+};
@@ -0,0 +1,52 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Rendering/LightingCPUReference.h"
+
+// A CPU implementation of the opacity the lit raymarch in WindowedRaymarchMaterials.usf accumulates along a ray, with fixed
+// (PerformWindowedLitRaymarch) or adaptive (PerformWindowedLitRaymarchAdaptive) steps. Used to measure how close adaptive steps
+// get to a finely sampled ray and how many samples they save. Colors, lighting, jitter, clipping and empty space skipping are
+// left out - they don't change where the adaptive raymarch takes its samples.
+
+/** A brick map on the CPU, laid out the same way as the BrickMapRenderTarget. */
+struct RAYMARCHER_API FRaymarchCPUBrickMap
+{
+	/// Size of the brick map in bricks.
+	FIntVector Size = FIntVector::ZeroValue;
+
+	/// Length of the side of a brick in voxels.
+	int32 BrickSize = 0;
+
+	/// Minimum (X) and maximum (Y) of every brick including the voxels right around it, X changing fastest.
+	TArray<FVector2f> Bricks;
+
+	/// Highest transfer function opacity within every brick, laid out like Bricks. Same as the BrickStepOpacityRenderTarget.
+	TArray<float> StepOpacities;
+
+	/// Generates the brick map of the data volume, same as GenerateBrickMapShader.usf, and the step opacities under the data's
+	/// transfer function and windowing, same as BrickOccupancyShader.usf.
+	void Generate(const FRaymarchCPUVolumeData& Data, int32 InBrickSize);
+};
+
+/** What a raymarch of a single ray ended with. */
+struct FRaymarchCPURayResult
+{
+	/// Accumulated opacity, 1 if the ray terminated early.
+	float Opacity = 0.0f;
+
+	/// Number of samples taken along the ray.
+	int32 NumSamples = 0;
+};
+
+/// Marches a ray from EntryPos (UVW space) along the unit Direction for Thickness, with StepCount base steps per unit of UVW
+/// space. Without a brick map or with MaxStepScale of 1, every step has the base length like in PerformWindowedLitRaymarch,
+/// otherwise step lengths get picked like in PerformWindowedLitRaymarchAdaptive. Uses the default RAYMARCH_ADAPTIVE_STEP_OPACITY.
+/// The ray stops at TerminationOpacity and takes at most MaxStepsPerPixel steps (0 for no limit), same as GetBudgetedStepCount().
+RAYMARCHER_API FRaymarchCPURayResult RaymarchCPURay(const FRaymarchCPUVolumeData& Data, const FVector& EntryPos,
+	const FVector& Direction, float Thickness, float StepCount, const FRaymarchCPUBrickMap* BrickMap = nullptr,
+	float MaxStepScale = 1.0f, float TerminationOpacity = 0.95f, float MaxStepsPerPixel = 0.0f);
@@ -21,5 +21,16 @@ const static FName TransferFunction = "TransferFunction";
 const static FName Steps = "Steps";
 const static FName OctreeVolume = "OctreeVolume";
 const static FName OctreeMip = "OctreeMip";
+const static FName BrickDistanceVolume = "BrickDistanceVolume";
+const static FName EmptySpaceSkipping = "EmptySpaceSkipping";
+const static FName BrickStepOpacityVolume = "BrickStepOpacityVolume";
+const static FName BrickSize = "BrickSize";
+const static FName AdaptiveStepScale = "AdaptiveStepScale";
+const static FName TerminationOpacity = "TerminationOpacity";
+const static FName MaxStepsPerPixel = "MaxStepsPerPixel";
+const static FName OccupancyBoundsMin = "OccupancyBoundsMin";
+const static FName OccupancyBoundsMax = "OccupancyBoundsMax";
+const static FName HeadlightShadowStrength = "HeadlightShadowStrength";
+const static FName HeadlightGradientShading = "HeadlightGradientShading";
 
 }	 // namespace RaymarchParams
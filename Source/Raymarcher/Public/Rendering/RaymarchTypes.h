@@ -13,9 +13,56 @@
 
 #include "RaymarchTypes.generated.h"
 
+class FLightPropagationCheckpointCache;
 class UTextureRenderTargetVolume;
 
-// USTRUCT for Directional light parameters.
+/** Formats the light volume can be stored in. */
+UENUM(BlueprintType)
+enum class ERaymarchLightVolumeFormat : uint8
+{
+	/// 1 byte per voxel. Light above 1 gets clipped and repeated light changes accumulate visible rounding errors.
+	G8 UMETA(DisplayName = "G8"),
+	/// 2 bytes per voxel. Enough precision for repeated light changes in most cases.
+	R16F UMETA(DisplayName = "R16F"),
+	/// 4 bytes per voxel, the most precise.
+	R32F UMETA(DisplayName = "R32F"),
+	/// 4 bytes per voxel, unsigned floats with the same light in all 3 channels.
+	R11G11B10 UMETA(DisplayName = "R11G11B10F"),
+	/// 8 bytes per voxel. Every channel holds one light group (see ARaymarchLight::LightGroup), the groups get weighted into
+	/// a separate R16F light volume, so that groups can be re-weighted without propagating the lights again.
+	RGBA16FLightGroups UMETA(DisplayName = "RGBA16F (4 light groups)"),
+	/// 8 bytes per voxel. RGB holds the light multiplied by each light's color (see ARaymarchLight::LightColor), the lit
+	/// material multiplies the transfer function color by it. Alpha stays 0, that's how the material tells it apart.
+	RGBA16FColored UMETA(DisplayName = "RGBA16F (colored lights)")
+};
+
+/** What the lit material gets its light from. */
+UENUM(BlueprintType)
+enum class ERaymarchLightingModel : uint8
+{
+	/// Directional lights propagated through the volume.
+	DirectionalLights UMETA(DisplayName = "Directional Lights"),
+	/// Only ambient occlusion. Independent of the lights and the view, so it only changes with the transfer function or
+	/// windowing.
+	AmbientOcclusion UMETA(DisplayName = "Ambient Occlusion"),
+	/// Directional lights plus ambient light occluded by the ambient occlusion volume.
+	DirectionalLightsWithAmbientOcclusion UMETA(DisplayName = "Directional Lights + Ambient Occlusion")
+};
+
+/** Kinds of lights that can light a volume. */
+UENUM(BlueprintType)
+enum class ERaymarchLightType : uint8
+{
+	/// Parallel light coming from infinitely far away, propagated through the light volume slice by slice.
+	Directional,
+	/// Light shining in all directions from a position near or inside the volume. Ray cast into the light volume.
+	Point,
+	/// Point light limited to a cone.
+	Spot
+};
+
+// USTRUCT for Directional light parameters. Also describes point and spot lights (see LightType), so that all lights can be
+// tracked and compared the same way.
 USTRUCT(BlueprintType)
 struct FDirLightParameters
 {
@@ -24,20 +71,51 @@ struct FDirLightParameters
 	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") FVector LightDirection;
 	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") float LightIntensity;
 
-	FDirLightParameters(FVector LightDir, float LightInt) : LightDirection(LightDir), LightIntensity(LightInt){};
+	/// Channel of RGBA16FLightGroups light volumes this light goes into (0-3). Ignored by other formats.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") int32 LightGroup = 0;
+
+	/// Color of the light in RGBA16FColored light volumes. Ignored by other formats.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") FLinearColor LightColor = FLinearColor::White;
+
+	/// Type of the light. LightDirection is the axis of the cone for spot lights and ignored for point lights.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") ERaymarchLightType LightType = ERaymarchLightType::Directional;
+
+	/// World position of point and spot lights.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") FVector LightPosition = FVector::ZeroVector;
+
+	/// Distance (in world units) at which the light of point and spot lights falls off to zero.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") float AttenuationRadius = 0.0f;
+
+	/// Half-angles (in degrees) of the cone spot lights are at full intensity in and the cone they fall off to zero at.
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") float InnerConeAngle = 0.0f;
+	UPROPERTY(BlueprintReadWrite, Category = "DirLightParameters") float OuterConeAngle = 0.0f;
+
+	FDirLightParameters(
+		FVector LightDir, float LightInt, int32 InLightGroup = 0, const FLinearColor& InLightColor = FLinearColor::White)
+		: LightDirection(LightDir), LightIntensity(LightInt), LightGroup(InLightGroup), LightColor(InLightColor){};
 	FDirLightParameters() : LightDirection(FVector(0, 0, 0)), LightIntensity(0){};
 
 	// Equal operator for convenient checking if a light changed.
-	inline bool operator==(const FDirLightParameters& rhs)
+	inline bool operator==(const FDirLightParameters& rhs) const
 	{
-		return (this->LightDirection == rhs.LightDirection) && (this->LightIntensity == rhs.LightIntensity);
+		return (this->LightDirection == rhs.LightDirection) && (this->LightIntensity == rhs.LightIntensity) &&
+			   (this->LightGroup == rhs.LightGroup) && (this->LightColor == rhs.LightColor) &&
+			   (this->LightType == rhs.LightType) && (this->LightPosition == rhs.LightPosition) &&
+			   (this->AttenuationRadius == rhs.AttenuationRadius) && (this->InnerConeAngle == rhs.InnerConeAngle) &&
+			   (this->OuterConeAngle == rhs.OuterConeAngle);
 	}
 
 	// Inequality operator for convenient checking if a light changed.
-	inline bool operator!=(const FDirLightParameters& rhs)
+	inline bool operator!=(const FDirLightParameters& rhs) const
 	{
 		return !(*this == rhs);
 	}
+
+	// Point and spot lights get ray cast into the light volume instead of being propagated.
+	inline bool IsLocalLight() const
+	{
+		return LightType != ERaymarchLightType::Directional;
+	}
 };
 
 // USTRUCT for Clipping plane parameters.
@@ -70,19 +148,92 @@ struct FClippingPlaneParameters
 	}
 };
 
-// A structure for 4 switchable read-write buffers. Used for one axis. Need 2 pairs for change-light
-// shader.
-struct OneAxisReadWriteBufferResources
+// USTRUCT for a box of data volume voxels, e.g. a part of the volume that got changed. Min is inclusive, Max exclusive.
+USTRUCT(BlueprintType)
+struct FRaymarchVoxelBox
 {
-	// 2D Textures whose dimensions match the matching axis in the volume texture.
-	FTexture2DRHIRef Buffers[4];
-	// UAV refs to the Buffers, when we need to make a RWTexture out of them.
-	FUnorderedAccessViewRHIRef UAVs[4];
+	GENERATED_BODY()
+
+	/// First voxel in the box.
+	UPROPERTY(BlueprintReadWrite, Category = "RaymarchVoxelBox")
+	FIntVector Min = FIntVector::ZeroValue;
+
+	/// One past the last voxel in the box along every axis.
+	UPROPERTY(BlueprintReadWrite, Category = "RaymarchVoxelBox")
+	FIntVector Max = FIntVector::ZeroValue;
+
+	FRaymarchVoxelBox(FIntVector BoxMin, FIntVector BoxMax) : Min(BoxMin), Max(BoxMax){};
+	FRaymarchVoxelBox() = default;
+
+	bool IsEmpty() const
+	{
+		return Max.X <= Min.X || Max.Y <= Min.Y || Max.Z <= Min.Z;
+	}
+
+	FIntVector GetSize() const
+	{
+		return Max - Min;
+	}
+
+	bool Intersects(const FRaymarchVoxelBox& Other) const
+	{
+		return Min.X < Other.Max.X && Other.Min.X < Max.X && Min.Y < Other.Max.Y && Other.Min.Y < Max.Y && Min.Z < Other.Max.Z &&
+			   Other.Min.Z < Max.Z;
+	}
+
+	// Returns the smallest box containing both boxes.
+	FRaymarchVoxelBox Union(const FRaymarchVoxelBox& Other) const
+	{
+		return FRaymarchVoxelBox(
+			FIntVector(FMath::Min(Min.X, Other.Min.X), FMath::Min(Min.Y, Other.Min.Y), FMath::Min(Min.Z, Other.Min.Z)),
+			FIntVector(FMath::Max(Max.X, Other.Max.X), FMath::Max(Max.Y, Other.Max.Y), FMath::Max(Max.Z, Other.Max.Z)));
+	}
+
+	// Returns the part of the box inside a volume of Size.
+	FRaymarchVoxelBox ClampToSize(const FIntVector& Size) const
+	{
+		return FRaymarchVoxelBox(
+			FIntVector(FMath::Clamp(Min.X, 0, Size.X), FMath::Clamp(Min.Y, 0, Size.Y), FMath::Clamp(Min.Z, 0, Size.Z)),
+			FIntVector(FMath::Clamp(Max.X, 0, Size.X), FMath::Clamp(Max.Y, 0, Size.Y), FMath::Clamp(Max.Z, 0, Size.Z)));
+	}
+
+	// Returns the box of cells of CellSize^3 voxels (e.g. octree nodes) that contain any of the box's voxels.
+	FRaymarchVoxelBox GetCells(int32 CellSize) const
+	{
+		return FRaymarchVoxelBox(FIntVector(FMath::DivideAndRoundDown(Min.X, CellSize), FMath::DivideAndRoundDown(Min.Y, CellSize),
+									 FMath::DivideAndRoundDown(Min.Z, CellSize)),
+			FIntVector(FMath::DivideAndRoundUp(Max.X, CellSize), FMath::DivideAndRoundUp(Max.Y, CellSize),
+				FMath::DivideAndRoundUp(Max.Z, CellSize)));
+	}
+
+	// Merges overlapping boxes until none of them overlap, so that nothing gets regenerated twice. Drops empty boxes.
+	static void MergeOverlapping(TArray<FRaymarchVoxelBox>& Boxes)
+	{
+		Boxes.RemoveAll([](const FRaymarchVoxelBox& Box) { return Box.IsEmpty(); });
+		// The union can overlap boxes that were already checked, so start over after every merge. There are only ever a few boxes.
+		bool bMerged = true;
+		while (bMerged)
+		{
+			bMerged = false;
+			for (int32 i = 0; i < Boxes.Num() && !bMerged; i++)
+			{
+				for (int32 j = i + 1; j < Boxes.Num() && !bMerged; j++)
+				{
+					if (Boxes[i].Intersects(Boxes[j]))
+					{
+						Boxes[i] = Boxes[i].Union(Boxes[j]);
+						Boxes.RemoveAtSwap(j);
+						bMerged = true;
+					}
+				}
+			}
+		}
+	}
 };
 
 /** A structure holding all resources related to a single raymarchable volume - its texture ref, the
    TF texture ref and TF Range parameters,
-	light volume texture ref, and read-write buffers used for propagating along all axes. */
+	light volume texture ref and octree render target. Buffers used for propagating light are transient render graph textures. */
 USTRUCT(BlueprintType)
 struct FBasicRaymarchRenderingResources
 {
@@ -104,28 +255,63 @@ struct FBasicRaymarchRenderingResources
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
 	UTextureRenderTargetVolume* LightVolumeRenderTarget = nullptr;
 
+	/// Format the light volume render target was created with. Decides which channels the lights go into.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	ERaymarchLightVolumeFormat LightVolumeFormat = ERaymarchLightVolumeFormat::G8;
+
+	/// Single channel light volume the light groups of an RGBA16FLightGroups light volume get weighted into. This is the one
+	/// materials sample in that case. Null for other formats.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	UTextureRenderTargetVolume* ResolvedLightVolumeRenderTarget = nullptr;
+
 	/// Pointer to the illumination volume texture render target.
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
 	URenderTargetVolumeMipped* OctreeVolumeRenderTarget = nullptr;
 
-	/// If true, Light Volume texture will be created with it's side scaled down by 1/2 (-> 1/8 total voxels!)
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Basic Raymarch Rendering Resources")
-	bool LightVolumeHalfResolution = false;
+	/// Minimum and maximum value of every BrickSize^3 brick of the data volume, see BrickMapShaders.h.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	URenderTargetVolumeMipped* BrickMapRenderTarget = nullptr;
+
+	/// Distance (in bricks) from every brick to the closest one that can contain anything visible under the current transfer
+	/// function and windowing. Sampled by materials to skip empty space.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	URenderTargetVolumeMipped* BrickDistanceRenderTarget = nullptr;
+
+	/// Highest transfer function opacity within every brick, 0 for empty and homogeneous ones. Sampled by materials to pick the
+	/// length of adaptive steps, computed along with the brick distances.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	URenderTargetVolumeMipped* BrickStepOpacityRenderTarget = nullptr;
+
+	/// Length of the side of a brick of the brick map, in voxels.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	int32 BrickSize = 8;
+
+	/// If set, propagating directional lights skips sampling the volume in bricks BrickDistanceRenderTarget marks as empty. Only
+	/// set this while the brick distances are up to date with the transfer function and windowing.
+	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	bool bSkipEmptyBricksInLightPropagation = false;
+
+	/// Low resolution ambient occlusion volume, computed from the transfer function mapped opacity. Null unless the lighting
+	/// model uses ambient occlusion.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	UTextureRenderTargetVolume* AmbientOcclusionVolumeRenderTarget = nullptr;
+
+	/// Light volume (or resolved light volume) with the occluded ambient light added, sampled by materials when lighting with
+	/// both directional lights and ambient occlusion. Null otherwise.
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Basic Raymarch Rendering Resources")
+	UTextureRenderTargetVolume* CombinedLightVolumeRenderTarget = nullptr;
+
+	/// Replaced by ARaymarchVolume::LightVolumeDownscale, only kept to load older levels.
+	UPROPERTY()
+	bool LightVolumeHalfResolution_DEPRECATED = false;
 
 	/// Windowing parameters that dictate how a value read from the volume is transferred onto the transfer function.
 	UPROPERTY(BlueprintReadWrite, EditAnywhere)
 	FWindowingParameters WindowingParameters;
 
-	// Following is not visible in BPs, it's too low level to be useful in BP.
-
-	// Unordered access view to Octree accelerator structure.
-	FUnorderedAccessViewRHIRef OctreeUAVRef;
-	
-	// Unordered access view to the Light Volume. Used in our compute shaders as a RWTexture.
-	FUnorderedAccessViewRHIRef LightVolumeUAVRef;
-	
-	// Read-write buffers for all 3 major axes. Used in compute shaders.
-	OneAxisReadWriteBufferResources XYZReadWriteBuffers[3];
+	// Light propagated so far, stored at brick boundaries, so that propagation can restart at a dirty brick. Only touched on
+	// the render thread.
+	TSharedPtr<FLightPropagationCheckpointCache, ESPMode::ThreadSafe> PropagationCheckpoints;
 };
 
 /** Structure containing the world parameters required for light propagation shaders - these include
@@ -34,15 +34,107 @@ public:
 		const FDirLightParameters& LightParameters, const bool Added, const FRaymarchWorldParameters WorldParameters,
 		bool& LightAdded, bool bGPUSync = false);
 
+	/** Adds all provided lights to light volume, propagating lights that go along the same axis together. Much faster than
+	 * calling AddDirLightToSingleVolume for every light when resetting many lights. Also works for removing the lights by setting
+	 * bLightAdded to false.*/
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void AddDirLightsToSingleVolumeBatched(const FBasicRaymarchRenderingResources& Resources,
+		const TArray<FDirLightParameters>& LightParameters, const bool Added, const FRaymarchWorldParameters WorldParameters,
+		bool& LightsAdded);
+
+	/** Adds the light to the light volume once with the per-slice and once with the single-dispatch (GPU synced) propagation
+	 * and logs how much the results differ. Blocks the render thread until the GPU is done. Afterwards the light volume only
+	 * contains this light, so all lights need to be reset. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void CompareGPUSyncLightPropagation(const FBasicRaymarchRenderingResources& Resources,
+		const FDirLightParameters& LightParameters, const FRaymarchWorldParameters WorldParameters, float Tolerance = 0.01);
+
+	/** Propagates the lights into temporary light volumes of every supported light volume format and logs the memory, time and
+	 * error of each of them (see ERaymarchLightVolumeFormat). Blocks the render thread until the GPU is done, the light volume
+	 * in the resources is left untouched. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void BenchmarkLightVolumeFormats(const FBasicRaymarchRenderingResources& Resources,
+		const TArray<FDirLightParameters>& LightParameters, const FRaymarchWorldParameters WorldParameters, int32 NumChanges = 16,
+		float Tolerance = 0.01);
+
+	/** Sums the light groups of a RGBA16F light group volume into the resolved light volume, weighting each group by the
+	 * corresponding channel of LightGroupWeights. Lights can be re-weighted this way without being propagated again. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void ResolveLightGroups(
+		const FBasicRaymarchRenderingResources& Resources, const FLinearColor LightGroupWeights, bool& LightGroupsResolved);
+
+	/** Computes the ambient occlusion volume from the transfer function mapped opacity of the data volume. Radius is how far
+	 * occluders are looked for, as a fraction of the volume's longest side. Only needs recomputing when the transfer function or
+	 * windowing change. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void ComputeAmbientOcclusion(
+		const FBasicRaymarchRenderingResources& Resources, const float Radius, bool& AmbientOcclusionComputed);
+
+	/** Adds ambient light occluded by the ambient occlusion volume to the light volume, writing the result into the combined light
+	 * volume. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void CombineAmbientOcclusion(
+		const FBasicRaymarchRenderingResources& Resources, const float AmbientIntensity, bool& AmbientOcclusionCombined);
+
+	/** Copies one light volume into another of the same size and format, e.g. to save or restore a light volume snapshot. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void CopyLightVolume(
+		UTextureRenderTargetVolume* Source, UTextureRenderTargetVolume* Destination, bool& LightVolumeCopied);
+
+	/** Propagates the lights on the CPU (see LightingCPUReference.h) into a volume texture of the light volume's size, which can be
+	 * used in place of the light volume, e.g. to bake lighting offline. If AssetName is set, the texture is created as an asset in
+	 * the "Generated" folder, otherwise it's transient. Needs the CPU data of the data volume and transfer function and only bakes
+	 * directional lights. Blocks until done. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void BakeLightVolumeOnCPU(const FBasicRaymarchRenderingResources& Resources,
+		const TArray<FDirLightParameters>& LightParameters, const FRaymarchWorldParameters WorldParameters, const FString AssetName,
+		UVolumeTexture*& OutLightVolume, bool& LightVolumeBaked);
+
 	/** Changes a light in the light volume.	 */
 	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
 	static RAYMARCHER_API void ChangeDirLightInSingleVolume(FBasicRaymarchRenderingResources& Resources,
 		const FDirLightParameters OldLightParameters, const FDirLightParameters NewLightParameters,
 		const FRaymarchWorldParameters WorldParameters, bool& LightAdded, bool bGPUSync = false);
 
+	/** Recomputes the light in the dirty bricks after the clipping plane moved. LightParameters have to be the lights currently in
+	 * the light volume and OldWorldParameters the parameters they were propagated with. Not exposed to blueprints, the dirty bricks
+	 * are tracked by the raymarch volume. */
+	static RAYMARCHER_API void UpdateDirtyBricksInSingleVolume(const FBasicRaymarchRenderingResources& Resources,
+		const TArray<FDirLightParameters>& LightParameters, const FLightVolumeDirtyBricks& DirtyBricks,
+		const FRaymarchWorldParameters OldWorldParameters, const FRaymarchWorldParameters NewWorldParameters, bool& LightsUpdated);
+
+	/** Propagates the given chunks of lights into the light volume. Used to spread a full light volume reset over several
+	 * frames, chunks of one light axis need to be added in order. Not exposed to blueprints, the chunks are scheduled by the
+	 * raymarch volume. */
+	static RAYMARCHER_API void AddDirLightChunksToSingleVolume(const FBasicRaymarchRenderingResources& Resources,
+		const TArray<FDirLightPropagationChunk>& Chunks, const FRaymarchWorldParameters WorldParameters, bool& LightsAdded);
+
 	/** Generates an octree in the provided resources to accelerate raymarching through the volume.	 */
 	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
 	static RAYMARCHER_API void GenerateOctree(FBasicRaymarchRenderingResources& Resources);
+
+	/** Regenerates only the octree nodes containing the voxels in DirtyBoxes and their ancestors, after those parts of the data
+	 * volume changed (e.g. streamed in or edited). Costs time proportional to the size of the boxes instead of the volume. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void UpdateOctreeRegions(
+		const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes, bool& OctreeUpdated);
+
+	/** Generates the brick map (min/max of every brick) in the provided resources, used to skip empty space. Only needs rerunning
+	 * when the data volume changes. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void GenerateBrickMap(const FBasicRaymarchRenderingResources& Resources, bool& BrickMapGenerated);
+
+	/** Regenerates only the bricks of the brick map that contain voxels in DirtyBoxes, after those parts of the data volume
+	 * changed. Brick distances need recomputing afterwards. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void UpdateBrickMapRegions(
+		const FBasicRaymarchRenderingResources& Resources, const TArray<FRaymarchVoxelBox>& DirtyBoxes, bool& BrickMapUpdated);
+
+	/** Computes the distance from every brick to the closest one that can contain anything visible under the current transfer
+	 * function and windowing, and the step opacity of every brick. Doesn't touch the brick map, so it's cheap enough to run on
+	 * every transfer function or windowing change. */
+	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
+	static RAYMARCHER_API void ComputeBrickDistances(const FBasicRaymarchRenderingResources& Resources, bool& DistancesComputed);
 	
 	/** Clears a light volume in provided raymarch resources. */
 	UFUNCTION(BlueprintCallable, Category = "Raymarcher")
@@ -87,11 +179,6 @@ public:
 	*/
 	static RAYMARCHER_API void TextureToLocalCoords(FVector TextureCoors, FVector& LocalCoords);
 
-	static RAYMARCHER_API void CreateBufferTextures(
-		FIntPoint Size, EPixelFormat PixelFormat, OneAxisReadWriteBufferResources& RWBuffers);
-
-	static RAYMARCHER_API void ReleaseOneAxisReadWriteBufferResources(OneAxisReadWriteBufferResources& Buffer);
-
 	static RAYMARCHER_API FRHICommandListBase& GetCmdList()
 	{
 		return FRHICommandListExecutor::GetImmediateCommandList();
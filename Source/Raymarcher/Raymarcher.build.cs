@@ -50,6 +50,7 @@ public class Raymarcher : ModuleRules
 				"SlateCore",
 				"UMG",
 				"XRBase",
+				"ProceduralMeshComponent",
 				// ... add private dependencies that you statically link with here ...	
 			}
 		);
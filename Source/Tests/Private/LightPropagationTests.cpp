@@ -0,0 +1,570 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich .Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "CoreMinimal.h"
+#include "Actor/RaymarchLight.h"
+#include "Actor/RaymarchVolume.h"
+#include "Curves/CurveLinearColor.h"
+#include "Engine/Engine.h"
+#include "Engine/TextureRenderTargetVolume.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/AutomationTest.h"
+#include "RaymarchTestUtils.h"
+#include "Rendering/LightVolumeBricks.h"
+#include "Rendering/LightingCPUReference.h"
+#include "Rendering/LightingShaders.h"
+#include "RenderingThread.h"
+#include "Util/RaymarchUtils.h"
+#include "VolumeAsset/VolumeAsset.h"
+#include "VolumeTextureToolkit/Public/TextureUtilities.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RaymarchLightPropagationTests
+{
+// Side of the test volume, small enough for thousands of light changes to finish in seconds.
+constexpr int32 VolumeSide = 24;
+
+// Voxels differing by more than this count as mismatched.
+constexpr float Tolerance = 0.01f;
+
+// A sphere of medium density with a denser slab through it, so that light gets partially occluded along every axis.
+FRaymarchCPUVolumeData MakeTestVolumeData(const int32 Side = VolumeSide)
+{
+	FRaymarchCPUVolumeData Data;
+	Data.Size = FIntVector(Side);
+	Data.Values.SetNumUninitialized((int64) Side * Side * Side);
+	for (int32 Z = 0; Z < Side; Z++)
+	{
+		for (int32 Y = 0; Y < Side; Y++)
+		{
+			for (int32 X = 0; X < Side; X++)
+			{
+				const FVector UVW = (FVector(X, Y, Z) + 0.5) / Side;
+				float Value = (UVW - 0.5).Size() < 0.35 ? 0.5f : 0.0f;
+				if (FMath::Abs(UVW.Z - 0.3) < 0.05)
+				{
+					Value = 0.9f;
+				}
+				Data.Values[X + (int64) Side * (Y + (int64) Side * Z)] = Value;
+			}
+		}
+	}
+
+	// Linear ramp, fairly transparent so that some light makes it through the whole volume.
+	const int32 NumSamples = 256;
+	Data.TransferFunction.SetNumUninitialized(NumSamples);
+	for (int32 i = 0; i < NumSamples; i++)
+	{
+		const float Position = (float) i / (NumSamples - 1);
+		Data.TransferFunction[i] = FLinearColor(Position, Position, Position, 0.1f * Position);
+	}
+	return Data;
+}
+
+FRaymarchWorldParameters MakeTestWorldParameters()
+{
+	FRaymarchWorldParameters WorldParameters;
+	WorldParameters.VolumeTransform = FTransform(FQuat::Identity, FVector::ZeroVector, FVector(100.0));
+	// Same as a volume without a clipping plane.
+	WorldParameters.ClippingPlaneParameters = FClippingPlaneParameters(FVector(0, 0, 100000), FVector(0, 0, -1));
+	return WorldParameters;
+}
+
+// The first two lights propagate along the same major axes (so changing between them propagates both together), the third one
+// doesn't.
+TArray<FDirLightParameters> MakeTestLights()
+{
+	return {FDirLightParameters(FVector(-1.0, 0.3, -0.4).GetSafeNormal(), 1.0f),
+		FDirLightParameters(FVector(-1.0, 0.35, -0.45).GetSafeNormal(), 1.0f),
+		FDirLightParameters(FVector(0.2, -1.0, -0.5).GetSafeNormal(), 1.0f)};
+}
+
+// Adds Lights[0] to the light volume, then changes it to the following lights NumChanges times in a cycle. NumChanges has to be a
+// multiple of the number of lights, so that the light ends up being Lights[0] again.
+void ChangeLightRepeatedly(FRaymarchCPULightVolume& LightVolume, const FRaymarchCPUVolumeData& Data,
+	const TArray<FDirLightParameters>& Lights, const FRaymarchWorldParameters& WorldParameters, int32 NumChanges)
+{
+	check(NumChanges % Lights.Num() == 0);
+	AddDirLightToCPULightVolume(LightVolume, Data, Lights[0], true, WorldParameters);
+	for (int32 Change = 0; Change < NumChanges; Change++)
+	{
+		ChangeDirLightInCPULightVolume(
+			LightVolume, Data, Lights[Change % Lights.Num()], Lights[(Change + 1) % Lights.Num()], WorldParameters);
+	}
+}
+
+// Calls Reset NumRuns times and returns the average time the render thread spent on the commands Reset enqueued and the average
+// time until the GPU finished them. The first call is a warm-up that compiles the pipelines and isn't counted.
+void TimeLightReset(TFunctionRef<void()> Reset, const int32 NumRuns, double& OutRenderThreadMs, double& OutTotalMs)
+{
+	Reset();
+	RaymarchTestUtils::WaitForGPU();
+
+	// Only touched by the render thread until the commands get flushed.
+	double RenderThreadSeconds = 0.0;
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Run = 0; Run < NumRuns; Run++)
+	{
+		ENQUEUE_RENDER_COMMAND(StartResetTiming)
+		([&RenderThreadSeconds](FRHICommandListImmediate& RHICmdList) { RenderThreadSeconds -= FPlatformTime::Seconds(); });
+		Reset();
+		ENQUEUE_RENDER_COMMAND(StopResetTiming)
+		([&RenderThreadSeconds](FRHICommandListImmediate& RHICmdList) { RenderThreadSeconds += FPlatformTime::Seconds(); });
+	}
+	RaymarchTestUtils::WaitForGPU();
+	OutTotalMs = (FPlatformTime::Seconds() - StartTime) * 1000.0 / NumRuns;
+	OutRenderThreadMs = RenderThreadSeconds * 1000.0 / NumRuns;
+}
+}	 // namespace RaymarchLightPropagationTests
+
+using namespace RaymarchLightPropagationTests;
+using namespace RaymarchTestUtils;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchLightPropagationDriftTest, "Raymarcher.LightPropagation.IncrementalDrift",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Measures how far a light volume drifts from a freshly propagated one after thousands of light changes, for the single channel
+// light volume formats, and checks that the drift stays within what rounding and the skipped tiny changes explain. Runs on the
+// CPU reference only, so it also works headless with -nullrhi.
+bool FRaymarchLightPropagationDriftTest::RunTest(const FString& Parameters)
+{
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	const FRaymarchWorldParameters WorldParameters = MakeTestWorldParameters();
+	const TArray<FDirLightParameters> Lights = MakeTestLights();
+
+	// Changing back and forth between lights on the same axes should cancel out up to rounding. Cycling through all lights also
+	// mixes in separate removals and additions, where the skipped tiny changes don't cancel out.
+	const TArray<FDirLightParameters> SameAxesLights = {Lights[0], Lights[1]};
+	const int32 NumChanges = 2000;
+	const int32 NumCycleChanges = 999;
+
+	for (const ERaymarchLightVolumeFormat Format :
+		{ERaymarchLightVolumeFormat::G8, ERaymarchLightVolumeFormat::R16F, ERaymarchLightVolumeFormat::R32F})
+	{
+		const FString FormatName = UEnum::GetValueAsString(Format);
+
+		FRaymarchCPULightVolume Reference;
+		Reference.Init(Data.Size, Format);
+		AddDirLightToCPULightVolume(Reference, Data, Lights[0], true, WorldParameters);
+
+		FRaymarchCPULightVolume SameAxesHalfway;
+		SameAxesHalfway.Init(Data.Size, Format);
+		ChangeLightRepeatedly(SameAxesHalfway, Data, SameAxesLights, WorldParameters, NumChanges / 2);
+
+		FRaymarchCPULightVolume SameAxes;
+		SameAxes.Init(Data.Size, Format);
+		ChangeLightRepeatedly(SameAxes, Data, SameAxesLights, WorldParameters, NumChanges);
+
+		FRaymarchCPULightVolume Cycled;
+		Cycled.Init(Data.Size, Format);
+		ChangeLightRepeatedly(Cycled, Data, Lights, WorldParameters, NumCycleChanges);
+
+		int64 SameAxesMismatched, CycledMismatched, HalfwayMismatched;
+		const float SameAxesDrift = SameAxes.GetMaxDifference(Reference, Tolerance, SameAxesMismatched);
+		const float HalfwayDrift = SameAxesHalfway.GetMaxDifference(Reference, Tolerance, HalfwayMismatched);
+		const float CycledDrift = Cycled.GetMaxDifference(Reference, Tolerance, CycledMismatched);
+		AddInfo(FString::Printf(TEXT("%s: max drift %f (%lld voxels over %f) after %d changes between lights on the same axes ")
+									TEXT("(%f after %d), %f (%lld voxels) after %d changes cycling through all lights."),
+			*FormatName, SameAxesDrift, SameAxesMismatched, Tolerance, NumChanges, HalfwayDrift, NumChanges / 2, CycledDrift,
+			CycledMismatched, NumCycleChanges));
+
+		if (Format == ERaymarchLightVolumeFormat::R32F)
+		{
+			// Changing to a light and back writes (Light + Change) - Change, which is Light up to float rounding.
+			TestTrue(FString::Printf(TEXT("%s light volume doesn't drift when changing lights on the same axes"), *FormatName),
+				SameAxesDrift <= Tolerance);
+		}
+		else
+		{
+			// The smaller formats don't round back exactly. G8 clamps at 1 between the passes of the two axes, where the first
+			// axis' change can go over the top, and R16F rounds in bigger steps above 1 than below it. Both only lose what a single
+			// change rounds or clamps away, so the drift stops growing instead of adding up with every change.
+			TestTrue(FString::Printf(TEXT("%s light volume drift settles when changing lights on the same axes"), *FormatName),
+				SameAxesDrift <= HalfwayDrift + Tolerance);
+		}
+
+		// Separate removals cancel out separate additions and the changes between the first two lights cancel out each other,
+		// but the changes below 1e-3 the propagation skips while changing from the first to the second light don't get cancelled
+		// by anything. That's at most 1e-3 per axis and cycle. G8 rounds every separate removal and addition to 1/255, which is
+		// more than the skipped changes, and clamps at 1, so after a few hundred cycles it can be off by almost the whole range.
+		if (Format != ERaymarchLightVolumeFormat::G8)
+		{
+			const float MaxCycledDrift = (NumCycleChanges / Lights.Num()) * 2 * 1e-3f + Tolerance;
+			TestTrue(FString::Printf(TEXT("%s light volume drift stays below %f when cycling through all lights"), *FormatName,
+						 MaxCycledDrift),
+				CycledDrift <= MaxCycledDrift);
+		}
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchLightPropagationGPUTest, "Raymarcher.LightPropagation.CPUvsGPU",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Propagates the same lights on the GPU and with the CPU reference and compares the light volumes, once after adding a light and
+// once after a few hundred changes. Skipped when there's no GPU (e.g. -nullrhi).
+bool FRaymarchLightPropagationGPUTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	const FRaymarchWorldParameters WorldParameters = MakeTestWorldParameters();
+	const TArray<FDirLightParameters> Lights = MakeTestLights();
+
+	FBasicRaymarchRenderingResources Resources = MakeLightingResources(Data);
+	UTextureRenderTargetVolume* LightVolume = Resources.LightVolumeRenderTarget;
+
+	FRaymarchCPULightVolume Reference;
+	Reference.Init(Data.Size, ERaymarchLightVolumeFormat::R32F);
+	const int64 NumVoxels = Reference.Voxels.Num();
+
+	bool bLightAdded;
+	URaymarchUtils::AddDirLightToSingleVolume(Resources, Lights[0], true, WorldParameters, bLightAdded);
+	AddDirLightToCPULightVolume(Reference, Data, Lights[0], true, WorldParameters);
+	TestTrue(TEXT("Light added on the GPU"), bLightAdded);
+
+	float MaxDifference;
+	uint32 MismatchedVoxels;
+	CompareLightVolumeWithCPUReference(LightVolume, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("Added light: max difference %f, %u of %lld voxels over %f."), MaxDifference, MismatchedVoxels,
+		NumVoxels, Tolerance));
+	// Bilinear filtering on the GPU has less precise weights, so allow a few voxels to differ.
+	TestTrue(TEXT("GPU and CPU agree after adding a light"), MismatchedVoxels <= NumVoxels / 100);
+
+	const int32 NumChanges = 300;
+	for (int32 Change = 0; Change < NumChanges; Change++)
+	{
+		const FDirLightParameters& OldLight = Lights[Change % Lights.Num()];
+		const FDirLightParameters& NewLight = Lights[(Change + 1) % Lights.Num()];
+		URaymarchUtils::ChangeDirLightInSingleVolume(Resources, OldLight, NewLight, WorldParameters, bLightAdded);
+		ChangeDirLightInCPULightVolume(Reference, Data, OldLight, NewLight, WorldParameters);
+	}
+
+	CompareLightVolumeWithCPUReference(LightVolume, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("After %d changes: max difference %f, %u of %lld voxels over %f."), NumChanges, MaxDifference,
+		MismatchedVoxels, NumVoxels, Tolerance));
+	TestTrue(TEXT("GPU and CPU agree after changing lights"), MismatchedVoxels <= NumVoxels / 100);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchLightPropagationEmptyBricksTest, "Raymarcher.LightPropagation.EmptyBrickSkipping",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Propagates lights on the GPU while skipping the bricks the transfer function makes fully transparent and compares the light
+// volume with the CPU reference, which samples everything. Lights get added one at a time, then batched (the way ResetAllLights
+// adds them) and then changed. Most of the test volume around the sphere is empty. Skipped when there's no GPU (e.g. -nullrhi).
+bool FRaymarchLightPropagationEmptyBricksTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	const FRaymarchWorldParameters WorldParameters = MakeTestWorldParameters();
+	const TArray<FDirLightParameters> Lights = MakeTestLights();
+	FBasicRaymarchRenderingResources Resources = MakeLightingResources(Data);
+
+	// Small bricks, so that there are empty ones between the sphere and the volume's edges.
+	TestTrue(TEXT("Brick distances computed"), InitBrickDistances(Resources, 4));
+	Resources.bSkipEmptyBricksInLightPropagation = true;
+
+	FRaymarchCPULightVolume Reference;
+	Reference.Init(Data.Size, ERaymarchLightVolumeFormat::R32F);
+	const int64 NumVoxels = Reference.Voxels.Num();
+
+	bool bLightAdded;
+	URaymarchUtils::AddDirLightToSingleVolume(Resources, Lights[0], true, WorldParameters, bLightAdded);
+	AddDirLightToCPULightVolume(Reference, Data, Lights[0], true, WorldParameters);
+	TestTrue(TEXT("Light added on the GPU"), bLightAdded);
+
+	float MaxDifference;
+	uint32 MismatchedVoxels;
+	CompareLightVolumeWithCPUReference(Resources.LightVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("Skipping empty bricks: max difference %f, %u of %lld voxels over %f."), MaxDifference,
+		MismatchedVoxels, NumVoxels, Tolerance));
+	// Same allowance as without skipping, empty bricks don't change the light at all.
+	TestTrue(TEXT("GPU with empty brick skipping and CPU agree"), MismatchedVoxels <= NumVoxels / 100);
+
+	URaymarchUtils::AddDirLightsToSingleVolumeBatched(Resources, {Lights[1], Lights[2]}, true, WorldParameters, bLightAdded);
+	AddDirLightToCPULightVolume(Reference, Data, Lights[1], true, WorldParameters);
+	AddDirLightToCPULightVolume(Reference, Data, Lights[2], true, WorldParameters);
+	TestTrue(TEXT("Batched lights added on the GPU"), bLightAdded);
+
+	CompareLightVolumeWithCPUReference(Resources.LightVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("Skipping empty bricks in batched lights: max difference %f, %u of %lld voxels over %f."),
+		MaxDifference, MismatchedVoxels, NumVoxels, Tolerance));
+	TestTrue(TEXT("Batched GPU with empty brick skipping and CPU agree"), MismatchedVoxels <= NumVoxels / 100);
+
+	// Changes between the first two lights go through the change shader, the others remove and add the lights separately.
+	const int32 NumChanges = 30;
+	for (int32 Change = 0; Change < NumChanges; Change++)
+	{
+		const FDirLightParameters& OldLight = Lights[Change % Lights.Num()];
+		const FDirLightParameters& NewLight = Lights[(Change + 1) % Lights.Num()];
+		URaymarchUtils::ChangeDirLightInSingleVolume(Resources, OldLight, NewLight, WorldParameters, bLightAdded);
+		ChangeDirLightInCPULightVolume(Reference, Data, OldLight, NewLight, WorldParameters);
+	}
+
+	CompareLightVolumeWithCPUReference(Resources.LightVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("Skipping empty bricks in %d light changes: max difference %f, %u of %lld voxels over %f."),
+		NumChanges, MaxDifference, MismatchedVoxels, NumVoxels, Tolerance));
+	TestTrue(TEXT("Changed GPU with empty brick skipping and CPU agree"), MismatchedVoxels <= NumVoxels / 100);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchBatchedCheckpointsTest, "Raymarcher.LightPropagation.BatchedCheckpoints",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Adds lights batched (the way ResetAllLights adds them), moves the clipping plane through the bricks the first lights reach last
+// and only updates the dirty bricks, restarting from the checkpoints recorded by the batched propagation. Compares the light volume
+// with the CPU reference propagated with the new clipping plane. Skipped when there's no GPU (e.g. -nullrhi).
+bool FRaymarchBatchedCheckpointsTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	// Big enough for every axis to have more than one checkpoint.
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData(3 * RAYMARCH_LIGHT_VOLUME_BRICK_SIZE);
+	const TArray<FDirLightParameters> Lights = MakeTestLights();
+	FBasicRaymarchRenderingResources Resources = MakeLightingResources(Data);
+	Resources.PropagationCheckpoints = MakeShared<FLightPropagationCheckpointCache, ESPMode::ThreadSafe>();
+
+	// Clip away a thin and then a thicker layer of the -X side.
+	FRaymarchWorldParameters OldWorldParameters = MakeTestWorldParameters();
+	OldWorldParameters.ClippingPlaneParameters = FClippingPlaneParameters(FVector(-45, 0, 0), FVector(1, 0, 0));
+	FRaymarchWorldParameters NewWorldParameters = OldWorldParameters;
+	NewWorldParameters.ClippingPlaneParameters = FClippingPlaneParameters(FVector(-30, 0, 0), FVector(1, 0, 0));
+
+	bool bLightsAdded;
+	URaymarchUtils::AddDirLightsToSingleVolumeBatched(Resources, Lights, true, OldWorldParameters, bLightsAdded);
+	TestTrue(TEXT("Batched lights added on the GPU"), bLightsAdded);
+
+	// The render thread is idle after the flush, so the checkpoint cache can be looked at from here.
+	FlushRenderingCommands();
+	for (const FDirLightParameters& Light : Lights)
+	{
+		const FLightPropagationCheckpoints* Checkpoints = Resources.PropagationCheckpoints->Find(Light);
+		TestTrue(TEXT("Batched propagation recorded checkpoints"), Checkpoints && Checkpoints->Textures[0].IsValid());
+	}
+
+	FLightVolumeDirtyBricks DirtyBricks;
+	DirtyBricks.Init(Data.Size);
+	DirtyBricks.MarkClippingPlaneMoved(
+		GetLocalClippingParameters(OldWorldParameters), GetLocalClippingParameters(NewWorldParameters));
+	TestTrue(TEXT("Clipping plane moved through some of the bricks"),
+		DirtyBricks.IsDirty() && DirtyBricks.GetNumDirty() < DirtyBricks.GetNumBricks());
+
+	bool bLightsUpdated;
+	URaymarchUtils::UpdateDirtyBricksInSingleVolume(
+		Resources, Lights, DirtyBricks, OldWorldParameters, NewWorldParameters, bLightsUpdated);
+	TestTrue(TEXT("Dirty bricks updated on the GPU"), bLightsUpdated);
+
+	FRaymarchCPULightVolume Reference;
+	Reference.Init(Data.Size, ERaymarchLightVolumeFormat::R32F);
+	for (const FDirLightParameters& Light : Lights)
+	{
+		AddDirLightToCPULightVolume(Reference, Data, Light, true, NewWorldParameters);
+	}
+	const int64 NumVoxels = Reference.Voxels.Num();
+
+	float MaxDifference;
+	uint32 MismatchedVoxels;
+	CompareLightVolumeWithCPUReference(Resources.LightVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+	AddInfo(FString::Printf(TEXT("Updated %d of %d bricks after batched lights: max difference %f, %u of %lld voxels over %f."),
+		DirtyBricks.GetNumDirty(), DirtyBricks.GetNumBricks(), MaxDifference, MismatchedVoxels, NumVoxels, Tolerance));
+	TestTrue(TEXT("GPU restarted from batched checkpoints and CPU agree"), MismatchedVoxels <= NumVoxels / 100);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchAmortizedResetWindowingTest, "Raymarcher.LightPropagation.AmortizedResetWindowingChange",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Changes the windowing of a raymarch volume while an amortized light reset is running, ticks the volume until the reset is done
+// and compares its light volume with the CPU reference propagated with the new windowing. Skipped when there's no GPU (e.g.
+// -nullrhi).
+bool FRaymarchAmortizedResetWindowingTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	const FDirLightParameters Light = MakeTestLights()[0];
+
+	// Same data as the other tests, in a volume asset with a curve for the transfer function like the ones the importers create.
+	UVolumeAsset* VolumeAsset = NewObject<UVolumeAsset>();
+	TArray<float> VolumeValues = Data.Values;
+	UVolumeTextureToolkit::CreateVolumeTextureTransient(
+		VolumeAsset->DataTexture, PF_R32_FLOAT, Data.Size, reinterpret_cast<uint8*>(VolumeValues.GetData()));
+	VolumeAsset->TransferFuncCurve = NewObject<UCurveLinearColor>();
+	for (int32 Channel = 0; Channel < 4; Channel++)
+	{
+		VolumeAsset->TransferFuncCurve->FloatCurves[Channel].AddKey(0.0f, 0.0f);
+		VolumeAsset->TransferFuncCurve->FloatCurves[Channel].AddKey(1.0f, Channel == 3 ? 0.1f : 1.0f);
+	}
+	VolumeAsset->ImageInfo.WorldDimensions = FVector(1000.0);
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false);
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	ARaymarchLight* RaymarchLight = World->SpawnActor<ARaymarchLight>(FVector::ZeroVector, Light.LightDirection.Rotation());
+	RaymarchLight->LightIntensity = Light.LightIntensity;
+
+	ARaymarchVolume* Volume = World->SpawnActor<ARaymarchVolume>();
+	Volume->SelectRaymarchMaterial = ERaymarchMaterial::Lit;
+	Volume->LightVolumeFormat = ERaymarchLightVolumeFormat::R32F;
+	Volume->bAmortizeLightReset = true;
+	Volume->AmortizedLightResetFrames = 8;
+	Volume->LightsArray.Add(RaymarchLight);
+
+	if (TestTrue(TEXT("Volume asset set"), Volume->SetVolumeAsset(VolumeAsset)))
+	{
+		// The first tick starts the reset with the asset's windowing, the change has to start it over.
+		Volume->Tick(0.0f);
+		TestFalse(TEXT("Amortized reset started"), Volume->bRequestedRecompute);
+		const FWindowingParameters OldWindowing = Volume->RaymarchResources.WindowingParameters;
+		Volume->SetWindowCenter(0.3f);
+		for (int32 Frame = 0; Frame < 4 * Volume->AmortizedLightResetFrames; Frame++)
+		{
+			Volume->Tick(0.0f);
+		}
+		TestFalse(TEXT("Windowing change got applied"), Volume->bRequestedRecompute);
+
+		FRaymarchCPUVolumeData NewData, OldData;
+		const bool bDataRead = NewData.InitFromTextures(Volume->RaymarchResources.DataVolumeTextureRef,
+								   Volume->RaymarchResources.TFTextureRef, Volume->RaymarchResources.WindowingParameters) &&
+							   OldData.InitFromTextures(Volume->RaymarchResources.DataVolumeTextureRef,
+								   Volume->RaymarchResources.TFTextureRef, OldWindowing);
+		if (TestTrue(TEXT("Volume read back for the CPU reference"), bDataRead))
+		{
+			FRaymarchCPULightVolume Reference, OldReference;
+			Reference.Init(NewData.Size, ERaymarchLightVolumeFormat::R32F);
+			OldReference.Init(OldData.Size, ERaymarchLightVolumeFormat::R32F);
+			AddDirLightToCPULightVolume(Reference, NewData, RaymarchLight->GetCurrentParameters(), true, Volume->WorldParameters);
+			AddDirLightToCPULightVolume(
+				OldReference, OldData, RaymarchLight->GetCurrentParameters(), true, Volume->WorldParameters);
+			const int64 NumVoxels = Reference.Voxels.Num();
+
+			// Otherwise a reset finishing with the old windowing would pass as well.
+			int64 WindowingMismatched;
+			Reference.GetMaxDifference(OldReference, Tolerance, WindowingMismatched);
+			TestTrue(TEXT("Windowing change changes the light volume"), WindowingMismatched > NumVoxels / 100);
+
+			float MaxDifference;
+			uint32 MismatchedVoxels;
+			CompareLightVolumeWithCPUReference(
+				Volume->RaymarchResources.LightVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedVoxels);
+			AddInfo(FString::Printf(TEXT("Windowing changed mid-reset: max difference %f, %u of %lld voxels over %f."),
+				MaxDifference, MismatchedVoxels, NumVoxels, Tolerance));
+			TestTrue(TEXT("Light volume propagated with the new windowing"), MismatchedVoxels <= NumVoxels / 100);
+		}
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchLightResetTimingTest, "Raymarcher.LightPropagation.ResetTiming512",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::StressFilter)
+
+// Times a full light reset (clearing the light volume and adding all test lights) of a 512^3 volume, the way ResetAllLights does
+// it with and without batching lights, with the propagation passes on async compute and on the graphics queue. The lights also get
+// added binding every parameter per slice (AddDirLightToSingleLightVolumePerSliceBaseline_RenderThread) as a baseline. Reports the
+// render thread time of the commands recording and executing the passes and the time until the GPU finished them. Skipped when
+// there's no GPU (e.g. -nullrhi).
+bool FRaymarchLightResetTimingTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to time."));
+		return true;
+	}
+
+	IConsoleVariable* AsyncComputeVariable = IConsoleManager::Get().FindConsoleVariable(TEXT("r.Raymarcher.AsyncCompute"));
+	if (!TestNotNull(TEXT("Async compute console variable exists"), AsyncComputeVariable))
+	{
+		return false;
+	}
+	const int32 OriginalAsyncCompute = AsyncComputeVariable->GetInt();
+	if (!GSupportsEfficientAsyncCompute)
+	{
+		AddInfo(TEXT("This RHI doesn't support efficient async compute, both runs use the graphics queue."));
+	}
+
+	const int32 NumRuns = 5;
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData(512);
+	const FRaymarchWorldParameters WorldParameters = MakeTestWorldParameters();
+	const TArray<FDirLightParameters> Lights = MakeTestLights();
+	const FBasicRaymarchRenderingResources Resources = MakeLightingResources(Data);
+
+	for (const int32 AsyncCompute : {0, 1})
+	{
+		AsyncComputeVariable->Set(AsyncCompute, ECVF_SetByCode);
+		const TCHAR* Queue = AsyncCompute ? TEXT("async compute") : TEXT("graphics queue");
+
+		double RenderThreadMs, TotalMs;
+		TimeLightReset(
+			[&]() {
+				UVolumeTextureToolkit::ClearVolumeTexture(Resources.LightVolumeRenderTarget, 0);
+				for (const FDirLightParameters& Light : Lights)
+				{
+					bool bLightAdded;
+					URaymarchUtils::AddDirLightToSingleVolume(Resources, Light, true, WorldParameters, bLightAdded);
+				}
+			},
+			NumRuns, RenderThreadMs, TotalMs);
+		AddInfo(FString::Printf(TEXT("Reset of %d lights in a 512^3 volume, a light at a time, %s: render thread %.3f ms, ")
+									TEXT("until the GPU finished %.3f ms (average of %d)."),
+			Lights.Num(), Queue, RenderThreadMs, TotalMs, NumRuns));
+
+		TimeLightReset(
+			[&]() {
+				UVolumeTextureToolkit::ClearVolumeTexture(Resources.LightVolumeRenderTarget, 0);
+				for (const FDirLightParameters& Light : Lights)
+				{
+					ENQUEUE_RENDER_COMMAND(AddDirLightPerSliceBaseline)
+					([Resources, Light, WorldParameters](FRHICommandListImmediate& RHICmdList) {
+						AddDirLightToSingleLightVolumePerSliceBaseline_RenderThread(
+							RHICmdList, Resources, Light, true, WorldParameters);
+					});
+				}
+			},
+			NumRuns, RenderThreadMs, TotalMs);
+		AddInfo(FString::Printf(TEXT("Reset of %d lights in a 512^3 volume, a light at a time binding every parameter per slice, ")
+									TEXT("%s: render thread %.3f ms, until the GPU finished %.3f ms (average of %d)."),
+			Lights.Num(), Queue, RenderThreadMs, TotalMs, NumRuns));
+
+		TimeLightReset(
+			[&]() {
+				UVolumeTextureToolkit::ClearVolumeTexture(Resources.LightVolumeRenderTarget, 0);
+				bool bLightsAdded;
+				URaymarchUtils::AddDirLightsToSingleVolumeBatched(Resources, Lights, true, WorldParameters, bLightsAdded);
+			},
+			NumRuns, RenderThreadMs, TotalMs);
+		AddInfo(FString::Printf(TEXT("Reset of %d lights in a 512^3 volume, batched, %s: render thread %.3f ms, ")
+									TEXT("until the GPU finished %.3f ms (average of %d)."),
+			Lights.Num(), Queue, RenderThreadMs, TotalMs, NumRuns));
+	}
+
+	AsyncComputeVariable->Set(OriginalAsyncCompute, ECVF_SetByCode);
+	return true;
+}
+
+#endif	  // WITH_DEV_AUTOMATION_TESTS
@@ -0,0 +1,237 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich .Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "CoreMinimal.h"
+#include "Engine/VolumeTexture.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/AutomationTest.h"
+#include "RaymarchTestUtils.h"
+#include "Rendering/OctreeCPUReference.h"
+#include "Rendering/OctreeShaders.h"
+#include "RenderTargetVolumeMipped.h"
+#include "RenderingThread.h"
+#include "Util/RaymarchUtils.h"
+#include "VolumeTextureToolkit/Public/TextureUtilities.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RaymarchOctreeTests
+{
+// Both sides round to 16 bits, allow for the GPU converting the 8 bit data volume slightly differently.
+constexpr float Tolerance = 1.5f / 65535.0f;
+
+// Nested spheres of different values with some noise, so that nodes at every mip have different minimums and maximums. Values are
+// multiples of 1/255, so that the G8 data volume holds exactly the same values.
+TArray<uint8> MakeTestVolume(const FIntVector& Size)
+{
+	TArray<uint8> Voxels;
+	Voxels.SetNumUninitialized((int64) Size.X * Size.Y * Size.Z);
+	FRandomStream Random(42);
+	for (int32 Z = 0; Z < Size.Z; Z++)
+	{
+		for (int32 Y = 0; Y < Size.Y; Y++)
+		{
+			for (int32 X = 0; X < Size.X; X++)
+			{
+				const float Distance = ((FVector(X, Y, Z) + 0.5) / FVector(Size) - 0.5).Size();
+				const int32 Shell = Distance < 0.2 ? 200 : (Distance < 0.4 ? 100 : 0);
+				Voxels[X + (int64) Size.X * (Y + (int64) Size.Y * Z)] = (uint8) (Shell + Random.RandHelper(40));
+			}
+		}
+	}
+	return Voxels;
+}
+
+FRaymarchCPUVolumeData MakeCPUVolumeData(const FIntVector& Size, const TArray<uint8>& Voxels)
+{
+	FRaymarchCPUVolumeData Data;
+	Data.Size = Size;
+	Data.Values.SetNumUninitialized(Voxels.Num());
+	for (int64 i = 0; i < Voxels.Num(); i++)
+	{
+		Data.Values[i] = Voxels[i] / 255.0f;
+	}
+	return Data;
+}
+
+// Uploads the volume and creates an octree render target for it, the same way the raymarch volume creates it's resources.
+FBasicRaymarchRenderingResources MakeOctreeResources(const FIntVector& Size, TArray<uint8>& Voxels, int32 NumMips)
+{
+	FBasicRaymarchRenderingResources Resources;
+	UVolumeTextureToolkit::CreateVolumeTextureTransient(Resources.DataVolumeTextureRef, PF_G8, Size, Voxels.GetData());
+
+	Resources.OctreeVolumeRenderTarget =
+		RaymarchTestUtils::CreateVolumeRenderTarget(GetOctreeSize(Size, NumMips), NumMips, PF_G16R16, false);
+	Resources.bIsInitialized = true;
+	FlushRenderingCommands();
+	return Resources;
+}
+
+// Returns how long Generate takes on average over NumRuns, including waiting for the GPU. The first run is a warm-up that compiles
+// the pipelines.
+double TimeOctreeGeneration(TFunctionRef<void()> Generate, int32 NumRuns)
+{
+	Generate();
+	RaymarchTestUtils::WaitForGPU();
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32 Run = 0; Run < NumRuns; Run++)
+	{
+		Generate();
+	}
+	RaymarchTestUtils::WaitForGPU();
+	return (FPlatformTime::Seconds() - StartTime) * 1000.0 / NumRuns;
+}
+}	 // namespace RaymarchOctreeTests
+
+using namespace RaymarchOctreeTests;
+using namespace RaymarchTestUtils;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchOctreeGPUTest, "Raymarcher.Octree.CPUvsGPU",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Generates the octree of a volume whose sizes aren't powers of two (or multiples of the coarsest node size) on the GPU and with
+// the CPU reference and compares all mips. Skipped when there's no GPU (e.g. -nullrhi).
+bool FRaymarchOctreeGPUTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	const FIntVector Size(70, 48, 41);
+	const int32 NumMips = 5;
+	TArray<uint8> Voxels = MakeTestVolume(Size);
+	FBasicRaymarchRenderingResources Resources = MakeOctreeResources(Size, Voxels, NumMips);
+
+	URaymarchUtils::GenerateOctree(Resources);
+
+	FRaymarchCPUOctree Reference;
+	Reference.Generate(MakeCPUVolumeData(Size, Voxels), GetOctreeSize(Size, NumMips), NumMips);
+
+	float MaxDifference;
+	uint32 MismatchedNodes;
+	CompareOctreeWithCPUReference(Resources.OctreeVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedNodes);
+	AddInfo(FString::Printf(TEXT("Max difference %f, %u nodes over %f."), MaxDifference, MismatchedNodes, Tolerance));
+	TestEqual(TEXT("GPU and CPU octrees match"), MismatchedNodes, 0u);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchOctreePartialUpdateTest, "Raymarcher.Octree.PartialUpdate",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Generates the octree of a volume, changes a few boxes of voxels (one of them crossing node boundaries of every mip, two of them
+// overlapping), updates only those regions of the octree and compares all mips with the CPU reference of the changed volume.
+// Skipped when there's no GPU (e.g. -nullrhi).
+bool FRaymarchOctreePartialUpdateTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to compare the CPU reference with."));
+		return true;
+	}
+
+	const FIntVector Size(70, 48, 41);
+	const int32 NumMips = 5;
+	TArray<uint8> Voxels = MakeTestVolume(Size);
+	FBasicRaymarchRenderingResources Resources = MakeOctreeResources(Size, Voxels, NumMips);
+
+	URaymarchUtils::GenerateOctree(Resources);
+
+	const TArray<FRaymarchVoxelBox> DirtyBoxes = {FRaymarchVoxelBox(FIntVector(13, 5, 30), FIntVector(35, 20, 33)),
+		FRaymarchVoxelBox(FIntVector(60, 40, 0), FIntVector(70, 48, 9)),
+		FRaymarchVoxelBox(FIntVector(30, 18, 31), FIntVector(33, 26, 40))};
+	for (const FRaymarchVoxelBox& Box : DirtyBoxes)
+	{
+		for (int32 Z = Box.Min.Z; Z < Box.Max.Z; Z++)
+		{
+			for (int32 Y = Box.Min.Y; Y < Box.Max.Y; Y++)
+			{
+				for (int32 X = Box.Min.X; X < Box.Max.X; X++)
+				{
+					// Both values the test volume doesn't have, so the edit changes the minimums and maximums of the nodes.
+					Voxels[X + (int64) Size.X * (Y + (int64) Size.Y * Z)] = (X + Y + Z) % 2 ? 255 : 0;
+				}
+			}
+		}
+	}
+
+	// Stands in for the raymarch volume updating its data texture, the octree keeps the nodes generated from the old one.
+	UVolumeTextureToolkit::CreateVolumeTextureTransient(Resources.DataVolumeTextureRef, PF_G8, Size, Voxels.GetData());
+	FlushRenderingCommands();
+
+	bool bOctreeUpdated;
+	URaymarchUtils::UpdateOctreeRegions(Resources, DirtyBoxes, bOctreeUpdated);
+	TestTrue(TEXT("Octree regions updated"), bOctreeUpdated);
+
+	FRaymarchCPUOctree Reference;
+	Reference.Generate(MakeCPUVolumeData(Size, Voxels), GetOctreeSize(Size, NumMips), NumMips);
+
+	float MaxDifference;
+	uint32 MismatchedNodes;
+	CompareOctreeWithCPUReference(Resources.OctreeVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedNodes);
+	AddInfo(FString::Printf(TEXT("Max difference %f, %u nodes over %f."), MaxDifference, MismatchedNodes, Tolerance));
+	TestEqual(TEXT("Partially updated GPU octree matches the CPU octree of the changed volume"), MismatchedNodes, 0u);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchOctreeTimingTest, "Raymarcher.Octree.Timing512",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::StressFilter)
+
+// Times generating all mips of the octree of a 512^3 volume on the GPU and with the (parallel) CPU reference. The serial shader
+// the octree used to be generated with only writes 4 mips, so a 4 mip octree gets timed with both the serial shader and the
+// current passes. Every GPU octree is checked against the CPU reference.
+bool FRaymarchOctreeTimingTest::RunTest(const FString& Parameters)
+{
+	if (!CanUseGPU())
+	{
+		AddInfo(TEXT("Skipping, there is no GPU to time."));
+		return true;
+	}
+
+	const FIntVector Size(512);
+	const int32 NumRuns = 5;
+	TArray<uint8> Voxels = MakeTestVolume(Size);
+	const FRaymarchCPUVolumeData Data = MakeCPUVolumeData(Size, Voxels);
+	float MaxDifference;
+	uint32 MismatchedNodes;
+
+	for (const int32 NumMips : {4, 8})
+	{
+		FBasicRaymarchRenderingResources Resources = MakeOctreeResources(Size, Voxels, NumMips);
+
+		FRaymarchCPUOctree Reference;
+		const double StartTime = FPlatformTime::Seconds();
+		Reference.Generate(Data, GetOctreeSize(Size, NumMips), NumMips);
+		const double CPUMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+
+		if (NumMips == 4)
+		{
+			const double SerialMs = TimeOctreeGeneration(
+				[&Resources]()
+				{
+					ENQUEUE_RENDER_COMMAND(GenerateOctreeSerial)
+					([Resources](FRHICommandListImmediate& RHICmdList)
+						{ GenerateOctreeSerialBaseline_RenderThread(RHICmdList, Resources); });
+				},
+				NumRuns);
+			AddInfo(FString::Printf(
+				TEXT("Octree of a 512^3 volume with 4 mips: previous serial shader %.3f ms (average of %d)."), SerialMs, NumRuns));
+
+			CompareOctreeWithCPUReference(Resources.OctreeVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedNodes);
+			TestEqual(TEXT("Serial GPU and CPU octrees match"), MismatchedNodes, 0u);
+		}
+
+		const double GPUMs = TimeOctreeGeneration([&Resources]() { URaymarchUtils::GenerateOctree(Resources); }, NumRuns);
+		AddInfo(FString::Printf(TEXT("Octree of a 512^3 volume with %d mips: GPU %.3f ms (average of %d), CPU reference %.3f ms."),
+			NumMips, GPUMs, NumRuns, CPUMs));
+
+		CompareOctreeWithCPUReference(Resources.OctreeVolumeRenderTarget, Reference, Tolerance, MaxDifference, MismatchedNodes);
+		TestEqual(TEXT("GPU and CPU octrees match"), MismatchedNodes, 0u);
+	}
+	return true;
+}
+
+#endif	  // WITH_DEV_AUTOMATION_TESTS
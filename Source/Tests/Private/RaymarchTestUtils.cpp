@@ -0,0 +1,96 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich .Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "RaymarchTestUtils.h"
+
+#include "Engine/Texture2D.h"
+#include "Engine/TextureRenderTargetVolume.h"
+#include "Engine/VolumeTexture.h"
+#include "Misc/App.h"
+#include "RHI.h"
+#include "Rendering/BrickMapShaders.h"
+#include "Rendering/LightingCPUReference.h"
+#include "RenderTargetVolumeMipped.h"
+#include "RenderingThread.h"
+#include "Util/RaymarchUtils.h"
+#include "VolumeTextureToolkit/Public/TextureUtilities.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RaymarchTestUtils
+{
+bool CanUseGPU()
+{
+	return FApp::CanEverRender() && GDynamicRHI && RHIGetInterfaceType() != ERHIInterfaceType::Null;
+}
+
+void WaitForGPU()
+{
+	ENQUEUE_RENDER_COMMAND(WaitForGPU)
+	([](FRHICommandListImmediate& RHICmdList) {
+		RHICmdList.SubmitCommandsAndFlushGPU();
+		RHICmdList.BlockUntilGPUIdle();
+	});
+	FlushRenderingCommands();
+}
+
+URenderTargetVolumeMipped* CreateVolumeRenderTarget(const FIntVector& Size, int32 NumMips, EPixelFormat Format, bool bHDR)
+{
+	URenderTargetVolumeMipped* RenderTarget = NewObject<URenderTargetVolumeMipped>();
+	RenderTarget->bCanCreateUAV = true;
+	RenderTarget->bHDR = bHDR;
+	RenderTarget->Init(Size.X, Size.Y, Size.Z, NumMips, Format);
+	RenderTarget->UpdateResourceImmediate(true);
+	return RenderTarget;
+}
+
+FBasicRaymarchRenderingResources MakeLightingResources(const FRaymarchCPUVolumeData& Data)
+{
+	FBasicRaymarchRenderingResources Resources;
+	TArray<float> VolumeValues = Data.Values;
+	UVolumeTextureToolkit::CreateVolumeTextureTransient(
+		Resources.DataVolumeTextureRef, PF_R32_FLOAT, Data.Size, reinterpret_cast<uint8*>(VolumeValues.GetData()));
+
+	TArray<FFloat16> TFSamples;
+	for (const FLinearColor& Sample : Data.TransferFunction)
+	{
+		TFSamples.Append({FFloat16(Sample.R), FFloat16(Sample.G), FFloat16(Sample.B), FFloat16(Sample.A)});
+	}
+	UVolumeTextureToolkit::Create2DTextureTransient(Resources.TFTextureRef, PF_FloatRGBA,
+		FIntPoint(Data.TransferFunction.Num(), 1), reinterpret_cast<uint8*>(TFSamples.GetData()));
+
+	UTextureRenderTargetVolume* LightVolume = NewObject<UTextureRenderTargetVolume>();
+	LightVolume->bCanCreateUAV = true;
+	LightVolume->bHDR = true;
+	LightVolume->Init(Data.Size.X, Data.Size.Y, Data.Size.Z, PF_R32_FLOAT);
+	LightVolume->UpdateResourceImmediate(true);
+
+	Resources.LightVolumeRenderTarget = LightVolume;
+	Resources.LightVolumeFormat = ERaymarchLightVolumeFormat::R32F;
+	Resources.WindowingParameters = Data.WindowingParameters;
+	Resources.bIsInitialized = true;
+	FlushRenderingCommands();
+	return Resources;
+}
+
+bool InitBrickDistances(FBasicRaymarchRenderingResources& Resources, int32 BrickSize)
+{
+	UVolumeTexture* DataVolume = Resources.DataVolumeTextureRef;
+	const FIntVector VolumeSize(DataVolume->GetSizeX(), DataVolume->GetSizeY(), DataVolume->GetSizeZ());
+	const FIntVector BrickMapSize = GetBrickMapSize(VolumeSize, BrickSize);
+
+	Resources.BrickSize = BrickSize;
+	Resources.BrickMapRenderTarget = CreateVolumeRenderTarget(BrickMapSize, 1, PF_G32R32F, true);
+	Resources.BrickDistanceRenderTarget = CreateVolumeRenderTarget(BrickMapSize, 1, PF_G8, false);
+	Resources.BrickStepOpacityRenderTarget = CreateVolumeRenderTarget(BrickMapSize, 1, PF_R16F, true);
+	FlushRenderingCommands();
+
+	bool bBrickMapGenerated, bDistancesComputed;
+	URaymarchUtils::GenerateBrickMap(Resources, bBrickMapGenerated);
+	URaymarchUtils::ComputeBrickDistances(Resources, bDistancesComputed);
+	return bBrickMapGenerated && bDistancesComputed;
+}
+}	 // namespace RaymarchTestUtils
+
+#endif	  // WITH_DEV_AUTOMATION_TESTS
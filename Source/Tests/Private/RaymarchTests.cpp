@@ -0,0 +1,307 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich .Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Rendering/OccupancyProxy.h"
+#include "Rendering/RaymarchCPUReference.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace RaymarchRaymarchTests
+{
+constexpr int32 VolumeSide = 64;
+
+// Base steps of the reference rays, fine enough to count as the exact result.
+constexpr float ReferenceStepCount = 2048.0f;
+
+// A homogeneous opaque core inside a homogeneous medium shell, surrounded by faint fog with a gradient - homogeneous, transparent
+// and transition regions for the adaptive steps to tell apart.
+FRaymarchCPUVolumeData MakeTestVolumeData()
+{
+	FRaymarchCPUVolumeData Data;
+	Data.Size = FIntVector(VolumeSide);
+	Data.Values.SetNumUninitialized(VolumeSide * VolumeSide * VolumeSide);
+	for (int32 Z = 0; Z < VolumeSide; Z++)
+	{
+		for (int32 Y = 0; Y < VolumeSide; Y++)
+		{
+			for (int32 X = 0; X < VolumeSide; X++)
+			{
+				const FVector UVW = (FVector(X, Y, Z) + 0.5) / VolumeSide;
+				const double Distance = (UVW - 0.5).Size();
+				const double Value = Distance < 0.2 ? 0.9 : (Distance < 0.35 ? 0.5 : 0.1 + 0.1 * UVW.X);
+				Data.Values[X + VolumeSide * (Y + VolumeSide * Z)] = FMath::RoundToFloat(Value * 255.0) / 255.0f;
+			}
+		}
+	}
+
+	// Steps between fog, medium and core opacities.
+	const int32 NumSamples = 256;
+	Data.TransferFunction.SetNumUninitialized(NumSamples);
+	for (int32 i = 0; i < NumSamples; i++)
+	{
+		const float Position = (i + 0.5f) / NumSamples;
+		const float Alpha = Position < 0.3f ? 0.002f : (Position < 0.7f ? 0.05f : 0.3f);
+		Data.TransferFunction[i] = FLinearColor(Position, Position, Position, Alpha);
+	}
+	return Data;
+}
+
+// A ray entering the volume, in UVW space.
+struct FTestRay
+{
+	FVector EntryPos;
+	float Thickness;
+};
+
+// Parallel rays along Direction through a grid covering the volume, only the ones that hit it.
+TArray<FTestRay> MakeTestRays(const FVector& Direction, int32 GridSide)
+{
+	const FVector Right = FVector(-Direction.Y, Direction.X, 0.0).GetSafeNormal();
+	const FVector Up = Direction ^ Right;
+	TArray<FTestRay> Rays;
+	for (int32 j = 0; j < GridSide; j++)
+	{
+		for (int32 i = 0; i < GridSide; i++)
+		{
+			const FVector Origin = FVector(0.5) - 2.0 * Direction + ((i + 0.5) / GridSide * 1.6 - 0.8) * Right +
+								   ((j + 0.5) / GridSide * 1.6 - 0.8) * Up;
+			double Entry = -UE_BIG_NUMBER;
+			double Exit = UE_BIG_NUMBER;
+			for (int32 Axis = 0; Axis < 3; Axis++)
+			{
+				const double TimeToMin = -Origin[Axis] / Direction[Axis];
+				const double TimeToMax = (1.0 - Origin[Axis]) / Direction[Axis];
+				Entry = FMath::Max(Entry, FMath::Min(TimeToMin, TimeToMax));
+				Exit = FMath::Min(Exit, FMath::Max(TimeToMin, TimeToMax));
+			}
+			if (Exit > Entry)
+			{
+				Rays.Add({Origin + Entry * Direction, float(Exit - Entry)});
+			}
+		}
+	}
+	return Rays;
+}
+}	 // namespace RaymarchRaymarchTests
+
+using namespace RaymarchRaymarchTests;
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchAdaptiveStepsTest, "Raymarcher.Raymarch.AdaptiveSteps",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Benchmarks quality against steps of the adaptive raymarch and the fixed step one. Rays get marched with both at a few step
+// counts and compared to finely sampled reference rays. Adaptive steps need to take clearly fewer samples without getting less
+// accurate than fixed steps with the same base step.
+bool FRaymarchAdaptiveStepsTest::RunTest(const FString& Parameters)
+{
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	FRaymarchCPUBrickMap BrickMap;
+	BrickMap.Generate(Data, 8);
+	const FVector Direction = FVector(1.0, 0.7, 0.4).GetSafeNormal();
+	const TArray<FTestRay> Rays = MakeTestRays(Direction, 32);
+	const float MaxStepScale = 4.0f;
+
+	TArray<float> Reference;
+	for (const FTestRay& Ray : Rays)
+	{
+		Reference.Add(RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, ReferenceStepCount).Opacity);
+	}
+
+	for (const float StepCount : {64.0f, 128.0f, 256.0f})
+	{
+		double Error[2] = {0.0, 0.0};
+		int64 NumSamples[2] = {0, 0};
+		for (int32 RayIndex = 0; RayIndex < Rays.Num(); RayIndex++)
+		{
+			const FTestRay& Ray = Rays[RayIndex];
+			const FRaymarchCPURayResult Fixed = RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount);
+			const FRaymarchCPURayResult Adaptive =
+				RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount, &BrickMap, MaxStepScale);
+			Error[0] += FMath::Abs(Fixed.Opacity - Reference[RayIndex]) / Rays.Num();
+			Error[1] += FMath::Abs(Adaptive.Opacity - Reference[RayIndex]) / Rays.Num();
+			NumSamples[0] += Fixed.NumSamples;
+			NumSamples[1] += Adaptive.NumSamples;
+		}
+
+		AddInfo(FString::Printf(TEXT("%.0f steps: fixed %.1f samples per ray, mean error %.5f; adaptive (up to %.0fx) %.1f samples "
+									 "per ray, mean error %.5f."),
+			StepCount, double(NumSamples[0]) / Rays.Num(), Error[0], MaxStepScale, double(NumSamples[1]) / Rays.Num(), Error[1]));
+		TestTrue(FString::Printf(TEXT("Adaptive steps take fewer samples at %.0f steps"), StepCount),
+			NumSamples[1] < NumSamples[0] * 3 / 4);
+		TestTrue(FString::Printf(TEXT("Adaptive steps are as accurate as fixed ones at %.0f steps"), StepCount),
+			Error[1] <= Error[0] * 1.5 + 1e-4);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchBrickStepOpacityTest, "Raymarcher.Raymarch.BrickStepOpacity",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Checks that the step opacity of every brick that isn't homogeneous bounds the opacity of every voxel in it, with a transfer
+// function that is opaque only in narrow spikes between the minimum, middle and maximum of the bricks' ranges, which the adaptive
+// steps need to catch.
+bool FRaymarchBrickStepOpacityTest::RunTest(const FString& Parameters)
+{
+	FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	for (int32 i = 0; i < Data.TransferFunction.Num(); i++)
+	{
+		Data.TransferFunction[i].A = i % 16 == 5 ? 0.5f : 0.0f;
+	}
+	FRaymarchCPUBrickMap BrickMap;
+	BrickMap.Generate(Data, 8);
+
+	int32 NumUnderestimated = 0;
+	int32 NumSpikes = 0;
+	for (int32 Z = 0; Z < Data.Size.Z; Z++)
+	{
+		for (int32 Y = 0; Y < Data.Size.Y; Y++)
+		{
+			for (int32 X = 0; X < Data.Size.X; X++)
+			{
+				const float Value = Data.Values[X + (int64) Data.Size.X * (Y + (int64) Data.Size.Y * Z)];
+				const FIntVector Brick = FIntVector(X, Y, Z) / BrickMap.BrickSize;
+				const int64 BrickIndex = Brick.X + (int64) BrickMap.Size.X * (Brick.Y + (int64) BrickMap.Size.Y * Brick.Z);
+				const FVector2f& MinMax = BrickMap.Bricks[BrickIndex];
+				// Homogeneous bricks get the longest steps whatever their opacity.
+				if ((MinMax.Y - MinMax.X) / Data.WindowingParameters.Width * Data.TransferFunction.Num() <= 1.0f)
+				{
+					continue;
+				}
+				const float StepOpacity = BrickMap.StepOpacities[BrickIndex];
+				NumUnderestimated += Data.SampleWindowedOpacity(Value, 1.0f) > StepOpacity + KINDA_SMALL_NUMBER ? 1 : 0;
+				NumSpikes += StepOpacity > 0.0f ? 1 : 0;
+			}
+		}
+	}
+
+	AddInfo(FString::Printf(TEXT("%d voxels in bricks with a spike."), NumSpikes));
+	TestEqual(TEXT("Voxels more opaque than their brick's step opacity"), NumUnderestimated, 0);
+	TestTrue(TEXT("Some bricks cover a spike"), NumSpikes > 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchStepBudgetTest, "Raymarcher.Raymarch.StepBudget",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Checks that a per-pixel step budget bounds the samples of every ray, with and without adaptive steps, and that a lower
+// termination opacity ends rays sooner. Reports how far budgeted rays get from the finely sampled reference.
+bool FRaymarchStepBudgetTest::RunTest(const FString& Parameters)
+{
+	const FRaymarchCPUVolumeData Data = MakeTestVolumeData();
+	FRaymarchCPUBrickMap BrickMap;
+	BrickMap.Generate(Data, 8);
+	const FVector Direction = FVector(1.0, 0.7, 0.4).GetSafeNormal();
+	const TArray<FTestRay> Rays = MakeTestRays(Direction, 32);
+	const float StepCount = 256.0f;
+	const float MaxStepsPerPixel = 96.0f;
+
+	for (const float MaxStepScale : {1.0f, 4.0f})
+	{
+		int32 MaxSamples[2] = {0, 0};
+		double Error[2] = {0.0, 0.0};
+		for (const FTestRay& Ray : Rays)
+		{
+			const float Reference = RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, ReferenceStepCount).Opacity;
+			const FRaymarchCPURayResult Unlimited =
+				RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount, &BrickMap, MaxStepScale);
+			const FRaymarchCPURayResult Budgeted = RaymarchCPURay(
+				Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount, &BrickMap, MaxStepScale, 0.95f, MaxStepsPerPixel);
+			MaxSamples[0] = FMath::Max(MaxSamples[0], Unlimited.NumSamples);
+			MaxSamples[1] = FMath::Max(MaxSamples[1], Budgeted.NumSamples);
+			Error[0] += FMath::Abs(Unlimited.Opacity - Reference) / Rays.Num();
+			Error[1] += FMath::Abs(Budgeted.Opacity - Reference) / Rays.Num();
+		}
+
+		AddInfo(FString::Printf(TEXT("Steps up to %.0fx: unlimited at most %d samples, mean error %.5f; budget of %.0f at most %d "
+									 "samples, mean error %.5f."),
+			MaxStepScale, MaxSamples[0], Error[0], MaxStepsPerPixel, MaxSamples[1], Error[1]));
+		// The last step can be a sliver left over after the budgeted ones.
+		TestTrue(TEXT("Budgeted rays take at most the budget of samples"), MaxSamples[1] <= MaxStepsPerPixel + 1);
+	}
+
+	int64 NumSamples[2] = {0, 0};
+	for (const FTestRay& Ray : Rays)
+	{
+		NumSamples[0] += RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount).NumSamples;
+		NumSamples[1] +=
+			RaymarchCPURay(Data, Ray.EntryPos, Direction, Ray.Thickness, StepCount, nullptr, 1.0f, 0.8f).NumSamples;
+	}
+	TestTrue(TEXT("Lower termination opacity takes fewer samples"), NumSamples[1] < NumSamples[0]);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FRaymarchOccupancyProxyTest, "Raymarcher.Raymarch.OccupancyProxy",
+	EAutomationTestFlags::EditorContext | EAutomationTestFlags::EngineFilter)
+
+// Checks that the occupancy proxy is a single box around all visible bricks, even separate ones (so the translucent material
+// never composites twice), clamps the last bricks to the volume and faces into the box, so that it gets drawn from inside like
+// the cube it replaces.
+bool FRaymarchOccupancyProxyTest::RunTest(const FString& Parameters)
+{
+	const FIntVector BrickMapSize(4);
+	const int32 BrickSize = 8;
+	// The last bricks only have 6 voxels inside of the volume.
+	const FIntVector VolumeSize(30);
+
+	auto MakeOccupancy = [&BrickMapSize](TFunctionRef<bool(const FIntVector&)> IsVisible)
+	{
+		TArray<uint32> Occupancy;
+		Occupancy.SetNumZeroed(FMath::DivideAndRoundUp(BrickMapSize.X * BrickMapSize.Y * BrickMapSize.Z, 32));
+		for (int32 Z = 0; Z < BrickMapSize.Z; Z++)
+		{
+			for (int32 Y = 0; Y < BrickMapSize.Y; Y++)
+			{
+				for (int32 X = 0; X < BrickMapSize.X; X++)
+				{
+					const int32 Index = X + BrickMapSize.X * (Y + BrickMapSize.Y * Z);
+					Occupancy[Index / 32] |= IsVisible(FIntVector(X, Y, Z)) ? 1u << (Index % 32) : 0u;
+				}
+			}
+		}
+		return Occupancy;
+	};
+
+	FRaymarchOccupancyProxyMesh Mesh;
+	Mesh.Build(MakeOccupancy([](const FIntVector&) { return false; }), BrickMapSize, BrickSize, VolumeSize);
+	TestEqual(TEXT("Empty volume has no triangles"), Mesh.Triangles.Num(), 0);
+	TestFalse(TEXT("Empty volume has no bounds"), bool(Mesh.Bounds.IsValid));
+
+	Mesh.Build(MakeOccupancy([](const FIntVector&) { return true; }), BrickMapSize, BrickSize, VolumeSize);
+	TestEqual(TEXT("Fully visible volume gets the cube"), Mesh.Triangles.Num(), 12 * 3);
+	TestTrue(TEXT("Fully visible volume is bounded by the cube"),
+		Mesh.Bounds.Min.Equals(FVector(0.0)) && Mesh.Bounds.Max.Equals(FVector(1.0)));
+
+	Mesh.Build(MakeOccupancy([](const FIntVector& Brick) { return Brick == FIntVector(0) || Brick == FIntVector(2); }),
+		BrickMapSize, BrickSize, VolumeSize);
+	TestEqual(TEXT("Separate bricks get a single box"), Mesh.Triangles.Num(), 12 * 3);
+	TestTrue(TEXT("Separate bricks are bounded by both"),
+		Mesh.Bounds.Min.Equals(FVector(0.0)) && Mesh.Bounds.Max.Equals(FVector(24.0 / 30.0)));
+
+	// A brick in the middle and a partial one in the corner, every triangle should face into the box around both.
+	const FIntVector Bricks[2] = {FIntVector(1), FIntVector(3)};
+	Mesh.Build(MakeOccupancy([&Bricks](const FIntVector& Brick) { return Brick == Bricks[0] || Brick == Bricks[1]; }),
+		BrickMapSize, BrickSize, VolumeSize);
+	// Bounds are in UVW space, the last brick ends at voxel 30 of 30 instead of 32.
+	TestTrue(TEXT("Last brick gets clamped to the volume"),
+		Mesh.Bounds.Min.Equals(FVector(8.0 / 30.0)) && Mesh.Bounds.Max.Equals(FVector(1.0)));
+	const FVector BoxCenter = Mesh.Bounds.GetCenter() - 0.5;
+	bool bFacesInside = Mesh.Triangles.Num() == 12 * 3;
+	for (int32 Triangle = 0; Triangle < Mesh.Triangles.Num(); Triangle += 3)
+	{
+		const FVector& V0 = Mesh.Vertices[Mesh.Triangles[Triangle]];
+		const FVector& V1 = Mesh.Vertices[Mesh.Triangles[Triangle + 1]];
+		const FVector& V2 = Mesh.Vertices[Mesh.Triangles[Triangle + 2]];
+		const FVector& Normal = Mesh.Normals[Mesh.Triangles[Triangle]];
+		// Same as the triangle normal UKismetProceduralMeshLibrary::CalculateTangentsForMesh computes.
+		const FVector TriangleNormal = (V1 - V2) ^ (V0 - V2);
+		const FVector Centroid = (V0 + V1 + V2) / 3.0;
+		bFacesInside &= (TriangleNormal | Normal) > 0.0 && (Normal | (BoxCenter - Centroid)) > 0.0;
+	}
+	TestTrue(TEXT("Triangles are wound along their normals, which face into the box"), bFacesInside);
+	return true;
+}
+
+#endif	  // WITH_DEV_AUTOMATION_TESTS
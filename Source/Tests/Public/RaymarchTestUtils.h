@@ -0,0 +1,35 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich .Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Rendering/RaymarchTypes.h"
+
+struct FRaymarchCPUVolumeData;
+class URenderTargetVolumeMipped;
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Fixtures shared by the GPU automation tests. Resources get created the same way the raymarch volume creates its own.
+namespace RaymarchTestUtils
+{
+/// Returns false if there's no GPU to run the shaders on (e.g. -nullrhi). GPU tests skip themselves then.
+bool CanUseGPU();
+
+/// Waits for the render thread and the GPU to finish everything enqueued so far.
+void WaitForGPU();
+
+/// Creates a volume render target with a UAV, like the octree, brick map and brick distance volumes.
+URenderTargetVolumeMipped* CreateVolumeRenderTarget(const FIntVector& Size, int32 NumMips, EPixelFormat Format, bool bHDR);
+
+/// Uploads the data and transfer function of Data and creates an R32F light volume of the same size.
+FBasicRaymarchRenderingResources MakeLightingResources(const FRaymarchCPUVolumeData& Data);
+
+/// Creates the brick map, brick distance and brick step opacity volumes of Resources with the given brick size, then generates
+/// the brick map and computes the brick distances. Returns false if either failed.
+bool InitBrickDistances(FBasicRaymarchRenderingResources& Resources, int32 BrickSize);
+}	 // namespace RaymarchTestUtils
+
+#endif	  // WITH_DEV_AUTOMATION_TESTS
@@ -6,6 +6,7 @@
 #include "TextureUtilities.h"
 
 #include "AssetRegistry/AssetRegistryModule.h"
+#include "Util/BlockCompression.h"
 #include "Util/UtilityShaders.h"
 #include "VolumeAsset/VolumeAsset.h"
 
@@ -43,8 +44,10 @@ void UVolumeTextureToolkit::SetVolumeTextureDetails(UVolumeTexture*& VolumeTextu
 void UVolumeTextureToolkit::CreateVolumeTextureMip(
 	UVolumeTexture*& VolumeTexture, EPixelFormat PixelFormat, FIntVector Dimensions, uint8* BulkData /*= nullptr*/)
 {
-	int PixelByteSize = GPixelFormats[PixelFormat].BlockBytes;
-	const long long TotalSize = (long long) Dimensions.X * Dimensions.Y * Dimensions.Z * PixelByteSize;
+	// Block compressed formats store 4x4 texel blocks per slice, uncompressed formats have a block size of 1.
+	const FPixelFormatInfo& FormatInfo = GPixelFormats[PixelFormat];
+	const long long TotalSize = (long long) FMath::DivideAndRoundUp(Dimensions.X, FormatInfo.BlockSizeX) *
+								FMath::DivideAndRoundUp(Dimensions.Y, FormatInfo.BlockSizeY) * Dimensions.Z * FormatInfo.BlockBytes;
 
 	// Create the one and only mip in this texture.
 	FTexture2DMipMap* mip = new FTexture2DMipMap();
@@ -220,6 +223,34 @@ bool UVolumeTextureToolkit::CreateVolumeTextureTransient(
 	return true;
 }
 
+bool UVolumeTextureToolkit::CreateBlockCompressedVolumeTextureTransient(UVolumeTexture*& OutTexture, EPixelFormat SourceFormat,
+	FIntVector Dimensions, const uint8* BulkData, EVolumeBlockCompression Compression, FBlockCompressionStats& OutStats)
+{
+	if (!VolumeBlockCompression::CanCompress(SourceFormat, Dimensions))
+	{
+		UE_LOG(LogTextureUtils, Warning,
+			TEXT("Cannot block compress volume of size %s and format %s. Only G8 and G16 volumes with X and Y dimensions divisible by "
+				 "4 are supported."),
+			*Dimensions.ToString(), GPixelFormats[SourceFormat].Name);
+		return false;
+	}
+
+	TArray<uint8> CompressedData;
+	if (!VolumeBlockCompression::CompressVolume(BulkData, SourceFormat, Dimensions, Compression, CompressedData, OutStats))
+	{
+		return false;
+	}
+
+	const EPixelFormat CompressedFormat = VolumeBlockCompression::GetCompressedPixelFormat(Compression);
+	UE_LOG(LogTextureUtils, Display,
+		TEXT("Block compressed volume %s to %s in %.1f ms. PSNR = %.2f dB, RMSE = %f, max error = %f, size %lld -> %d bytes."),
+		*Dimensions.ToString(), GPixelFormats[CompressedFormat].Name, OutStats.EncodeTimeMs, OutStats.PSNR, OutStats.RMSE,
+		OutStats.MaxError, (long long) Dimensions.X * Dimensions.Y * Dimensions.Z * GPixelFormats[SourceFormat].BlockBytes,
+		CompressedData.Num());
+
+	return CreateVolumeTextureTransient(OutTexture, CompressedFormat, Dimensions, CompressedData.GetData());
+}
+
 uint8* UVolumeTextureToolkit::LoadRawFileIntoArray(const FString FileName, const int64 BytesToLoad)
 {
 	IPlatformFile& PlatformFile = FPlatformFileManager::Get().GetPlatformFile();
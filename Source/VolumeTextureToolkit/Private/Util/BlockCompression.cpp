@@ -0,0 +1,293 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+#include "Util/BlockCompression.h"
+
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+#include "Math/Float16.h"
+
+namespace
+{
+constexpr int32 BlockDim = 4;
+constexpr int32 TexelsPerBlock = BlockDim * BlockDim;
+
+// Interpolation weights of 4-bit BC6H indices (see the D3D BC6H format documentation).
+constexpr int32 BC6HWeights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+/// Reads a 4x4 block of normalized values from a G8 or G16 slice. Always in bounds, as we only compress multiple-of-4 slices.
+void ReadBlock(const uint8* SliceData, EPixelFormat SourceFormat, int32 SizeX, int32 BlockX, int32 BlockY, float OutValues[16])
+{
+	for (int32 y = 0; y < BlockDim; y++)
+	{
+		const int32 RowStart = (BlockY * BlockDim + y) * SizeX + BlockX * BlockDim;
+		for (int32 x = 0; x < BlockDim; x++)
+		{
+			if (SourceFormat == PF_G16)
+			{
+				OutValues[y * BlockDim + x] = reinterpret_cast<const uint16*>(SliceData)[RowStart + x] / 65535.0f;
+			}
+			else
+			{
+				OutValues[y * BlockDim + x] = SliceData[RowStart + x] / 255.0f;
+			}
+		}
+	}
+}
+
+/// Encodes a block into BC4 (unsigned). Writes 8 bytes into OutBlock and the decoded values into OutDecoded.
+void EncodeBC4Block(const float Values[16], uint8* OutBlock, float OutDecoded[16])
+{
+	float Min = Values[0];
+	float Max = Values[0];
+	for (int32 i = 1; i < TexelsPerBlock; i++)
+	{
+		Min = FMath::Min(Min, Values[i]);
+		Max = FMath::Max(Max, Values[i]);
+	}
+
+	const int32 Endpoint0 = FMath::RoundToInt(Max * 255.0f);
+	const int32 Endpoint1 = FMath::RoundToInt(Min * 255.0f);
+
+	// Endpoint0 > Endpoint1 selects the 8-value palette. Equal endpoints select the 6-value one, but then every index is 0 anyways.
+	float Palette[8];
+	Palette[0] = Endpoint0 / 255.0f;
+	Palette[1] = Endpoint1 / 255.0f;
+	for (int32 i = 2; i < 8; i++)
+	{
+		Palette[i] = ((8 - i) * Endpoint0 + (i - 1) * Endpoint1) / (7.0f * 255.0f);
+	}
+	const int32 PaletteSize = (Endpoint0 > Endpoint1) ? 8 : 1;
+
+	uint64 Bits = uint64(Endpoint0) | (uint64(Endpoint1) << 8);
+	for (int32 i = 0; i < TexelsPerBlock; i++)
+	{
+		int32 BestIndex = 0;
+		float BestError = FMath::Abs(Values[i] - Palette[0]);
+		for (int32 p = 1; p < PaletteSize; p++)
+		{
+			const float Error = FMath::Abs(Values[i] - Palette[p]);
+			if (Error < BestError)
+			{
+				BestError = Error;
+				BestIndex = p;
+			}
+		}
+		Bits |= uint64(BestIndex) << (16 + 3 * i);
+		OutDecoded[i] = Palette[BestIndex];
+	}
+	FMemory::Memcpy(OutBlock, &Bits, 8);
+}
+
+/// Unquantizes a 10-bit unsigned BC6H endpoint to the 16-bit interpolation range.
+int32 UnquantizeBC6H(int32 Component)
+{
+	if (Component == 0)
+	{
+		return 0;
+	}
+	if (Component == 1023)
+	{
+		return 0xFFFF;
+	}
+	return ((Component << 16) + 0x8000) >> 10;
+}
+
+/// Finds the 10-bit endpoint that unquantizes closest to Target (in the 16-bit interpolation range).
+int32 QuantizeBC6H(int32 Target)
+{
+	int32 Best = 0;
+	int32 BestError = MAX_int32;
+	const int32 Guess = Target >> 6;
+	for (int32 Candidate = FMath::Max(Guess - 1, 0); Candidate <= FMath::Min(Guess + 1, 1023); Candidate++)
+	{
+		const int32 Error = FMath::Abs(UnquantizeBC6H(Candidate) - Target);
+		if (Error < BestError)
+		{
+			BestError = Error;
+			Best = Candidate;
+		}
+	}
+	return Best;
+}
+
+/// Writes Count bits of Value into the 128 bit block at Offset (LSB first, as BC6H is specified).
+void WriteBits(uint64 Block[2], int32& Offset, int32 Count, uint32 Value)
+{
+	for (int32 i = 0; i < Count; i++, Offset++)
+	{
+		if ((Value >> i) & 1)
+		{
+			Block[Offset / 64] |= uint64(1) << (Offset % 64);
+		}
+	}
+}
+
+/// Encodes a block into BC6H unsigned mode 11 (one region, untransformed 10-bit endpoints, 4-bit indices) with the same value in
+/// R, G and B. Writes 16 bytes into OutBlock and the decoded values into OutDecoded.
+void EncodeBC6HBlock(const float Values[16], uint8* OutBlock, float OutDecoded[16])
+{
+	// For non-negative halfs the bit pattern is monotonic with the value, so we can fit the endpoints in the bit-pattern domain.
+	// The decoder scales the interpolated value by 31/64 to get the final half, so we invert that here.
+	int32 MinHalf = MAX_int32;
+	int32 MaxHalf = 0;
+	for (int32 i = 0; i < TexelsPerBlock; i++)
+	{
+		const int32 Half = FFloat16(Values[i]).Encoded;
+		MinHalf = FMath::Min(MinHalf, Half);
+		MaxHalf = FMath::Max(MaxHalf, Half);
+	}
+	int32 Endpoint0 = QuantizeBC6H(FMath::Min((MinHalf * 64 + 30) / 31, 0xFFFF));
+	int32 Endpoint1 = QuantizeBC6H(FMath::Min((MaxHalf * 64 + 30) / 31, 0xFFFF));
+
+	const int32 Unquantized0 = UnquantizeBC6H(Endpoint0);
+	const int32 Unquantized1 = UnquantizeBC6H(Endpoint1);
+	float Palette[16];
+	for (int32 i = 0; i < 16; i++)
+	{
+		const int32 Interpolated = ((64 - BC6HWeights[i]) * Unquantized0 + BC6HWeights[i] * Unquantized1 + 32) >> 6;
+		FFloat16 Decoded;
+		Decoded.Encoded = static_cast<uint16>((Interpolated * 31) >> 6);
+		Palette[i] = Decoded.GetFloat();
+	}
+
+	int32 Indices[16];
+	for (int32 i = 0; i < TexelsPerBlock; i++)
+	{
+		int32 BestIndex = 0;
+		float BestError = FMath::Abs(Values[i] - Palette[0]);
+		for (int32 p = 1; p < 16; p++)
+		{
+			const float Error = FMath::Abs(Values[i] - Palette[p]);
+			if (Error < BestError)
+			{
+				BestError = Error;
+				BestIndex = p;
+			}
+		}
+		Indices[i] = BestIndex;
+		OutDecoded[i] = Palette[BestIndex];
+	}
+
+	// The MSB of the first (anchor) index is implicit zero. The weights are symmetric, so swapping the endpoints and inverting all
+	// indices gives the same decoded block.
+	if (Indices[0] >= 8)
+	{
+		Swap(Endpoint0, Endpoint1);
+		for (int32 i = 0; i < TexelsPerBlock; i++)
+		{
+			Indices[i] = 15 - Indices[i];
+		}
+	}
+
+	uint64 Block[2] = {0, 0};
+	int32 Offset = 0;
+	// Mode 11 = 0b00011.
+	WriteBits(Block, Offset, 5, 0x03);
+	// rw, gw, bw
+	WriteBits(Block, Offset, 10, Endpoint0);
+	WriteBits(Block, Offset, 10, Endpoint0);
+	WriteBits(Block, Offset, 10, Endpoint0);
+	// rx, gx, bx
+	WriteBits(Block, Offset, 10, Endpoint1);
+	WriteBits(Block, Offset, 10, Endpoint1);
+	WriteBits(Block, Offset, 10, Endpoint1);
+	WriteBits(Block, Offset, 3, Indices[0]);
+	for (int32 i = 1; i < TexelsPerBlock; i++)
+	{
+		WriteBits(Block, Offset, 4, Indices[i]);
+	}
+	check(Offset == 128);
+	FMemory::Memcpy(OutBlock, Block, 16);
+}
+}	 // namespace
+
+EPixelFormat VolumeBlockCompression::GetCompressedPixelFormat(EVolumeBlockCompression Compression)
+{
+	switch (Compression)
+	{
+		case EVolumeBlockCompression::BC4:
+			return PF_BC4;
+		case EVolumeBlockCompression::BC6H:
+			return PF_BC6H;
+		default:
+			return PF_Unknown;
+	}
+}
+
+bool VolumeBlockCompression::CanCompress(EPixelFormat SourceFormat, FIntVector Dimensions)
+{
+	return (SourceFormat == PF_G8 || SourceFormat == PF_G16) && Dimensions.X > 0 && Dimensions.Y > 0 && Dimensions.Z > 0 &&
+		   (Dimensions.X % BlockDim) == 0 && (Dimensions.Y % BlockDim) == 0;
+}
+
+bool VolumeBlockCompression::CompressVolume(const uint8* SourceData, EPixelFormat SourceFormat, FIntVector Dimensions,
+	EVolumeBlockCompression Compression, TArray<uint8>& OutData, FBlockCompressionStats& OutStats)
+{
+	const EPixelFormat TargetFormat = GetCompressedPixelFormat(Compression);
+	if (!SourceData || TargetFormat == PF_Unknown || !CanCompress(SourceFormat, Dimensions))
+	{
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+
+	const int32 BlocksX = Dimensions.X / BlockDim;
+	const int32 BlocksY = Dimensions.Y / BlockDim;
+	const int32 BlockBytes = GPixelFormats[TargetFormat].BlockBytes;
+	const int64 SourceSliceBytes = (int64) Dimensions.X * Dimensions.Y * GPixelFormats[SourceFormat].BlockBytes;
+	const int64 TargetSliceBytes = (int64) BlocksX * BlocksY * BlockBytes;
+
+	OutData.SetNumUninitialized(TargetSliceBytes * Dimensions.Z);
+
+	// Per-slice error accumulators, reduced after the parallel part so that no locking is needed.
+	TArray<double> SliceSquaredError;
+	TArray<double> SliceMaxError;
+	SliceSquaredError.SetNumZeroed(Dimensions.Z);
+	SliceMaxError.SetNumZeroed(Dimensions.Z);
+
+	ParallelFor(Dimensions.Z, [&](int32 Z) {
+		const uint8* SourceSlice = SourceData + Z * SourceSliceBytes;
+		uint8* TargetSlice = OutData.GetData() + Z * TargetSliceBytes;
+		float Values[TexelsPerBlock];
+		float Decoded[TexelsPerBlock];
+
+		for (int32 BlockY = 0; BlockY < BlocksY; BlockY++)
+		{
+			for (int32 BlockX = 0; BlockX < BlocksX; BlockX++)
+			{
+				ReadBlock(SourceSlice, SourceFormat, Dimensions.X, BlockX, BlockY, Values);
+				uint8* TargetBlock = TargetSlice + ((int64) BlockY * BlocksX + BlockX) * BlockBytes;
+				if (Compression == EVolumeBlockCompression::BC4)
+				{
+					EncodeBC4Block(Values, TargetBlock, Decoded);
+				}
+				else
+				{
+					EncodeBC6HBlock(Values, TargetBlock, Decoded);
+				}
+
+				for (int32 i = 0; i < TexelsPerBlock; i++)
+				{
+					const double Error = FMath::Abs(Values[i] - Decoded[i]);
+					SliceSquaredError[Z] += Error * Error;
+					SliceMaxError[Z] = FMath::Max(SliceMaxError[Z], Error);
+				}
+			}
+		}
+	});
+
+	double SquaredError = 0.0;
+	OutStats.MaxError = 0.0;
+	for (int32 Z = 0; Z < Dimensions.Z; Z++)
+	{
+		SquaredError += SliceSquaredError[Z];
+		OutStats.MaxError = FMath::Max(OutStats.MaxError, SliceMaxError[Z]);
+	}
+	OutStats.RMSE = FMath::Sqrt(SquaredError / ((double) Dimensions.X * Dimensions.Y * Dimensions.Z));
+	OutStats.PSNR = OutStats.RMSE > 0.0 ? FMath::Min(20.0 * FMath::LogX(10.0, 1.0 / OutStats.RMSE), 100.0) : 100.0;
+	OutStats.EncodeTimeMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	return true;
+}
@@ -5,6 +5,9 @@
 
 #include "Util/UtilityShaders.h"
 
+#include "RenderGraphBuilder.h"
+#include "RenderGraphUtils.h"
+
 #define CLEAR_NUM_THREADS_PER_GROUP_DIMENSION 16	  // This has to be the same as in the compute shader's spec [X, X, 1]
 
 IMPLEMENT_GLOBAL_SHADER(
@@ -25,32 +28,45 @@ FRHICommandListImmediate& GetCmdList()
 }
 
 void ClearVolumeTexture_RenderThread(FRHICommandListImmediate& RHICmdList, FRHITexture3D* VolumeResourceRef, float ClearValues)
+{
+	FRDGBuilder GraphBuilder(RHICmdList, RDG_EVENT_NAME("ClearVolumeTexture"));
+
+	FRDGTextureRef Volume = GraphBuilder.RegisterExternalTexture(CreateRenderTarget(VolumeResourceRef, TEXT("ClearedVolume")));
+	AddClearVolumeTexturePass(GraphBuilder, Volume, ClearValues);
+	// Leave the volume ready to be sampled by materials.
+	GraphBuilder.SetTextureAccessFinal(Volume, ERHIAccess::SRVMask);
+
+	GraphBuilder.Execute();
+}
+
+void AddClearVolumeTexturePass(FRDGBuilder& GraphBuilder, FRDGTextureRef Volume, float ClearValue)
 {
 	// For GPU profiling.
-	SCOPED_DRAW_EVENTF(RHICmdList, ClearVolumeTexture_RenderThread, TEXT("Clearing volume texture"));
-	SCOPED_GPU_STAT(RHICmdList, GPUClearingVolumeTextures);
+	RDG_EVENT_SCOPE(GraphBuilder, "Clearing volume texture");
+	RDG_GPU_STAT_SCOPE(GraphBuilder, GPUClearingVolumeTextures);
 
-	TShaderMapRef<FClearVolumeTextureShaderCS> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
-	FRHIComputeShader* ShaderRHI = ComputeShader.GetComputeShader();
-	SetComputePipelineState(RHICmdList, ShaderRHI);
+	// The clear shader only writes a single channel.
+	if (GPixelFormats[Volume->Desc.Format].NumComponents > 1)
+	{
+		const float ClearValues[4] = {ClearValue, ClearValue, ClearValue, ClearValue};
+		AddClearUAVPass(GraphBuilder, GraphBuilder.CreateUAV(Volume), ClearValues);
+		return;
+	}
 
-	// RHICmdList.TransitionResource(EResourceTransitionAccess::ERWNoBarrier,
-	// LightVolumeResource);
-	FUnorderedAccessViewRHIRef VolumeUAVRef = GetCmdList().CreateUnorderedAccessView(VolumeResourceRef);
+	TShaderMapRef<FClearVolumeTextureShaderCS> ComputeShader(GetGlobalShaderMap(ERHIFeatureLevel::SM5));
 
-	// Don't need barriers on these - we only ever read/write to the same pixel from one thread ->
-	// no race conditions But we definitely need to transition the resource to Compute-shader
-	// accessible, otherwise the renderer might touch our textures while we're writing them.
-	RHICmdList.Transition(FRHITransitionInfo(VolumeUAVRef, ERHIAccess::UAVGraphics, ERHIAccess::UAVCompute));
+	const FIntVector VolumeSize = Volume->Desc.GetSize();
 
-	ComputeShader->SetParameters(RHICmdList, VolumeUAVRef, ClearValues, VolumeResourceRef->GetSizeZ());
+	FClearVolumeTextureShaderCS::FParameters* PassParameters =
+		GraphBuilder.AllocParameters<FClearVolumeTextureShaderCS::FParameters>();
+	PassParameters->Volume = GraphBuilder.CreateUAV(Volume);
+	PassParameters->ClearValue = ClearValue;
+	PassParameters->ZSize = VolumeSize.Z;
 
-	uint32 GroupSizeX = FMath::DivideAndRoundUp((int32) VolumeResourceRef->GetSizeX(), CLEAR_NUM_THREADS_PER_GROUP_DIMENSION);
-	uint32 GroupSizeY = FMath::DivideAndRoundUp((int32) VolumeResourceRef->GetSizeY(), CLEAR_NUM_THREADS_PER_GROUP_DIMENSION);
+	const FIntVector GroupCount(FMath::DivideAndRoundUp(VolumeSize.X, CLEAR_NUM_THREADS_PER_GROUP_DIMENSION),
+		FMath::DivideAndRoundUp(VolumeSize.Y, CLEAR_NUM_THREADS_PER_GROUP_DIMENSION), 1);
 
-	RHICmdList.DispatchComputeShader(GroupSizeX, GroupSizeY, 1);
-	ComputeShader->UnbindUAV(RHICmdList);
-	RHICmdList.Transition(FRHITransitionInfo(VolumeUAVRef, ERHIAccess::UAVCompute, ERHIAccess::UAVGraphics));
+	FComputeShaderUtils::AddPass(GraphBuilder, RDG_EVENT_NAME("ClearVolumeTexture"), ComputeShader, PassParameters, GroupCount);
 }
 
 /// Clears a FloatTexture accesible as a UAV.
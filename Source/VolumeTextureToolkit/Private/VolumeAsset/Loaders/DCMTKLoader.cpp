@@ -288,7 +288,7 @@ UVolumeAsset* UDCMTKLoader::CreateVolumeFromFile(FString FileName, bool bNormali
 	const EPixelFormat PixelFormat = FVolumeInfo::VoxelFormatToPixelFormat(VolumeInfo.ActualFormat);
 
 	// Create the transient Volume texture.
-	UVolumeTextureToolkit::CreateVolumeTextureTransient(OutAsset->DataTexture, PixelFormat, VolumeInfo.Dimensions, LoadedArray.Get());
+	CreateTransientDataTexture(OutAsset->DataTexture, PixelFormat, VolumeInfo, LoadedArray.Get());
 
 	// Check that the texture got created properly.
 	if (OutAsset->DataTexture)
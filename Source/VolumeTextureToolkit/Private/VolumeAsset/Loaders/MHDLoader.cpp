@@ -205,8 +205,7 @@ UVolumeAsset* UMHDLoader::CreateVolumeFromFile(FString FileName, bool bNormalize
 	EPixelFormat PixelFormat = FVolumeInfo::VoxelFormatToPixelFormat(VolumeInfo.ActualFormat);
 
 	// Create the transient Volume texture.
-	UVolumeTextureToolkit::CreateVolumeTextureTransient(
-		OutAsset->DataTexture, PixelFormat, VolumeInfo.Dimensions, LoadedArray.Get());
+	CreateTransientDataTexture(OutAsset->DataTexture, PixelFormat, VolumeInfo, LoadedArray.Get());
 
 	// Check that the texture got created properly.
 	if (OutAsset->DataTexture)
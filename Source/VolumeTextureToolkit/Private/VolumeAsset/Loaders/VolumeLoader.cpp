@@ -10,6 +10,7 @@
 #include "Misc/FileHelper.h"
 #include "Misc/Paths.h"
 #include "TextureUtilities.h"
+#include "Util/BlockCompression.h"
 
 DEFINE_LOG_CATEGORY(LogVolumeLoader)
 
@@ -94,6 +95,28 @@ TUniquePtr<uint8[]> IVolumeLoader::LoadAndConvertData(
 	return LoadedArray;
 }
 
+void IVolumeLoader::CreateTransientDataTexture(
+	UVolumeTexture*& OutTexture, EPixelFormat PixelFormat, FVolumeInfo& VolumeInfo, uint8* Data)
+{
+	VolumeInfo.BlockCompression = EVolumeBlockCompression::None;
+	VolumeInfo.BlockCompressionPSNR = 0.0f;
+
+	if (TransientBlockCompression != EVolumeBlockCompression::None)
+	{
+		FBlockCompressionStats Stats;
+		if (UVolumeTextureToolkit::CreateBlockCompressedVolumeTextureTransient(
+				OutTexture, PixelFormat, VolumeInfo.Dimensions, Data, TransientBlockCompression, Stats))
+		{
+			VolumeInfo.BlockCompression = TransientBlockCompression;
+			VolumeInfo.BlockCompressionPSNR = Stats.PSNR;
+			return;
+		}
+		UE_LOG(LogVolumeLoader, Warning, TEXT("Block compression failed, creating uncompressed data texture instead."));
+	}
+
+	UVolumeTextureToolkit::CreateVolumeTextureTransient(OutTexture, PixelFormat, VolumeInfo.Dimensions, Data);
+}
+
 TUniquePtr<uint8[]> IVolumeLoader::ConvertData(TUniquePtr<uint8[]>&& LoadedArray, FVolumeInfo& VolumeInfo, bool bNormalize, bool bConvertToFloat)
 {
 	VolumeInfo.bIsNormalized = bNormalize;
@@ -104,8 +104,9 @@ public:
 		, TextureReference(&InOwner->TextureReference)
 	{
 		check(0 < NumMips && NumMips <= MAX_TEXTURE_MIP_COUNT);
-		check(FMath::IsPowerOfTwo(SizeX) && FMath::IsPowerOfTwo(SizeY) && FMath::IsPowerOfTwo(SizeZ)) uint32 MinAxis =
-			FMath::Min3(SizeX, SizeY, SizeZ);
+		// Sizes don't need to be powers of two, every mip is half the previous one rounded down (like with any other texture).
+		// Make the sizes multiples of 2^(NumMips - 1) to have them divide exactly.
+		const uint32 MinAxis = FMath::Min3(SizeX, SizeY, SizeZ);
 		check((1U << (NumMips - 1)) <= MinAxis);
 
 		TextureName = Owner->GetName();
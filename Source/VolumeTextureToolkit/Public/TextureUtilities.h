@@ -22,6 +22,7 @@
 #include "VolumeAsset/VolumeAsset.h"
 
 class UTextureRenderTargetVolume;
+struct FBlockCompressionStats;
 
 DECLARE_LOG_CATEGORY_EXTERN(LogTextureUtils, All, All);
 class VOLUMETEXTURETOOLKIT_API UVolumeTextureToolkit
@@ -64,6 +65,12 @@ public:
 	static bool CreateVolumeTextureTransient(UVolumeTexture*& OutTexture, EPixelFormat PixelFormat, FIntVector Dimensions,
 		uint8* BulkData = nullptr, bool ShouldUpdateResource = true);
 
+	/** Creates a transient Volume Texture with each slice of the provided G8 or G16 data block compressed into BC4 or BC6H.
+	 * Encoding runs in parallel over slices. Returns false (and creates nothing) if the data can't be compressed, so the caller can
+	 * fall back to CreateVolumeTextureTransient. OutStats holds the error of the compressed data against the source.*/
+	static bool CreateBlockCompressedVolumeTextureTransient(UVolumeTexture*& OutTexture, EPixelFormat SourceFormat,
+		FIntVector Dimensions, const uint8* BulkData, EVolumeBlockCompression Compression, FBlockCompressionStats& OutStats);
+
 	/** Loads a RAW file into a newly allocated uint8* array. Loads the given number
 	 * of bytes. Don't forget to delete[] after storing the data somewhere.*/
 	static uint8* LoadRawFileIntoArray(const FString FileName, const int64 ByteSize);
@@ -0,0 +1,42 @@
+// Copyright 2021 Tomas Bartipan and Technical University of Munich.
+// Licensed under MIT license - See License.txt for details.
+// Special credits go to : Temaran (compute shader tutorial), TheHugeManatee (original concept, supervision) and Ryan Brucks
+// (original raymarching code).
+
+// Contains a minimal CPU encoder for single-channel BC4 and BC6H blocks, used to block-compress volume textures slice by slice.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "VolumeAsset/VolumeInfo.h"
+
+/// Quality of a block compressed volume compared to the source data. All errors are measured on the normalized [0,1] range.
+struct VOLUMETEXTURETOOLKIT_API FBlockCompressionStats
+{
+	/// Root mean square error of the decoded data against the source.
+	double RMSE = 0.0;
+
+	/// Largest absolute error of a single voxel.
+	double MaxError = 0.0;
+
+	/// Peak signal to noise ratio in dB. Infinite (lossless) compression is reported as 100 dB.
+	double PSNR = 0.0;
+
+	/// Time taken by the encode, in milliseconds.
+	double EncodeTimeMs = 0.0;
+};
+
+namespace VolumeBlockCompression
+{
+/// Returns the pixel format the GPU texture needs to be created with for the given compression.
+VOLUMETEXTURETOOLKIT_API EPixelFormat GetCompressedPixelFormat(EVolumeBlockCompression Compression);
+
+/// Returns true if a volume of the given format and dimensions can be block compressed. BC formats need the slice dimensions to
+/// be a multiple of the 4x4 block size and we only support normalized G8 and G16 sources.
+VOLUMETEXTURETOOLKIT_API bool CanCompress(EPixelFormat SourceFormat, FIntVector Dimensions);
+
+/// Encodes every Z slice of the source volume into 4x4 blocks in parallel. OutData is laid out exactly like the mip data of a
+/// compressed volume texture (slices of block rows). Returns false if the volume cannot be compressed.
+VOLUMETEXTURETOOLKIT_API bool CompressVolume(const uint8* SourceData, EPixelFormat SourceFormat, FIntVector Dimensions,
+	EVolumeBlockCompression Compression, TArray<uint8>& OutData, FBlockCompressionStats& OutStats);
+}	 // namespace VolumeBlockCompression
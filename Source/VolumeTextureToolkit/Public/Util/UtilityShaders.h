@@ -11,14 +11,20 @@
 #include "Engine/VolumeTexture.h"
 #include "Engine/World.h"
 #include "GlobalShader.h"
+#include "RenderGraphResources.h"
 #include "SceneUtils.h"
 #include "Shader.h"
+#include "ShaderParameterStruct.h"
 #include "ShaderParameterUtils.h"
 #include "ShaderParameters.h"
 
+// Clears the volume in it's own render graph. The volume is left readable by shaders (SRVMask) afterwards.
 void VOLUMETEXTURETOOLKIT_API ClearVolumeTexture_RenderThread(
 	FRHICommandListImmediate& RHICmdList, FRHITexture3D* ALightVolumeResource, float ClearValue);
 
+// Adds a pass clearing a single-channel volume texture with UAV support to the provided render graph.
+void VOLUMETEXTURETOOLKIT_API AddClearVolumeTexturePass(FRDGBuilder& GraphBuilder, FRDGTextureRef Volume, float ClearValue);
+
 void VOLUMETEXTURETOOLKIT_API Clear2DTexture_RenderThread(
 	FRHICommandListImmediate& RHICmdList, FRHIUnorderedAccessView* TextureRW, FIntPoint TextureSize, float Value);
 // void ClearVolumeTexture_RenderThread(FRHICommandListImmediate& RHICmdList, FRHITexture2D* ALightVolumeResource, float
@@ -73,47 +79,18 @@ protected:
 // Compute Shader used for fast clearing of RW volume textures.
 class FClearVolumeTextureShaderCS : public FGlobalShader
 {
-	DECLARE_EXPORTED_SHADER_TYPE(FClearVolumeTextureShaderCS, Global, VOLUMETEXTURETOOLKIT_API);
+	DECLARE_EXPORTED_GLOBAL_SHADER(FClearVolumeTextureShaderCS, VOLUMETEXTURETOOLKIT_API);
+	SHADER_USE_PARAMETER_STRUCT(FClearVolumeTextureShaderCS, FGlobalShader);
 
-public:
-	FClearVolumeTextureShaderCS() : FGlobalShader()
-	{
-	}
+	BEGIN_SHADER_PARAMETER_STRUCT(FParameters, )
+		// Float values to be set to the alpha volume.
+		SHADER_PARAMETER_RDG_TEXTURE_UAV(RWTexture3D<float>, Volume)
+		SHADER_PARAMETER(float, ClearValue)
+		SHADER_PARAMETER(int32, ZSize)
+	END_SHADER_PARAMETER_STRUCT()
 
 	static bool ShouldCompilePermutation(const FGlobalShaderPermutationParameters& Parameters)
 	{
 		return IsFeatureLevelSupported(Parameters.Platform, ERHIFeatureLevel::SM5);
 	}
-
-	static void ModifyCompilationEnvironment(
-		const FGlobalShaderPermutationParameters& Parameters, FShaderCompilerEnvironment& OutEnvironment)
-	{
-		FGlobalShader::ModifyCompilationEnvironment(Parameters, OutEnvironment);
-	}
-
-	FClearVolumeTextureShaderCS(const ShaderMetaType::CompiledShaderInitializerType& Initializer) : FGlobalShader(Initializer)
-	{
-		Volume.Bind(Initializer.ParameterMap, TEXT("Volume"), SPF_Mandatory);
-		ClearValue.Bind(Initializer.ParameterMap, TEXT("ClearValue"), SPF_Mandatory);
-		ZSize.Bind(Initializer.ParameterMap, TEXT("ZSize"), SPF_Mandatory);
-	}
-
-	void SetParameters(FRHICommandListImmediate& RHICmdList, FRHIUnorderedAccessView* VolumeRef, float clearColor, int ZSizeParam)
-	{
-		FRHIComputeShader* ShaderRHI = RHICmdList.GetBoundComputeShader();
-		SetUAVParameter(RHICmdList, ShaderRHI, Volume, VolumeRef);
-		SetShaderValue(RHICmdList, ShaderRHI, ClearValue, clearColor);
-		SetShaderValue(RHICmdList, ShaderRHI, ZSize, ZSizeParam);
-	}
-
-	void UnbindUAV(FRHICommandList& RHICmdList)
-	{
-		SetUAVParameter(RHICmdList, RHICmdList.GetBoundComputeShader(), Volume, nullptr);
-	}
-	
-protected:
-	// Float values to be set to the alpha volume.
-	LAYOUT_FIELD(FShaderResourceParameter, Volume);
-	LAYOUT_FIELD(FShaderParameter, ClearValue);
-	LAYOUT_FIELD(FShaderParameter, ZSize);
 };
@@ -26,6 +26,10 @@ class VOLUMETEXTURETOOLKIT_API IVolumeLoader
 {
 	GENERATED_BODY()
 public:
+	// Block compression applied to the data texture of transient volumes created by CreateVolumeFromFile. Default is None.
+	// Only normalized (G8/G16) volumes with X and Y divisible by 4 get compressed, others stay uncompressed.
+	EVolumeBlockCompression TransientBlockCompression = EVolumeBlockCompression::None;
+
 	// Returns a FVolumeInfo without actually creating a volume from the file. Useful for getting info about a volume before loading
 	// it.
 	virtual FVolumeInfo ParseVolumeInfoFromHeader(FString FileName) = 0;
@@ -66,6 +70,10 @@ public:
 	// This means either converting it to U8 or U16 and normalizing or a conversion to Float.
 	virtual TUniquePtr<uint8[]> LoadAndConvertData(FString FilePath, FVolumeInfo& VolumeInfo, bool bNormalize, bool bConvertToFloat);
 	
+	// Creates the transient data texture for a loaded volume, block compressing it according to TransientBlockCompression if
+	// possible. Stores the used compression and it's quality into VolumeInfo.
+	void CreateTransientDataTexture(UVolumeTexture*& OutTexture, EPixelFormat PixelFormat, FVolumeInfo& VolumeInfo, uint8* Data);
+
 	// Converts raw data read from a Volume file so that it's useable by our materials.
 	// if bNormalize is true, the data gets normalized to 0.0 to 1.0 range and gets saved as a G8 or G16 texture later in the process.
 	// if bConvertToFloat is true, the data gets converted to float and gets saved as a R32_Float texture later in the process.
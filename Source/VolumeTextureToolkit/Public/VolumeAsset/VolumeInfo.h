@@ -26,6 +26,18 @@ enum class EVolumeVoxelFormat : uint8
 	// #TODO maybe double? Unreal materials don't support them anyways...
 };
 
+/// GPU block compression applied to the data texture of a transient volume.
+UENUM(BlueprintType)
+enum class EVolumeBlockCompression : uint8
+{
+	// Data is kept in it's uncompressed G8/G16/R32F format.
+	None = 0,
+	// 8-bit endpoints, 3-bit indices per texel. Quarter of G16 memory, half of G8 memory.
+	BC4 = 1,
+	// Single-region 10-bit endpoints, 4-bit indices per texel (mode 11, unsigned half). Same memory as G8, better for 16-bit data.
+	BC6H = 2
+};
+
 
 /// Struct for raymarch windowing parameters. These work exactly the same as DICOM window.
 USTRUCT(BlueprintType)
@@ -102,6 +114,14 @@ public:
 	UPROPERTY(VisibleAnywhere)
 	float MaxValue = 3000;
 
+	// Block compression that was applied to the data texture when it was created.
+	UPROPERTY(VisibleAnywhere)
+	EVolumeBlockCompression BlockCompression = EVolumeBlockCompression::None;
+
+	// Peak signal to noise ratio (in dB, on the normalized [0,1] range) of the block compressed data texture against the source.
+	UPROPERTY(VisibleAnywhere)
+	float BlockCompressionPSNR = 0.0f;
+
 	bool bIsCompressed = false;
 
 	int32 CompressedByteSize = 0;